@@ -8,8 +8,18 @@ static const char *TAG = "golioth_audio_upload";
 
 /* Microphone and SD Card */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
 #include <sys/stat.h>
 #include "audio.h"
+#include "bench.h"
+#include "capture_stats.h"
+#include "raw_store.h"
+#include "segments.h"
+#include "upload.h"
+#include "upload_queue.h"
+#include "upload_sink.h"
 
 /* Golioth */
 #include "nvs.h"
@@ -17,7 +27,6 @@ static const char *TAG = "golioth_audio_upload";
 #include "wifi.h"
 #include "sample_credentials.h"
 #include <golioth/client.h>
-#include <golioth/stream.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 
@@ -31,96 +40,148 @@ static const char *TAG = "golioth_audio_upload";
 #include "bsp/m5stack_core_s3.h"
 #endif /* CONFIG_IDF_TARGET_ESP32S3 */
 
-static SemaphoreHandle_t _connected_sem = NULL;
+#ifdef CONFIG_EXAMPLE_UPLOAD_QUEUE
+#define UPLOAD_QUEUE_WAIT_MS    (CONFIG_EXAMPLE_UPLOAD_QUEUE_WAIT_S * 1000)
+#endif
 
-static void on_client_event(struct golioth_client *client,
-                            enum golioth_client_event event,
-                            void *arg)
+#if !defined(CONFIG_EXAMPLE_UPLOAD_MODE_STREAM) || defined(CONFIG_EXAMPLE_STREAM_TEE_SD) \
+    || defined(CONFIG_EXAMPLE_CAPTURE_WAV_FILE) || defined(CONFIG_EXAMPLE_UPLOAD_SINK_FILE)
+#define USE_SDCARD 1
+#endif
+
+#ifdef CONFIG_EXAMPLE_RAW_STORE
+/* FAT file reserving the sectors of the raw recording store */
+#define RAW_STORE_FILE              "rawstore.bin"
+#define RAW_STORE_SECTORS           \
+    (CONFIG_EXAMPLE_RAW_STORE_SIZE_MB * 1024 * (1024 / RAW_STORE_SECTOR_SIZE))
+#define RAW_STORE_SEGMENT_SECTORS   \
+    (CONFIG_EXAMPLE_RAW_STORE_SEGMENT_KB * (1024 / RAW_STORE_SECTOR_SIZE))
+#define RAW_STORE_CHUNK_SECTORS     \
+    (CONFIG_EXAMPLE_SD_WRITE_CHUNK_KB * (1024 / RAW_STORE_SECTOR_SIZE))
+#endif
+
+#ifdef CONFIG_EXAMPLE_PSRAM_RECORDING
+struct clip_upload {
+    const struct audio_clip *clip;
+    size_t offset;
+};
+
+enum golioth_status block_upload_audio_memory_cb(uint32_t block_idx,
+                                                 uint8_t *block_buffer,
+                                                 size_t *block_size,
+                                                 bool *is_last,
+                                                 void *arg)
 {
-    bool is_connected = (event == GOLIOTH_CLIENT_EVENT_CONNECTED);
-    if (is_connected)
+    struct clip_upload *upload = (struct clip_upload *)arg;
+
+    if (!upload)
     {
-        xSemaphoreGive(_connected_sem);
+        GLTH_LOGE(TAG, "arg was NULL but should have been pointer to a clip upload");
+        return GOLIOTH_ERR_INVALID_STATE;
     }
-    GLTH_LOGI(TAG, "Golioth client %s", is_connected ? "connected" : "disconnected");
-}
-
-FILE *get_audio_filestream(struct audio_ctx *a_ctx)
-{
-    char path[sizeof(SD_MOUNT_POINT) + sizeof(a_ctx->filename)];
-    snprintf(path, sizeof(path), "%s/%s", SD_MOUNT_POINT, a_ctx->filename);
 
-    struct stat st;
-    if (stat(path, &st) != 0) {
-        GLTH_LOGE(TAG, "File not found");
-        return NULL;
+    size_t remaining = upload->clip->len - upload->offset;
+    if (remaining == 0)
+    {
+        GLTH_LOGE(TAG, "Error, no bytes left in audio clip");
+        *block_size = 0;
+        *is_last = 1;
+        return GOLIOTH_ERR_NO_MORE_DATA;
     }
-    else {
-        GLTH_LOGI(TAG, "File size: %li", st.st_size);
+
+    if (remaining < *block_size)
+    {
+        *block_size = remaining;
     }
 
-    GLTH_LOGI(TAG, "Opening file: %s", path);
+    memcpy(block_buffer, &upload->clip->data[upload->offset], *block_size);
+    upload->offset += *block_size;
+    *is_last = (upload->offset == upload->clip->len);
 
-    FILE *f = fopen(SD_MOUNT_POINT"/record.wav", "r");
-    if (!f) {
-        GLTH_LOGE(TAG, "Failed to open file for reading");
-        return NULL;
-    }
+    upload_metrics_first_byte();
+
+    GLTH_LOGI(TAG,
+              "Uploading block_id: %u block_size: %zu is_last: %u",
+              (unsigned int) block_idx,
+              *block_size,
+              *is_last);
 
-    return f;
+    return GOLIOTH_OK;
 }
 
-void release_audio_filestream(FILE *f)
+static int upload_audio_clip(const struct upload_sink *sink, const struct audio_clip *clip)
 {
-    if (!f)
+    struct clip_upload upload = {
+        .clip = clip,
+    };
+
+    int err = upload_blockwise(sink,
+                               "file_upload",
+                               block_upload_audio_memory_cb,
+                               (void *) &upload);
+
+#ifdef CONFIG_EXAMPLE_VAD
+    if (err == GOLIOTH_OK)
     {
-        GLTH_LOGE(TAG, "Filestream is NULL");
-        return;
+        err = upload_activity_index(sink);
     }
+#endif
 
-    fclose(f);
+    return err;
 }
+#endif
 
-enum golioth_status block_upload_audio_filestream_cb(uint32_t block_idx,
-                                                     uint8_t *block_buffer,
-                                                     size_t *block_size,
-                                                     bool *is_last,
-                                                     void *arg)
-{
-    int err = 0;
-    FILE *f = (FILE *)arg;
+#ifdef CONFIG_EXAMPLE_RAW_STORE
+struct raw_upload {
+    struct raw_store *store;
+    uint32_t id;
+    uint32_t length;
+    uint32_t offset;
+};
 
-    if (!f)
-    {
-        GLTH_LOGE(TAG, "arg was NULL but should have been pointer to a filestream");
-        return GOLIOTH_ERR_INVALID_STATE;
-    }
+static sdmmc_card_t *sdcard_handle(void)
+{
+#ifdef CONFIG_IDF_TARGET_ESP32
+    return bsp_sdcard_get_card();
+#else
+    return bsp_sdcard;
+#endif
+}
 
-    size_t bytes_read = fread(block_buffer, 1, *block_size, f);
+enum golioth_status block_upload_raw_store_cb(uint32_t block_idx,
+                                              uint8_t *block_buffer,
+                                              size_t *block_size,
+                                              bool *is_last,
+                                              void *arg)
+{
+    struct raw_upload *upload = (struct raw_upload *)arg;
+    size_t bytes_read = 0;
 
-    err = ferror(f);
-    if (err)
+    if (!upload)
     {
-        GLTH_LOGE(TAG, "Error reading filestream: %d", err);
-        return ESP_ERR_INVALID_STATE;
+        GLTH_LOGE(TAG, "arg was NULL but should have been pointer to a raw store upload");
+        return GOLIOTH_ERR_INVALID_STATE;
     }
 
-    if (bytes_read < *block_size)
+    esp_err_t err = raw_store_read(upload->store,
+                                   upload->id,
+                                   upload->offset,
+                                   block_buffer,
+                                   *block_size,
+                                   &bytes_read);
+    if (err != ESP_OK || bytes_read == 0)
     {
-        *block_size = bytes_read;
+        GLTH_LOGE(TAG, "Error reading raw store recording: %d", err);
+        *block_size = 0;
+        *is_last = 1;
+        return GOLIOTH_ERR_NO_MORE_DATA;
     }
 
-    int eof = feof(f);
-    if (eof)
-    {
-        *is_last = true;
-    }
+    upload->offset += bytes_read;
+    *block_size = bytes_read;
+    *is_last = (upload->offset >= upload->length);
 
-    if (*block_size == 0)
-    {
-        GLTH_LOGE(TAG, "Error, no bytes read from audio filestream");
-        goto error_uploading_file;
-    }
+    upload_metrics_first_byte();
 
     GLTH_LOGI(TAG,
               "Uploading block_id: %u block_size: %zu is_last: %u",
@@ -129,27 +190,148 @@ enum golioth_status block_upload_audio_filestream_cb(uint32_t block_idx,
               *is_last);
 
     return GOLIOTH_OK;
+}
+
+/* Uploads every pending recording oldest first, including any a power loss left behind */
+static int upload_raw_store(const struct upload_sink *sink,
+                            struct raw_store *store,
+                            uint32_t latest)
+{
+    const struct raw_store_entry *entry;
+    int err = GOLIOTH_OK;
+
+    while (err == GOLIOTH_OK && (entry = raw_store_next_pending(store)) != NULL)
+    {
+        struct raw_upload upload = {
+            .store = store,
+            .id = entry->id,
+            .length = entry->length,
+        };
+
+        GLTH_LOGI(TAG,
+                  "Uploading raw store recording %" PRIu32 " (%" PRIu32 " bytes)",
+                  upload.id,
+                  upload.length);
+
+        err = upload_blockwise(sink,
+                               "file_upload",
+                               block_upload_raw_store_cb,
+                               (void *) &upload);
+
+#ifdef CONFIG_EXAMPLE_VAD
+        /* Only the latest recording's activity index is still in RAM */
+        if (err == GOLIOTH_OK && upload.id == latest)
+        {
+            err = upload_activity_index(sink);
+        }
+#endif
+
+        if (err == GOLIOTH_OK)
+        {
+            raw_store_set_state(store, upload.id, RAW_STORE_UPLOADED);
+        }
+    }
 
-error_uploading_file:
-    *block_size = 0;
-    *is_last = 1;
-    return GOLIOTH_ERR_NO_MORE_DATA;
+    return err;
 }
 
-void app_main(void)
+static int record_and_upload_raw(const struct upload_sink *sink, struct audio_ctx *a_ctx)
 {
-    GLTH_LOGI(TAG, "Start Golioth upload audio example");
+    static struct raw_store store;
+    struct raw_store_dev dev;
+
+    esp_err_t err = raw_store_dev_sdmmc_open(&dev,
+                                             sdcard_handle(),
+                                             SD_MOUNT_POINT,
+                                             RAW_STORE_FILE,
+                                             RAW_STORE_SECTORS);
+    if (err == ESP_OK)
+    {
+        err = raw_store_open(&store, &dev, RAW_STORE_SEGMENT_SECTORS, RAW_STORE_CHUNK_SECTORS);
+    }
+    if (err != ESP_OK)
+    {
+        GLTH_LOGE(TAG, "Unable to open raw store: %d", err);
+        return GOLIOTH_ERR_FAIL;
+    }
 
-#ifdef CONFIG_IDF_TARGET_ESP32
-    /* Initialize PMU */
-    m5stack_core2_init_pmu();
+    uint32_t id = record_raw(&store, a_ctx);
+    upload_metrics_recorded();
+
+    int status = upload_raw_store(sink, &store, id);
+
+    raw_store_close(&store);
+    return status;
+}
 #endif
 
-    /* Golioth connection */
-    /* Get credentials from NVS and enable shell */
-    nvs_init();
-    shell_start();
+#ifdef CONFIG_EXAMPLE_UPLOAD_MODE_SEGMENTED
+static int upload_segment(struct audio_ctx *segment, void *arg)
+{
+    return upload_audio_file((const struct upload_sink *) arg, segment);
+}
+#endif
+
+#ifdef CONFIG_EXAMPLE_UPLOAD_QUEUE
+static int upload_queued(struct audio_ctx *rec, void *arg)
+{
+    return upload_audio_file((const struct upload_sink *) arg, rec);
+}
+
+/*
+ * Recordings left over from earlier runs upload while this one records. The queue
+ * then gets UPLOAD_QUEUE_WAIT_MS to drain, whatever is left waits for the next run.
+ */
+static int record_and_enqueue(const struct upload_sink *sink, struct audio_ctx *a_ctx)
+{
+    if (upload_queue_start(upload_queued, (void *) sink) != ESP_OK)
+    {
+        return GOLIOTH_ERR_FAIL;
+    }
+
+    if (upload_queue_reserve(a_ctx) == ESP_OK)
+    {
+        record_wav(a_ctx, NULL);
+        upload_metrics_recorded();
+        upload_queue_add(a_ctx);
+    }
+    else
+    {
+        GLTH_LOGW(TAG, "Skipping this recording until the queue has room");
+    }
+
+    bool drained = upload_queue_wait_empty(pdMS_TO_TICKS(UPLOAD_QUEUE_WAIT_MS));
+    upload_queue_stop();
+
+    struct upload_queue_metrics m = upload_queue_get_metrics();
+    GLTH_LOGI(TAG,
+              "Upload queue: %" PRIu32 " uploaded, %" PRIu32 " failed attempts, %" PRIu32
+              " pending",
+              m.uploaded,
+              m.failures,
+              m.pending);
 
+    return drained ? GOLIOTH_OK : GOLIOTH_ERR_TIMEOUT;
+}
+#endif
+
+#ifdef CONFIG_EXAMPLE_UPLOAD_SINK_GOLIOTH
+static SemaphoreHandle_t _connected_sem = NULL;
+
+static void on_client_event(struct golioth_client *client,
+                            enum golioth_client_event event,
+                            void *arg)
+{
+    bool is_connected = (event == GOLIOTH_CLIENT_EVENT_CONNECTED);
+    if (is_connected)
+    {
+        xSemaphoreGive(_connected_sem);
+    }
+    GLTH_LOGI(TAG, "Golioth client %s", is_connected ? "connected" : "disconnected");
+}
+
+static struct golioth_client *connect_to_golioth(void)
+{
     if (!nvs_credentials_are_set())
     {
         GLTH_LOGW(TAG,
@@ -175,23 +357,107 @@ void app_main(void)
     GLTH_LOGW(TAG, "Waiting for connection to Golioth...");
     xSemaphoreTake(_connected_sem, portMAX_DELAY);
 
+    return client;
+}
+#endif
+
+void app_main(void)
+{
+    GLTH_LOGI(TAG, "Start Golioth upload audio example");
+
+#ifdef CONFIG_IDF_TARGET_ESP32
+    /* Initialize PMU */
+    m5stack_core2_init_pmu();
+#endif
+
+    /* Golioth connection */
+    /* Get credentials from NVS and enable shell */
+    nvs_init();
+    shell_start();
+
+#ifdef CONFIG_EXAMPLE_BENCHMARK
+    bench_start();
+#endif
+
+#ifdef CONFIG_EXAMPLE_UPLOAD_SINK_GOLIOTH
+    struct golioth_client *client = connect_to_golioth();
+#else
+    struct golioth_client *client = NULL;
+#endif
+
     /* Record Audio */
     struct audio_ctx a_ctx = audio_ctx_default();
+#ifdef USE_SDCARD
     bsp_sdcard_mount();
+#endif
     init_microphone();
+    capture_stats_start();
+    upload_init();
+
+    struct upload_sink sink;
+    ESP_ERROR_CHECK(upload_sink_default_open(&sink, client));
+
+#ifdef CONFIG_EXAMPLE_RESAMPLE_BENCHMARK
+    audio_resampler_benchmark();
+#endif
+
+#ifdef CONFIG_EXAMPLE_RAW_STORE_BENCHMARK
+    raw_store_benchmark(sdcard_handle(),
+                        SD_MOUNT_POINT,
+                        RAW_STORE_FILE,
+                        RAW_STORE_SECTORS,
+                        RAW_STORE_SEGMENT_SECTORS,
+                        RAW_STORE_CHUNK_SECTORS);
+#endif
 
     GLTH_LOGI(TAG, "Starting recording for %" PRIu32 " seconds!", a_ctx.rec_time);
 
-    record_wav(&a_ctx);
+#ifdef CONFIG_EXAMPLE_UPLOAD_MODE_SEGMENTED
+    /* Record continuously, uploading each closed segment in the background */
+    esp_err_t seg_err = segments_run(&a_ctx, upload_segment, &sink);
+    GLTH_LOGE(TAG,
+              "Segmented recording unavailable: %d, falling back to a single recording",
+              seg_err);
+#endif
 
-    /* Stream to Golioth */
-    FILE *f = get_audio_filestream(&a_ctx);
+    upload_metrics_start();
+
+#ifdef CONFIG_EXAMPLE_UPLOAD_MODE_STREAM
+    /* Upload while recording */
+    int err = upload_audio_stream(&sink, &a_ctx);
+#elif defined(CONFIG_EXAMPLE_RAW_STORE)
+    /* Record to the raw log, then upload whatever it holds */
+    int err = record_and_upload_raw(&sink, &a_ctx);
+#else
+    int err;
+    const char *mode = "file";
+
+#ifdef CONFIG_EXAMPLE_PSRAM_RECORDING
+    /* Short clips skip the SD card round trip, longer ones fall back to it */
+    struct audio_clip clip;
+    if (record_to_memory(&a_ctx, &clip) == ESP_OK)
+    {
+        upload_metrics_recorded();
+        err = upload_audio_clip(&sink, &clip);
+        audio_clip_free(&clip);
+        mode = "psram";
+    }
+    else
+#endif
+    {
+#ifdef CONFIG_EXAMPLE_UPLOAD_QUEUE
+        err = record_and_enqueue(&sink, &a_ctx);
+        mode = "queue";
+#else
+        record_wav(&a_ctx, NULL);
+        upload_metrics_recorded();
+
+        /* Upload the recording */
+        err = upload_audio_file(&sink, &a_ctx);
+#endif
+    }
+#endif
 
-    int err = golioth_stream_set_blockwise_sync(client,
-                                                "file_upload",
-                                                GOLIOTH_CONTENT_TYPE_OCTET_STREAM,
-                                                block_upload_audio_filestream_cb,
-                                                (void *) f);
     if (err)
     {
         GLTH_LOGE(TAG, "Failed to upload file: %d", err);
@@ -201,8 +467,18 @@ void app_main(void)
         GLTH_LOGI(TAG, "Upload successful!");
     }
 
-    release_audio_filestream(f);
+#ifdef CONFIG_EXAMPLE_UPLOAD_MODE_STREAM
+    upload_metrics_report("stream");
+#elif defined(CONFIG_EXAMPLE_RAW_STORE)
+    upload_metrics_report("raw");
+#else
+    upload_metrics_report(mode);
+#endif
+
+    sink.close(sink.ctx);
 
+#ifdef USE_SDCARD
     /* Unmount and disable SD card */
     bsp_sdcard_unmount();
+#endif
 }
@@ -1,22 +1,36 @@
 /* Audio */
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include "esp_cpu.h"
 #include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#ifdef ESP_PLATFORM
+#include "esp_idf_version.h"
 #include "esp_vfs.h"
-#include "driver/i2s_pdm.h"
+#include "esp_vfs_fat.h"
+#include "ff.h"
+#endif
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
 #include "format_wav.h"
 
 #include "audio.h"
-
-#ifdef CONFIG_IDF_TARGET_ESP32
-#include "m5stack_core2.h"
-i2s_chan_handle_t rx_handle = NULL;
-#endif /* CONFIG_IDF_TARGET_ESP32 */
-
-#ifdef CONFIG_IDF_TARGET_ESP32S3
-#include "esp_codec_dev.h"
-#include "bsp/m5stack_core_s3.h"
-static esp_codec_dev_handle_t mic_codec_dev = NULL;
-#endif /* CONFIG_IDF_TARGET_ESP32S3 */
+#include "audio_ring.h"
+#include "audio_source.h"
+#include "capture_stats.h"
+#include "flac_lite.h"
+#include "ima_adpcm.h"
+#include "raw_store.h"
+#include "resampler.h"
+#include "sd_writer.h"
+#include "vad.h"
 
 /* Include the Golioth Client to access backend logging */
 #include <golioth/client.h>
@@ -24,14 +38,82 @@ static const char *TAG = "audio_and_sd";
 
 #define SPI_DMA_CHAN        SPI_DMA_CH_AUTO
 #define NUM_CHANNELS        (1) // For mono recording only!
-#define FILENAME_DEFAULT    "record.wav"
+#define FILENAME_DEFAULT    "record" AUDIO_FILE_EXT
 #define SAMPLE_SIZE         (CONFIG_EXAMPLE_BIT_SAMPLE * 1024)
 #define BYTE_RATE           (CONFIG_EXAMPLE_SAMPLE_RATE * (CONFIG_EXAMPLE_BIT_SAMPLE / 8)) * NUM_CHANNELS
+#define BYTES_PER_SAMPLE    (CONFIG_EXAMPLE_BIT_SAMPLE / 8)
+
+/* Rate of the stored and uploaded audio */
+#ifdef CONFIG_EXAMPLE_RESAMPLE
+#define OUTPUT_SAMPLE_RATE  CONFIG_EXAMPLE_RESAMPLE_RATE
+#else
+#define OUTPUT_SAMPLE_RATE  CONFIG_EXAMPLE_SAMPLE_RATE
+#endif
 
-static int16_t i2s_readraw_buff[SAMPLE_SIZE];
-size_t bytes_read;
+#define CAPTURE_TASK_PRIORITY   (configMAX_PRIORITIES - 5)
+#define WRITER_TASK_PRIORITY    (5)
+#define AUDIO_TASK_STACK_SIZE   (4096)
+
+/* Scratch buffer the capture task drains into when every ring slot is busy */
+static uint8_t overrun_buff[SAMPLE_SIZE];
 const int WAVE_HEADER_SIZE = 44;
 
+union audio_header {
+    wav_header_t pcm;
+    wav_header_ima_adpcm_t ima_adpcm;
+    uint8_t flac[FLAC_LITE_STREAM_HEADER_SIZE];
+};
+
+struct recording {
+    struct audio_ring ring;
+    /* Recording file, sd.f is NULL when nothing is stored */
+    struct sd_writer sd;
+#ifdef CONFIG_EXAMPLE_RAW_STORE
+    /* Raw log the recording goes to instead of a file */
+    struct raw_store *raw;
+#endif
+#ifdef CONFIG_EXAMPLE_PSRAM_RECORDING
+    /* Memory the recording goes to instead of a file */
+    struct audio_clip *clip;
+#endif
+    /* PCM bytes to capture */
+    uint32_t target_bytes;
+    uint32_t captured_bytes;
+    /* PCM bytes taken from the ring */
+    uint32_t consumed_bytes;
+    /* PCM bytes (at the output rate) let through by the activity gate and encoded */
+    uint32_t kept_bytes;
+    /* Encoded bytes stored or streamed */
+    uint32_t written_bytes;
+    uint32_t dropped_bytes;
+    uint32_t read_failures;
+    uint32_t write_failures;
+    SemaphoreHandle_t done_sem;
+    int num_tasks;
+    int64_t start_us;
+    uint8_t *enc_buf;
+    uint64_t enc_cycles;
+#ifdef CONFIG_EXAMPLE_AUDIO_FORMAT_IMA_ADPCM
+    struct ima_adpcm_enc *adpcm;
+#endif
+#ifdef CONFIG_EXAMPLE_AUDIO_FORMAT_FLAC
+    struct flac_lite_enc *flac;
+#endif
+#ifdef CONFIG_EXAMPLE_RESAMPLE
+    struct resampler *resampler;
+    int16_t *resample_buf;
+#endif
+#ifdef CONFIG_EXAMPLE_VAD
+    struct vad *vad;
+    int16_t *gate_buf;
+#endif
+};
+
+#ifdef CONFIG_EXAMPLE_VAD
+/* Kept ranges of the last recording */
+static struct vad_index activity_index;
+#endif
+
 
 struct audio_ctx audio_ctx_default(void)
 {
@@ -42,7 +124,149 @@ struct audio_ctx audio_ctx_default(void)
     return a_ctx;
 }
 
-static FILE *prep_recording(struct audio_ctx *a_ctx)
+struct audio_ctx audio_ctx_index(const struct audio_ctx *a_ctx)
+{
+    struct audio_ctx index_ctx = *a_ctx;
+    const char *ext = strrchr(a_ctx->filename, '.');
+    int base_len = ext ? (int) (ext - a_ctx->filename) : (int) strlen(a_ctx->filename);
+
+    snprintf(index_ctx.filename,
+             sizeof(index_ctx.filename),
+             "%.*s" AUDIO_INDEX_EXT,
+             base_len,
+             a_ctx->filename);
+
+    return index_ctx;
+}
+
+size_t audio_activity_index_json(char *buf, size_t len)
+{
+#ifdef CONFIG_EXAMPLE_VAD
+    return vad_index_to_json(&activity_index, buf, len);
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Size of the data chunk once num_samples samples have been encoded, or
+ * ENCODED_SIZE_VARIABLE if it depends on the signal
+ */
+#define ENCODED_SIZE_VARIABLE   UINT32_MAX
+
+static uint32_t encoded_data_size(uint32_t num_samples)
+{
+#if defined(CONFIG_EXAMPLE_VAD) || defined(CONFIG_EXAMPLE_AUDIO_FORMAT_FLAC)
+    /* Gated silence and lossless compression both depend on the signal */
+    (void) num_samples;
+    return ENCODED_SIZE_VARIABLE;
+#elif defined(CONFIG_EXAMPLE_AUDIO_FORMAT_IMA_ADPCM)
+    return ima_adpcm_encoded_size(num_samples, ima_adpcm_block_align(OUTPUT_SAMPLE_RATE));
+#else
+    return num_samples * BYTES_PER_SAMPLE;
+#endif
+}
+
+/*
+ * Fills in the file header for the configured format and returns its size. A WAV
+ * header for ENCODED_SIZE_VARIABLE data, or a FLAC header with num_samples == 0,
+ * leaves the stream length unspecified.
+ */
+static size_t build_header(union audio_header *hdr, uint32_t data_size, uint32_t num_samples)
+{
+#if defined(CONFIG_EXAMPLE_AUDIO_FORMAT_IMA_ADPCM)
+    uint16_t block_align = ima_adpcm_block_align(OUTPUT_SAMPLE_RATE);
+    hdr->ima_adpcm = (wav_header_ima_adpcm_t)
+        WAV_HEADER_IMA_ADPCM_DEFAULT(data_size,
+                                     num_samples,
+                                     OUTPUT_SAMPLE_RATE,
+                                     1,
+                                     block_align,
+                                     ima_adpcm_samples_per_block(block_align));
+    if (data_size == ENCODED_SIZE_VARIABLE)
+    {
+        hdr->ima_adpcm.descriptor_chunk.chunk_size = UINT32_MAX;
+        hdr->ima_adpcm.data_chunk.subchunk_size = UINT32_MAX;
+    }
+    return sizeof(hdr->ima_adpcm);
+#elif defined(CONFIG_EXAMPLE_AUDIO_FORMAT_FLAC)
+    (void) data_size;
+    return flac_lite_stream_header(hdr->flac, OUTPUT_SAMPLE_RATE, num_samples, 0, 0);
+#else
+    (void) num_samples;
+    hdr->pcm = (wav_header_t)
+        WAV_HEADER_PCM_DEFAULT(data_size, 16, OUTPUT_SAMPLE_RATE, 1);
+    if (data_size == ENCODED_SIZE_VARIABLE)
+    {
+        hdr->pcm.descriptor_chunk.chunk_size = UINT32_MAX;
+    }
+    return sizeof(hdr->pcm);
+#endif
+}
+
+/* Largest data chunk num_samples can encode to, used to size preallocated files */
+static uint32_t max_data_size(uint32_t num_samples)
+{
+#if defined(CONFIG_EXAMPLE_AUDIO_FORMAT_IMA_ADPCM)
+    return ima_adpcm_encoded_size(num_samples, ima_adpcm_block_align(OUTPUT_SAMPLE_RATE));
+#elif defined(CONFIG_EXAMPLE_AUDIO_FORMAT_FLAC)
+    uint32_t frames = (num_samples + FLAC_LITE_BLOCK_SIZE - 1) / FLAC_LITE_BLOCK_SIZE;
+    return frames * FLAC_LITE_MAX_FRAME_SIZE;
+#else
+    return num_samples * BYTES_PER_SAMPLE;
+#endif
+}
+
+#ifdef CONFIG_EXAMPLE_PREALLOCATE_FILES
+/* Creates path at size bytes, in contiguous clusters */
+static esp_err_t create_contiguous(const char *path, uint32_t size)
+{
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
+    return esp_vfs_fat_create_contiguous_file(SD_MOUNT_POINT, path, size, true);
+#elif FF_USE_EXPAND
+    /* The VFS helper is new in ESP-IDF 5.3, before it go to FatFs: the card is drive 0 */
+    char ff_path[64];
+    snprintf(ff_path, sizeof(ff_path), "0:%s", path + strlen(SD_MOUNT_POINT));
+
+    FIL fil;
+    FRESULT res = f_open(&fil, ff_path, FA_WRITE | FA_CREATE_ALWAYS);
+    if (res == FR_OK)
+    {
+        res = f_expand(&fil, size, 1);
+        f_close(&fil);
+    }
+
+    return (res == FR_OK) ? ESP_OK : ESP_FAIL;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+#endif
+
+/*
+ * Creates the file at its final size with contiguous clusters, so FAT never has to
+ * search for and link a new cluster in the middle of the recording.
+ */
+static FILE *open_preallocated(const char *path, uint32_t size)
+{
+#ifdef CONFIG_EXAMPLE_PREALLOCATE_FILES
+    esp_err_t err = create_contiguous(path, size);
+    if (err == ESP_OK)
+    {
+        /* "r+" keeps the allocation that "w" would truncate away */
+        FILE *f = fopen(path, "r+");
+        if (f)
+        {
+            return f;
+        }
+    }
+
+    GLTH_LOGW(TAG, "Unable to preallocate %" PRIu32 " bytes (%d), growing file", size, err);
+#endif
+    return fopen(path, "w");
+}
+
+static bool prep_recording(struct audio_ctx *a_ctx, struct sd_writer *w)
 {
     char path[sizeof(SD_MOUNT_POINT) + sizeof(a_ctx->filename)];
     snprintf(path, sizeof(path), "%s/%s", SD_MOUNT_POINT, a_ctx->filename);
@@ -50,9 +274,9 @@ static FILE *prep_recording(struct audio_ctx *a_ctx)
     // Use POSIX and C standard library functions to work with files.
     GLTH_LOGI(TAG, "Opening file: %s", path);
 
-    uint32_t flash_rec_time = BYTE_RATE * a_ctx->rec_time;
-    const wav_header_t wav_header =
-        WAV_HEADER_PCM_DEFAULT(flash_rec_time, 16, CONFIG_EXAMPLE_SAMPLE_RATE, 1);
+    uint32_t num_samples = OUTPUT_SAMPLE_RATE * a_ctx->rec_time;
+    union audio_header header;
+    size_t header_size = build_header(&header, encoded_data_size(num_samples), num_samples);
 
     // First check if file exists before creating a new file.
     struct stat st;
@@ -61,128 +285,1006 @@ static FILE *prep_recording(struct audio_ctx *a_ctx)
         unlink(path);
     }
 
-    // Create new WAV file
-    FILE *f = fopen(path, "a");
+    // Create new audio file
+    FILE *f = open_preallocated(path, header_size + max_data_size(num_samples));
     if (f == NULL) {
         GLTH_LOGE(TAG, "Failed to open file for writing");
-        return NULL;
+        return false;
     }
 
-    // Write the header to the WAV file
-    fwrite(&wav_header, sizeof(wav_header), 1, f);
-    return f;
+    esp_err_t err = sd_writer_open(w, f, CONFIG_EXAMPLE_SD_WRITE_CHUNK_KB * 1024);
+    if (err != ESP_OK)
+    {
+        GLTH_LOGE(TAG, "Failed to allocate SD write buffer: %d", err);
+        fclose(f);
+        return false;
+    }
+
+    // The header starts the first chunk, keeping every chunk sector-aligned in the file
+    sd_writer_write(w, &header, header_size);
+    return true;
 }
 
+/* Returns false when the end of the recording could not be written */
+static bool finish_recording(struct sd_writer *w, uint32_t data_size, uint32_t num_samples)
+{
+    FILE *f = w->f;
+    bool flushed = sd_writer_flush(w);
+
+    if (!flushed)
+    {
+        GLTH_LOGW(TAG, "Unable to write the end of the recording");
+    }
+
+    if (w->writes)
+    {
+        uint32_t rate = sd_writer_rate_centi_mbps(w);
+
+        GLTH_LOGI(TAG,
+                  "SD writes: %" PRIu32 " x %u KB, %" PRIu32 ".%02" PRIu32
+                  " MB/s, avg %" PRIu32 " us, max %" PRIu32 " us, %" PRIu32 " over %u ms",
+                  w->writes,
+                  (unsigned int) (w->chunk_size / 1024),
+                  rate / 100,
+                  rate % 100,
+                  (uint32_t) (w->total_us / w->writes),
+                  w->max_us,
+                  w->slow_writes,
+                  (unsigned int) (SD_WRITER_SLOW_US / 1000));
+    }
 
-#ifdef CONFIG_IDF_TARGET_ESP32
+    // Dropped buffers make the file shorter than planned, so fix up the header
+    union audio_header header;
+    size_t header_size = build_header(&header, data_size, num_samples);
+
+    fseek(f, 0, SEEK_SET);
+    fwrite(&header, header_size, 1, f);
+
+    // Release the preallocated space that was not used
+    uint32_t file_size = header_size + data_size;
+    fflush(f);
+    if (ftruncate(fileno(f), file_size) != 0)
+    {
+        GLTH_LOGW(TAG, "Unable to truncate file to %" PRIu32 " bytes", file_size);
+    }
+    sd_writer_close(w);
+
+    return flushed;
+}
+
+
+static struct audio_source _default_source;
+/* Every recording reads from here, see init_microphone() and audio_set_source() */
+static const struct audio_source *_source;
 
 void init_microphone(void)
 {
-    i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_AUTO, I2S_ROLE_MASTER);
-    ESP_ERROR_CHECK(i2s_new_channel(&chan_cfg, NULL, &rx_handle));
-
-    i2s_pdm_rx_config_t pdm_rx_cfg = {
-        .clk_cfg = I2S_PDM_RX_CLK_DEFAULT_CONFIG(CONFIG_EXAMPLE_SAMPLE_RATE),
-        /* The default mono slot is the left slot (whose 'select pin' of the PDM microphone is pulled down) */
-        .slot_cfg = I2S_PDM_RX_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_MONO),
-        .gpio_cfg = {
-            .clk = CONFIG_EXAMPLE_I2S_CLK_GPIO,
-            .din = CONFIG_EXAMPLE_I2S_DATA_GPIO,
-            .invert_flags = {
-                .clk_inv = false,
-            },
-        },
+    ESP_ERROR_CHECK(audio_source_default_open(&_default_source));
+    _source = &_default_source;
+
+    GLTH_LOGI(TAG, "Capturing from %s", _source->name);
+}
+
+void audio_set_source(const struct audio_source *source)
+{
+    _source = source;
+}
+
+
+/*
+ * Only drains the microphone into the ring, never touches the SD card. Progress is
+ * reported through capture_stats, this loop does no formatted I/O.
+ */
+static void capture_task(void *arg)
+{
+    struct recording *rec = arg;
+
+    while (rec->captured_bytes < rec->target_bytes) {
+        struct audio_slot *slot = audio_ring_acquire(&rec->ring);
+        uint8_t *buf = slot ? slot->data : overrun_buff;
+        size_t bytes_read = 0;
+
+        int64_t read_start = esp_timer_get_time();
+        esp_err_t err = _source->read(_source->ctx, buf, rec->ring.slot_size, &bytes_read);
+        uint32_t latency_us = (uint32_t) (esp_timer_get_time() - read_start);
+
+        capture_stats_record((err == ESP_OK) ? (const int16_t *) buf : NULL,
+                             bytes_read,
+                             latency_us);
+
+        if (err != ESP_OK) {
+            rec->read_failures++;
+        }
+        /* A timed out read can succeed with nothing, its slot goes back unused */
+        if (err != ESP_OK || bytes_read == 0) {
+            if (slot) {
+                audio_ring_cancel(&rec->ring, slot);
+            }
+            continue;
+        }
+
+        rec->captured_bytes += bytes_read;
+
+        if (slot) {
+            slot->len = bytes_read;
+            audio_ring_commit(&rec->ring, slot);
+        } else {
+            rec->dropped_bytes += bytes_read;
+        }
+    }
+
+    audio_ring_finish(&rec->ring);
+    xSemaphoreGive(rec->done_sem);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t encoder_init(struct recording *rec)
+{
+    /* Most samples a single slot can hand to the encoder */
+    size_t max_samples = rec->ring.slot_size / BYTES_PER_SAMPLE;
+
+#ifdef CONFIG_EXAMPLE_RESAMPLE
+    rec->resampler = calloc(1, sizeof(struct resampler));
+    if (!rec->resampler)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = resampler_init(rec->resampler,
+                                   CONFIG_EXAMPLE_SAMPLE_RATE,
+                                   OUTPUT_SAMPLE_RATE,
+                                   RESAMPLER_KERNEL_DEFAULT);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    max_samples = resampler_max_output(rec->resampler, max_samples);
+    rec->resample_buf = malloc(max_samples * sizeof(int16_t));
+    if (!rec->resample_buf)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+
+#ifdef CONFIG_EXAMPLE_VAD
+    struct vad_config vad_config = {
+        .sample_rate = OUTPUT_SAMPLE_RATE,
+        .threshold_db = CONFIG_EXAMPLE_VAD_THRESHOLD_DB,
+        .hangover_ms = CONFIG_EXAMPLE_VAD_HANGOVER_MS,
+        .preroll_ms = CONFIG_EXAMPLE_VAD_PREROLL_MS,
     };
-    ESP_ERROR_CHECK(i2s_channel_init_pdm_rx_mode(rx_handle, &pdm_rx_cfg));
-    ESP_ERROR_CHECK(i2s_channel_enable(rx_handle));
+
+    rec->vad = calloc(1, sizeof(struct vad));
+    if (!rec->vad || vad_init(rec->vad, &vad_config) != ESP_OK)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* The gate can release its pre-roll on top of a whole slot */
+    max_samples = vad_max_output(rec->vad, max_samples);
+    rec->gate_buf = malloc(max_samples * sizeof(int16_t));
+    if (!rec->gate_buf)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+
+#if defined(CONFIG_EXAMPLE_AUDIO_FORMAT_IMA_ADPCM)
+    uint16_t block_align = ima_adpcm_block_align(OUTPUT_SAMPLE_RATE);
+
+    rec->adpcm = malloc(sizeof(struct ima_adpcm_enc));
+    size_t max_blocks = max_samples / ima_adpcm_samples_per_block(block_align) + 1;
+
+    rec->enc_buf = malloc(max_blocks * block_align);
+    if (!rec->adpcm || !rec->enc_buf)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ima_adpcm_init(rec->adpcm, block_align);
+#elif defined(CONFIG_EXAMPLE_AUDIO_FORMAT_FLAC)
+    rec->flac = malloc(sizeof(struct flac_lite_enc));
+    rec->enc_buf = malloc((max_samples / FLAC_LITE_BLOCK_SIZE + 1) * FLAC_LITE_MAX_FRAME_SIZE);
+    if (!rec->flac || !rec->enc_buf)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    flac_lite_init(rec->flac, OUTPUT_SAMPLE_RATE);
+#else
+    /* PCM is passed through */
+    (void) max_samples;
+#endif
+    return ESP_OK;
 }
 
-void record_wav(struct audio_ctx *a_ctx)
+static void encoder_deinit(struct recording *rec)
 {
-    int flash_wr_size = 0;
-    uint32_t flash_rec_time = BYTE_RATE * a_ctx->rec_time;
+#ifdef CONFIG_EXAMPLE_AUDIO_FORMAT_IMA_ADPCM
+    free(rec->adpcm);
+    rec->adpcm = NULL;
+#endif
+#ifdef CONFIG_EXAMPLE_AUDIO_FORMAT_FLAC
+    free(rec->flac);
+    rec->flac = NULL;
+#endif
+#ifdef CONFIG_EXAMPLE_RESAMPLE
+    if (rec->resampler)
+    {
+        resampler_deinit(rec->resampler);
+        free(rec->resampler);
+        rec->resampler = NULL;
+    }
+    free(rec->resample_buf);
+    rec->resample_buf = NULL;
+#endif
+#ifdef CONFIG_EXAMPLE_VAD
+    if (rec->vad)
+    {
+        vad_deinit(rec->vad);
+        free(rec->vad);
+        rec->vad = NULL;
+    }
+    free(rec->gate_buf);
+    rec->gate_buf = NULL;
+#endif
+    free(rec->enc_buf);
+    rec->enc_buf = NULL;
+}
+
+/* Runs PCM through the configured encoder and returns the encoded size */
+static size_t encode_pcm(struct recording *rec,
+                         const int16_t *pcm,
+                         size_t num_samples,
+                         const uint8_t **out)
+{
+    rec->kept_bytes += num_samples * BYTES_PER_SAMPLE;
+
+#if defined(CONFIG_EXAMPLE_AUDIO_FORMAT_IMA_ADPCM)
+    uint32_t start = esp_cpu_get_cycle_count();
+    size_t len = ima_adpcm_encode(rec->adpcm, pcm, num_samples, rec->enc_buf);
+    rec->enc_cycles += esp_cpu_get_cycle_count() - start;
+    *out = rec->enc_buf;
+    return len;
+#elif defined(CONFIG_EXAMPLE_AUDIO_FORMAT_FLAC)
+    uint32_t start = esp_cpu_get_cycle_count();
+    size_t len = flac_lite_encode(rec->flac, pcm, num_samples, rec->enc_buf);
+    rec->enc_cycles += esp_cpu_get_cycle_count() - start;
+    *out = rec->enc_buf;
+    return len;
+#else
+    *out = (const uint8_t *) pcm;
+    return num_samples * BYTES_PER_SAMPLE;
+#endif
+}
+
+/*
+ * Runs one slot of PCM through the resampler and activity gate (if enabled) and the
+ * configured encoder. Input beyond the requested recording length is discarded so the output
+ * always matches the planned header.
+ */
+static size_t encoder_process(struct recording *rec,
+                              const struct audio_slot *slot,
+                              const uint8_t **out)
+{
+    size_t len = MIN(slot->len, rec->target_bytes - rec->consumed_bytes);
+    rec->consumed_bytes += len;
+
+    const int16_t *pcm = (const int16_t *) slot->data;
+    size_t num_samples = len / BYTES_PER_SAMPLE;
+
+#ifdef CONFIG_EXAMPLE_RESAMPLE
+    num_samples = resampler_process(rec->resampler, pcm, num_samples, rec->resample_buf);
+    pcm = rec->resample_buf;
+#endif
+
+#ifdef CONFIG_EXAMPLE_VAD
+    num_samples = vad_process(rec->vad, pcm, num_samples, rec->gate_buf);
+    pcm = rec->gate_buf;
+#endif
 
-    FILE *f = prep_recording(a_ctx);
-    if (!f)
+    return encode_pcm(rec, pcm, num_samples, out);
+}
+
+/* Emits whatever the gate and encoder still buffer once the stream has ended */
+static size_t encoder_flush(struct recording *rec, const uint8_t **out)
+{
+    size_t len = 0;
+
+    *out = NULL;
+
+#ifdef CONFIG_EXAMPLE_VAD
+    len = encode_pcm(rec, rec->gate_buf, vad_flush(rec->vad, rec->gate_buf), out);
+#endif
+
+#if defined(CONFIG_EXAMPLE_AUDIO_FORMAT_IMA_ADPCM)
+    len += ima_adpcm_flush(rec->adpcm, &rec->enc_buf[len]);
+    *out = rec->enc_buf;
+#elif defined(CONFIG_EXAMPLE_AUDIO_FORMAT_FLAC)
+    uint32_t start = esp_cpu_get_cycle_count();
+    len += flac_lite_flush(rec->flac, &rec->enc_buf[len]);
+    rec->enc_cycles += esp_cpu_get_cycle_count() - start;
+    *out = rec->enc_buf;
+#endif
+
+    return len;
+}
+
+#ifdef CONFIG_EXAMPLE_PSRAM_RECORDING
+static bool audio_clip_append(struct audio_clip *clip, const void *data, size_t len)
+{
+    if (len > clip->size - clip->len)
+    {
+        return false;
+    }
+
+    memcpy(&clip->data[clip->len], data, len);
+    clip->len += len;
+    return true;
+}
+#endif
+
+/* Appends to wherever the recording is stored, the file by default */
+static bool sd_write(struct recording *rec, const uint8_t *data, size_t len)
+{
+    bool ok;
+
+#ifdef CONFIG_EXAMPLE_RAW_STORE
+    if (rec->raw)
+    {
+        ok = (raw_store_append(rec->raw, data, len) == ESP_OK);
+    }
+    else
+#endif
+#ifdef CONFIG_EXAMPLE_PSRAM_RECORDING
+    if (rec->clip)
+    {
+        ok = audio_clip_append(rec->clip, data, len);
+    }
+    else
+#endif
+    {
+        /* The file writes whole chunks as they fill */
+        ok = sd_writer_write(&rec->sd, data, len);
+    }
+
+    if (!ok)
+    {
+        rec->write_failures++;
+    }
+
+    return ok;
+}
+
+static void write_encoded(struct recording *rec, const uint8_t *data, size_t len)
+{
+    if (len == 0)
     {
-        GLTH_LOGE(TAG, "Recording unsuccessful");
         return;
     }
 
-    // Start recording
-    while (flash_wr_size < flash_rec_time) {
-        // Read the RAW samples from the microphone
-        if (i2s_channel_read(rx_handle, (char *)i2s_readraw_buff, SAMPLE_SIZE, &bytes_read, 1000) == ESP_OK) {
-            printf("[0] %d [1] %d [2] %d [3]%d ...\n", i2s_readraw_buff[0], i2s_readraw_buff[1], i2s_readraw_buff[2], i2s_readraw_buff[3]);
-            // Write the samples to the WAV file
-            fwrite(i2s_readraw_buff, bytes_read, 1, f);
-            flash_wr_size += bytes_read;
-        } else {
-            printf("Read Failed!\n");
+    if (sd_write(rec, data, len)) {
+        rec->written_bytes += len;
+    }
+}
+
+/* Flushes full slots to the file, absorbing SD/FAT stalls */
+static void writer_task(void *arg)
+{
+    struct recording *rec = arg;
+    const uint8_t *out;
+    size_t len;
+
+    while (true) {
+        struct audio_slot *slot = audio_ring_consume(&rec->ring, portMAX_DELAY);
+        if (audio_slot_is_eos(slot)) {
+            audio_ring_release(&rec->ring, slot);
+            break;
+        }
+
+        len = encoder_process(rec, slot, &out);
+        write_encoded(rec, out, len);
+
+        audio_ring_release(&rec->ring, slot);
+    }
+
+    len = encoder_flush(rec, &out);
+    write_encoded(rec, out, len);
+
+    xSemaphoreGive(rec->done_sem);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t recording_start(struct recording *rec, uint32_t rec_time, bool with_writer)
+{
+    rec->target_bytes = BYTE_RATE * rec_time;
+
+    if (audio_ring_init(&rec->ring, CONFIG_EXAMPLE_CAPTURE_RING_SLOTS, SAMPLE_SIZE) != ESP_OK)
+    {
+        GLTH_LOGE(TAG, "Unable to allocate capture ring");
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (encoder_init(rec) != ESP_OK)
+    {
+        GLTH_LOGE(TAG, "Unable to allocate encoder");
+        encoder_deinit(rec);
+        audio_ring_deinit(&rec->ring);
+        return ESP_ERR_NO_MEM;
+    }
+
+    rec->done_sem = xSemaphoreCreateCounting(2, 0);
+    if (!rec->done_sem || _source->start(_source->ctx) != ESP_OK)
+    {
+        GLTH_LOGE(TAG, "Unable to start capture");
+        if (rec->done_sem)
+        {
+            vSemaphoreDelete(rec->done_sem);
+            rec->done_sem = NULL;
         }
+        encoder_deinit(rec);
+        audio_ring_deinit(&rec->ring);
+        return ESP_FAIL;
+    }
+
+    rec->num_tasks = with_writer ? 2 : 1;
+    rec->start_us = esp_timer_get_time();
+    capture_stats_reset();
+
+    // Start recording
+    if (with_writer)
+    {
+        xTaskCreate(writer_task,
+                    "audio_writer",
+                    AUDIO_TASK_STACK_SIZE,
+                    rec,
+                    WRITER_TASK_PRIORITY,
+                    NULL);
+    }
+    xTaskCreate(capture_task,
+                "audio_capture",
+                AUDIO_TASK_STACK_SIZE,
+                rec,
+                CAPTURE_TASK_PRIORITY,
+                NULL);
+
+    return ESP_OK;
+}
+
+/* Waits for the capture (and writer) task to exit, then reports and frees the ring */
+static void recording_finish(struct recording *rec)
+{
+    for (int i = 0; i < rec->num_tasks; i++)
+    {
+        xSemaphoreTake(rec->done_sem, portMAX_DELAY);
+    }
+
+    int64_t elapsed_us = esp_timer_get_time() - rec->start_us;
+    _source->stop(_source->ctx);
+
+    /* Anything the consumer did not pick up goes back to the pool */
+    struct audio_slot *slot;
+    while ((slot = audio_ring_consume(&rec->ring, 0)) != NULL)
+    {
+        audio_ring_release(&rec->ring, slot);
+    }
+
+    uint32_t kbps = 0;
+    if (elapsed_us > 0)
+    {
+        kbps = (uint32_t) (((int64_t) rec->written_bytes * 1000000 / elapsed_us) / 1024);
     }
 
     GLTH_LOGI(TAG, "Recording done!");
+    GLTH_LOGI(TAG,
+              "Captured %" PRIu32 " bytes, wrote %" PRIu32 " bytes in %" PRIu32
+              " ms (%" PRIu32 " KB/s)",
+              rec->captured_bytes,
+              rec->written_bytes,
+              (uint32_t) (elapsed_us / 1000),
+              kbps);
+    GLTH_LOGI(TAG,
+              "Ring: %u slots, high-water %u, overruns %" PRIu32 " (%" PRIu32 " bytes dropped)",
+              (unsigned int) rec->ring.num_slots,
+              (unsigned int) rec->ring.high_water,
+              rec->ring.overruns,
+              rec->dropped_bytes);
+    if (rec->read_failures || rec->write_failures)
+    {
+        GLTH_LOGW(TAG,
+                  "Read failures: %" PRIu32 ", write failures: %" PRIu32,
+                  rec->read_failures,
+                  rec->write_failures);
+    }
+
+#ifdef CONFIG_EXAMPLE_VAD
+    activity_index = rec->vad->index;
+    GLTH_LOGI(TAG,
+              "Activity: kept %" PRIu32 " of %" PRIu32 " ms in %u ranges%s",
+              (uint32_t) ((uint64_t) activity_index.kept_samples * 1000
+                          / OUTPUT_SAMPLE_RATE),
+              (uint32_t) ((uint64_t) activity_index.total_samples * 1000
+                          / OUTPUT_SAMPLE_RATE),
+              (unsigned int) activity_index.num_ranges,
+              activity_index.saturated ? " (index full, gate left open)" : "");
+#endif
+
+    uint32_t kept_samples = rec->kept_bytes / BYTES_PER_SAMPLE;
+    if (rec->enc_cycles && kept_samples && rec->written_bytes)
+    {
+        uint32_t ratio_x100 =
+            (uint32_t) ((uint64_t) rec->kept_bytes * 100 / rec->written_bytes);
+        /* Share of one core spent encoding per second of audio */
+        uint32_t load_permille = (uint32_t) (rec->enc_cycles * OUTPUT_SAMPLE_RATE
+                                             / ((uint64_t) kept_samples
+                                                * CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 1000));
+
+        GLTH_LOGI(TAG,
+                  "Encoder: %" PRIu32 " -> %" PRIu32 " bytes (ratio %" PRIu32 ".%02" PRIu32
+                  "), %" PRIu32 ".%02" PRIu32 " cycles/sample, CPU load %" PRIu32 ".%" PRIu32
+                  "%%",
+                  rec->kept_bytes,
+                  rec->written_bytes,
+                  ratio_x100 / 100,
+                  ratio_x100 % 100,
+                  (uint32_t) (rec->enc_cycles / kept_samples),
+                  (uint32_t) ((rec->enc_cycles * 100 / kept_samples) % 100),
+                  load_permille / 10,
+                  load_permille % 10);
+    }
+
+    vSemaphoreDelete(rec->done_sem);
+    rec->done_sem = NULL;
+    encoder_deinit(rec);
+    audio_ring_deinit(&rec->ring);
+}
+
+#ifdef CONFIG_EXAMPLE_RESAMPLE_BENCHMARK
+
+#define RESAMPLE_BENCH_SAMPLES  (CONFIG_EXAMPLE_SAMPLE_RATE / 4)
+
+/* Runs one kernel over the input, returns the cycles spent per output sample */
+static uint32_t resampler_bench_kernel(enum resampler_kernel kernel,
+                                       const int16_t *in,
+                                       int16_t *out,
+                                       size_t *num_out)
+{
+    struct resampler rs;
+
+    if (resampler_init(&rs, CONFIG_EXAMPLE_SAMPLE_RATE, OUTPUT_SAMPLE_RATE, kernel) != ESP_OK)
+    {
+        return 0;
+    }
+
+    uint32_t start = esp_cpu_get_cycle_count();
+    *num_out = resampler_process(&rs, in, RESAMPLE_BENCH_SAMPLES, out);
+    uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+    resampler_deinit(&rs);
+    return *num_out ? cycles / *num_out : 0;
+}
+
+void audio_resampler_benchmark(void)
+{
+    int16_t *in = malloc(RESAMPLE_BENCH_SAMPLES * sizeof(int16_t));
+    size_t max_out = RESAMPLE_BENCH_SAMPLES * (uint64_t) OUTPUT_SAMPLE_RATE
+                     / CONFIG_EXAMPLE_SAMPLE_RATE + 1;
+    int16_t *out_scalar = malloc(max_out * sizeof(int16_t));
+    int16_t *out_simd = malloc(max_out * sizeof(int16_t));
+
+    if (!in || !out_scalar || !out_simd)
+    {
+        GLTH_LOGE(TAG, "Unable to allocate resampler benchmark buffers");
+        goto cleanup;
+    }
+
+    /* Same half-scale chirp through both kernels */
+    for (size_t i = 0; i < RESAMPLE_BENCH_SAMPLES; i++)
+    {
+        float t = (float) i / CONFIG_EXAMPLE_SAMPLE_RATE;
+        in[i] = (int16_t) (16000.0f * sinf(2.0f * (float) M_PI * (200.0f + 20000.0f * t) * t));
+    }
+
+    size_t n_scalar = 0;
+    uint32_t scalar = resampler_bench_kernel(RESAMPLER_KERNEL_SCALAR, in, out_scalar, &n_scalar);
+
+    GLTH_LOGI(TAG,
+              "Resampler %u -> %u Hz, %u taps: scalar %" PRIu32 " cycles/sample",
+              (unsigned int) CONFIG_EXAMPLE_SAMPLE_RATE,
+              (unsigned int) OUTPUT_SAMPLE_RATE,
+              (unsigned int) RESAMPLER_TAPS,
+              scalar);
+
+#ifdef RESAMPLER_HAVE_ESP_DSP
+    size_t n_simd = 0;
+    uint32_t simd = resampler_bench_kernel(RESAMPLER_KERNEL_ESP_DSP, in, out_simd, &n_simd);
+    uint32_t mismatches = 0;
+
+    for (size_t i = 0; i < MIN(n_scalar, n_simd); i++)
+    {
+        mismatches += (out_scalar[i] != out_simd[i]);
+    }
+
+    GLTH_LOGI(TAG,
+              "Resampler esp-dsp %" PRIu32 " cycles/sample (%" PRIu32 ".%02" PRIu32
+              "x), %" PRIu32 " of %u outputs differ",
+              simd,
+              simd ? scalar / simd : 0,
+              simd ? (scalar * 100 / simd) % 100 : 0,
+              mismatches,
+              (unsigned int) n_simd);
+#endif
+
+cleanup:
+    free(in);
+    free(out_scalar);
+    free(out_simd);
+}
+#endif
+
+#ifdef CONFIG_EXAMPLE_VAD
+/* Stores the kept ranges next to the recording so timestamps can be rebuilt */
+static void save_activity_index(const struct audio_ctx *a_ctx)
+{
+    struct audio_ctx index_ctx = audio_ctx_index(a_ctx);
+    char path[sizeof(SD_MOUNT_POINT) + sizeof(index_ctx.filename)];
+    snprintf(path, sizeof(path), "%s/%s", SD_MOUNT_POINT, index_ctx.filename);
+
+    char *json = malloc(VAD_INDEX_JSON_MAX);
+    FILE *f = fopen(path, "w");
+    if (!json || !f)
+    {
+        GLTH_LOGE(TAG, "Unable to save activity index %s", path);
+        free(json);
+        if (f)
+        {
+            fclose(f);
+        }
+        return;
+    }
+
+    size_t len = vad_index_to_json(&activity_index, json, VAD_INDEX_JSON_MAX);
+    fwrite(json, 1, len, f);
     fclose(f);
+    free(json);
+}
+#endif
+
+esp_err_t record_wav(struct audio_ctx *a_ctx, uint32_t *recorded_ms)
+{
+    struct recording rec = {0};
+
+    if (recorded_ms)
+    {
+        *recorded_ms = 0;
+    }
+
+    if (!prep_recording(a_ctx, &rec.sd))
+    {
+        GLTH_LOGE(TAG, "Recording unsuccessful");
+        return ESP_FAIL;
+    }
+
+    if (recording_start(&rec, a_ctx->rec_time, true) != ESP_OK)
+    {
+        GLTH_LOGE(TAG, "Recording unsuccessful");
+        sd_writer_close(&rec.sd);
+        return ESP_FAIL;
+    }
+
+    recording_finish(&rec);
+
+    bool flushed =
+        finish_recording(&rec.sd, rec.written_bytes, rec.kept_bytes / BYTES_PER_SAMPLE);
     GLTH_LOGI(TAG, "File written on SDCard");
+
+#ifdef CONFIG_EXAMPLE_VAD
+    save_activity_index(a_ctx);
+#endif
+
+    /* Overruns never reached the writer */
+    uint32_t stored_bytes = rec.captured_bytes - rec.dropped_bytes;
+    if (recorded_ms)
+    {
+        *recorded_ms = (uint32_t) ((uint64_t) stored_bytes * 1000 / (BYTE_RATE));
+    }
+
+    if (!flushed || rec.write_failures)
+    {
+        return ESP_FAIL;
+    }
+    return stored_bytes ? ESP_OK : ESP_ERR_INVALID_SIZE;
 }
-#endif /* CONFIG_IDF_TARGET_ESP32 */
 
+#ifdef CONFIG_EXAMPLE_PSRAM_RECORDING
+esp_err_t record_to_memory(struct audio_ctx *a_ctx, struct audio_clip *clip)
+{
+    uint32_t num_samples = OUTPUT_SAMPLE_RATE * a_ctx->rec_time;
+    union audio_header header;
+    size_t header_size = build_header(&header, encoded_data_size(num_samples), num_samples);
+    size_t size = header_size + max_data_size(num_samples);
 
-#ifdef CONFIG_IDF_TARGET_ESP32S3
+    *clip = (struct audio_clip) {0};
 
-void init_microphone(void)
+    if (size > CONFIG_EXAMPLE_PSRAM_RECORDING_MAX_KB * 1024
+        || heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM) < size)
+    {
+        GLTH_LOGI(TAG, "A %u byte clip does not fit in PSRAM", (unsigned int) size);
+        return ESP_ERR_NO_MEM;
+    }
+
+    clip->data = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (!clip->data)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    clip->size = size;
+
+    struct recording rec = {
+        .clip = clip,
+    };
+
+    audio_clip_append(clip, &header, header_size);
+
+    if (recording_start(&rec, a_ctx->rec_time, true) != ESP_OK)
+    {
+        GLTH_LOGE(TAG, "Recording unsuccessful");
+        audio_clip_free(clip);
+        return ESP_FAIL;
+    }
+
+    recording_finish(&rec);
+
+    // Same fix-up as for files, the header goes first in the buffer
+    header_size = build_header(&header, rec.written_bytes, rec.kept_bytes / BYTES_PER_SAMPLE);
+    memcpy(clip->data, &header, header_size);
+    GLTH_LOGI(TAG, "Clip of %u bytes recorded to PSRAM", (unsigned int) clip->len);
+
+    return ESP_OK;
+}
+
+void audio_clip_free(struct audio_clip *clip)
 {
-    mic_codec_dev = bsp_audio_codec_microphone_init();
-    esp_codec_dev_set_in_gain(mic_codec_dev, 42.0);
+    heap_caps_free(clip->data);
+    *clip = (struct audio_clip) {0};
 }
+#endif
 
-void record_wav(struct audio_ctx *a_ctx)
+#ifdef CONFIG_EXAMPLE_RAW_STORE
+uint32_t record_raw(struct raw_store *store, struct audio_ctx *a_ctx)
 {
-    int flash_wr_size = 0;
-    uint32_t flash_rec_time = BYTE_RATE * a_ctx->rec_time;
+    struct recording rec = {
+        .raw = store,
+    };
+    uint32_t num_samples = OUTPUT_SAMPLE_RATE * a_ctx->rec_time;
+    union audio_header header;
+    size_t header_size = build_header(&header, encoded_data_size(num_samples), num_samples);
+    uint32_t id;
+
+    if (raw_store_begin(store, &id) != ESP_OK)
+    {
+        GLTH_LOGE(TAG, "Unable to start a raw store recording");
+        return 0;
+    }
+
+    /* Same layout as the file: a header, rewritten once the real size is known */
+    raw_store_append(store, &header, header_size);
 
-    FILE *f = prep_recording(a_ctx);
-    if (!f)
+    if (recording_start(&rec, a_ctx->rec_time, true) != ESP_OK)
     {
         GLTH_LOGE(TAG, "Recording unsuccessful");
-        return;
+        raw_store_end(store, NULL, 0);
+        return 0;
     }
 
-    // Open codec
-    esp_codec_dev_sample_info_t codec_record_cfg = {
-        .bits_per_sample = CONFIG_EXAMPLE_BIT_SAMPLE,
-        .channel = 1,
-        .sample_rate = CONFIG_EXAMPLE_SAMPLE_RATE,
-    };
+    recording_finish(&rec);
 
-    int err = esp_codec_dev_open(mic_codec_dev, &codec_record_cfg);
-    if (err != ESP_CODEC_DEV_OK)
+    header_size = build_header(&header, rec.written_bytes, rec.kept_bytes / BYTES_PER_SAMPLE);
+    if (raw_store_end(store, &header, header_size) != ESP_OK)
     {
-        GLTH_LOGE(TAG, "Unable to open mic codec %d", err);
-        return;
+        GLTH_LOGW(TAG, "Raw store recording %" PRIu32 " is incomplete", id);
+    }
+    if (store->evicted_unsent)
+    {
+        GLTH_LOGW(TAG,
+                  "%" PRIu32 " recordings overwritten before upload",
+                  store->evicted_unsent);
     }
+    GLTH_LOGI(TAG, "Recording %" PRIu32 " written to the raw store", id);
 
-    // Start recording
-    while (flash_wr_size < flash_rec_time) {
-        if (esp_codec_dev_read(mic_codec_dev, (char *)i2s_readraw_buff, SAMPLE_SIZE) == ESP_CODEC_DEV_OK) {
-            printf("[0] %d [1] %d [2] %d [3]%d ...\n", i2s_readraw_buff[0], i2s_readraw_buff[1], i2s_readraw_buff[2], i2s_readraw_buff[3]);
-            // Write the samples to the WAV file
-            fwrite(i2s_readraw_buff, SAMPLE_SIZE, 1, f);
-            flash_wr_size += SAMPLE_SIZE;
-        } else {
-            printf("Read Failed!\n");
+    return id;
+}
+#endif
+
+
+struct audio_stream {
+    struct recording rec;
+    union audio_header header;
+    size_t header_size;
+    size_t header_pos;
+    /* Planned size of the data chunk announced in the header, or ENCODED_SIZE_VARIABLE */
+    uint32_t data_size;
+    /* Slot backing the current chunk, NULL once the encoder has been flushed */
+    struct audio_slot *slot;
+    const uint8_t *chunk;
+    size_t chunk_len;
+    size_t chunk_pos;
+    bool eos;
+    /* No chunk left after the encoder flush */
+    bool ended;
+    uint32_t tee_bytes;
+    /* Names the SD card backup and its activity index */
+    struct audio_ctx ctx;
+};
+
+struct audio_stream *audio_stream_start(struct audio_ctx *a_ctx)
+{
+    struct audio_stream *stream = calloc(1, sizeof(struct audio_stream));
+    if (!stream)
+    {
+        GLTH_LOGE(TAG, "Unable to allocate audio stream");
+        return NULL;
+    }
+
+    uint32_t num_samples = OUTPUT_SAMPLE_RATE * a_ctx->rec_time;
+    stream->data_size = encoded_data_size(num_samples);
+    /* Variable-size streams go out before their final length is known */
+    uint32_t header_samples = (stream->data_size == ENCODED_SIZE_VARIABLE) ? 0 : num_samples;
+    stream->header_size = build_header(&stream->header, stream->data_size, header_samples);
+
+#ifdef CONFIG_EXAMPLE_STREAM_TEE_SD
+    stream->ctx = *a_ctx;
+    if (!prep_recording(a_ctx, &stream->rec.sd))
+    {
+        GLTH_LOGW(TAG, "SD card backup unavailable, streaming only");
+    }
+#endif
+
+    if (recording_start(&stream->rec, a_ctx->rec_time, false) != ESP_OK)
+    {
+        sd_writer_close(&stream->rec.sd);
+        free(stream);
+        return NULL;
+    }
+
+    return stream;
+}
+
+/* Tees the consumed chunk to SD if enabled and hands its slot back to the capture task */
+static void stream_retire_chunk(struct audio_stream *stream)
+{
+    struct recording *rec = &stream->rec;
+
+    if (rec->sd.f && stream->chunk_len)
+    {
+        if (sd_write(rec, stream->chunk, stream->chunk_len))
+        {
+            stream->tee_bytes += stream->chunk_len;
         }
     }
 
-    GLTH_LOGI(TAG, "Recording done!");
-    fclose(f);
+    if (stream->slot)
+    {
+        audio_ring_release(&rec->ring, stream->slot);
+        stream->slot = NULL;
+    }
 
-    err = esp_codec_dev_close(mic_codec_dev);
-    if (err == ESP_CODEC_DEV_INVALID_ARG)
+    stream->chunk = NULL;
+    stream->chunk_len = 0;
+    stream->chunk_pos = 0;
+}
+
+/* Loads the next encoded chunk, returns false once the capture has ended */
+static bool stream_next_chunk(struct audio_stream *stream)
+{
+    struct recording *rec = &stream->rec;
+
+    while (!stream->eos)
+    {
+        struct audio_slot *slot = audio_ring_consume(&rec->ring, portMAX_DELAY);
+
+        if (audio_slot_is_eos(slot))
+        {
+            audio_ring_release(&rec->ring, slot);
+            stream->eos = true;
+            stream->chunk_len = encoder_flush(rec, &stream->chunk);
+            return stream->chunk_len > 0;
+        }
+
+        stream->slot = slot;
+        stream->chunk_len = encoder_process(rec, slot, &stream->chunk);
+        if (stream->chunk_len > 0)
+        {
+            return true;
+        }
+
+        /* Encoder buffered the whole slot without completing a block */
+        stream_retire_chunk(stream);
+    }
+
+    return false;
+}
+
+size_t audio_stream_read(struct audio_stream *stream, uint8_t *buf, size_t len, bool *is_last)
+{
+    struct recording *rec = &stream->rec;
+    size_t n = 0;
+
+    while (n < len && rec->written_bytes < stream->data_size && !stream->ended)
+    {
+        if (stream->header_pos < stream->header_size)
+        {
+            size_t chunk = MIN(len - n, stream->header_size - stream->header_pos);
+            memcpy(&buf[n], (uint8_t *) &stream->header + stream->header_pos, chunk);
+            stream->header_pos += chunk;
+            n += chunk;
+            continue;
+        }
+
+        size_t wanted = MIN(len - n, stream->data_size - rec->written_bytes);
+
+        if (stream->chunk_pos == stream->chunk_len && !stream_next_chunk(stream))
+        {
+            if (stream->data_size == ENCODED_SIZE_VARIABLE)
+            {
+                stream->ended = true;
+                break;
+            }
+
+            /* Dropped buffers leave the stream short of what the header promised */
+            memset(&buf[n], 0, wanted);
+            rec->written_bytes += wanted;
+            n += wanted;
+            continue;
+        }
+
+        size_t chunk = MIN(wanted, stream->chunk_len - stream->chunk_pos);
+        memcpy(&buf[n], &stream->chunk[stream->chunk_pos], chunk);
+        stream->chunk_pos += chunk;
+        rec->written_bytes += chunk;
+        n += chunk;
+
+        if (stream->chunk_pos == stream->chunk_len)
+        {
+            stream_retire_chunk(stream);
+        }
+    }
+
+    /* Look ahead so a variable-size stream flags its final block rather than an empty one */
+    if (stream->data_size == ENCODED_SIZE_VARIABLE
+        && !stream->ended
+        && stream->header_pos == stream->header_size
+        && stream->chunk_pos == stream->chunk_len
+        && !stream_next_chunk(stream))
+    {
+        stream->ended = true;
+    }
+
+    *is_last = (rec->written_bytes >= stream->data_size) || stream->ended;
+    return n;
+}
+
+void audio_stream_stop(struct audio_stream *stream)
+{
+    if (!stream)
     {
-        GLTH_LOGE(TAG, "Invalid arg when closing mic codec %d", err);
         return;
     }
+
+    struct recording *rec = &stream->rec;
+
+    stream_retire_chunk(stream);
+    recording_finish(rec);
+
+    if (rec->sd.f)
+    {
+        finish_recording(&rec->sd, stream->tee_bytes, rec->kept_bytes / BYTES_PER_SAMPLE);
+        GLTH_LOGI(TAG, "Stream backup written on SDCard");
+#ifdef CONFIG_EXAMPLE_VAD
+        save_activity_index(&stream->ctx);
+#endif
+    }
+
+    free(stream);
 }
-#endif /* CONFIG_IDF_TARGET_ESP32S3 */
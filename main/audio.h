@@ -3,8 +3,19 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
 
+#ifndef SD_MOUNT_POINT
 #define SD_MOUNT_POINT      "/sdcard"
+#endif
+
+#ifdef CONFIG_EXAMPLE_AUDIO_FORMAT_FLAC
+#define AUDIO_FILE_EXT      ".flac"
+#else
+#define AUDIO_FILE_EXT      ".wav"
+#endif
+#define AUDIO_INDEX_EXT     ".idx"
 
 struct audio_ctx {
     char filename[32];
@@ -12,5 +23,71 @@ struct audio_ctx {
 };
 
 struct audio_ctx audio_ctx_default(void);
-void record_wav(struct audio_ctx *a_ctx);
+
+/*
+ * Records a_ctx->rec_time seconds to a_ctx->filename. recorded_ms, when not NULL,
+ * is set to the captured audio that made it into the file. Returns ESP_FAIL when
+ * the file could not be created or a write failed, ESP_ERR_INVALID_SIZE when
+ * nothing was captured.
+ */
+esp_err_t record_wav(struct audio_ctx *a_ctx, uint32_t *recorded_ms);
+
+/*
+ * Recordings read from the source picked by CONFIG_EXAMPLE_CAPTURE_SOURCE, opened
+ * by init_microphone(). audio_set_source() plugs in another one instead, which
+ * must stay open while recording.
+ */
+struct audio_source;
+
 void init_microphone(void);
+void audio_set_source(const struct audio_source *source);
+
+/*
+ * Short clips (CONFIG_EXAMPLE_PSRAM_RECORDING) are recorded into a PSRAM buffer
+ * holding the same bytes as the file would: header first, then the encoded
+ * audio. record_to_memory() returns ESP_ERR_NO_MEM without recording when the
+ * clip would not fit, so the caller can fall back to the SD card.
+ */
+struct audio_clip {
+    uint8_t *data;
+    size_t len;
+    size_t size;
+};
+
+esp_err_t record_to_memory(struct audio_ctx *a_ctx, struct audio_clip *clip);
+void audio_clip_free(struct audio_clip *clip);
+
+/*
+ * Records to the raw SD log (CONFIG_EXAMPLE_RAW_STORE) instead of a FAT file.
+ * Returns the recording id, 0 on failure.
+ */
+struct raw_store;
+
+uint32_t record_raw(struct raw_store *store, struct audio_ctx *a_ctx);
+
+/*
+ * Activity gating (CONFIG_EXAMPLE_VAD): only active regions are recorded. The kept
+ * ranges of the last recording are available as JSON, and SD recordings get a copy
+ * in the file named by audio_ctx_index().
+ */
+struct audio_ctx audio_ctx_index(const struct audio_ctx *a_ctx);
+size_t audio_activity_index_json(char *buf, size_t len);
+
+/*
+ * Resampling (CONFIG_EXAMPLE_RESAMPLE) converts the captured audio to
+ * CONFIG_EXAMPLE_RESAMPLE_RATE before gating and encoding. The benchmark runs the
+ * same input through the scalar and (on ESP32-S3) esp-dsp kernels and logs both.
+ */
+void audio_resampler_benchmark(void);
+
+/*
+ * Streaming capture: the WAV header and samples are read straight out of the
+ * capture ring while recording is still running, so no SD round trip is needed.
+ * With CONFIG_EXAMPLE_STREAM_TEE_SD the consumed audio is also saved to
+ * a_ctx->filename as a backup.
+ */
+struct audio_stream;
+
+struct audio_stream *audio_stream_start(struct audio_ctx *a_ctx);
+size_t audio_stream_read(struct audio_stream *stream, uint8_t *buf, size_t len, bool *is_last);
+void audio_stream_stop(struct audio_stream *stream);
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include "esp_heap_caps.h"
+#include "audio_ring.h"
+
+/* Shared end-of-stream marker, never part of the free pool */
+static struct audio_slot eos_slot = {
+    .data = NULL,
+    .len = 0,
+    .eos = true,
+};
+
+esp_err_t audio_ring_init(struct audio_ring *ring, size_t num_slots, size_t slot_size)
+{
+    if (!ring || num_slots == 0 || slot_size == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *ring = (struct audio_ring) {
+        .num_slots = num_slots,
+        .slot_size = slot_size,
+    };
+
+    ring->slots = calloc(num_slots, sizeof(struct audio_slot));
+    ring->storage = heap_caps_malloc(num_slots * slot_size, MALLOC_CAP_8BIT);
+    /* One extra entry in full_q so the end-of-stream marker always fits */
+    ring->free_q = xQueueCreate(num_slots, sizeof(struct audio_slot *));
+    ring->full_q = xQueueCreate(num_slots + 1, sizeof(struct audio_slot *));
+
+    if (!ring->slots || !ring->storage || !ring->free_q || !ring->full_q)
+    {
+        audio_ring_deinit(ring);
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (size_t i = 0; i < num_slots; i++)
+    {
+        struct audio_slot *slot = &ring->slots[i];
+        slot->data = ring->storage + (i * slot_size);
+        slot->len = 0;
+        xQueueSend(ring->free_q, &slot, 0);
+    }
+
+    return ESP_OK;
+}
+
+void audio_ring_deinit(struct audio_ring *ring)
+{
+    if (!ring)
+    {
+        return;
+    }
+
+    if (ring->free_q)
+    {
+        vQueueDelete(ring->free_q);
+    }
+    if (ring->full_q)
+    {
+        vQueueDelete(ring->full_q);
+    }
+    free(ring->storage);
+    free(ring->slots);
+
+    ring->free_q = NULL;
+    ring->full_q = NULL;
+    ring->storage = NULL;
+    ring->slots = NULL;
+}
+
+struct audio_slot *audio_ring_acquire(struct audio_ring *ring)
+{
+    struct audio_slot *slot = NULL;
+
+    if (xQueueReceive(ring->free_q, &slot, 0) != pdTRUE)
+    {
+        ring->overruns++;
+        return NULL;
+    }
+
+    size_t in_use = ring->num_slots - uxQueueMessagesWaiting(ring->free_q);
+    if (in_use > ring->high_water)
+    {
+        ring->high_water = in_use;
+    }
+
+    slot->len = 0;
+    return slot;
+}
+
+struct audio_slot *audio_ring_acquire_wait(struct audio_ring *ring, TickType_t timeout)
+{
+    struct audio_slot *slot = NULL;
+
+    if (xQueueReceive(ring->free_q, &slot, timeout) != pdTRUE)
+    {
+        return NULL;
+    }
+
+    slot->len = 0;
+    return slot;
+}
+
+void audio_ring_commit(struct audio_ring *ring, struct audio_slot *slot)
+{
+    xQueueSend(ring->full_q, &slot, portMAX_DELAY);
+}
+
+void audio_ring_cancel(struct audio_ring *ring, struct audio_slot *slot)
+{
+    xQueueSend(ring->free_q, &slot, portMAX_DELAY);
+}
+
+void audio_ring_finish(struct audio_ring *ring)
+{
+    struct audio_slot *slot = &eos_slot;
+    xQueueSend(ring->full_q, &slot, portMAX_DELAY);
+}
+
+struct audio_slot *audio_ring_consume(struct audio_ring *ring, TickType_t timeout)
+{
+    struct audio_slot *slot = NULL;
+
+    if (xQueueReceive(ring->full_q, &slot, timeout) != pdTRUE)
+    {
+        return NULL;
+    }
+
+    return slot;
+}
+
+void audio_ring_release(struct audio_ring *ring, struct audio_slot *slot)
+{
+    if (slot == &eos_slot)
+    {
+        return;
+    }
+
+    xQueueSend(ring->free_q, &slot, portMAX_DELAY);
+}
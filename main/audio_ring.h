@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+/**
+ * @brief One fixed-size buffer in the capture ring.
+ *
+ * Only the marker queued by audio_ring_finish() has eos set, so an empty
+ * slot committed by the producer is just an empty buffer.
+ */
+struct audio_slot {
+    uint8_t *data;
+    size_t len;
+    bool eos;
+};
+
+/**
+ * @brief Multi-slot ring used to hand captured audio from a producer task
+ * (the microphone) to a consumer task (SD writer, uploader, ...).
+ *
+ * Slot ownership moves between two queues: the producer takes empty slots
+ * from free_q and posts them to full_q, the consumer does the reverse. The
+ * producer never blocks; if no slot is free the buffer is counted as an
+ * overrun and the caller is expected to drain the source into scratch memory.
+ */
+struct audio_ring {
+    struct audio_slot *slots;
+    uint8_t *storage;
+    size_t num_slots;
+    size_t slot_size;
+    QueueHandle_t free_q;
+    QueueHandle_t full_q;
+    uint32_t overruns;
+    size_t high_water;
+};
+
+esp_err_t audio_ring_init(struct audio_ring *ring, size_t num_slots, size_t slot_size);
+void audio_ring_deinit(struct audio_ring *ring);
+
+/* Producer side */
+struct audio_slot *audio_ring_acquire(struct audio_ring *ring);
+/* Blocking variant for producers that can wait, e.g. file readers. Not counted as overruns. */
+struct audio_slot *audio_ring_acquire_wait(struct audio_ring *ring, TickType_t timeout);
+void audio_ring_commit(struct audio_ring *ring, struct audio_slot *slot);
+void audio_ring_cancel(struct audio_ring *ring, struct audio_slot *slot);
+void audio_ring_finish(struct audio_ring *ring);
+
+/* Consumer side */
+struct audio_slot *audio_ring_consume(struct audio_ring *ring, TickType_t timeout);
+void audio_ring_release(struct audio_ring *ring, struct audio_slot *slot);
+
+static inline bool audio_slot_is_eos(const struct audio_slot *slot)
+{
+    return slot->eos;
+}
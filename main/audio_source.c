@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include "sdkconfig.h"
+#include "audio_source.h"
+
+#include <golioth/client.h>
+static const char *TAG = "audio_source";
+
+#define SYNTH_TABLE_SIZE    (256)
+#define SYNTH_TONE_HZ       (440)
+
+#define WAV_FORMAT_PCM      (1)
+
+struct synth_source {
+    int16_t table[SYNTH_TABLE_SIZE];
+    uint32_t phase;
+};
+
+struct wav_source {
+    FILE *f;
+    long data_start;
+    uint32_t data_len;
+    /* Read position within the data chunk */
+    uint32_t pos;
+};
+
+static esp_err_t no_start(void *ctx)
+{
+    return ESP_OK;
+}
+
+static void no_stop(void *ctx)
+{
+}
+
+/* Generates a sine tone as fast as the caller asks for it (no real-time pacing) */
+static esp_err_t synth_read(void *ctx, void *buf, size_t len, size_t *bytes_read)
+{
+    struct synth_source *synth = ctx;
+    const uint32_t step =
+        (uint32_t) (((uint64_t) SYNTH_TONE_HZ << 32) / CONFIG_EXAMPLE_SAMPLE_RATE);
+    int16_t *samples = buf;
+    size_t count = len / sizeof(int16_t);
+
+    for (size_t i = 0; i < count; i++) {
+        samples[i] = synth->table[synth->phase >> 24];
+        synth->phase += step;
+    }
+
+    *bytes_read = count * sizeof(int16_t);
+    return ESP_OK;
+}
+
+static void free_ctx(void *ctx)
+{
+    free(ctx);
+}
+
+esp_err_t audio_source_synthetic_open(struct audio_source *src)
+{
+    struct synth_source *synth = calloc(1, sizeof(struct synth_source));
+    if (!synth)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (int i = 0; i < SYNTH_TABLE_SIZE; i++) {
+        synth->table[i] = (int16_t) (8192.0f * sinf(2.0f * (float) M_PI * i / SYNTH_TABLE_SIZE));
+    }
+
+    *src = (struct audio_source) {
+        .start = no_start,
+        .read = synth_read,
+        .stop = no_stop,
+        .close = free_ctx,
+        .name = "synthetic",
+        .ctx = synth,
+    };
+
+    return ESP_OK;
+}
+
+static uint32_t le32(const uint8_t *p)
+{
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16)
+           | ((uint32_t) p[3] << 24);
+}
+
+static uint16_t le16(const uint8_t *p)
+{
+    return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+/*
+ * Walks the RIFF chunks up to "data", checking "fmt " on the way. Leaves f at the
+ * first sample.
+ */
+static esp_err_t wav_parse(struct wav_source *wav)
+{
+    uint8_t hdr[16];
+    bool have_fmt = false;
+
+    if (fread(hdr, 1, 12, wav->f) != 12 || memcmp(hdr, "RIFF", 4) != 0
+        || memcmp(&hdr[8], "WAVE", 4) != 0)
+    {
+        GLTH_LOGE(TAG, "Not a WAV file");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    while (fread(hdr, 1, 8, wav->f) == 8)
+    {
+        uint32_t size = le32(&hdr[4]);
+
+        if (memcmp(hdr, "data", 4) == 0)
+        {
+            if (!have_fmt)
+            {
+                break;
+            }
+
+            wav->data_start = ftell(wav->f);
+            wav->data_len = size;
+            return ESP_OK;
+        }
+
+        if (memcmp(hdr, "fmt ", 4) == 0 && size >= 16)
+        {
+            if (fread(hdr, 1, 16, wav->f) != 16)
+            {
+                break;
+            }
+
+            uint16_t format = le16(&hdr[0]);
+            uint16_t channels = le16(&hdr[2]);
+            uint32_t rate = le32(&hdr[4]);
+            uint16_t bits = le16(&hdr[14]);
+
+            if (format != WAV_FORMAT_PCM || channels != 1 || bits != CONFIG_EXAMPLE_BIT_SAMPLE
+                || rate != CONFIG_EXAMPLE_SAMPLE_RATE)
+            {
+                GLTH_LOGE(TAG,
+                          "WAV file is format %u, %u channels, %u bits at %" PRIu32
+                          " Hz, expected mono %u-bit PCM at %u Hz",
+                          format,
+                          channels,
+                          bits,
+                          rate,
+                          CONFIG_EXAMPLE_BIT_SAMPLE,
+                          CONFIG_EXAMPLE_SAMPLE_RATE);
+                return ESP_ERR_NOT_SUPPORTED;
+            }
+
+            have_fmt = true;
+            size -= 16;
+        }
+
+        /* Chunks are padded to an even size */
+        if (fseek(wav->f, (long) size + (size & 1), SEEK_CUR) != 0)
+        {
+            break;
+        }
+    }
+
+    GLTH_LOGE(TAG, "WAV file has no samples");
+    return ESP_ERR_INVALID_SIZE;
+}
+
+static esp_err_t wav_read(void *ctx, void *buf, size_t len, size_t *bytes_read)
+{
+    struct wav_source *wav = ctx;
+    uint8_t *out = buf;
+    size_t total = 0;
+
+    while (total < len)
+    {
+        size_t n = fread(&out[total], 1, MIN(len - total, wav->data_len - wav->pos), wav->f);
+
+        total += n;
+        wav->pos += n;
+
+        /* Back to the first sample at the end of the data, or of a truncated file */
+        if (n == 0 || wav->pos >= wav->data_len)
+        {
+            if (wav->pos == 0 || fseek(wav->f, wav->data_start, SEEK_SET) != 0)
+            {
+                break;
+            }
+            wav->data_len = wav->pos;
+            wav->pos = 0;
+        }
+    }
+
+    *bytes_read = total;
+    return (total == len) ? ESP_OK : ESP_FAIL;
+}
+
+static void wav_close(void *ctx)
+{
+    struct wav_source *wav = ctx;
+
+    fclose(wav->f);
+    free(wav);
+}
+
+esp_err_t audio_source_wav_open(struct audio_source *src, const char *path)
+{
+    struct wav_source *wav = calloc(1, sizeof(struct wav_source));
+    if (!wav)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    wav->f = fopen(path, "rb");
+    if (!wav->f)
+    {
+        GLTH_LOGE(TAG, "Unable to open %s", path);
+        free(wav);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    esp_err_t err = wav_parse(wav);
+    if (err != ESP_OK)
+    {
+        wav_close(wav);
+        return err;
+    }
+
+    GLTH_LOGI(TAG, "Playing %" PRIu32 " bytes of samples from %s", wav->data_len, path);
+
+    *src = (struct audio_source) {
+        .start = no_start,
+        .read = wav_read,
+        .stop = no_stop,
+        .close = wav_close,
+        .name = "wav",
+        .ctx = wav,
+    };
+
+    return ESP_OK;
+}
+
+esp_err_t audio_source_default_open(struct audio_source *src)
+{
+#if defined(CONFIG_EXAMPLE_CAPTURE_SYNTHETIC)
+    return audio_source_synthetic_open(src);
+#elif defined(CONFIG_EXAMPLE_CAPTURE_WAV_FILE)
+    return audio_source_wav_open(src, CONFIG_EXAMPLE_CAPTURE_WAV_PATH);
+#elif defined(CONFIG_IDF_TARGET_ESP32)
+    return audio_source_pdm_open(src);
+#elif defined(CONFIG_IDF_TARGET_ESP32S3)
+    return audio_source_es7210_open(src);
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Where recordings get their samples from.
+ *
+ * read fills buf with mono CONFIG_EXAMPLE_BIT_SAMPLE-bit samples at
+ * CONFIG_EXAMPLE_SAMPLE_RATE. Microphones block until the samples are captured,
+ * the other sources return them as fast as they are asked for. start and stop
+ * bracket each recording.
+ */
+struct audio_source {
+    esp_err_t (*start)(void *ctx);
+    esp_err_t (*read)(void *ctx, void *buf, size_t len, size_t *bytes_read);
+    void (*stop)(void *ctx);
+    void (*close)(void *ctx);
+    const char *name;
+    void *ctx;
+};
+
+/**
+ * @brief Sine tone, for measuring the pipeline without a microphone attached.
+ */
+esp_err_t audio_source_synthetic_open(struct audio_source *src);
+
+/**
+ * @brief Samples of a mono PCM WAV file, looped to fill recordings of any length.
+ *
+ * The sample rate and size in the file's header must match the configuration.
+ */
+esp_err_t audio_source_wav_open(struct audio_source *src, const char *path);
+
+/**
+ * @brief PDM microphone of the m5stack Core2, through I2S.
+ */
+esp_err_t audio_source_pdm_open(struct audio_source *src);
+
+/**
+ * @brief ES7210 codec microphones of the m5stack CoreS3.
+ */
+esp_err_t audio_source_es7210_open(struct audio_source *src);
+
+/**
+ * @brief Source picked by CONFIG_EXAMPLE_CAPTURE_SOURCE.
+ */
+esp_err_t audio_source_default_open(struct audio_source *src);
+
+#ifdef __cplusplus
+}
+#endif
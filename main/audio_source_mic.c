@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "sdkconfig.h"
+#include "audio_source.h"
+
+#ifdef CONFIG_IDF_TARGET_ESP32
+#include "driver/i2s_pdm.h"
+#endif /* CONFIG_IDF_TARGET_ESP32 */
+
+#ifdef CONFIG_IDF_TARGET_ESP32S3
+#include "esp_codec_dev.h"
+#include "bsp/m5stack_core_s3.h"
+#endif /* CONFIG_IDF_TARGET_ESP32S3 */
+
+/* Microphones of the supported boards, audio_source.c has the portable sources */
+
+#ifdef CONFIG_IDF_TARGET_ESP32
+
+static i2s_chan_handle_t rx_handle = NULL;
+
+static esp_err_t pdm_start(void *ctx)
+{
+    return ESP_OK;
+}
+
+static esp_err_t pdm_read(void *ctx, void *buf, size_t len, size_t *bytes_read)
+{
+    return i2s_channel_read(rx_handle, buf, len, bytes_read, 1000);
+}
+
+static void pdm_stop(void *ctx)
+{
+}
+
+static void pdm_close(void *ctx)
+{
+    i2s_channel_disable(rx_handle);
+    i2s_del_channel(rx_handle);
+    rx_handle = NULL;
+}
+
+esp_err_t audio_source_pdm_open(struct audio_source *src)
+{
+    i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_AUTO, I2S_ROLE_MASTER);
+    ESP_ERROR_CHECK(i2s_new_channel(&chan_cfg, NULL, &rx_handle));
+
+    i2s_pdm_rx_config_t pdm_rx_cfg = {
+        .clk_cfg = I2S_PDM_RX_CLK_DEFAULT_CONFIG(CONFIG_EXAMPLE_SAMPLE_RATE),
+        /* The default mono slot is the left slot (whose 'select pin' of the PDM microphone is pulled down) */
+        .slot_cfg = I2S_PDM_RX_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_MONO),
+        .gpio_cfg = {
+            .clk = CONFIG_EXAMPLE_I2S_CLK_GPIO,
+            .din = CONFIG_EXAMPLE_I2S_DATA_GPIO,
+            .invert_flags = {
+                .clk_inv = false,
+            },
+        },
+    };
+    ESP_ERROR_CHECK(i2s_channel_init_pdm_rx_mode(rx_handle, &pdm_rx_cfg));
+    ESP_ERROR_CHECK(i2s_channel_enable(rx_handle));
+
+    *src = (struct audio_source) {
+        .start = pdm_start,
+        .read = pdm_read,
+        .stop = pdm_stop,
+        .close = pdm_close,
+        .name = "pdm",
+    };
+
+    return ESP_OK;
+}
+
+#endif /* CONFIG_IDF_TARGET_ESP32 */
+
+#ifdef CONFIG_IDF_TARGET_ESP32S3
+
+#include <golioth/client.h>
+static const char *TAG = "audio_source";
+
+static esp_codec_dev_handle_t mic_codec_dev = NULL;
+
+static esp_err_t es7210_start(void *ctx)
+{
+    // Open codec
+    esp_codec_dev_sample_info_t codec_record_cfg = {
+        .bits_per_sample = CONFIG_EXAMPLE_BIT_SAMPLE,
+        .channel = 1,
+        .sample_rate = CONFIG_EXAMPLE_SAMPLE_RATE,
+    };
+
+    int err = esp_codec_dev_open(mic_codec_dev, &codec_record_cfg);
+    if (err != ESP_CODEC_DEV_OK)
+    {
+        GLTH_LOGE(TAG, "Unable to open mic codec %d", err);
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t es7210_read(void *ctx, void *buf, size_t len, size_t *bytes_read)
+{
+    if (esp_codec_dev_read(mic_codec_dev, buf, len) != ESP_CODEC_DEV_OK) {
+        return ESP_FAIL;
+    }
+
+    *bytes_read = len;
+    return ESP_OK;
+}
+
+static void es7210_stop(void *ctx)
+{
+    int err = esp_codec_dev_close(mic_codec_dev);
+    if (err == ESP_CODEC_DEV_INVALID_ARG)
+    {
+        GLTH_LOGE(TAG, "Invalid arg when closing mic codec %d", err);
+    }
+}
+
+/* The codec belongs to the BSP, which has no way to release it */
+static void es7210_close(void *ctx)
+{
+}
+
+esp_err_t audio_source_es7210_open(struct audio_source *src)
+{
+    mic_codec_dev = bsp_audio_codec_microphone_init();
+    if (!mic_codec_dev)
+    {
+        return ESP_FAIL;
+    }
+    esp_codec_dev_set_in_gain(mic_codec_dev, 42.0);
+
+    *src = (struct audio_source) {
+        .start = es7210_start,
+        .read = es7210_read,
+        .stop = es7210_stop,
+        .close = es7210_close,
+        .name = "es7210",
+    };
+
+    return ESP_OK;
+}
+
+#endif /* CONFIG_IDF_TARGET_ESP32S3 */
@@ -0,0 +1,696 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include "esp_attr.h"
+#include "esp_console.h"
+#include "esp_cpu.h"
+#include "sdkconfig.h"
+#include "format_wav.h"
+#include "bench.h"
+#include "capture_stats.h"
+#include "flac_lite.h"
+#include "ima_adpcm.h"
+#include "lz_stream.h"
+#include "resampler.h"
+#include "upload_sink.h"
+#include "vad.h"
+
+/* The Core2's internal bus, or the host's stand-in for it */
+#if defined(CONFIG_IDF_TARGET_ESP32) || defined(CONFIG_IDF_TARGET_LINUX)
+#define BENCH_HAVE_I2C_DEVICE
+#include "i2c_device.h"
+#endif
+
+#include <golioth/client.h>
+static const char *TAG = "bench";
+
+/* Corpora are fixed, whatever rate the recordings use */
+#define BENCH_SAMPLE_RATE       (44100)
+#define BENCH_RESAMPLE_RATE     (16000)
+#define BENCH_CORPUS_SAMPLES    (16384)
+/* Passes per case, the fastest one counts */
+#define BENCH_REPS              (5)
+/* Headers built or bus transfers made per pass by kernels without a corpus */
+#define BENCH_UNITS             (1000)
+/*
+ * Output of one call: a FLAC frame and a half, or a buffer plus the activity
+ * gate's pre-roll
+ */
+#define BENCH_OUT_SIZE          (32 * 1024)
+
+static const size_t _buffers[] = {32, 256, 1024, 4096};
+
+/* Heap allocations so far, see CONFIG_HEAP_USE_HOOKS */
+static atomic_uint _allocs;
+
+void IRAM_ATTR esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    atomic_fetch_add_explicit(&_allocs, 1, memory_order_relaxed);
+}
+
+void IRAM_ATTR esp_heap_trace_free_hook(void *ptr)
+{
+}
+
+enum bench_corpus {
+    BENCH_CORPUS_SILENCE,
+    BENCH_CORPUS_TONE,
+    BENCH_CORPUS_NOISE,
+    BENCH_CORPUS_SPEECH,
+    BENCH_NUM_CORPORA,
+};
+
+static const char *const _corpus_names[BENCH_NUM_CORPORA] = {
+    "silence",
+    "tone",
+    "noise",
+    "speech",
+};
+
+struct bench_ctx {
+    const int16_t *pcm;
+    size_t num_samples;
+    /* Samples per kernel call */
+    size_t buffer;
+    uint8_t *out;
+    void *state;
+};
+
+struct bench_kernel {
+    const char *name;
+    /* What count and the per-unit figures refer to */
+    const char *unit;
+    size_t unit_bytes;
+    /* Largest buffer worth running, 0 for kernels that do not read the corpus */
+    size_t max_buffer;
+    /* Fresh state for one pass, not timed. Optional. */
+    bool (*init)(struct bench_ctx *ctx);
+    void (*pass)(struct bench_ctx *ctx);
+    void (*deinit)(struct bench_ctx *ctx);
+};
+
+/* Numerical Recipes LCG, the same noise on every target */
+static uint32_t lcg_next(uint32_t *state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return *state;
+}
+
+static void make_corpus(enum bench_corpus corpus, int16_t *pcm, size_t num_samples)
+{
+    uint32_t rng = 1;
+    /* Speech-like: 150 ms bursts of loud noise over a quiet background */
+    size_t burst = BENCH_SAMPLE_RATE * 150 / 1000;
+
+    for (size_t i = 0; i < num_samples; i++)
+    {
+        int16_t noise = (int16_t) (lcg_next(&rng) >> 16);
+
+        switch (corpus)
+        {
+            case BENCH_CORPUS_SILENCE:
+                pcm[i] = 0;
+                break;
+            case BENCH_CORPUS_TONE:
+                pcm[i] = (int16_t) (16000.0f
+                                    * sinf(2.0f * (float) M_PI * 440.0f * i / BENCH_SAMPLE_RATE));
+                break;
+            case BENCH_CORPUS_NOISE:
+                pcm[i] = noise / 4;
+                break;
+            default:
+                pcm[i] = ((i / burst) % 2) ? noise / 2 : noise / 256;
+                break;
+        }
+    }
+}
+
+static void pass_wav_header_pcm(struct bench_ctx *ctx)
+{
+    for (uint32_t i = 0; i < BENCH_UNITS; i++)
+    {
+        wav_header_t hdr = WAV_HEADER_PCM_DEFAULT(i * 2, 16, BENCH_SAMPLE_RATE, 1);
+        memcpy(&ctx->out[(i % 256) * sizeof(hdr)], &hdr, sizeof(hdr));
+    }
+}
+
+static void pass_wav_header_ima_adpcm(struct bench_ctx *ctx)
+{
+    uint16_t block_align = ima_adpcm_block_align(BENCH_SAMPLE_RATE);
+
+    for (uint32_t i = 0; i < BENCH_UNITS; i++)
+    {
+        wav_header_ima_adpcm_t hdr =
+            WAV_HEADER_IMA_ADPCM_DEFAULT(ima_adpcm_encoded_size(i, block_align),
+                                         i,
+                                         BENCH_SAMPLE_RATE,
+                                         1,
+                                         block_align,
+                                         ima_adpcm_samples_per_block(block_align));
+        memcpy(&ctx->out[(i % 256) * sizeof(hdr)], &hdr, sizeof(hdr));
+    }
+}
+
+static void pass_flac_header(struct bench_ctx *ctx)
+{
+    for (uint32_t i = 0; i < BENCH_UNITS; i++)
+    {
+        flac_lite_stream_header(&ctx->out[(i % 256) * FLAC_LITE_STREAM_HEADER_SIZE],
+                                BENCH_SAMPLE_RATE,
+                                i,
+                                0,
+                                0);
+    }
+}
+
+static void pass_capture_stats(struct bench_ctx *ctx)
+{
+    for (size_t i = 0; i < ctx->num_samples; i += ctx->buffer)
+    {
+        size_t n = MIN(ctx->buffer, ctx->num_samples - i);
+        capture_stats_record(&ctx->pcm[i], n * sizeof(int16_t), 0);
+    }
+}
+
+static bool init_resampler(struct bench_ctx *ctx, enum resampler_kernel kernel)
+{
+    struct resampler *rs = malloc(sizeof(struct resampler));
+    if (!rs)
+    {
+        return false;
+    }
+
+    if (resampler_init(rs, BENCH_SAMPLE_RATE, BENCH_RESAMPLE_RATE, kernel) != ESP_OK)
+    {
+        free(rs);
+        return false;
+    }
+
+    ctx->state = rs;
+    return true;
+}
+
+static bool init_resampler_scalar(struct bench_ctx *ctx)
+{
+    return init_resampler(ctx, RESAMPLER_KERNEL_SCALAR);
+}
+
+#ifdef RESAMPLER_HAVE_ESP_DSP
+static bool init_resampler_esp_dsp(struct bench_ctx *ctx)
+{
+    return init_resampler(ctx, RESAMPLER_KERNEL_ESP_DSP);
+}
+#endif
+
+static void pass_resampler(struct bench_ctx *ctx)
+{
+    for (size_t i = 0; i < ctx->num_samples; i += ctx->buffer)
+    {
+        size_t n = MIN(ctx->buffer, ctx->num_samples - i);
+        resampler_process(ctx->state, &ctx->pcm[i], n, (int16_t *) ctx->out);
+    }
+}
+
+static void deinit_resampler(struct bench_ctx *ctx)
+{
+    resampler_deinit(ctx->state);
+    free(ctx->state);
+}
+
+static bool init_vad(struct bench_ctx *ctx)
+{
+    const struct vad_config config = {
+        .sample_rate = BENCH_SAMPLE_RATE,
+        .threshold_db = 9,
+        .hangover_ms = 300,
+        .preroll_ms = 200,
+    };
+
+    struct vad *vad = malloc(sizeof(struct vad));
+    if (!vad || vad_init(vad, &config) != ESP_OK)
+    {
+        free(vad);
+        return false;
+    }
+
+    ctx->state = vad;
+    return true;
+}
+
+static void pass_vad(struct bench_ctx *ctx)
+{
+    for (size_t i = 0; i < ctx->num_samples; i += ctx->buffer)
+    {
+        size_t n = MIN(ctx->buffer, ctx->num_samples - i);
+        vad_process(ctx->state, &ctx->pcm[i], n, (int16_t *) ctx->out);
+    }
+    vad_flush(ctx->state, (int16_t *) ctx->out);
+}
+
+static void deinit_vad(struct bench_ctx *ctx)
+{
+    vad_deinit(ctx->state);
+    free(ctx->state);
+}
+
+static bool init_ima_adpcm(struct bench_ctx *ctx)
+{
+    struct ima_adpcm_enc *enc = malloc(sizeof(struct ima_adpcm_enc));
+    if (!enc)
+    {
+        return false;
+    }
+
+    ima_adpcm_init(enc, ima_adpcm_block_align(BENCH_SAMPLE_RATE));
+    ctx->state = enc;
+    return true;
+}
+
+static void pass_ima_adpcm(struct bench_ctx *ctx)
+{
+    for (size_t i = 0; i < ctx->num_samples; i += ctx->buffer)
+    {
+        size_t n = MIN(ctx->buffer, ctx->num_samples - i);
+        ima_adpcm_encode(ctx->state, &ctx->pcm[i], n, ctx->out);
+    }
+    ima_adpcm_flush(ctx->state, ctx->out);
+}
+
+static bool init_flac(struct bench_ctx *ctx)
+{
+    struct flac_lite_enc *enc = malloc(sizeof(struct flac_lite_enc));
+    if (!enc)
+    {
+        return false;
+    }
+
+    flac_lite_init(enc, BENCH_SAMPLE_RATE);
+    ctx->state = enc;
+    return true;
+}
+
+static void pass_flac(struct bench_ctx *ctx)
+{
+    for (size_t i = 0; i < ctx->num_samples; i += ctx->buffer)
+    {
+        size_t n = MIN(ctx->buffer, ctx->num_samples - i);
+        flac_lite_encode(ctx->state, &ctx->pcm[i], n, ctx->out);
+    }
+    flac_lite_flush(ctx->state, ctx->out);
+}
+
+static void deinit_free(struct bench_ctx *ctx)
+{
+    free(ctx->state);
+}
+
+/* The compressor pulls its input, so buffer sets the output asked for per call */
+struct bench_lz {
+    struct lz_stream lz;
+    const uint8_t *data;
+    size_t len;
+    size_t pos;
+};
+
+static size_t lz_read_corpus(void *arg, uint8_t *buf, size_t len)
+{
+    struct bench_lz *b = arg;
+
+    len = MIN(len, b->len - b->pos);
+    memcpy(buf, &b->data[b->pos], len);
+    b->pos += len;
+
+    return len;
+}
+
+static bool init_lz(struct bench_ctx *ctx, uint8_t flags)
+{
+    struct bench_lz *b = malloc(sizeof(struct bench_lz));
+    if (!b)
+    {
+        return false;
+    }
+
+    b->data = (const uint8_t *) ctx->pcm;
+    b->len = ctx->num_samples * sizeof(int16_t);
+    b->pos = 0;
+    lz_stream_init(&b->lz, flags, b->len, lz_read_corpus, b);
+
+    ctx->state = b;
+    return true;
+}
+
+static bool init_lz_plain(struct bench_ctx *ctx)
+{
+    return init_lz(ctx, 0);
+}
+
+static bool init_lz_delta16(struct bench_ctx *ctx)
+{
+    return init_lz(ctx, LZ_STREAM_FLAG_DELTA16);
+}
+
+static void pass_lz(struct bench_ctx *ctx)
+{
+    struct bench_lz *b = ctx->state;
+    bool is_last = false;
+
+    while (!is_last)
+    {
+        lz_stream_read(&b->lz, ctx->out, ctx->buffer * sizeof(int16_t), &is_last);
+    }
+}
+
+/* Never closed, so its totals do not end up in the log after every case */
+static struct upload_sink _loopback;
+
+struct bench_blocks {
+    const uint8_t *data;
+    size_t len;
+    size_t pos;
+    size_t block_size;
+};
+
+static enum golioth_status bench_block_cb(uint32_t block_idx,
+                                          uint8_t *block_buffer,
+                                          size_t *block_size,
+                                          bool *is_last,
+                                          void *arg)
+{
+    struct bench_blocks *b = arg;
+
+    *block_size = MIN(MIN(*block_size, b->block_size), b->len - b->pos);
+    memcpy(block_buffer, &b->data[b->pos], *block_size);
+    b->pos += *block_size;
+    *is_last = (b->pos == b->len);
+
+    return GOLIOTH_OK;
+}
+
+static bool init_block_framing(struct bench_ctx *ctx)
+{
+    return _loopback.ctx || upload_sink_loopback_open(&_loopback) == ESP_OK;
+}
+
+static void pass_block_framing(struct bench_ctx *ctx)
+{
+    struct bench_blocks b = {
+        .data = (const uint8_t *) ctx->pcm,
+        .len = ctx->num_samples * sizeof(int16_t),
+        .block_size = ctx->buffer * sizeof(int16_t),
+    };
+
+    _loopback.write_blockwise(_loopback.ctx, "bench", bench_block_cb, &b);
+}
+
+#ifdef BENCH_HAVE_I2C_DEVICE
+
+/* The AXP192 on the Core2. Its data buffer registers are scratch space. */
+#define BENCH_I2C_PORT          I2C_NUM_1
+#define BENCH_I2C_SDA           (21)
+#define BENCH_I2C_SCL           (22)
+#define BENCH_I2C_FREQ          (400000)
+#define BENCH_I2C_ADDR          (0x34)
+#define BENCH_I2C_REG           (0x06)
+
+/* Created on first use and kept, so the passes time transfers, not device setup */
+static I2CDevice_t _i2c_device;
+
+static bool init_i2c(struct bench_ctx *ctx)
+{
+    if (!_i2c_device)
+    {
+        _i2c_device = i2c_malloc_device(BENCH_I2C_PORT,
+                                        BENCH_I2C_SDA,
+                                        BENCH_I2C_SCL,
+                                        BENCH_I2C_FREQ,
+                                        BENCH_I2C_ADDR);
+    }
+
+    ctx->state = _i2c_device;
+    return ctx->state != NULL;
+}
+
+static void pass_i2c_read_byte(struct bench_ctx *ctx)
+{
+    for (uint32_t i = 0; i < BENCH_UNITS; i++)
+    {
+        i2c_read_byte(ctx->state, BENCH_I2C_REG, &ctx->out[i % 256]);
+    }
+}
+
+static void pass_i2c_write_byte(struct bench_ctx *ctx)
+{
+    for (uint32_t i = 0; i < BENCH_UNITS; i++)
+    {
+        i2c_write_byte(ctx->state, BENCH_I2C_REG, (uint8_t) i);
+    }
+}
+
+#endif /* BENCH_HAVE_I2C_DEVICE */
+
+static const struct bench_kernel _kernels[] = {
+    {"wav_header_pcm", "header", sizeof(wav_header_t), 0, NULL, pass_wav_header_pcm, NULL},
+    {"wav_header_ima_adpcm",
+     "header",
+     sizeof(wav_header_ima_adpcm_t),
+     0,
+     NULL,
+     pass_wav_header_ima_adpcm,
+     NULL},
+    {"flac_header", "header", FLAC_LITE_STREAM_HEADER_SIZE, 0, NULL, pass_flac_header, NULL},
+    {"capture_stats", "sample", sizeof(int16_t), SIZE_MAX, NULL, pass_capture_stats, NULL},
+    {"resampler_scalar",
+     "sample",
+     sizeof(int16_t),
+     SIZE_MAX,
+     init_resampler_scalar,
+     pass_resampler,
+     deinit_resampler},
+#ifdef RESAMPLER_HAVE_ESP_DSP
+    {"resampler_esp_dsp",
+     "sample",
+     sizeof(int16_t),
+     SIZE_MAX,
+     init_resampler_esp_dsp,
+     pass_resampler,
+     deinit_resampler},
+#endif
+    {"vad", "sample", sizeof(int16_t), SIZE_MAX, init_vad, pass_vad, deinit_vad},
+    {"ima_adpcm_encode",
+     "sample",
+     sizeof(int16_t),
+     SIZE_MAX,
+     init_ima_adpcm,
+     pass_ima_adpcm,
+     deinit_free},
+    {"flac_encode", "sample", sizeof(int16_t), SIZE_MAX, init_flac, pass_flac, deinit_free},
+    {"lz_compress", "sample", sizeof(int16_t), SIZE_MAX, init_lz_plain, pass_lz, deinit_free},
+    {"lz_compress_delta16",
+     "sample",
+     sizeof(int16_t),
+     SIZE_MAX,
+     init_lz_delta16,
+     pass_lz,
+     deinit_free},
+    {"block_framing",
+     "sample",
+     sizeof(int16_t),
+     UPLOAD_SINK_BLOCK_SIZE / sizeof(int16_t),
+     init_block_framing,
+     pass_block_framing,
+     NULL},
+#ifdef BENCH_HAVE_I2C_DEVICE
+    {"i2c_read_byte", "transfer", 1, 0, init_i2c, pass_i2c_read_byte, NULL},
+    {"i2c_write_byte", "transfer", 1, 0, init_i2c, pass_i2c_write_byte, NULL},
+#endif
+};
+
+/* Prints value / 100 with two decimals */
+#define X100_FMT            "%" PRIu64 ".%02u"
+#define X100_ARG(value)     (value) / 100, (unsigned int) ((value) % 100)
+
+static void print_meta(void)
+{
+    printf("{\"bench\":\"_meta\",\"target\":\"%s\",\"cpu_mhz\":%u,\"sample_rate\":%u,"
+           "\"corpus_samples\":%u,\"reps\":%u}\n",
+           CONFIG_IDF_TARGET,
+           (unsigned int) CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+           (unsigned int) BENCH_SAMPLE_RATE,
+           (unsigned int) BENCH_CORPUS_SAMPLES,
+           (unsigned int) BENCH_REPS);
+}
+
+static void print_result(const struct bench_kernel *k,
+                         const char *corpus,
+                         size_t buffer,
+                         uint32_t count,
+                         uint32_t cycles,
+                         uint32_t allocs)
+{
+    uint64_t bytes = (uint64_t) count * k->unit_bytes;
+    uint64_t cycles_x100 = (uint64_t) cycles * 100 / count;
+    uint64_t ns_x100 = (uint64_t) cycles * 100000 / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ / count;
+    /* Bytes per microsecond */
+    uint64_t mb_s_x100 = bytes * CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 100 / MAX(cycles, 1);
+
+    printf("{\"bench\":\"%s\",\"corpus\":\"%s\",\"buffer\":%u,\"unit\":\"%s\",\"count\":%" PRIu32
+           ",\"bytes\":%" PRIu64 ",\"cycles_per_unit\":" X100_FMT ",\"ns_per_unit\":" X100_FMT
+           ",\"mb_s\":" X100_FMT ",\"allocs\":%" PRIu32 "}\n",
+           k->name,
+           corpus,
+           (unsigned int) buffer,
+           k->unit,
+           count,
+           bytes,
+           X100_ARG(cycles_x100),
+           X100_ARG(ns_x100),
+           X100_ARG(mb_s_x100),
+           allocs);
+}
+
+/*
+ * Fastest of BENCH_REPS passes in cycles, 0 when the kernel could not be set up.
+ * allocs is the fewest heap allocations made during a pass. Other tasks can add
+ * to it, hence the minimum.
+ */
+static uint32_t run_case(const struct bench_kernel *k, struct bench_ctx *ctx, uint32_t *allocs)
+{
+    uint32_t best = UINT32_MAX;
+
+    *allocs = UINT32_MAX;
+
+    for (int rep = 0; rep < BENCH_REPS; rep++)
+    {
+        if (k->init && !k->init(ctx))
+        {
+            return 0;
+        }
+
+        unsigned int allocs_before = atomic_load(&_allocs);
+        uint32_t start = esp_cpu_get_cycle_count();
+        k->pass(ctx);
+        uint32_t cycles = esp_cpu_get_cycle_count() - start;
+        *allocs = MIN(*allocs, atomic_load(&_allocs) - allocs_before);
+
+        if (k->deinit)
+        {
+            k->deinit(ctx);
+        }
+
+        best = MIN(best, cycles);
+    }
+
+    return best;
+}
+
+int bench_run(const char *filter)
+{
+    int16_t *pcm = malloc(BENCH_CORPUS_SAMPLES * sizeof(int16_t));
+    uint8_t *out = malloc(BENCH_OUT_SIZE);
+    int cases = 0;
+
+    if (!pcm || !out)
+    {
+        GLTH_LOGE(TAG, "Unable to allocate benchmark buffers");
+        cases = -1;
+        goto cleanup;
+    }
+
+    print_meta();
+
+    struct bench_ctx ctx = {
+        .pcm = pcm,
+        .num_samples = BENCH_CORPUS_SAMPLES,
+        .out = out,
+    };
+
+    for (size_t i = 0; i < sizeof(_kernels) / sizeof(_kernels[0]); i++)
+    {
+        const struct bench_kernel *k = &_kernels[i];
+        if (filter && strncmp(k->name, filter, strlen(filter)) != 0)
+        {
+            continue;
+        }
+
+        if (k->max_buffer == 0)
+        {
+            ctx.buffer = 0;
+            uint32_t allocs;
+            uint32_t cycles = run_case(k, &ctx, &allocs);
+            if (cycles)
+            {
+                print_result(k, "none", 0, BENCH_UNITS, cycles, allocs);
+                cases++;
+            }
+            continue;
+        }
+
+        for (int c = 0; c < BENCH_NUM_CORPORA; c++)
+        {
+            make_corpus(c, pcm, BENCH_CORPUS_SAMPLES);
+
+            for (size_t b = 0; b < sizeof(_buffers) / sizeof(_buffers[0]); b++)
+            {
+                if (_buffers[b] > k->max_buffer)
+                {
+                    continue;
+                }
+
+                ctx.buffer = _buffers[b];
+                uint32_t allocs;
+                uint32_t cycles = run_case(k, &ctx, &allocs);
+                if (!cycles)
+                {
+                    GLTH_LOGE(TAG, "Unable to set up %s", k->name);
+                    continue;
+                }
+
+                print_result(k, _corpus_names[c], ctx.buffer, BENCH_CORPUS_SAMPLES, cycles, allocs);
+                cases++;
+            }
+        }
+    }
+
+    capture_stats_reset();
+
+cleanup:
+    free(out);
+    free(pcm);
+    return cases;
+}
+
+static int cmd_bench(int argc, char **argv)
+{
+    int cases = bench_run((argc > 1) ? argv[1] : NULL);
+
+    GLTH_LOGI(TAG, "%d benchmark cases", cases);
+    return (cases > 0) ? 0 : 1;
+}
+
+void bench_start(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "bench",
+        .help = "Benchmark the audio kernels, optionally only those whose name starts "
+                "with the argument. Prints one JSON line per case.",
+        .hint = "[kernel]",
+        .func = cmd_bench,
+    };
+    esp_console_cmd_register(&cmd);
+
+#ifdef CONFIG_EXAMPLE_BENCHMARK_AT_BOOT
+    GLTH_LOGI(TAG, "%d benchmark cases", bench_run(NULL));
+#endif
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Microbenchmarks of the audio kernels: header generation, capture statistics,
+ * resampling, activity gating, the encoders, upload compression and block
+ * framing, and on the Core2 I2C register access. Each kernel runs over fixed
+ * corpora (silence, tone, noise, speech-like bursts) in calls of several buffer
+ * sizes, timed with the CPU cycle counter. Heap allocations made during a pass
+ * are counted with the heap trace hooks.
+ *
+ * Every case prints one JSON line to stdout:
+ *
+ *   {"bench":"ima_adpcm_encode","corpus":"noise","buffer":256,"unit":"sample",
+ *    "count":16384,"bytes":32768,"cycles_per_unit":41.07,"ns_per_unit":171.12,
+ *    "mb_s":11.68,"allocs":0}
+ *
+ * preceded by a line with "bench":"_meta" that names the target, CPU clock and
+ * corpus. tools/bench_compare.py compares two runs.
+ */
+
+/**
+ * @brief Run every kernel whose name starts with filter, all of them with NULL.
+ *
+ * Allocates its corpus and scratch buffers for the duration of the run. Best not
+ * started during a recording, which it would slow down and whose capture
+ * statistics it resets.
+ *
+ * @return Number of cases run, negative when the buffers could not be allocated
+ */
+int bench_run(const char *filter);
+
+/**
+ * @brief Register the "bench" shell command and, with
+ * CONFIG_EXAMPLE_BENCHMARK_AT_BOOT, run all kernels once.
+ */
+void bench_start(void);
+
+#ifdef __cplusplus
+}
+#endif
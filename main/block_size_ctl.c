@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+#include "block_size_ctl.h"
+
+/* Smoothing weights, as in TCP's RTT estimator */
+#define RTT_GAIN        (0.125f)
+#define LOSS_GAIN       (0.0625f)
+/* Switch only for a predicted gain of 10% */
+#define HYSTERESIS      (1.1f)
+/* Above a loss of 1/2 the doubling retransmission timeouts no longer converge */
+#define LOSS_MAX        (0.45f)
+/* CoAP waits 2-3 s before the first retransmission */
+#define TIMEOUT_INIT_US (2500000.0f)
+
+static int size_index(uint32_t size)
+{
+    int idx = 0;
+
+    for (uint32_t s = BLOCK_SIZE_CTL_MIN; s < size && idx < BLOCK_SIZE_CTL_SIZES - 1; s <<= 1)
+    {
+        idx++;
+    }
+
+    return idx;
+}
+
+static uint32_t index_size(int idx)
+{
+    return (uint32_t) BLOCK_SIZE_CTL_MIN << idx;
+}
+
+static float loss_for_size(const struct block_size_ctl *ctl, uint32_t size)
+{
+    float p = 1.0f - expf(-ctl->loss_per_byte * (float) (size + BLOCK_SIZE_CTL_OVERHEAD));
+
+    return (p < LOSS_MAX) ? p : LOSS_MAX;
+}
+
+/* Nearest measured size index from idx in direction step, -1 if none */
+static int measured_from(const struct block_size_ctl *ctl, int idx, int step)
+{
+    for (int i = idx; i >= 0 && i < BLOCK_SIZE_CTL_SIZES; i += step)
+    {
+        if (ctl->samples[i])
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * Latency of a block of a given size. Between two measured sizes it is
+ * interpolated linearly, outside them it follows the line through the two
+ * nearest, or stays flat if only one size has been measured.
+ */
+static float latency_for_size(const struct block_size_ctl *ctl, uint32_t size)
+{
+    int target = size_index(size);
+    int below = measured_from(ctl, target, -1);
+    int above = measured_from(ctl, target, 1);
+
+    if (below == target)
+    {
+        return ctl->srtt_us[target];
+    }
+
+    if (below < 0 && above >= 0)
+    {
+        below = above;
+        above = measured_from(ctl, below + 1, 1);
+    }
+    else if (above < 0 && below >= 0)
+    {
+        above = below;
+        below = measured_from(ctl, above - 1, -1);
+    }
+
+    if (below < 0 || above < 0)
+    {
+        int only = (below >= 0) ? below : above;
+        return (only >= 0) ? ctl->srtt_us[only] : 0.0f;
+    }
+
+    float x0 = (float) index_size(below);
+    float x1 = (float) index_size(above);
+    float slope = (ctl->srtt_us[above] - ctl->srtt_us[below]) / (x1 - x0);
+    float latency = ctl->srtt_us[below] + slope * ((float) size - x0);
+
+    /* Noisy measurements can tilt the line, a block is never faster than in proportion */
+    float proportional = ctl->srtt_us[below] * (float) size / x0;
+    if (size < x0 && latency < proportional)
+    {
+        latency = proportional;
+    }
+
+    return (latency > 0.0f) ? latency : 0.0f;
+}
+
+/*
+ * Expected payload bytes per microsecond. Each retransmission waits twice as long
+ * as the one before, so with a first timeout T and a loss rate p the expected
+ * wait per block is T * p / (1 - 2p).
+ */
+static float goodput(const struct block_size_ctl *ctl, uint32_t size)
+{
+    float p = loss_for_size(ctl, size);
+    float time_us = latency_for_size(ctl, size) + ctl->timeout_us * p / (1.0f - 2.0f * p);
+
+    return (time_us > 0.0f) ? (float) size / time_us : 0.0f;
+}
+
+void block_size_ctl_init(struct block_size_ctl *ctl)
+{
+    memset(ctl, 0, sizeof(*ctl));
+    ctl->size = BLOCK_SIZE_CTL_MAX;
+    ctl->timeout_us = TIMEOUT_INIT_US;
+}
+
+void block_size_ctl_observe(struct block_size_ctl *ctl, uint32_t block_size, uint32_t latency_us)
+{
+    int idx = size_index(block_size);
+    float srtt = ctl->srtt_us[idx];
+    bool lost = latency_us > BLOCK_SIZE_CTL_LOSS_US
+                || (ctl->samples[idx] > 0 && (float) latency_us > 3.0f * srtt);
+
+    if (lost)
+    {
+        /* A lost block waits T / (1 - 2p) on average, solve for the first timeout T */
+        float timeout = ((float) latency_us - srtt) * (1.0f - 2.0f * ctl->loss);
+        ctl->timeout_us += RTT_GAIN * (timeout - ctl->timeout_us);
+    }
+    else if (ctl->samples[idx]++ == 0)
+    {
+        ctl->srtt_us[idx] = (float) latency_us;
+    }
+    else
+    {
+        ctl->srtt_us[idx] += RTT_GAIN * ((float) latency_us - srtt);
+    }
+
+    ctl->loss += LOSS_GAIN * ((lost ? 1.0f : 0.0f) - ctl->loss);
+    ctl->loss = (ctl->loss < LOSS_MAX) ? ctl->loss : LOSS_MAX;
+    ctl->loss_per_byte = -logf(1.0f - ctl->loss) / (float) (block_size + BLOCK_SIZE_CTL_OVERHEAD);
+}
+
+uint32_t block_size_ctl_select(struct block_size_ctl *ctl, uint32_t max_size)
+{
+    uint32_t current = (ctl->size < max_size) ? ctl->size : max_size;
+    uint32_t best = current;
+    float best_rate = 0.0f;
+
+    for (uint32_t size = BLOCK_SIZE_CTL_MIN; size <= max_size && size <= BLOCK_SIZE_CTL_MAX;
+         size <<= 1)
+    {
+        float rate = goodput(ctl, size);
+        if (rate > best_rate)
+        {
+            best = size;
+            best_rate = rate;
+        }
+    }
+
+    if (best_rate <= goodput(ctl, current) * HYSTERESIS)
+    {
+        best = current;
+    }
+
+    if (best != ctl->size)
+    {
+        /* Carry the loss estimate over to the new size */
+        ctl->loss = loss_for_size(ctl, best);
+        ctl->size = best;
+    }
+
+    return best;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/* Smallest block the controller picks, smaller ones spend most of the link on headers */
+#define BLOCK_SIZE_CTL_MIN          (64)
+/* CoAP's largest block */
+#define BLOCK_SIZE_CTL_MAX          (1024)
+#define BLOCK_SIZE_CTL_SIZES        (5)
+/* Bytes sent with every block: IP, UDP, DTLS and CoAP headers */
+#define BLOCK_SIZE_CTL_OVERHEAD     (80)
+/* A block acknowledged later than this was retransmitted, CoAP's ACK_TIMEOUT is 2 s */
+#define BLOCK_SIZE_CTL_LOSS_US      (2000000)
+
+/**
+ * @brief Picks the CoAP block size of the next transfer from the latency and
+ * loss of recent blocks.
+ *
+ * Losses are not reported by the CoAP stack, a block whose acknowledgement took
+ * longer than BLOCK_SIZE_CTL_LOSS_US (or three times the usual latency) is
+ * counted as lost. The loss rate is kept per byte on air, so it predicts the
+ * loss of every block size from the ones measured. With CoAP's doubling
+ * retransmission timeouts, the expected goodput of each size is then
+ *
+ *     size / (latency(size) + timeout * p(size) / (1 - 2 * p(size)))
+ *
+ * where latency(size) is interpolated from the sizes measured so far. The size
+ * only changes when another one is predicted to be 10% faster.
+ *
+ * No allocation and no platform dependencies, so it runs unchanged in the host
+ * simulator under tools/block_size_sim.
+ */
+struct block_size_ctl {
+    uint32_t size;
+    /* Smoothed latency of blocks that were not lost, per size */
+    float srtt_us[BLOCK_SIZE_CTL_SIZES];
+    uint32_t samples[BLOCK_SIZE_CTL_SIZES];
+    /* Smoothed loss indicator at the current size */
+    float loss;
+    /* Loss rate per byte on air, derived from loss */
+    float loss_per_byte;
+    /* Smoothed first retransmission timeout, derived from lost blocks */
+    float timeout_us;
+};
+
+void block_size_ctl_init(struct block_size_ctl *ctl);
+
+/**
+ * @brief Account for one acknowledged block.
+ */
+void block_size_ctl_observe(struct block_size_ctl *ctl, uint32_t block_size, uint32_t latency_us);
+
+/**
+ * @brief Block size for the next transfer, a power of two no larger than max_size.
+ */
+uint32_t block_size_ctl_select(struct block_size_ctl *ctl, uint32_t max_size);
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include "esp_console.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "capture_stats.h"
+
+#include <golioth/client.h>
+static const char *TAG = "capture_stats";
+
+#define REPORTER_TASK_PRIORITY      (1)
+#define REPORTER_TASK_STACK_SIZE    (3072)
+
+static struct capture_stats _stats = {
+    .min_sample = INT16_MAX,
+    .max_sample = INT16_MIN,
+};
+static portMUX_TYPE _stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void capture_stats_reset(void)
+{
+    portENTER_CRITICAL(&_stats_lock);
+    _stats = (struct capture_stats) {
+        .min_sample = INT16_MAX,
+        .max_sample = INT16_MIN,
+    };
+    portEXIT_CRITICAL(&_stats_lock);
+}
+
+static int latency_bucket(uint32_t latency_us)
+{
+    int bucket = 0;
+    uint32_t ms = latency_us / 1000;
+
+    while (ms && bucket < CAPTURE_STATS_LATENCY_BUCKETS - 1)
+    {
+        ms >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+void capture_stats_record(const int16_t *samples, size_t len, uint32_t latency_us)
+{
+    int16_t lo = INT16_MAX;
+    int16_t hi = INT16_MIN;
+
+    /* Scan outside the critical section, it only guards the shared counters */
+    for (size_t i = 0; samples && i < len / sizeof(int16_t); i++)
+    {
+        lo = (samples[i] < lo) ? samples[i] : lo;
+        hi = (samples[i] > hi) ? samples[i] : hi;
+    }
+
+    int bucket = latency_bucket(latency_us);
+
+    portENTER_CRITICAL(&_stats_lock);
+    if (samples)
+    {
+        _stats.buffers++;
+        _stats.bytes += len;
+        _stats.min_sample = (lo < _stats.min_sample) ? lo : _stats.min_sample;
+        _stats.max_sample = (hi > _stats.max_sample) ? hi : _stats.max_sample;
+    }
+    else
+    {
+        _stats.read_failures++;
+    }
+    _stats.latency_hist[bucket]++;
+    if (latency_us > _stats.max_latency_us)
+    {
+        _stats.max_latency_us = latency_us;
+    }
+    portEXIT_CRITICAL(&_stats_lock);
+}
+
+struct capture_stats capture_stats_get(void)
+{
+    portENTER_CRITICAL(&_stats_lock);
+    struct capture_stats stats = _stats;
+    portEXIT_CRITICAL(&_stats_lock);
+
+    return stats;
+}
+
+void capture_stats_log(void)
+{
+    struct capture_stats s = capture_stats_get();
+
+    if (s.buffers == 0)
+    {
+        GLTH_LOGI(TAG, "No buffers captured, %" PRIu32 " read failures", s.read_failures);
+        return;
+    }
+
+    int peak = abs(s.min_sample) > abs(s.max_sample) ? abs(s.min_sample) : abs(s.max_sample);
+    const uint32_t *h = s.latency_hist;
+
+    GLTH_LOGI(TAG,
+              "%" PRIu32 " buffers, %" PRIu32 " bytes, %" PRIu32
+              " read failures, samples [%d, %d] peak %d",
+              s.buffers,
+              s.bytes,
+              s.read_failures,
+              s.min_sample,
+              s.max_sample,
+              peak);
+    GLTH_LOGI(TAG,
+              "Read latency max %" PRIu32 " us, ms histogram <1:%" PRIu32 " <2:%" PRIu32
+              " <4:%" PRIu32 " <8:%" PRIu32 " <16:%" PRIu32 " <32:%" PRIu32 " <64:%" PRIu32
+              " >=64:%" PRIu32,
+              s.max_latency_us,
+              h[0],
+              h[1],
+              h[2],
+              h[3],
+              h[4],
+              h[5],
+              h[6],
+              h[7]);
+}
+
+static void reporter_task(void *arg)
+{
+    uint32_t last_buffers = 0;
+
+    while (true)
+    {
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_EXAMPLE_CAPTURE_STATS_INTERVAL * 1000));
+
+        struct capture_stats s = capture_stats_get();
+        if (s.buffers != last_buffers)
+        {
+            last_buffers = s.buffers;
+            capture_stats_log();
+        }
+    }
+}
+
+static int cmd_capture_stats(int argc, char **argv)
+{
+    capture_stats_log();
+    return 0;
+}
+
+void capture_stats_start(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "capture_stats",
+        .help = "Show microphone capture statistics for the current recording",
+        .hint = NULL,
+        .func = cmd_capture_stats,
+    };
+    esp_console_cmd_register(&cmd);
+
+    if (CONFIG_EXAMPLE_CAPTURE_STATS_INTERVAL > 0)
+    {
+        xTaskCreate(reporter_task,
+                    "capture_stats",
+                    REPORTER_TASK_STACK_SIZE,
+                    NULL,
+                    REPORTER_TASK_PRIORITY,
+                    NULL);
+    }
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Read latency buckets: < 1 ms, < 2 ms, < 4 ms, ... < 64 ms, >= 64 ms */
+#define CAPTURE_STATS_LATENCY_BUCKETS   (8)
+
+struct capture_stats {
+    uint32_t buffers;
+    uint32_t bytes;
+    uint32_t read_failures;
+    int16_t min_sample;
+    int16_t max_sample;
+    uint32_t max_latency_us;
+    uint32_t latency_hist[CAPTURE_STATS_LATENCY_BUCKETS];
+};
+
+/**
+ * @brief Clear the counters, called when a recording starts.
+ */
+void capture_stats_reset(void);
+
+/**
+ * @brief Account for one microphone read. Called from the capture loop: no
+ * allocation, no blocking and no formatted I/O.
+ *
+ * @param samples Samples read, NULL if the read failed
+ * @param len Bytes read
+ * @param latency_us Time spent in the read call
+ */
+void capture_stats_record(const int16_t *samples, size_t len, uint32_t latency_us);
+
+struct capture_stats capture_stats_get(void);
+
+/**
+ * @brief Log a one-line summary of the current counters.
+ */
+void capture_stats_log(void);
+
+/**
+ * @brief Start the low-priority reporter task and register the "capture_stats"
+ * shell command.
+ *
+ * The reporter logs a summary at most every CONFIG_EXAMPLE_CAPTURE_STATS_INTERVAL
+ * seconds, and only when new buffers were read since the last one.
+ */
+void capture_stats_start(void);
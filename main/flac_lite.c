@@ -0,0 +1,797 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "flac_lite.h"
+
+#define BITS_PER_SAMPLE         (16)
+#define MAX_PARTITION_ORDER     (4)
+#define MAX_RICE_PARAM          (14)
+#define RICE_ESCAPE_PARAM       (15)
+
+#define SUBFRAME_CONSTANT       (0x00)
+#define SUBFRAME_VERBATIM       (0x01)
+#define SUBFRAME_FIXED          (0x08)
+
+static uint8_t crc8_table[256];
+static uint16_t crc16_table[256];
+static bool crc_tables_ready;
+
+static void crc_tables_init(void)
+{
+    if (crc_tables_ready)
+    {
+        return;
+    }
+
+    for (int i = 0; i < 256; i++)
+    {
+        uint8_t c8 = (uint8_t) i;
+        uint16_t c16 = (uint16_t) (i << 8);
+
+        for (int b = 0; b < 8; b++)
+        {
+            c8 = (c8 & 0x80) ? (uint8_t) ((c8 << 1) ^ 0x07) : (uint8_t) (c8 << 1);
+            c16 = (c16 & 0x8000) ? (uint16_t) ((c16 << 1) ^ 0x8005) : (uint16_t) (c16 << 1);
+        }
+
+        crc8_table[i] = c8;
+        crc16_table[i] = c16;
+    }
+
+    crc_tables_ready = true;
+}
+
+static uint8_t crc8(const uint8_t *data, size_t len)
+{
+    uint8_t crc = 0;
+
+    while (len--)
+    {
+        crc = crc8_table[crc ^ *data++];
+    }
+
+    return crc;
+}
+
+static uint16_t crc16(const uint8_t *data, size_t len)
+{
+    uint16_t crc = 0;
+
+    while (len--)
+    {
+        crc = (uint16_t) ((crc << 8) ^ crc16_table[(crc >> 8) ^ *data++]);
+    }
+
+    return crc;
+}
+
+/* MSB-first bit writer, at most 24 bits per call */
+struct bit_writer {
+    uint8_t *buf;
+    size_t pos;
+    uint32_t acc;
+    int bits;
+};
+
+static inline void bw_put(struct bit_writer *bw, uint32_t value, int nbits)
+{
+    bw->acc = (bw->acc << nbits) | (value & ((1u << nbits) - 1));
+    bw->bits += nbits;
+
+    while (bw->bits >= 8)
+    {
+        bw->bits -= 8;
+        bw->buf[bw->pos++] = (uint8_t) (bw->acc >> bw->bits);
+    }
+}
+
+static inline void bw_align(struct bit_writer *bw)
+{
+    if (bw->bits)
+    {
+        bw_put(bw, 0, 8 - bw->bits);
+    }
+}
+
+static inline void bw_put_rice(struct bit_writer *bw, int32_t residual, uint32_t k)
+{
+    uint32_t u = ((uint32_t) residual << 1) ^ (uint32_t) (residual >> 31);
+    uint32_t q = u >> k;
+    uint32_t low = (1u << k) | (u & ((1u << k) - 1));
+
+    if (q + 1 + k <= 24)
+    {
+        bw_put(bw, low, (int) (q + 1 + k));
+        return;
+    }
+
+    while (q >= 16)
+    {
+        bw_put(bw, 0, 16);
+        q -= 16;
+    }
+    bw_put(bw, 0, (int) q);
+    bw_put(bw, low, (int) (k + 1));
+}
+
+static void bw_put_utf8(struct bit_writer *bw, uint32_t v)
+{
+    if (v < 0x80)
+    {
+        bw_put(bw, v, 8);
+        return;
+    }
+
+    int extra = (v < 0x800) ? 1 : (v < 0x10000) ? 2 : (v < 0x200000) ? 3 : (v < 0x4000000) ? 4 : 5;
+    uint32_t lead_mask = (0xFF00u >> (extra + 1)) & 0xFF;
+
+    bw_put(bw, lead_mask | (v >> (6 * extra)), 8);
+    for (int i = extra - 1; i >= 0; i--)
+    {
+        bw_put(bw, 0x80 | ((v >> (6 * i)) & 0x3F), 8);
+    }
+}
+
+static uint32_t sample_rate_code(uint32_t rate)
+{
+    switch (rate)
+    {
+        case 88200:
+            return 1;
+        case 176400:
+            return 2;
+        case 192000:
+            return 3;
+        case 8000:
+            return 4;
+        case 16000:
+            return 5;
+        case 22050:
+            return 6;
+        case 24000:
+            return 7;
+        case 32000:
+            return 8;
+        case 44100:
+            return 9;
+        case 48000:
+            return 10;
+        case 96000:
+            return 11;
+        default:
+            /* 16-bit rate in Hz at the end of the header, or look it up in STREAMINFO */
+            return (rate <= 0xFFFF) ? 13 : 0;
+    }
+}
+
+void flac_lite_init(struct flac_lite_enc *enc, uint32_t sample_rate)
+{
+    crc_tables_init();
+
+    enc->sample_rate = sample_rate;
+    enc->frame_number = 0;
+    enc->min_frame_size = 0;
+    enc->max_frame_size = 0;
+    enc->block_fill = 0;
+}
+
+size_t flac_lite_stream_header(uint8_t *out,
+                               uint32_t sample_rate,
+                               uint64_t total_samples,
+                               uint32_t min_frame_size,
+                               uint32_t max_frame_size)
+{
+    struct bit_writer bw = {.buf = out};
+
+    memcpy(out, "fLaC", 4);
+    bw.pos = 4;
+
+    /* Last metadata block, type STREAMINFO, 34 bytes */
+    bw_put(&bw, 0x80, 8);
+    bw_put(&bw, 34, 24);
+
+    bw_put(&bw, FLAC_LITE_BLOCK_SIZE, 16);
+    bw_put(&bw, FLAC_LITE_BLOCK_SIZE, 16);
+    bw_put(&bw, min_frame_size, 24);
+    bw_put(&bw, max_frame_size, 24);
+    bw_put(&bw, sample_rate, 20);
+    bw_put(&bw, 0, 3); /* channels - 1 */
+    bw_put(&bw, BITS_PER_SAMPLE - 1, 5);
+    bw_put(&bw, (uint32_t) (total_samples >> 32) & 0x0F, 4);
+    bw_put(&bw, (uint32_t) (total_samples >> 16) & 0xFFFF, 16);
+    bw_put(&bw, (uint32_t) total_samples & 0xFFFF, 16);
+
+    /* MD5 of the unencoded audio is optional, zero means not computed */
+    memset(&out[bw.pos], 0, 16);
+    bw.pos += 16;
+
+    return bw.pos;
+}
+
+/* Picks the fixed predictor order with the smallest residual magnitude */
+static int best_fixed_order(const int16_t *x, uint32_t n)
+{
+    uint64_t sum[FLAC_LITE_MAX_ORDER + 1] = {0};
+    int32_t l0 = x[3];
+    int32_t l1 = x[3] - x[2];
+    int32_t l2 = l1 - (x[2] - x[1]);
+    int32_t l3 = l2 - ((x[2] - x[1]) - (x[1] - x[0]));
+
+    for (uint32_t i = 4; i < n; i++)
+    {
+        int32_t e0 = x[i];
+        int32_t e1 = e0 - l0;
+        int32_t e2 = e1 - l1;
+        int32_t e3 = e2 - l2;
+        int32_t e4 = e3 - l3;
+
+        sum[0] += (uint32_t) (e0 < 0 ? -e0 : e0);
+        sum[1] += (uint32_t) (e1 < 0 ? -e1 : e1);
+        sum[2] += (uint32_t) (e2 < 0 ? -e2 : e2);
+        sum[3] += (uint32_t) (e3 < 0 ? -e3 : e3);
+        sum[4] += (uint32_t) (e4 < 0 ? -e4 : e4);
+
+        l0 = e0;
+        l1 = e1;
+        l2 = e2;
+        l3 = e3;
+    }
+
+    int best = 0;
+    for (int order = 1; order <= FLAC_LITE_MAX_ORDER; order++)
+    {
+        if (sum[order] < sum[best])
+        {
+            best = order;
+        }
+    }
+
+    return best;
+}
+
+static void fixed_residual(const int16_t *x, uint32_t n, int order, int32_t *res)
+{
+    for (uint32_t i = order; i < n; i++)
+    {
+        switch (order)
+        {
+            case 0:
+                res[i] = x[i];
+                break;
+            case 1:
+                res[i] = x[i] - x[i - 1];
+                break;
+            case 2:
+                res[i] = x[i] - 2 * x[i - 1] + x[i - 2];
+                break;
+            case 3:
+                res[i] = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3];
+                break;
+            default:
+                res[i] = x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4];
+                break;
+        }
+    }
+}
+
+/* Rice parameter for a partition, and an upper bound of its cost in bits */
+static uint32_t rice_param(uint64_t sum, uint32_t count, uint64_t *bits)
+{
+    uint32_t k = 0;
+
+    while (k < MAX_RICE_PARAM && ((uint64_t) count << (k + 1)) < sum)
+    {
+        k++;
+    }
+
+    *bits = 4 + (uint64_t) count * (k + 1) + (sum >> k);
+    return k;
+}
+
+struct rice_plan {
+    uint32_t partition_order;
+    uint32_t params[1 << MAX_PARTITION_ORDER];
+    uint64_t bits;
+};
+
+static void plan_partitions(const int32_t *res, uint32_t n, int order, struct rice_plan *plan)
+{
+    uint64_t sums[1 << MAX_PARTITION_ORDER] = {0};
+    uint32_t max_porder = 0;
+
+    while (max_porder < MAX_PARTITION_ORDER
+           && (n % (2u << max_porder)) == 0
+           && (n >> (max_porder + 1)) > (uint32_t) order)
+    {
+        max_porder++;
+    }
+
+    /* Zigzag magnitudes summed per partition at the finest partition order */
+    uint32_t psize = n >> max_porder;
+    for (uint32_t p = 0; p < (1u << max_porder); p++)
+    {
+        uint32_t start = (p == 0) ? (uint32_t) order : p * psize;
+        for (uint32_t i = start; i < (p + 1) * psize; i++)
+        {
+            sums[p] += ((uint32_t) res[i] << 1) ^ (uint32_t) (res[i] >> 31);
+        }
+    }
+
+    plan->bits = UINT64_MAX;
+
+    for (int porder = (int) max_porder; porder >= 0; porder--)
+    {
+        uint32_t parts = 1u << porder;
+        uint32_t params[1 << MAX_PARTITION_ORDER];
+        uint64_t total = 0;
+
+        for (uint32_t p = 0; p < parts; p++)
+        {
+            uint32_t count = (n >> porder) - (p == 0 ? (uint32_t) order : 0);
+            uint64_t bits;
+
+            params[p] = rice_param(sums[p], count, &bits);
+            total += bits;
+        }
+
+        if (total < plan->bits)
+        {
+            plan->bits = total;
+            plan->partition_order = (uint32_t) porder;
+            memcpy(plan->params, params, parts * sizeof(params[0]));
+        }
+
+        /* Merge neighbours for the next coarser order */
+        for (uint32_t p = 0; p < parts / 2; p++)
+        {
+            sums[p] = sums[2 * p] + sums[2 * p + 1];
+        }
+    }
+}
+
+static void encode_subframe(struct flac_lite_enc *enc,
+                            struct bit_writer *bw,
+                            const int16_t *x,
+                            uint32_t n)
+{
+    bool constant = true;
+    for (uint32_t i = 1; i < n && constant; i++)
+    {
+        constant = (x[i] == x[0]);
+    }
+
+    if (constant)
+    {
+        bw_put(bw, SUBFRAME_CONSTANT << 1, 8);
+        bw_put(bw, (uint16_t) x[0], BITS_PER_SAMPLE);
+        return;
+    }
+
+    int order = -1;
+    struct rice_plan plan;
+
+    if (n > FLAC_LITE_MAX_ORDER)
+    {
+        order = best_fixed_order(x, n);
+        fixed_residual(x, n, order, enc->residual);
+        plan_partitions(enc->residual, n, order, &plan);
+
+        uint64_t fixed_bits = 6 + (uint64_t) order * BITS_PER_SAMPLE + plan.bits;
+        if (fixed_bits >= (uint64_t) n * BITS_PER_SAMPLE)
+        {
+            order = -1;
+        }
+    }
+
+    if (order < 0)
+    {
+        bw_put(bw, SUBFRAME_VERBATIM << 1, 8);
+        for (uint32_t i = 0; i < n; i++)
+        {
+            bw_put(bw, (uint16_t) x[i], BITS_PER_SAMPLE);
+        }
+        return;
+    }
+
+    bw_put(bw, (SUBFRAME_FIXED | order) << 1, 8);
+    for (int i = 0; i < order; i++)
+    {
+        bw_put(bw, (uint16_t) x[i], BITS_PER_SAMPLE);
+    }
+
+    /* Residual coding method 0: 4-bit Rice parameters */
+    bw_put(bw, 0, 2);
+    bw_put(bw, plan.partition_order, 4);
+
+    uint32_t psize = n >> plan.partition_order;
+    for (uint32_t p = 0; p < (1u << plan.partition_order); p++)
+    {
+        uint32_t k = plan.params[p];
+        uint32_t start = (p == 0) ? (uint32_t) order : p * psize;
+
+        bw_put(bw, k, 4);
+        for (uint32_t i = start; i < (p + 1) * psize; i++)
+        {
+            bw_put_rice(bw, enc->residual[i], k);
+        }
+    }
+}
+
+static size_t encode_frame(struct flac_lite_enc *enc, const int16_t *x, uint32_t n, uint8_t *out)
+{
+    struct bit_writer bw = {.buf = out};
+    uint32_t sr_code = sample_rate_code(enc->sample_rate);
+    uint32_t bs_code = (n == FLAC_LITE_BLOCK_SIZE) ? 12 : (n <= 256) ? 6 : 7;
+
+    /* Sync code, fixed block size stream */
+    bw_put(&bw, 0xFFF8, 16);
+    bw_put(&bw, bs_code, 4);
+    bw_put(&bw, sr_code, 4);
+    bw_put(&bw, 0, 4); /* mono */
+    bw_put(&bw, 4, 3); /* 16 bits per sample */
+    bw_put(&bw, 0, 1);
+    bw_put_utf8(&bw, enc->frame_number);
+
+    if (bs_code == 6)
+    {
+        bw_put(&bw, n - 1, 8);
+    }
+    else if (bs_code == 7)
+    {
+        bw_put(&bw, n - 1, 16);
+    }
+
+    if (sr_code == 13)
+    {
+        bw_put(&bw, enc->sample_rate, 16);
+    }
+
+    bw_put(&bw, crc8(out, bw.pos), 8);
+
+    encode_subframe(enc, &bw, x, n);
+    bw_align(&bw);
+
+    uint16_t crc = crc16(out, bw.pos);
+    bw_put(&bw, crc, 16);
+
+    enc->frame_number++;
+    if (enc->min_frame_size == 0 || bw.pos < enc->min_frame_size)
+    {
+        enc->min_frame_size = bw.pos;
+    }
+    if (bw.pos > enc->max_frame_size)
+    {
+        enc->max_frame_size = bw.pos;
+    }
+
+    return bw.pos;
+}
+
+size_t flac_lite_encode(struct flac_lite_enc *enc,
+                        const int16_t *pcm,
+                        size_t num_samples,
+                        uint8_t *out)
+{
+    size_t written = 0;
+
+    while (num_samples > 0)
+    {
+        /* Whole blocks straight from the input, partial ones through the block buffer */
+        if (enc->block_fill == 0 && num_samples >= FLAC_LITE_BLOCK_SIZE)
+        {
+            written += encode_frame(enc, pcm, FLAC_LITE_BLOCK_SIZE, &out[written]);
+            pcm += FLAC_LITE_BLOCK_SIZE;
+            num_samples -= FLAC_LITE_BLOCK_SIZE;
+            continue;
+        }
+
+        size_t chunk = FLAC_LITE_BLOCK_SIZE - enc->block_fill;
+        if (chunk > num_samples)
+        {
+            chunk = num_samples;
+        }
+
+        memcpy(&enc->block[enc->block_fill], pcm, chunk * sizeof(int16_t));
+        enc->block_fill += chunk;
+        pcm += chunk;
+        num_samples -= chunk;
+
+        if (enc->block_fill == FLAC_LITE_BLOCK_SIZE)
+        {
+            written += encode_frame(enc, enc->block, FLAC_LITE_BLOCK_SIZE, &out[written]);
+            enc->block_fill = 0;
+        }
+    }
+
+    return written;
+}
+
+size_t flac_lite_flush(struct flac_lite_enc *enc, uint8_t *out)
+{
+    if (enc->block_fill == 0)
+    {
+        return 0;
+    }
+
+    size_t written = encode_frame(enc, enc->block, enc->block_fill, out);
+    enc->block_fill = 0;
+
+    return written;
+}
+
+
+/* MSB-first bit reader used by the verification decoder */
+struct bit_reader {
+    const uint8_t *buf;
+    size_t len;
+    size_t bitpos;
+};
+
+static int br_get(struct bit_reader *br, int nbits, uint32_t *value)
+{
+    if (br->bitpos + nbits > br->len * 8)
+    {
+        return -1;
+    }
+
+    uint32_t v = 0;
+    for (int i = 0; i < nbits; i++)
+    {
+        size_t bit = br->bitpos++;
+        v = (v << 1) | ((br->buf[bit >> 3] >> (7 - (bit & 7))) & 1);
+    }
+
+    *value = v;
+    return 0;
+}
+
+static int br_get_signed(struct bit_reader *br, int nbits, int32_t *value)
+{
+    uint32_t v;
+
+    if (br_get(br, nbits, &v) < 0)
+    {
+        return -1;
+    }
+
+    *value = (int32_t) (v << (32 - nbits)) >> (32 - nbits);
+    return 0;
+}
+
+static int br_get_rice(struct bit_reader *br, uint32_t k, int32_t *value)
+{
+    uint32_t q = 0;
+    uint32_t bit;
+    uint32_t low = 0;
+
+    do
+    {
+        if (br_get(br, 1, &bit) < 0)
+        {
+            return -1;
+        }
+    } while (bit == 0 && ++q);
+
+    if (k && br_get(br, (int) k, &low) < 0)
+    {
+        return -1;
+    }
+
+    uint32_t u = (q << k) | low;
+    *value = (int32_t) (u >> 1) ^ -(int32_t) (u & 1);
+    return 0;
+}
+
+static int decode_residual(struct bit_reader *br, uint32_t n, int order, int32_t *res)
+{
+    uint32_t method;
+    uint32_t porder;
+
+    if (br_get(br, 2, &method) < 0 || method != 0 || br_get(br, 4, &porder) < 0)
+    {
+        return -1;
+    }
+
+    uint32_t psize = n >> porder;
+    for (uint32_t p = 0; p < (1u << porder); p++)
+    {
+        uint32_t k;
+        uint32_t start = (p == 0) ? (uint32_t) order : p * psize;
+
+        if (br_get(br, 4, &k) < 0)
+        {
+            return -1;
+        }
+
+        for (uint32_t i = start; i < (p + 1) * psize; i++)
+        {
+            if (k == RICE_ESCAPE_PARAM)
+            {
+                uint32_t raw_bits;
+                if (br_get(br, 5, &raw_bits) < 0
+                    || (raw_bits && br_get_signed(br, (int) raw_bits, &res[i]) < 0))
+                {
+                    return -1;
+                }
+                if (!raw_bits)
+                {
+                    res[i] = 0;
+                }
+            }
+            else if (br_get_rice(br, k, &res[i]) < 0)
+            {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int flac_lite_decode_frame(const uint8_t *in, size_t len, int16_t *pcm, size_t *num_samples)
+{
+    struct bit_reader br = {.buf = in, .len = len};
+    int32_t res[FLAC_LITE_BLOCK_SIZE];
+    uint32_t v;
+    uint32_t bs_code;
+    uint32_t sr_code;
+    uint32_t n;
+
+    crc_tables_init();
+
+    if (br_get(&br, 16, &v) < 0 || v != 0xFFF8)
+    {
+        return -1;
+    }
+
+    br_get(&br, 4, &bs_code);
+    br_get(&br, 4, &sr_code);
+    if (br_get(&br, 8, &v) < 0 || v != 0x08) /* mono, 16 bits per sample */
+    {
+        return -1;
+    }
+
+    /* UTF-8 coded frame number */
+    if (br_get(&br, 8, &v) < 0)
+    {
+        return -1;
+    }
+    for (uint32_t lead = v; lead & 0x80 && (lead & 0x40); lead = (lead << 1) & 0xFF)
+    {
+        if (br_get(&br, 8, &v) < 0)
+        {
+            return -1;
+        }
+    }
+
+    if (bs_code == 12)
+    {
+        n = FLAC_LITE_BLOCK_SIZE;
+    }
+    else if (bs_code == 6 || bs_code == 7)
+    {
+        if (br_get(&br, bs_code == 6 ? 8 : 16, &n) < 0)
+        {
+            return -1;
+        }
+        n += 1;
+    }
+    else
+    {
+        return -1;
+    }
+
+    if (n > FLAC_LITE_BLOCK_SIZE)
+    {
+        return -1;
+    }
+
+    if (sr_code == 12)
+    {
+        br_get(&br, 8, &v);
+    }
+    else if (sr_code == 13 || sr_code == 14)
+    {
+        br_get(&br, 16, &v);
+    }
+
+    size_t header_len = br.bitpos / 8;
+    if (br_get(&br, 8, &v) < 0 || v != crc8(in, header_len))
+    {
+        return -2;
+    }
+
+    uint32_t type;
+    if (br_get(&br, 8, &type) < 0 || (type & 0x81))
+    {
+        return -1;
+    }
+    type >>= 1;
+
+    if (type == SUBFRAME_CONSTANT)
+    {
+        int32_t s;
+        if (br_get_signed(&br, BITS_PER_SAMPLE, &s) < 0)
+        {
+            return -1;
+        }
+        for (uint32_t i = 0; i < n; i++)
+        {
+            pcm[i] = (int16_t) s;
+        }
+    }
+    else if (type == SUBFRAME_VERBATIM)
+    {
+        for (uint32_t i = 0; i < n; i++)
+        {
+            int32_t s;
+            if (br_get_signed(&br, BITS_PER_SAMPLE, &s) < 0)
+            {
+                return -1;
+            }
+            pcm[i] = (int16_t) s;
+        }
+    }
+    else if ((type & 0x38) == SUBFRAME_FIXED && (type & 0x07) <= FLAC_LITE_MAX_ORDER)
+    {
+        int order = (int) (type & 0x07);
+        int32_t s;
+
+        for (int i = 0; i < order; i++)
+        {
+            if (br_get_signed(&br, BITS_PER_SAMPLE, &s) < 0)
+            {
+                return -1;
+            }
+            pcm[i] = (int16_t) s;
+        }
+
+        if (decode_residual(&br, n, order, res) < 0)
+        {
+            return -1;
+        }
+
+        for (uint32_t i = order; i < n; i++)
+        {
+            switch (order)
+            {
+                case 0:
+                    s = res[i];
+                    break;
+                case 1:
+                    s = res[i] + pcm[i - 1];
+                    break;
+                case 2:
+                    s = res[i] + 2 * pcm[i - 1] - pcm[i - 2];
+                    break;
+                case 3:
+                    s = res[i] + 3 * pcm[i - 1] - 3 * pcm[i - 2] + pcm[i - 3];
+                    break;
+                default:
+                    s = res[i] + 4 * pcm[i - 1] - 6 * pcm[i - 2] + 4 * pcm[i - 3] - pcm[i - 4];
+                    break;
+            }
+            pcm[i] = (int16_t) s;
+        }
+    }
+    else
+    {
+        return -1;
+    }
+
+    /* Byte align, then check the frame CRC */
+    br.bitpos = (br.bitpos + 7) & ~(size_t) 7;
+    size_t frame_len = br.bitpos / 8;
+    if (br_get(&br, 16, &v) < 0 || v != crc16(in, frame_len))
+    {
+        return -2;
+    }
+
+    *num_samples = n;
+    return (int) (frame_len + 2);
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Minimal lossless encoder producing a standard mono 16-bit FLAC stream.
+ *
+ * Every frame holds FLAC_LITE_BLOCK_SIZE samples (the last one may be shorter) and
+ * is coded with the best of the CONSTANT, VERBATIM and FIXED (order 0-4) subframe
+ * types. FIXED residuals use partitioned Rice coding. Frames carry their own CRCs
+ * and are independently decodable, so the output can be consumed block by block.
+ */
+#define FLAC_LITE_BLOCK_SIZE        (4096)
+#define FLAC_LITE_MAX_ORDER         (4)
+#define FLAC_LITE_STREAM_HEADER_SIZE (42)
+/* Frame header (<= 16) + verbatim subframe + CRC-16 */
+#define FLAC_LITE_MAX_FRAME_SIZE    (16 + 1 + (FLAC_LITE_BLOCK_SIZE * 2) + 2)
+
+struct flac_lite_enc {
+    uint32_t sample_rate;
+    uint32_t frame_number;
+    uint32_t min_frame_size;
+    uint32_t max_frame_size;
+    uint16_t block_fill;
+    int16_t block[FLAC_LITE_BLOCK_SIZE];
+    int32_t residual[FLAC_LITE_BLOCK_SIZE];
+};
+
+void flac_lite_init(struct flac_lite_enc *enc, uint32_t sample_rate);
+
+/**
+ * @brief Write the "fLaC" marker and STREAMINFO block.
+ *
+ * total_samples, min_frame_size and max_frame_size may be 0 when not (yet) known.
+ *
+ * @return FLAC_LITE_STREAM_HEADER_SIZE
+ */
+size_t flac_lite_stream_header(uint8_t *out,
+                               uint32_t sample_rate,
+                               uint64_t total_samples,
+                               uint32_t min_frame_size,
+                               uint32_t max_frame_size);
+
+/**
+ * @brief Encode samples, writing every frame completed along the way to out.
+ *
+ * @return Number of bytes written. out must hold
+ * ((num_samples / FLAC_LITE_BLOCK_SIZE) + 1) * FLAC_LITE_MAX_FRAME_SIZE bytes.
+ */
+size_t flac_lite_encode(struct flac_lite_enc *enc,
+                        const int16_t *pcm,
+                        size_t num_samples,
+                        uint8_t *out);
+
+/**
+ * @brief Encode the partially filled frame, if any.
+ *
+ * @return Number of bytes written (at most FLAC_LITE_MAX_FRAME_SIZE).
+ */
+size_t flac_lite_flush(struct flac_lite_enc *enc, uint8_t *out);
+
+/**
+ * @brief Decode one frame produced by flac_lite_encode().
+ *
+ * Verifies both frame CRCs. Intended for checking uploads off-device, as
+ * host_pipeline -c does.
+ *
+ * @param[out] pcm Holds up to FLAC_LITE_BLOCK_SIZE decoded samples
+ * @param[out] num_samples Number of samples decoded
+ *
+ * @return Number of bytes consumed, or a negative value if the frame is invalid
+ */
+int flac_lite_decode_frame(const uint8_t *in, size_t len, int16_t *pcm, size_t *num_samples);
+
+#ifdef __cplusplus
+}
+#endif
@@ -68,6 +68,76 @@ typedef struct {
     } \
 }
 
+/**
+ * @brief Header structure for IMA/DVI ADPCM WAV files with only one data chunk
+ *
+ * @note Compressed formats extend the "fmt " subchunk with cbSize and the number of samples per
+ *       block, and add a "fact" subchunk holding the total number of samples per channel.
+ */
+typedef struct {
+    struct {
+        char chunk_id[4]; /*!< Contains the letters "RIFF" in ASCII form */
+        uint32_t chunk_size; /*!< This is the size of the rest of the chunk following this number */
+        char chunk_format[4]; /*!< Contains the letters "WAVE" */
+    } descriptor_chunk; /*!< Canonical WAVE format starts with the RIFF header */
+    struct {
+        char subchunk_id[4]; /*!< Contains the letters "fmt " */
+        uint32_t subchunk_size; /*!< 20 for IMA ADPCM */
+        uint16_t audio_format; /*!< IMA ADPCM = 0x11 */
+        uint16_t num_of_channels; /*!< Mono = 1, Stereo = 2, etc. */
+        uint32_t sample_rate; /*!< 8000, 44100, etc. */
+        uint32_t byte_rate; /*!< ==SampleRate * BlockAlign / SamplesPerBlock */
+        uint16_t block_align; /*!< Size of one encoded block in bytes */
+        uint16_t bits_per_sample; /*!< 4 for IMA ADPCM */
+        uint16_t extra_size; /*!< Size of the extension that follows, 2 */
+        uint16_t samples_per_block; /*!< ==(BlockAlign - 4 * NumChannels) * 8 / (4 * NumChannels) + 1 */
+    } fmt_chunk; /*!< The "fmt " subchunk describes the sound data's format */
+    struct {
+        char subchunk_id[4]; /*!< Contains the letters "fact" */
+        uint32_t subchunk_size; /*!< 4 */
+        uint32_t sample_length; /*!< Number of samples per channel */
+    } fact_chunk; /*!< The "fact" subchunk is required for compressed formats */
+    struct {
+        char subchunk_id[4]; /*!< Contains the letters "data" */
+        uint32_t subchunk_size; /*!< ==NumBlocks * BlockAlign */
+        uint8_t data[0]; /*!< Holds encoded audio blocks */
+    } data_chunk; /*!< The "data" subchunk contains the size of the data and the actual sound */
+} wav_header_ima_adpcm_t;
+
+/**
+ * @brief Default header for IMA ADPCM format WAV files
+ *
+ */
+#define WAV_HEADER_IMA_ADPCM_DEFAULT(wav_data_size, wav_sample_count, wav_sample_rate, wav_channel_num, \
+                                     wav_block_align, wav_samples_per_block) { \
+    .descriptor_chunk = { \
+        .chunk_id = {'R', 'I', 'F', 'F'}, \
+        .chunk_size = (wav_data_size) + sizeof(wav_header_ima_adpcm_t) - 8, \
+        .chunk_format = {'W', 'A', 'V', 'E'} \
+    }, \
+    .fmt_chunk = { \
+        .subchunk_id = {'f', 'm', 't', ' '}, \
+        .subchunk_size = 20, /* 20 for IMA ADPCM */ \
+        .audio_format = 0x11, /* 0x11 for IMA ADPCM */ \
+        .num_of_channels = (wav_channel_num), \
+        .sample_rate = (wav_sample_rate), \
+        .byte_rate = (uint32_t) ((uint64_t) (wav_sample_rate) * (wav_block_align) / (wav_samples_per_block)), \
+        .block_align = (wav_block_align), \
+        .bits_per_sample = 4, \
+        .extra_size = 2, \
+        .samples_per_block = (wav_samples_per_block) \
+    }, \
+    .fact_chunk = { \
+        .subchunk_id = {'f', 'a', 'c', 't'}, \
+        .subchunk_size = 4, \
+        .sample_length = (wav_sample_count) \
+    }, \
+    .data_chunk = { \
+        .subchunk_id = {'d', 'a', 't', 'a'}, \
+        .subchunk_size = (wav_data_size) \
+    } \
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include "ima_adpcm.h"
+
+static const int16_t step_table[89] = {
+    7,     8,     9,     10,    11,    12,    13,    14,    16,    17,    19,    21,    23,
+    25,    28,    31,    34,    37,    41,    45,    50,    55,    60,    66,    73,    80,
+    88,    97,    107,   118,   130,   143,   157,   173,   190,   209,   230,   253,   279,
+    307,   337,   371,   408,   449,   494,   544,   598,   658,   724,   796,   876,   963,
+    1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,  2272,  2499,  2749,  3024,  3327,
+    3660,  4026,  4428,  4871,  5358,  5894,  6484,  7132,  7845,  8630,  9493,  10442, 11487,
+    12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+};
+
+static const int8_t index_table[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8,
+};
+
+uint16_t ima_adpcm_block_align(uint32_t sample_rate)
+{
+    uint16_t block_align = 256;
+
+    while (sample_rate > 11025 && block_align < IMA_ADPCM_MAX_BLOCK_ALIGN)
+    {
+        sample_rate /= 2;
+        block_align *= 2;
+    }
+
+    return block_align;
+}
+
+uint32_t ima_adpcm_encoded_size(uint32_t num_samples, uint16_t block_align)
+{
+    uint32_t spb = ima_adpcm_samples_per_block(block_align);
+    return ((num_samples + spb - 1) / spb) * block_align;
+}
+
+void ima_adpcm_init(struct ima_adpcm_enc *enc, uint16_t block_align)
+{
+    if (block_align > IMA_ADPCM_MAX_BLOCK_ALIGN)
+    {
+        block_align = IMA_ADPCM_MAX_BLOCK_ALIGN;
+    }
+
+    enc->predictor = 0;
+    enc->index = 0;
+    enc->block_align = block_align;
+    enc->samples_per_block = ima_adpcm_samples_per_block(block_align);
+    enc->sample_in_block = 0;
+}
+
+static inline uint8_t encode_nibble(struct ima_adpcm_enc *enc, int32_t sample)
+{
+    int32_t step = step_table[enc->index];
+    int32_t diff = sample - enc->predictor;
+    int32_t vpdiff = step >> 3;
+    uint8_t code = 0;
+
+    if (diff < 0)
+    {
+        code = 8;
+        diff = -diff;
+    }
+    if (diff >= step)
+    {
+        code |= 4;
+        diff -= step;
+        vpdiff += step;
+    }
+    step >>= 1;
+    if (diff >= step)
+    {
+        code |= 2;
+        diff -= step;
+        vpdiff += step;
+    }
+    step >>= 1;
+    if (diff >= step)
+    {
+        code |= 1;
+        vpdiff += step;
+    }
+
+    enc->predictor += (code & 8) ? -vpdiff : vpdiff;
+    if (enc->predictor > INT16_MAX)
+    {
+        enc->predictor = INT16_MAX;
+    }
+    else if (enc->predictor < INT16_MIN)
+    {
+        enc->predictor = INT16_MIN;
+    }
+
+    enc->index += index_table[code];
+    if (enc->index < 0)
+    {
+        enc->index = 0;
+    }
+    else if (enc->index > 88)
+    {
+        enc->index = 88;
+    }
+
+    return code;
+}
+
+static inline void encode_one(struct ima_adpcm_enc *enc, int16_t sample)
+{
+    uint16_t pos = enc->sample_in_block;
+
+    if (pos == 0)
+    {
+        /* Block header: the first sample is stored verbatim and seeds the predictor */
+        enc->predictor = sample;
+        enc->block[0] = (uint8_t) (sample & 0xFF);
+        enc->block[1] = (uint8_t) ((uint16_t) sample >> 8);
+        enc->block[2] = (uint8_t) enc->index;
+        enc->block[3] = 0;
+    }
+    else
+    {
+        uint8_t code = encode_nibble(enc, sample);
+        uint8_t *byte = &enc->block[4 + ((pos - 1) >> 1)];
+
+        if ((pos - 1) & 1)
+        {
+            *byte |= (uint8_t) (code << 4);
+        }
+        else
+        {
+            *byte = code;
+        }
+    }
+
+    enc->sample_in_block = pos + 1;
+}
+
+size_t ima_adpcm_encode(struct ima_adpcm_enc *enc,
+                        const int16_t *pcm,
+                        size_t num_samples,
+                        uint8_t *out)
+{
+    size_t written = 0;
+
+    for (size_t i = 0; i < num_samples; i++)
+    {
+        encode_one(enc, pcm[i]);
+
+        if (enc->sample_in_block == enc->samples_per_block)
+        {
+            memcpy(&out[written], enc->block, enc->block_align);
+            written += enc->block_align;
+            enc->sample_in_block = 0;
+        }
+    }
+
+    return written;
+}
+
+size_t ima_adpcm_flush(struct ima_adpcm_enc *enc, uint8_t *out)
+{
+    if (enc->sample_in_block == 0)
+    {
+        return 0;
+    }
+
+    while (enc->sample_in_block < enc->samples_per_block)
+    {
+        encode_one(enc, 0);
+    }
+
+    memcpy(out, enc->block, enc->block_align);
+    enc->sample_in_block = 0;
+
+    return enc->block_align;
+}
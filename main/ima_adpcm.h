@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMA_ADPCM_MAX_BLOCK_ALIGN   (2048)
+
+/**
+ * @brief Streaming mono IMA/DVI ADPCM encoder producing WAV (format 0x11) blocks.
+ *
+ * Each block starts with a 4 byte header (first sample, step index) followed by
+ * 4-bit codes packed two per byte, low nibble first. Only complete blocks are
+ * emitted; ima_adpcm_flush() pads the last one with silence.
+ */
+struct ima_adpcm_enc {
+    int32_t predictor;
+    int32_t index;
+    uint16_t block_align;
+    uint16_t samples_per_block;
+    uint16_t sample_in_block;
+    uint8_t block[IMA_ADPCM_MAX_BLOCK_ALIGN];
+};
+
+/**
+ * @brief Block size used by common encoders for the given sample rate
+ * (256 bytes up to 11025 Hz, doubled for every doubling of the rate).
+ */
+uint16_t ima_adpcm_block_align(uint32_t sample_rate);
+
+static inline uint16_t ima_adpcm_samples_per_block(uint16_t block_align)
+{
+    return (uint16_t) ((block_align - 4) * 2 + 1);
+}
+
+/**
+ * @brief Encoded size, in bytes, of num_samples samples including padding of the last block.
+ */
+uint32_t ima_adpcm_encoded_size(uint32_t num_samples, uint16_t block_align);
+
+void ima_adpcm_init(struct ima_adpcm_enc *enc, uint16_t block_align);
+
+/**
+ * @brief Encode samples, writing every block completed along the way to out.
+ *
+ * @return Number of bytes written to out (a multiple of block_align). out must hold
+ * at least ((num_samples / samples_per_block) + 1) * block_align bytes.
+ */
+size_t ima_adpcm_encode(struct ima_adpcm_enc *enc,
+                        const int16_t *pcm,
+                        size_t num_samples,
+                        uint8_t *out);
+
+/**
+ * @brief Pad and emit the partially filled block, if any.
+ *
+ * @return Number of bytes written to out (0 or block_align).
+ */
+size_t ima_adpcm_flush(struct ima_adpcm_enc *enc, uint8_t *out);
+
+#ifdef __cplusplus
+}
+#endif
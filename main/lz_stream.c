@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include "lz_stream.h"
+
+#define BUF_SIZE        (LZ_STREAM_WINDOW + LZ_STREAM_LOOKAHEAD)
+#define HASH_SIZE       (1 << LZ_STREAM_HASH_BITS)
+/* Candidates compared per position, trades ratio for CPU time */
+#define MAX_CHAIN       (8)
+#define NO_POS          (-1)
+
+static uint32_t hash3(const uint8_t *p)
+{
+    uint32_t v = ((uint32_t) p[0] << 16) | ((uint32_t) p[1] << 8) | p[2];
+
+    return (v * 2654435761u) >> (32 - LZ_STREAM_HASH_BITS);
+}
+
+/*
+ * Differences of 16-bit little-endian samples, one byte at a time so reads may
+ * split a sample: the low byte carries a borrow into the high byte.
+ */
+static void delta16(struct lz_stream *lz, uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        uint8_t b = data[i];
+
+        if (lz->lo_next)
+        {
+            data[i] = (uint8_t) (b - lz->prev_lo);
+            lz->borrow = (b < lz->prev_lo);
+            lz->prev_lo = b;
+        }
+        else
+        {
+            data[i] = (uint8_t) (b - lz->prev_hi - lz->borrow);
+            lz->prev_hi = b;
+        }
+
+        lz->lo_next = !lz->lo_next;
+    }
+}
+
+/* Drop everything older than the window to make room for more input */
+static void slide(struct lz_stream *lz)
+{
+    uint32_t shift = lz->pos - LZ_STREAM_WINDOW;
+
+    memmove(lz->buf, &lz->buf[shift], lz->end - shift);
+    memmove(lz->prev, &lz->prev[shift], (lz->end - shift) * sizeof(lz->prev[0]));
+
+    for (size_t i = 0; i < lz->end - shift; i++)
+    {
+        lz->prev[i] = (lz->prev[i] >= (int32_t) shift) ? (int16_t) (lz->prev[i] - shift) : NO_POS;
+    }
+    for (size_t i = 0; i < HASH_SIZE; i++)
+    {
+        lz->head[i] = (lz->head[i] >= (int32_t) shift) ? (int16_t) (lz->head[i] - shift) : NO_POS;
+    }
+
+    lz->pos -= shift;
+    lz->end -= shift;
+}
+
+/* Keep at least a full match of lookahead until the input runs out */
+static void refill(struct lz_stream *lz)
+{
+    while (!lz->eof && lz->end - lz->pos < LZ_STREAM_MAX_MATCH)
+    {
+        if (lz->end == BUF_SIZE)
+        {
+            slide(lz);
+        }
+
+        size_t n = lz->read(lz->ctx, &lz->buf[lz->end], BUF_SIZE - lz->end);
+        if (n == 0)
+        {
+            lz->eof = true;
+            break;
+        }
+
+        if (lz->flags & LZ_STREAM_FLAG_DELTA16)
+        {
+            delta16(lz, &lz->buf[lz->end], n);
+        }
+
+        lz->end += n;
+        lz->bytes_in += n;
+    }
+}
+
+static void insert(struct lz_stream *lz, uint32_t pos)
+{
+    if (pos + LZ_STREAM_MIN_MATCH <= lz->end)
+    {
+        uint32_t h = hash3(&lz->buf[pos]);
+
+        lz->prev[pos] = lz->head[h];
+        lz->head[h] = (int16_t) pos;
+    }
+}
+
+static uint32_t find_match(const struct lz_stream *lz, uint32_t *offset)
+{
+    uint32_t avail = lz->end - lz->pos;
+    uint32_t max_len = (avail < LZ_STREAM_MAX_MATCH) ? avail : LZ_STREAM_MAX_MATCH;
+    uint32_t best = 0;
+
+    if (max_len < LZ_STREAM_MIN_MATCH)
+    {
+        return 0;
+    }
+
+    int32_t cand = lz->head[hash3(&lz->buf[lz->pos])];
+    const uint8_t *cur = &lz->buf[lz->pos];
+
+    for (int chain = 0; chain < MAX_CHAIN && cand != NO_POS; chain++)
+    {
+        uint32_t dist = lz->pos - (uint32_t) cand;
+        if (dist > LZ_STREAM_WINDOW)
+        {
+            break;
+        }
+
+        const uint8_t *ref = &lz->buf[cand];
+        uint32_t len = 0;
+        while (len < max_len && ref[len] == cur[len])
+        {
+            len++;
+        }
+
+        if (len > best)
+        {
+            best = len;
+            *offset = dist;
+            if (len == max_len)
+            {
+                break;
+            }
+        }
+
+        cand = lz->prev[cand];
+    }
+
+    return (best >= LZ_STREAM_MIN_MATCH) ? best : 0;
+}
+
+/* Compress the next group of up to eight items into out */
+static void encode_group(struct lz_stream *lz)
+{
+    uint8_t flags = 0;
+    uint8_t n = 1;
+    int items = 0;
+
+    for (; items < 8; items++)
+    {
+        refill(lz);
+        if (lz->pos >= lz->end)
+        {
+            break;
+        }
+
+        uint32_t offset = 0;
+        uint32_t len = find_match(lz, &offset);
+
+        if (len)
+        {
+            flags |= (uint8_t) (1 << items);
+            lz->out[n++] = (uint8_t) ((((offset - 1) >> 8) << 4) | (len - LZ_STREAM_MIN_MATCH));
+            lz->out[n++] = (uint8_t) ((offset - 1) & 0xFF);
+        }
+        else
+        {
+            len = 1;
+            lz->out[n++] = lz->buf[lz->pos];
+        }
+
+        for (uint32_t i = 0; i < len; i++)
+        {
+            insert(lz, lz->pos + i);
+        }
+        lz->pos += len;
+    }
+
+    lz->out[0] = flags;
+    lz->out_pos = 0;
+    lz->out_len = items ? n : 0;
+}
+
+void lz_stream_init(struct lz_stream *lz,
+                    uint8_t flags,
+                    uint32_t original_size,
+                    lz_stream_read_fn read,
+                    void *ctx)
+{
+    memset(lz, 0, sizeof(*lz));
+    memset(lz->head, 0xFF, sizeof(lz->head));
+    memset(lz->prev, 0xFF, sizeof(lz->prev));
+
+    lz->read = read;
+    lz->ctx = ctx;
+    lz->flags = flags;
+    lz->lo_next = 1;
+
+    uint8_t *h = lz->out;
+    memcpy(h, "GLZ", 3);
+    h[3] = LZ_STREAM_VERSION;
+    h[4] = flags;
+    h[5] = (uint8_t) __builtin_ctz(LZ_STREAM_WINDOW);
+    h[6] = 0;
+    h[7] = 0;
+    h[8] = (uint8_t) original_size;
+    h[9] = (uint8_t) (original_size >> 8);
+    h[10] = (uint8_t) (original_size >> 16);
+    h[11] = (uint8_t) (original_size >> 24);
+    lz->out_len = LZ_STREAM_HEADER_SIZE;
+}
+
+size_t lz_stream_read(struct lz_stream *lz, uint8_t *out, size_t len, bool *is_last)
+{
+    size_t copied = 0;
+
+    while (copied < len)
+    {
+        if (lz->out_pos == lz->out_len)
+        {
+            if (!lz->done)
+            {
+                encode_group(lz);
+                lz->done = (lz->out_len == 0);
+            }
+            if (lz->done)
+            {
+                break;
+            }
+        }
+
+        size_t n = lz->out_len - lz->out_pos;
+        n = (n < len - copied) ? n : len - copied;
+        memcpy(&out[copied], &lz->out[lz->out_pos], n);
+        lz->out_pos += n;
+        copied += n;
+    }
+
+    /* Look one group ahead, so the block holding the end of the stream is marked last */
+    if (lz->out_pos == lz->out_len && !lz->done)
+    {
+        encode_group(lz);
+        lz->done = (lz->out_len == 0);
+    }
+
+    lz->bytes_out += copied;
+    *is_last = lz->done && lz->out_pos == lz->out_len;
+
+    return copied;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Matches reach back at most this far */
+#define LZ_STREAM_WINDOW        (1024)
+/* Input read ahead of the match position */
+#define LZ_STREAM_LOOKAHEAD     (1024)
+#define LZ_STREAM_HASH_BITS     (10)
+#define LZ_STREAM_MIN_MATCH     (3)
+#define LZ_STREAM_MAX_MATCH     (18)
+
+#define LZ_STREAM_HEADER_SIZE   (12)
+#define LZ_STREAM_VERSION       (1)
+/* Input was 16-bit little-endian samples, stored as differences to the previous one */
+#define LZ_STREAM_FLAG_DELTA16  (1 << 0)
+#define LZ_STREAM_SIZE_UNKNOWN  (0xFFFFFFFF)
+
+/* Flag byte plus eight items of at most two bytes */
+#define LZ_STREAM_GROUP_MAX     (17)
+
+/**
+ * @brief Pulls up to len bytes of input. Returns 0 at the end of the input.
+ */
+typedef size_t (*lz_stream_read_fn)(void *ctx, uint8_t *buf, size_t len);
+
+/**
+ * @brief Streaming LZSS compressor with a small, fixed memory footprint.
+ *
+ * Output starts with a 12 byte container header:
+ *
+ *     "GLZ" version flags window_bits reserved[2] original_size (u32 LE)
+ *
+ * followed by groups of a flag byte and eight items, least significant flag bit
+ * first. A clear bit is a literal byte. A set bit is a two byte match, the high
+ * nibble and second byte holding offset - 1 (12 bits) and the low nibble
+ * length - 3. The last group may hold fewer than eight items, the stream simply
+ * ends. tools/glz_decompress.py restores the original bytes.
+ *
+ * Output is pulled in pieces of any size, so it can fill upload blocks directly.
+ */
+struct lz_stream {
+    lz_stream_read_fn read;
+    void *ctx;
+    uint8_t flags;
+    bool eof;
+    bool done;
+    /* Delta filter state */
+    uint8_t prev_lo;
+    uint8_t prev_hi;
+    uint8_t borrow;
+    uint8_t lo_next;
+    uint32_t pos;
+    uint32_t end;
+    uint32_t bytes_in;
+    uint32_t bytes_out;
+    uint8_t out[LZ_STREAM_HEADER_SIZE + LZ_STREAM_GROUP_MAX];
+    uint8_t out_pos;
+    uint8_t out_len;
+    int16_t head[1 << LZ_STREAM_HASH_BITS];
+    int16_t prev[LZ_STREAM_WINDOW + LZ_STREAM_LOOKAHEAD];
+    uint8_t buf[LZ_STREAM_WINDOW + LZ_STREAM_LOOKAHEAD];
+};
+
+/**
+ * @param original_size Bytes read will return in total, LZ_STREAM_SIZE_UNKNOWN if not known
+ */
+void lz_stream_init(struct lz_stream *lz,
+                    uint8_t flags,
+                    uint32_t original_size,
+                    lz_stream_read_fn read,
+                    void *ctx);
+
+/**
+ * @brief Copy up to len bytes of compressed output into out.
+ *
+ * @param is_last Set once the last byte of the stream has been copied
+ * @return Bytes copied, less than len only at the end of the stream
+ */
+size_t lz_stream_read(struct lz_stream *lz, uint8_t *out, size_t len, bool *is_last);
+
+#ifdef __cplusplus
+}
+#endif
@@ -42,6 +42,15 @@
 #define AXP192_VOFF_VOLT_MIN  2600
 #define AXP192_VOFF_VOLT_MAX  3300
 
+#define AXP192_GPIO0_VOLT_STEP 100
+#define AXP192_GPIO0_VOLT_MIN  1800
+
+/* Register field values of voltages in mV, for PMU profiles. Not range checked. */
+#define AXP192_DC_VOLT(mv)      (((mv) - AXP192_DC_VOLT_MIN) / AXP192_DC_VOLT_STEP)
+#define AXP192_LDO_VOLT(mv)     (((mv) - AXP192_LDO_VOLT_MIN) / AXP192_LDO_VOLT_STEP)
+#define AXP192_VOFF_VOLT(mv)    (((mv) - AXP192_VOFF_VOLT_MIN) / AXP192_VOFF_VOLT_STEP)
+#define AXP192_GPIO0_VOLT(mv)   (((mv) - AXP192_GPIO0_VOLT_MIN) / AXP192_GPIO0_VOLT_STEP)
+
 #define AXP192_LDO23_DC123_EXT_CTL_REG 0x12
 #define AXP192_DC1_EN_BIT   (0)
 #define AXP192_DC3_EN_BIT   (1)
@@ -23,23 +23,261 @@
  */
 
 #include "stdint.h"
+#include "string.h"
 #include "i2c_device.h"
 #include "esp_err.h"
+#include "axp192_i2c.h"
 
 #define AXP192_ADDR (0x34)
+#define AXP192_PORT I2C_NUM_1
 
 static I2CDevice_t axp192_device;
 
+/*
+ * Write-through copy of the control registers, so bit-field updates are a
+ * single write instead of a read and a write. Only registers that nothing but
+ * this driver changes are mirrored: the power status, IRQ, ADC, coulomb counter
+ * and GPIO signal state registers are always read from the chip.
+ */
+typedef struct {
+    uint8_t reg;
+    uint8_t length;
+} Axp192_RegRange_t;
+
+static const Axp192_RegRange_t shadow_ranges[] = {
+    { 0x10, 3 },    /* EXTEN/DC-DC2 and output power control */
+    { 0x23, 6 },    /* DC-DC and LDO voltages */
+    { 0x30, 7 },    /* VBUS-IPSOUT, VOFF, power off, charge and PEK control */
+    { 0x82, 3 },    /* ADC enable and sample rate */
+    { 0x90, 4 },    /* GPIO0 to GPIO2 function */
+    { 0x95, 1 },    /* GPIO3 and GPIO4 function */
+};
+
+static uint8_t shadow[256];
+static uint8_t shadow_valid[256 / 8];
+
+/* The shadow and stats are only touched as the port's owner, see bus_write() */
+static Axp192_I2CStats_t stats;
+
+static bool is_shadowed(uint8_t reg) {
+    for (size_t i = 0; i < sizeof(shadow_ranges) / sizeof(shadow_ranges[0]); i++) {
+        if (reg >= shadow_ranges[i].reg && reg < shadow_ranges[i].reg + shadow_ranges[i].length) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool shadow_has(uint8_t reg) {
+    return shadow_valid[reg / 8] & (1 << (reg % 8));
+}
+
+/* Mirrors the bytes of a transfer that land in shadowed registers */
+static void shadow_update(uint8_t reg_addr, const uint8_t *data, uint16_t length) {
+    for (uint16_t i = 0; i < length && reg_addr + i < 256; i++) {
+        uint8_t reg = reg_addr + i;
+        if (is_shadowed(reg)) {
+            shadow[reg] = data[i];
+            shadow_valid[reg / 8] |= 1 << (reg % 8);
+        }
+    }
+}
+
+static void shadow_invalidate(uint8_t reg_addr, uint16_t length) {
+    for (uint16_t i = 0; i < length && reg_addr + i < 256; i++) {
+        uint8_t reg = reg_addr + i;
+        shadow_valid[reg / 8] &= ~(1 << (reg % 8));
+    }
+}
+
+/*
+ * Everything below the public functions runs as the port's owner, through
+ * i2c_service_call(), so the port is held across each transfer and its shadow
+ * update, and a read-modify-write never sees a shadow about to change. With
+ * the I2C service running, all of it happens on the service task.
+ */
+static bool bus_write(uint8_t reg_addr, uint8_t *data, uint16_t length) {
+    stats.writes++;
+    if (i2c_write_bytes(axp192_device, reg_addr, data, length) != ESP_OK) {
+        shadow_invalidate(reg_addr, length);
+        return false;
+    }
+    shadow_update(reg_addr, data, length);
+    return true;
+}
+
+static bool bus_read(uint8_t reg_addr, uint8_t *data, uint16_t length) {
+    stats.reads++;
+    if (i2c_read_bytes(axp192_device, reg_addr, data, length) != ESP_OK) {
+        return false;
+    }
+    shadow_update(reg_addr, data, length);
+    return true;
+}
+
+static bool read_regs(uint8_t reg_addr, uint8_t *data, uint16_t length) {
+    bool cached = true;
+
+    for (uint16_t i = 0; i < length && cached; i++) {
+        cached = (reg_addr + i < 256) && shadow_has(reg_addr + i);
+    }
+
+    if (cached) {
+        memcpy(data, &shadow[reg_addr], length);
+        stats.shadow_hits++;
+        return true;
+    }
+    return bus_read(reg_addr, data, length);
+}
+
+/* Arguments of the calls below */
+typedef struct {
+    uint8_t reg_addr;
+    uint8_t *data;
+    uint16_t length;
+    uint8_t bit_pos;
+    uint8_t bit_length;
+} Axp192_Access_t;
+
+typedef struct {
+    const Axp192_RegSetting_t *settings;
+    size_t count;
+    int changed;
+} Axp192_Profile_t;
+
+static esp_err_t call_write(void *arg) {
+    Axp192_Access_t *access = arg;
+    return bus_write(access->reg_addr, access->data, access->length) ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t call_read(void *arg) {
+    Axp192_Access_t *access = arg;
+    return read_regs(access->reg_addr, access->data, access->length) ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t call_write_bits(void *arg) {
+    Axp192_Access_t *access = arg;
+    uint8_t data = access->data[0];
+    uint8_t value = 0x00;
+
+    if (read_regs(access->reg_addr, &value, 1) == false) {
+        return ESP_FAIL;
+    }
+
+    value &= ~(((1 << access->bit_length) - 1) << access->bit_pos);
+    data &= (1 << access->bit_length) - 1;
+    value |= data << access->bit_pos;
+
+    return bus_write(access->reg_addr, &value, 1) ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t call_shadow_load(void *arg) {
+    uint8_t buf[8];
+
+    memset(shadow_valid, 0, sizeof(shadow_valid));
+    for (size_t i = 0; i < sizeof(shadow_ranges) / sizeof(shadow_ranges[0]); i++) {
+        bus_read(shadow_ranges[i].reg, buf, shadow_ranges[i].length);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t call_get_stats(void *arg) {
+    *(Axp192_I2CStats_t *)arg = stats;
+    return ESP_OK;
+}
+
+static esp_err_t call_apply_profile(void *arg) {
+    Axp192_Profile_t *profile = arg;
+    const Axp192_RegSetting_t *settings = profile->settings;
+    /* Register, value read and value wanted, in the order first listed */
+    uint8_t regs[AXP192_PROFILE_MAX_REGS];
+    uint8_t current[AXP192_PROFILE_MAX_REGS];
+    uint8_t target[AXP192_PROFILE_MAX_REGS];
+    size_t num_regs = 0;
+
+    profile->changed = -1;
+
+    for (size_t i = 0; i < profile->count; i++) {
+        size_t r = 0;
+        while (r < num_regs && regs[r] != settings[i].reg) {
+            r++;
+        }
+
+        if (r == num_regs) {
+            if (num_regs == AXP192_PROFILE_MAX_REGS ||
+                !read_regs(settings[i].reg, &current[r], 1)) {
+                return ESP_FAIL;
+            }
+            regs[r] = settings[i].reg;
+            target[r] = current[r];
+            num_regs++;
+        }
+
+        target[r] = (target[r] & ~settings[i].mask) | (settings[i].value & settings[i].mask);
+    }
+
+    /*
+     * The AXP192 takes alternating register addresses and values in one write,
+     * so every change goes out in a single transfer: reg, value, reg, value...
+     * The first address is the one i2c_write_bytes() sends.
+     */
+    uint8_t pairs[2 * AXP192_PROFILE_MAX_REGS];
+    size_t len = 0;
+    for (size_t r = 0; r < num_regs; r++) {
+        if (target[r] != current[r]) {
+            pairs[len++] = regs[r];
+            pairs[len++] = target[r];
+        }
+    }
+
+    if (len > 0) {
+        stats.writes++;
+        if (i2c_write_bytes(axp192_device, pairs[0], &pairs[1], len - 1) != ESP_OK) {
+            for (size_t i = 0; i < len; i += 2) {
+                shadow_invalidate(pairs[i], 1);
+            }
+            return ESP_FAIL;
+        }
+        for (size_t i = 0; i < len; i += 2) {
+            shadow_update(pairs[i], &pairs[i + 1], 1);
+        }
+    }
+
+    profile->changed = len / 2;
+    return ESP_OK;
+}
+
+static esp_err_t call(esp_err_t (*fn)(void *arg), void *arg) {
+    return i2c_service_call(AXP192_PORT, I2C_SERVICE_NORMAL, fn, arg);
+}
+
 void Axp192_I2CInit() {
-    axp192_device = i2c_malloc_device(I2C_NUM_1, 21, 22, 400000, AXP192_ADDR);
+    axp192_device = i2c_malloc_device(AXP192_PORT, 21, 22, 400000, AXP192_ADDR);
+    Axp192_ShadowLoad();
+}
+
+void Axp192_ShadowLoad() {
+    call(call_shadow_load, NULL);
+}
+
+void Axp192_GetI2CStats(Axp192_I2CStats_t *out) {
+    call(call_get_stats, out);
 }
 
 bool Axp192_WriteBytes(uint8_t reg_addr, uint8_t *data, uint16_t length) {
-    return i2c_write_bytes(axp192_device, reg_addr, data, length) == ESP_OK;
+    Axp192_Access_t access = { .reg_addr = reg_addr, .data = data, .length = length };
+    return call(call_write, &access) == ESP_OK;
 }
 
 bool Axp192_ReadBytes(uint8_t reg_addr, uint8_t *data, uint16_t length) {
-    return i2c_read_bytes(axp192_device, reg_addr, data, length) == ESP_OK;
+    Axp192_Access_t access = { .reg_addr = reg_addr, .data = data, .length = length };
+    return call(call_read, &access) == ESP_OK;
+}
+
+int Axp192_ApplyProfile(const Axp192_RegSetting_t *settings, size_t count) {
+    Axp192_Profile_t profile = { .settings = settings, .count = count };
+    call(call_apply_profile, &profile);
+    return profile.changed;
 }
 
 void Axp192_Write8Bit(uint8_t reg_addr, uint8_t value) {
@@ -51,16 +289,31 @@ void Axp192_WriteBits(uint8_t reg_addr, uint8_t data, uint8_t bit_pos, uint8_t b
         return ;
     }
 
-    uint8_t value = 0x00;
-    if (Axp192_ReadBytes(reg_addr, &value, 1) == false) {
-        return ;
-    }
+    Axp192_Access_t access = {
+        .reg_addr = reg_addr,
+        .data = &data,
+        .length = 1,
+        .bit_pos = bit_pos,
+        .bit_length = bit_length,
+    };
+    call(call_write_bits, &access);
+}
 
-    value &= ~(((1 << bit_length) - 1) << bit_pos);
-    data &= (1 << bit_length) - 1;
-    value |= data << bit_pos;
+/* Runs on the service task, with the port taken */
+static esp_err_t service_run(struct i2c_service_xfer *xfer) {
+    bool ok = xfer->write ? bus_write(xfer->reg_addr, xfer->data, xfer->length)
+                          : read_regs(xfer->reg_addr, xfer->data, xfer->length);
+    return ok ? ESP_OK : ESP_FAIL;
+}
 
-    Axp192_WriteBytes(reg_addr, &value, 1);
+esp_err_t Axp192_SubmitXfer(struct i2c_service_xfer *xfer, enum i2c_service_prio prio) {
+    if (xfer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xfer->device = axp192_device;
+    xfer->run = service_run;
+    return i2c_service_submit(xfer, prio);
 }
 
 uint8_t Axp192_Read8Bit(uint8_t reg_addr) {
@@ -107,8 +360,8 @@ uint32_t Axp192_Read24Bit(uint8_t reg_addr) {
 
 uint32_t Axp192_Read32Bit(uint8_t reg_addr) {
     uint8_t buf[4];
-    if (Axp192_ReadBytes(reg_addr, buf, 3)) {
-        return (buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+    if (Axp192_ReadBytes(reg_addr, buf, 4)) {
+        return ((uint32_t)buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
     } else {
         return 0;
     }
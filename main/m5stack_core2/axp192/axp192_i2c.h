@@ -28,12 +28,69 @@
 extern "C" {
 #endif
 
+#include "stdbool.h"
+#include "stddef.h"
 #include "stdint.h"
+#include "i2c_service.h"
+
+/** @brief Most distinct registers one profile can set. */
+#define AXP192_PROFILE_MAX_REGS 32
+
+/**
+ * @brief I2C traffic to the AXP192 since boot.
+ */
+typedef struct {
+    uint32_t reads;       /**< @brief Read transfers on the bus. */
+    uint32_t writes;      /**< @brief Write transfers on the bus. */
+    uint32_t shadow_hits; /**< @brief Reads served from the register shadow. */
+} Axp192_I2CStats_t;
+
+/**
+ * @brief One entry of a PMU profile: the bits of mask in reg are set to value.
+ */
+typedef struct {
+    uint8_t reg;
+    uint8_t mask;
+    uint8_t value;
+} Axp192_RegSetting_t;
+
+/**
+ * @brief Sets up the AXP192's I2C device and loads the register shadow.
+ *
+ * Once an I2C service runs on the AXP192's port, as m5stack_core2_init_pmu()
+ * starts it, the functions below run on the service task and wait for it.
+ */
 void Axp192_I2CInit();
 
-void Axp192_WriteBytes(uint8_t reg_addr, uint8_t *data, uint16_t length);
+/**
+ * @brief Reloads the shadow of the control registers from the chip, one burst
+ * read per register range.
+ *
+ * Needed only if something other than this driver changed them.
+ */
+void Axp192_ShadowLoad();
+
+void Axp192_GetI2CStats(Axp192_I2CStats_t *stats);
+
+bool Axp192_WriteBytes(uint8_t reg_addr, uint8_t *data, uint16_t length);
 
-void Axp192_ReadBytes(uint8_t reg_addr, uint8_t *data, uint16_t length);
+/**
+ * @brief Reads registers, from the shadow when all of them are shadowed.
+ */
+bool Axp192_ReadBytes(uint8_t reg_addr, uint8_t *data, uint16_t length);
+
+/**
+ * @brief Brings the registers of a profile to the values it lists.
+ *
+ * Entries for the same register are merged, later ones winning. Current values
+ * come from the shadow where possible. Registers that already hold their
+ * value are left alone, the rest are written in one I2C transfer, in the order
+ * the profile first lists them.
+ *
+ * @return Number of registers written, -1 on a bus error or a profile of more
+ * than AXP192_PROFILE_MAX_REGS registers
+ */
+int Axp192_ApplyProfile(const Axp192_RegSetting_t *settings, size_t count);
 
 void Axp192_Write8Bit(uint8_t reg_addr, uint8_t value);
 
@@ -51,6 +108,16 @@ uint32_t Axp192_Read24Bit(uint8_t reg_addr);
 
 uint32_t Axp192_Read32Bit(uint8_t reg_addr);
 
+/**
+ * @brief Queues a register transfer with the I2C service of the AXP192's port.
+ *
+ * The transfer runs as Axp192_WriteBytes() or Axp192_ReadBytes() would, so the
+ * shadow stays in step with the chip, but the caller does not wait for it.
+ * Sets xfer->device and xfer->run. The service must have been started with
+ * i2c_service_start().
+ */
+esp_err_t Axp192_SubmitXfer(struct i2c_service_xfer *xfer, enum i2c_service_prio prio);
+
 
 #ifdef __cplusplus
 }
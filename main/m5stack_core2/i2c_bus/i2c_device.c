@@ -30,6 +30,7 @@
 #include "esp_err.h"
 
 #include "i2c_device.h"
+#include "i2c_service.h"
 
 #define TAG "I2C-DEVICE"
 
@@ -60,9 +61,20 @@ typedef struct _i2c_port_obj_t {
     uint32_t freq;
 } i2c_port_obj_t;
 
+/*
+ * Room for the longest command list built here, a register address write
+ * followed by a read
+ */
+#define I2C_CMD_BUF_SIZE I2C_LINK_RECOMMENDED_SIZE(2)
+
 typedef struct _i2c_device_t {
     i2c_port_obj_t* i2c_port;
     uint8_t addr;
+    /*
+     * Command list of the transfer in progress, only used with the bus taken, so
+     * register accesses do not allocate a command link each
+     */
+    uint8_t cmd_buf[I2C_CMD_BUF_SIZE] __attribute__((aligned(sizeof(void *))));
 } i2c_device_t;
 
 static SemaphoreHandle_t i2c_mutex[I2C_NUM_MAX];
@@ -93,6 +105,7 @@ I2CDevice_t i2c_malloc_device(i2c_port_t i2c_num, gpio_num_t sda, gpio_num_t scl
 
     i2c_device_t* device = (i2c_device_t *)malloc(sizeof(i2c_device_t));
     if (device == NULL) {
+        free(new_device_port);
         return NULL;
     }
 
@@ -108,8 +121,19 @@ void i2c_free_device(I2CDevice_t i2c_device) {
     if (i2c_device == NULL) {
         return ;
     }
-    free(((i2c_device_t *)i2c_device)->i2c_port);
-    free(i2c_device);
+
+    i2c_device_t* device = (i2c_device_t *)i2c_device;
+    i2c_port_t port = device->i2c_port->port;
+
+    /* The next i2c_apply_bus() must not compare against the freed port */
+    xSemaphoreTakeRecursive(i2c_mutex[port], portMAX_DELAY);
+    if (i2c_port_used[port] == device->i2c_port) {
+        i2c_port_used[port] = NULL;
+    }
+    xSemaphoreGiveRecursive(i2c_mutex[port]);
+
+    free(device->i2c_port);
+    free(device);
 }
 
 BaseType_t i2c_take_port(i2c_port_t i2c_num, uint32_t timeout) {
@@ -117,6 +141,12 @@ BaseType_t i2c_take_port(i2c_port_t i2c_num, uint32_t timeout) {
         return pdFAIL;
     }
 
+    /* The service would wait for the port while the holder waits for the service */
+    if (i2c_service_owns(i2c_num)) {
+        log_e("Port %d is owned by its I2C service, use i2c_service_call()", i2c_num);
+        return pdFAIL;
+    }
+
     return xSemaphoreTakeRecursive(i2c_mutex[i2c_num], timeout);
 }
 
@@ -134,6 +164,11 @@ esp_err_t i2c_apply_bus(I2CDevice_t i2c_device) {
     }
 
     i2c_device_t* device = (i2c_device_t *)i2c_device;
+    if (i2c_service_owns(device->i2c_port->port)) {
+        log_e("Port %d is owned by its I2C service, use i2c_service_call()", device->i2c_port->port);
+        return ESP_ERR_INVALID_STATE;
+    }
+
     xSemaphoreTakeRecursive(i2c_mutex[device->i2c_port->port], portMAX_DELAY);
     i2c_port_obj_t* used_port = i2c_port_used[device->i2c_port->port];
 
@@ -183,14 +218,66 @@ esp_err_t i2c_free_bus(I2CDevice_t i2c_device) {
     return (xSemaphoreGiveRecursive(i2c_mutex[device->i2c_port->port]) == pdTRUE) ? ESP_OK : ESP_FAIL;
 }
 
+typedef esp_err_t (*i2c_xfer_fn_t)(I2CDevice_t i2c_device, uint32_t reg_addr, uint8_t *data, uint16_t length);
+
+typedef struct {
+    i2c_xfer_fn_t fn;
+    I2CDevice_t device;
+    uint32_t reg_addr;
+    uint8_t *data;
+    uint16_t length;
+} i2c_forward_t;
+
+static esp_err_t i2c_forward_run(void *arg) {
+    i2c_forward_t *forward = (i2c_forward_t *)arg;
+    return forward->fn(forward->device, forward->reg_addr, forward->data, forward->length);
+}
+
+/* Has the I2C service owning the device's port make the transfer, see i2c_service.h */
+static esp_err_t i2c_forward(i2c_xfer_fn_t fn, i2c_device_t* device, uint32_t reg_addr, uint8_t *data, uint16_t length) {
+    i2c_forward_t forward = {
+        .fn = fn,
+        .device = device,
+        .reg_addr = reg_addr,
+        .data = data,
+        .length = length,
+    };
+    return i2c_service_call(device->i2c_port->port, I2C_SERVICE_NORMAL, i2c_forward_run, &forward);
+}
+
+/* Takes the bus and starts a command list in the device's buffer */
+static i2c_cmd_handle_t i2c_cmd_start(i2c_device_t* device) {
+    i2c_apply_bus(device);
+
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(device->cmd_buf, sizeof(device->cmd_buf));
+    if (cmd == NULL) {
+        i2c_free_bus(device);
+    }
+    return cmd;
+}
+
+/* Runs the command list and gives the bus back */
+static esp_err_t i2c_cmd_run(i2c_device_t* device, i2c_cmd_handle_t cmd) {
+    esp_err_t err = i2c_master_cmd_begin(device->i2c_port->port, cmd, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
+    i2c_cmd_link_delete_static(cmd);
+    i2c_free_bus(device);
+    return err;
+}
+
 esp_err_t i2c_read_bytes(I2CDevice_t i2c_device, uint32_t reg_addr, uint8_t *data, uint16_t length) {
     if (i2c_device == NULL || (length > 0 && data == NULL)) {
         return ESP_ERR_INVALID_ARG;
     }
 
     i2c_device_t* device = (i2c_device_t *)i2c_device;
+    if (i2c_service_owns(device->i2c_port->port)) {
+        return i2c_forward(i2c_read_bytes, device, reg_addr, data, length);
+    }
 
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    i2c_cmd_handle_t cmd = i2c_cmd_start(device);
+    if (cmd == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
 
     if(!(reg_addr & I2C_NO_REG)){
         i2c_master_start(cmd);
@@ -207,13 +294,8 @@ esp_err_t i2c_read_bytes(I2CDevice_t i2c_device, uint32_t reg_addr, uint8_t *dat
         i2c_master_read_byte(cmd, &data[length-1], I2C_MASTER_NACK);
     }
     i2c_master_stop(cmd);
-    i2c_apply_bus(i2c_device);
 
-    esp_err_t err = ESP_FAIL;
-
-    err = i2c_master_cmd_begin(device->i2c_port->port, cmd, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
-    i2c_free_bus(i2c_device);
-    i2c_cmd_link_delete(cmd);
+    esp_err_t err = i2c_cmd_run(device, cmd);
 
     if (err != ESP_OK) {
         log_e("I2C Read Error: 0x%02x, reg: 0x%02x, length: %d, Code: 0x%x", device->addr, reg_addr, length, err);
@@ -231,8 +313,14 @@ esp_err_t i2c_read_bytes_no_stop(I2CDevice_t i2c_device, uint32_t reg_addr, uint
     }
 
     i2c_device_t* device = (i2c_device_t *)i2c_device;
+    if (i2c_service_owns(device->i2c_port->port)) {
+        return i2c_forward(i2c_read_bytes_no_stop, device, reg_addr, data, length);
+    }
 
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+    i2c_cmd_handle_t cmd = i2c_cmd_start(device);
+    if (cmd == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
 
     if(!(reg_addr & I2C_NO_REG)){
         i2c_master_start(cmd);
@@ -249,13 +337,8 @@ esp_err_t i2c_read_bytes_no_stop(I2CDevice_t i2c_device, uint32_t reg_addr, uint
         i2c_master_read_byte(cmd, &data[length-1], I2C_MASTER_NACK);
     }
     i2c_master_stop(cmd);
-    i2c_apply_bus(i2c_device);
 
-    esp_err_t err = ESP_FAIL;
-
-    err = i2c_master_cmd_begin(device->i2c_port->port, cmd, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
-    i2c_free_bus(i2c_device);
-    i2c_cmd_link_delete(cmd);
+    esp_err_t err = i2c_cmd_run(device, cmd);
 
     if (err != ESP_OK) {
         log_e("I2C Read Error: 0x%02x, reg: 0x%02x, length: %d, Code: 0x%x", device->addr, reg_addr, length, err);
@@ -311,8 +394,15 @@ esp_err_t i2c_write_bytes(I2CDevice_t i2c_device, uint32_t reg_addr, uint8_t *da
     }
 
     i2c_device_t* device = (i2c_device_t *)i2c_device;
+    if (i2c_service_owns(device->i2c_port->port)) {
+        return i2c_forward(i2c_write_bytes, device, reg_addr, data, length);
+    }
+
+    i2c_cmd_handle_t write_cmd = i2c_cmd_start(device);
+    if (write_cmd == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
 
-    i2c_cmd_handle_t write_cmd = i2c_cmd_link_create();
     i2c_master_start(write_cmd);
     i2c_master_write_byte(write_cmd, (device->addr << 1) | I2C_MASTER_WRITE, 1);
     if(!(reg_addr & I2C_NO_REG)){
@@ -323,13 +413,7 @@ esp_err_t i2c_write_bytes(I2CDevice_t i2c_device, uint32_t reg_addr, uint8_t *da
     }
     i2c_master_stop(write_cmd);
 
-    esp_err_t err = ESP_FAIL;
-
-    i2c_apply_bus(i2c_device);
-    err = i2c_master_cmd_begin(device->i2c_port->port, write_cmd, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
-    i2c_free_bus(i2c_device);
-
-    i2c_cmd_link_delete(write_cmd);
+    esp_err_t err = i2c_cmd_run(device, write_cmd);
 
     if (err != ESP_OK) {
         log_e("I2C Write Error, addr: 0x%02x, reg: 0x%02x, length: %d, Code: 0x%x", device->addr, reg_addr, length, err);
@@ -396,24 +480,35 @@ esp_err_t i2c_device_change_freq(I2CDevice_t i2c_device, uint32_t freq) {
     return ESP_OK;
 }
 
+static esp_err_t i2c_device_valid_run(I2CDevice_t i2c_device, uint32_t reg_addr, uint8_t *data, uint16_t length) {
+    return i2c_device_valid(i2c_device);
+}
+
 esp_err_t i2c_device_valid(I2CDevice_t i2c_device) {
     if (i2c_device == NULL ) {
         return ESP_FAIL;
     }
 
     i2c_device_t* device = (i2c_device_t *)i2c_device;
+    if (i2c_service_owns(device->i2c_port->port)) {
+        return i2c_forward(i2c_device_valid_run, device, I2C_NO_REG, NULL, 0);
+    }
+
+    i2c_cmd_handle_t write_cmd = i2c_cmd_start(device);
+    if (write_cmd == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
 
-    i2c_cmd_handle_t write_cmd = i2c_cmd_link_create();
     i2c_master_start(write_cmd);
     i2c_master_write_byte(write_cmd, (device->addr << 1) | I2C_MASTER_WRITE, 1);
     i2c_master_stop(write_cmd);
 
-    esp_err_t err = ESP_FAIL;
-
-    i2c_apply_bus(i2c_device);
-    err = i2c_master_cmd_begin(device->i2c_port->port, write_cmd, pdMS_TO_TICKS(I2C_TIMEOUT_MS));
-    i2c_free_bus(i2c_device);
+    return i2c_cmd_run(device, write_cmd);
+}
 
-    i2c_cmd_link_delete(write_cmd);
-    return err;
+i2c_port_t i2c_device_port(I2CDevice_t i2c_device) {
+    if (i2c_device == NULL) {
+        return I2C_NUM_MAX;
+    }
+    return ((i2c_device_t *)i2c_device)->i2c_port->port;
 }
@@ -111,6 +111,13 @@ esp_err_t i2c_write_bits(I2CDevice_t i2c_device, uint32_t reg_addr, uint8_t data
 
 esp_err_t i2c_device_valid(I2CDevice_t i2c_device);
 
+i2c_port_t i2c_device_port(I2CDevice_t i2c_device);
+
+/*
+    On a port owned by an I2C service (i2c_service.h), the transfers above
+    made by other tasks run on the service task, and i2c_take_port() and
+    i2c_apply_bus() fail for them: use i2c_service_call() instead.
+*/
 BaseType_t i2c_take_port(i2c_port_t i2c_num, uint32_t timeout);
 
 BaseType_t i2c_free_port(i2c_port_t i2c_num);
@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "i2c_service.h"
+
+#define TAG "I2C-SERVICE"
+
+/* Transfers each priority can have queued */
+#define I2C_SERVICE_QUEUE_LEN (16)
+#define I2C_SERVICE_STACK_SIZE (3072)
+
+struct i2c_service {
+    i2c_port_t port;
+    TaskHandle_t task;
+    /* Queued struct i2c_service_xfer pointers, one queue per priority */
+    QueueHandle_t queues[I2C_SERVICE_NUM_PRIOS];
+    /* Given once per queued transfer */
+    SemaphoreHandle_t wake;
+    portMUX_TYPE stats_lock;
+    struct i2c_service_stats stats[I2C_SERVICE_NUM_PRIOS];
+};
+
+/* A function run by i2c_service_call() */
+struct i2c_service_job {
+    esp_err_t (*fn)(void *arg);
+    void *arg;
+};
+
+static struct i2c_service *services[I2C_NUM_MAX];
+
+static void update_stats(struct i2c_service *svc, enum i2c_service_prio prio,
+                         const struct i2c_service_xfer *xfer, int64_t start_us) {
+    struct i2c_service_stats *stats = &svc->stats[prio];
+    uint32_t wait_us = start_us - xfer->submit_us;
+    uint32_t latency_us = xfer->done_us - xfer->submit_us;
+
+    portENTER_CRITICAL(&svc->stats_lock);
+    stats->completed++;
+    if (xfer->err != ESP_OK) {
+        stats->failed++;
+    }
+    if (wait_us > stats->max_wait_us) {
+        stats->max_wait_us = wait_us;
+    }
+    if (latency_us > stats->max_latency_us) {
+        stats->max_latency_us = latency_us;
+    }
+    portEXIT_CRITICAL(&svc->stats_lock);
+}
+
+static void run_xfer(struct i2c_service_xfer *xfer) {
+    if (xfer->run) {
+        xfer->err = xfer->run(xfer);
+    } else if (xfer->write) {
+        xfer->err = i2c_write_bytes(xfer->device, xfer->reg_addr, xfer->data, xfer->length);
+    } else {
+        xfer->err = i2c_read_bytes(xfer->device, xfer->reg_addr, xfer->data, xfer->length);
+    }
+}
+
+static void service_task(void *arg) {
+    struct i2c_service *svc = arg;
+
+    while (true) {
+        struct i2c_service_xfer *xfer = NULL;
+        enum i2c_service_prio prio;
+
+        xSemaphoreTake(svc->wake, portMAX_DELAY);
+
+        /* Every give matches a queued transfer, so one of the queues has it */
+        for (prio = 0; prio < I2C_SERVICE_NUM_PRIOS; prio++) {
+            if (xQueueReceive(svc->queues[prio], &xfer, 0) == pdPASS) {
+                break;
+            }
+        }
+        if (xfer == NULL) {
+            continue;
+        }
+
+        int64_t start_us = esp_timer_get_time();
+
+        i2c_take_port(svc->port, portMAX_DELAY);
+        run_xfer(xfer);
+        i2c_free_port(svc->port);
+        xfer->done_us = esp_timer_get_time();
+
+        update_stats(svc, prio, xfer, start_us);
+
+        /* The submitter may reuse xfer as soon as it sees it done */
+        SemaphoreHandle_t done_sem = xfer->done_sem;
+        if (xfer->done) {
+            xfer->done(xfer);
+        }
+        if (done_sem) {
+            xSemaphoreGive(done_sem);
+        }
+    }
+}
+
+static esp_err_t queue_xfer(struct i2c_service *svc, struct i2c_service_xfer *xfer,
+                            enum i2c_service_prio prio, TickType_t timeout) {
+    xfer->err = ESP_ERR_INVALID_STATE;
+    xfer->submit_us = esp_timer_get_time();
+    xfer->done_us = 0;
+
+    if (xQueueSend(svc->queues[prio], &xfer, timeout) != pdPASS) {
+        portENTER_CRITICAL(&svc->stats_lock);
+        svc->stats[prio].rejected++;
+        portEXIT_CRITICAL(&svc->stats_lock);
+        return ESP_ERR_NO_MEM;
+    }
+
+    xSemaphoreGive(svc->wake);
+    return ESP_OK;
+}
+
+static void delete_service(struct i2c_service *svc) {
+    for (int prio = 0; prio < I2C_SERVICE_NUM_PRIOS; prio++) {
+        if (svc->queues[prio]) {
+            vQueueDelete(svc->queues[prio]);
+        }
+    }
+    if (svc->wake) {
+        vSemaphoreDelete(svc->wake);
+    }
+    free(svc);
+}
+
+esp_err_t i2c_service_start(i2c_port_t i2c_num, UBaseType_t priority) {
+    if (i2c_num >= I2C_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (services[i2c_num]) {
+        return ESP_OK;
+    }
+
+    struct i2c_service *svc = calloc(1, sizeof(struct i2c_service));
+    if (svc == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    svc->port = i2c_num;
+    svc->stats_lock = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
+    svc->wake = xSemaphoreCreateCounting(I2C_SERVICE_NUM_PRIOS * I2C_SERVICE_QUEUE_LEN, 0);
+    bool created = svc->wake != NULL;
+    for (int prio = 0; prio < I2C_SERVICE_NUM_PRIOS; prio++) {
+        svc->queues[prio] = xQueueCreate(I2C_SERVICE_QUEUE_LEN, sizeof(struct i2c_service_xfer *));
+        created = created && svc->queues[prio];
+    }
+
+    if (!created ||
+        xTaskCreate(service_task, "i2c_service", I2C_SERVICE_STACK_SIZE, svc, priority,
+                    &svc->task) != pdPASS) {
+        ESP_LOGE(TAG, "Unable to start the service of port %d", i2c_num);
+        delete_service(svc);
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* Transfers only reach the task once it is published */
+    services[i2c_num] = svc;
+    return ESP_OK;
+}
+
+bool i2c_service_owns(i2c_port_t i2c_num) {
+    if (i2c_num >= I2C_NUM_MAX || services[i2c_num] == NULL) {
+        return false;
+    }
+    return services[i2c_num]->task != xTaskGetCurrentTaskHandle();
+}
+
+static esp_err_t run_job(struct i2c_service_xfer *xfer) {
+    struct i2c_service_job *job = xfer->arg;
+    return job->fn(job->arg);
+}
+
+esp_err_t i2c_service_call(i2c_port_t i2c_num, enum i2c_service_prio prio,
+                           esp_err_t (*fn)(void *arg), void *arg) {
+    if (i2c_num >= I2C_NUM_MAX || prio >= I2C_SERVICE_NUM_PRIOS || fn == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!i2c_service_owns(i2c_num)) {
+        i2c_take_port(i2c_num, portMAX_DELAY);
+        esp_err_t err = fn(arg);
+        i2c_free_port(i2c_num);
+        return err;
+    }
+
+    /* Static, so a call does not allocate */
+    StaticSemaphore_t done_buf;
+    struct i2c_service_job job = {
+        .fn = fn,
+        .arg = arg,
+    };
+    struct i2c_service_xfer xfer = {
+        .run = run_job,
+        .arg = &job,
+        .done_sem = xSemaphoreCreateBinaryStatic(&done_buf),
+    };
+
+    /* Waits for room rather than fail, as a direct call would wait for the bus */
+    queue_xfer(services[i2c_num], &xfer, prio, portMAX_DELAY);
+    xSemaphoreTake(xfer.done_sem, portMAX_DELAY);
+    vSemaphoreDelete(xfer.done_sem);
+
+    return xfer.err;
+}
+
+esp_err_t i2c_service_submit(struct i2c_service_xfer *xfer, enum i2c_service_prio prio) {
+    if (xfer == NULL || prio >= I2C_SERVICE_NUM_PRIOS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    i2c_port_t port = i2c_device_port(xfer->device);
+    if (port >= I2C_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (services[port] == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    return queue_xfer(services[port], xfer, prio, 0);
+}
+
+void i2c_service_get_stats(i2c_port_t i2c_num, enum i2c_service_prio prio,
+                           struct i2c_service_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+
+    if (i2c_num >= I2C_NUM_MAX || prio >= I2C_SERVICE_NUM_PRIOS || services[i2c_num] == NULL) {
+        return;
+    }
+
+    struct i2c_service *svc = services[i2c_num];
+
+    portENTER_CRITICAL(&svc->stats_lock);
+    *stats = svc->stats[prio];
+    portEXIT_CRITICAL(&svc->stats_lock);
+}
+
+void i2c_service_reset_stats(i2c_port_t i2c_num) {
+    if (i2c_num >= I2C_NUM_MAX || services[i2c_num] == NULL) {
+        return;
+    }
+
+    struct i2c_service *svc = services[i2c_num];
+
+    portENTER_CRITICAL(&svc->stats_lock);
+    memset(svc->stats, 0, sizeof(svc->stats));
+    portEXIT_CRITICAL(&svc->stats_lock);
+}
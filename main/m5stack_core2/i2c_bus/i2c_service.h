@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "i2c_device.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A service task that owns an I2C port. Once it runs, it is the only task
+ * putting transfers on the port: the transfer functions of i2c_device.h
+ * called from any other task hand their transfer to it and wait, and drivers
+ * run sequences that must not be split, like a read-modify-write, with
+ * i2c_service_call(). Urgent work runs before any normal work still queued,
+ * so an urgent write waits at most for the job already on the bus.
+ *
+ * i2c_service_submit() queues a transfer without waiting for it, for tasks
+ * that must not stall behind another device's traffic.
+ */
+
+enum i2c_service_prio {
+    /* Control writes that must not wait behind polling */
+    I2C_SERVICE_URGENT,
+    /* Telemetry reads and anything else */
+    I2C_SERVICE_NORMAL,
+    I2C_SERVICE_NUM_PRIOS,
+};
+
+struct i2c_service_xfer;
+
+typedef void (*i2c_service_done_fn)(struct i2c_service_xfer *xfer);
+
+/*
+ * A transfer owned by the submitter, which must keep it and its data valid
+ * until it completes. Completion calls done, on the service task, and gives
+ * done_sem. Both are optional.
+ *
+ * run, when set, performs the transfer instead of i2c_read_bytes() or
+ * i2c_write_bytes(), for drivers that keep state in step with the device. It
+ * runs with the port taken. Registers a driver caches, like the AXP192's
+ * shadowed control registers, must only be written through that driver: see
+ * Axp192_SubmitXfer().
+ */
+struct i2c_service_xfer {
+    I2CDevice_t device;
+    uint32_t reg_addr;
+    uint8_t *data;
+    uint16_t length;
+    bool write;
+    esp_err_t (*run)(struct i2c_service_xfer *xfer);
+    i2c_service_done_fn done;
+    SemaphoreHandle_t done_sem;
+    void *arg;
+    /* Set by the service: the result, and when it was submitted and completed */
+    esp_err_t err;
+    int64_t submit_us;
+    int64_t done_us;
+};
+
+struct i2c_service_stats {
+    uint32_t completed;
+    uint32_t failed;
+    /* Transfers refused because the queue was full */
+    uint32_t rejected;
+    /* Longest time from submission to the start and to the end of a transfer */
+    uint32_t max_wait_us;
+    uint32_t max_latency_us;
+};
+
+/*
+ * Starts the service task of a port, if not already running. Its priority is
+ * best above that of the tasks using the port.
+ */
+esp_err_t i2c_service_start(i2c_port_t i2c_num, UBaseType_t priority);
+
+/*
+ * True when a service owns the port and the caller is not its task, so its
+ * transfers must go through the service.
+ */
+bool i2c_service_owns(i2c_port_t i2c_num);
+
+/*
+ * Runs fn(arg) with the port taken and returns its result. With a service on
+ * the port, fn runs on the service task and the caller waits for it; without
+ * one, or when called from the service task, it runs on the caller's task.
+ */
+esp_err_t i2c_service_call(i2c_port_t i2c_num, enum i2c_service_prio prio,
+                           esp_err_t (*fn)(void *arg), void *arg);
+
+/*
+ * Queues a transfer on its device's port without waiting. Returns
+ * ESP_ERR_INVALID_STATE without a service on the port, ESP_ERR_NO_MEM when
+ * the queue is full.
+ */
+esp_err_t i2c_service_submit(struct i2c_service_xfer *xfer, enum i2c_service_prio prio);
+
+void i2c_service_get_stats(i2c_port_t i2c_num, enum i2c_service_prio prio,
+                           struct i2c_service_stats *stats);
+
+void i2c_service_reset_stats(i2c_port_t i2c_num);
+
+#ifdef __cplusplus
+}
+#endif
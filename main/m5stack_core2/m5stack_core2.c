@@ -23,9 +23,14 @@
  * SOFTWARE.
  */
 
+#include <inttypes.h>
 #include "audio.h"
 #include "axp192.h"
+#include "axp192_i2c.h"
+#include "i2c_service.h"
+#include "m5stack_core2_pmu.h"
 #include "esp_err.h"
+#include "esp_timer.h"
 #include "esp_vfs_fat.h"
 #include "driver/i2s_pdm.h"
 #include "driver/sdmmc_host.h"
@@ -37,6 +42,10 @@ static const char *TAG = "m5stack_core2";
 
 #define SPI_DMA_CHAN        SPI_DMA_CH_AUTO
 
+/* The PMU's port, owned by an I2C service task above the pipeline's writers */
+#define PMU_I2C_PORT                I2C_NUM_1
+#define PMU_I2C_SERVICE_PRIORITY    (10)
+
 // When testing SD and SPI modes, keep in mind that once the card has been
 // initialized in SPI mode, it can not be reinitialized in SD mode without
 // toggling power to the card.
@@ -45,45 +54,29 @@ sdmmc_card_t *card;
 
 void m5stack_core2_init_pmu(void)
 {
-    /* LDO2 powers SD card and sreen on the Core2 */
-
-    int ldo2_volt = 3300;
-    int ldo3_volt = 0;
-    int dc2_volt = 0;
-    int dc3_volt = 2700;
+    int64_t start_us = esp_timer_get_time();
 
-    uint8_t value = 0x00;
-    value |= (ldo2_volt > 0) << AXP192_LDO2_EN_BIT;
-    value |= (ldo3_volt > 0) << AXP192_LDO3_EN_BIT;
-    value |= (dc2_volt > 0) << AXP192_DC2_EN_BIT;
-    value |= (dc3_volt > 0) << AXP192_DC3_EN_BIT;
-    value |= 0x01 << AXP192_DC1_EN_BIT;
+    /* From here on every PMU transfer, telemetry included, runs on the service task */
+    if (i2c_service_start(PMU_I2C_PORT, PMU_I2C_SERVICE_PRIORITY) != ESP_OK) {
+        GLTH_LOGE(TAG, "Failed to start the PMU's I2C service");
+    }
 
     Axp192_Init();
+    int changed = Axp192_ApplyProfile(m5stack_core2_pmu_profile, m5stack_core2_pmu_profile_len);
+    if (changed < 0) {
+        GLTH_LOGE(TAG, "Failed to apply the PMU profile");
+    }
 
-    Axp192_SetLDO23Volt(ldo2_volt, ldo3_volt);
-    Axp192_SetDCDC2Volt(dc2_volt);
-    Axp192_SetDCDC3Volt(dc3_volt);
-    Axp192_SetVoffVolt(3000);
-    Axp192_SetChargeCurrent(CHARGE_Current_100mA);
-    Axp192_SetChargeVoltage(CHARGE_VOLT_4200mV);
-    Axp192_EnableCharge(1);
-    Axp192_SetPressStartupTime(STARTUP_128mS);
-    Axp192_SetPressPoweroffTime(POWEROFF_4S);
-
-    Axp192_EnableLDODCExt(value);
-    Axp192_SetGPIO4Mode(1);
-    Axp192_SetGPIO2Mode(1);
-    Axp192_SetGPIO2Level(0);
-
-    Axp192_SetGPIO0Volt(3300);
-    Axp192_SetAdc1Enable(0xfe);
-
-    Axp192_SetGPIO0Mode(1);
-    Axp192_EnableExten(1);
-
-    /* Power LED */
-    Axp192_SetGPIO1Mode(0);
+    Axp192_I2CStats_t stats;
+    Axp192_GetI2CStats(&stats);
+    GLTH_LOGI(TAG,
+              "PMU init: %d registers changed, %" PRIu32 " I2C reads, %" PRIu32 " writes, %" PRIu32
+              " reads from the shadow, %" PRId64 " us",
+              changed,
+              stats.reads,
+              stats.writes,
+              stats.shadow_hits,
+              esp_timer_get_time() - start_us);
 }
 
 
@@ -143,3 +136,8 @@ int bsp_sdcard_unmount(void)
     // All done, unmount partition and disable SPI peripheral
     return esp_vfs_fat_sdcard_unmount(SD_MOUNT_POINT, card);
 }
+
+sdmmc_card_t *bsp_sdcard_get_card(void)
+{
+    return card;
+}
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "sdmmc_cmd.h"
+
 void m5stack_core2_init_pmu(void);
 int bsp_sdcard_mount(void);
 int bsp_sdcard_unmount(void);
+sdmmc_card_t *bsp_sdcard_get_card(void);
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "axp192.h"
+#include "m5stack_core2_pmu.h"
+
+#define BIT(n) (1 << (n))
+
+const Axp192_RegSetting_t m5stack_core2_pmu_profile[] = {
+    /* LDO2 powers the SD card and screen, LDO3 the vibration motor */
+    {AXP192_LDO23_VOLT_REG, 0xff, (AXP192_LDO_VOLT(3300) << 4) | AXP192_LDO_VOLT(1800)},
+    /* DC-DC3 drives the backlight, DC-DC2 is unused */
+    {AXP192_DC2_VOLT_REG, 0x3f, AXP192_DC_VOLT(700)},
+    {AXP192_DC3_VOLT_REG, 0xff, AXP192_DC_VOLT(2700)},
+    /* Power off below 3.0 V */
+    {AXP192_VOFF_VOLT_REG, 0x07, AXP192_VOFF_VOLT(3000)},
+    /* Charge at 100 mA up to 4.2 V */
+    {AXP192_CHG_CTL1_REG, 0x0f, CHARGE_Current_100mA},
+    {AXP192_CHG_CTL1_REG, 0x60, CHARGE_VOLT_4200mV << 5},
+    {AXP192_CHG_CTL1_REG, 0x80, 0x80},
+    /* Power key: 128 ms press to start, 4 s to power off */
+    {AXP192_PEK_CTL_REG, 0xc0, STARTUP_128mS << 6},
+    {AXP192_PEK_CTL_REG, 0x03, POWEROFF_4S},
+    /* DC-DC1, DC-DC3, LDO2 and the 5 V boost (EXTEN) on, LDO3 and DC-DC2 off */
+    {AXP192_LDO23_DC123_EXT_CTL_REG,
+     0x5f,
+     BIT(AXP192_DC1_EN_BIT) | BIT(AXP192_DC3_EN_BIT) | BIT(AXP192_LDO2_EN_BIT)
+         | BIT(AXP192_EXT_EN_BIT)},
+    /* GPIO4 (LCD reset) as an output */
+    {AXP192_GPIO34_CTL_REG, 0x0c, 0x01 << 2},
+    {AXP192_GPIO34_CTL_REG, 0x80, 0x80},
+    /* GPIO2 (speaker enable) as an open-drain output, low */
+    {AXP192_GPIO2_CTL_REG, 0x07, 0x00},
+    {AXP192_GPIO012_STATE_REG, 0x04, 0x00},
+    /* GPIO0 as a 3.3 V LDO for the microphone */
+    {AXP192_GPIO0_VOLT_REG, 0xf0, AXP192_GPIO0_VOLT(3300) << 4},
+    {AXP192_GPIO0_CTL_REG, 0x0f, 0x02},
+    /* Every ADC but the battery temperature sensor */
+    {AXP192_ADC1_ENABLE_REG, 0xff, 0xfe},
+    /* GPIO1 (power LED) as an open-drain output */
+    {AXP192_GPIO1_CTL_REG, 0x07, 0x00},
+};
+
+const size_t m5stack_core2_pmu_profile_len =
+    sizeof(m5stack_core2_pmu_profile) / sizeof(m5stack_core2_pmu_profile[0]);
@@ -0,0 +1,14 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include "axp192_i2c.h"
+
+/* Power rails and PMU GPIOs of the Core2, applied by m5stack_core2_init_pmu() */
+extern const Axp192_RegSetting_t m5stack_core2_pmu_profile[];
+extern const size_t m5stack_core2_pmu_profile_len;
@@ -0,0 +1,574 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include "raw_store.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#endif
+
+#define RAW_STORE_MAGIC     (0x52415731) /* "RAW1" */
+
+_Static_assert(sizeof(struct raw_store_index) == RAW_STORE_SECTOR_SIZE,
+               "The index must fill exactly one sector");
+
+static void *alloc_buffer(size_t size)
+{
+#ifdef ESP_PLATFORM
+    /* The SD driver bounces buffers it cannot DMA from one sector at a time */
+    void *buf = heap_caps_malloc(size, MALLOC_CAP_DMA);
+    if (buf)
+    {
+        return buf;
+    }
+#endif
+    return malloc(size);
+}
+
+static uint32_t crc32(const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    uint32_t crc = UINT32_MAX;
+
+    while (len--)
+    {
+        crc ^= *p++;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+
+    return ~crc;
+}
+
+static uint32_t index_crc(const struct raw_store_index *index)
+{
+    return crc32(index, offsetof(struct raw_store_index, crc));
+}
+
+static esp_err_t commit(struct raw_store *store)
+{
+    struct raw_store_index *index = &store->index;
+
+    index->sequence++;
+    index->crc = index_crc(index);
+
+    return store->dev.write(store->dev.ctx, index->sequence & 1, index, 1);
+}
+
+static uint32_t data_to_dev(const struct raw_store *store, uint32_t sector)
+{
+    return RAW_STORE_INDEX_SECTORS + sector % store->data_sectors;
+}
+
+static uint32_t num_segments(const struct raw_store *store)
+{
+    return store->data_sectors / store->segment_sectors;
+}
+
+/* Segments an entry covers, at least the one it starts in */
+static uint32_t entry_segments(const struct raw_store *store,
+                               const struct raw_store_entry *entry)
+{
+    uint32_t sectors = (entry == store->active)
+                           ? store->active_sectors
+                           : (entry->length + RAW_STORE_SECTOR_SIZE - 1) / RAW_STORE_SECTOR_SIZE;
+    uint32_t segments = (sectors + store->segment_sectors - 1) / store->segment_sectors;
+
+    return MAX(segments, 1);
+}
+
+static void evict_oldest(struct raw_store *store)
+{
+    struct raw_store_index *index = &store->index;
+
+    if (index->entries[0].state != RAW_STORE_UPLOADED)
+    {
+        store->evicted_unsent++;
+    }
+
+    index->count--;
+    memmove(&index->entries[0], &index->entries[1], index->count * sizeof(index->entries[0]));
+    memset(&index->entries[index->count], 0, sizeof(index->entries[0]));
+
+    if (store->active)
+    {
+        store->active--;
+    }
+}
+
+/* The log only ever wraps onto its oldest recordings */
+static void evict_for_segment(struct raw_store *store, uint32_t segment)
+{
+    struct raw_store_index *index = &store->index;
+    uint32_t segments = num_segments(store);
+
+    while (index->count > 0 && &index->entries[0] != store->active)
+    {
+        const struct raw_store_entry *oldest = &index->entries[0];
+        uint32_t start = oldest->first_sector / store->segment_sectors;
+
+        if ((segment + segments - start) % segments >= entry_segments(store, oldest))
+        {
+            break;
+        }
+
+        evict_oldest(store);
+    }
+}
+
+static struct raw_store_entry *find_entry(struct raw_store *store, uint32_t id)
+{
+    for (uint32_t i = 0; i < store->index.count; i++)
+    {
+        if (store->index.entries[i].id == id)
+        {
+            return &store->index.entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+static bool index_valid(const struct raw_store *store, const struct raw_store_index *index)
+{
+    return index->magic == RAW_STORE_MAGIC && index->crc == index_crc(index)
+           && index->segment_sectors == store->segment_sectors
+           && index->head < store->data_sectors && index->count <= RAW_STORE_MAX_RECORDINGS;
+}
+
+static esp_err_t load_index(struct raw_store *store)
+{
+    struct raw_store_index *copy = (struct raw_store_index *) store->chunk;
+    bool found = false;
+
+    for (uint32_t i = 0; i < RAW_STORE_INDEX_SECTORS; i++)
+    {
+        if (store->dev.read(store->dev.ctx, i, copy, 1) != ESP_OK || !index_valid(store, copy))
+        {
+            continue;
+        }
+
+        if (!found || (int32_t) (copy->sequence - store->index.sequence) > 0)
+        {
+            store->index = *copy;
+            found = true;
+        }
+    }
+
+    if (!found)
+    {
+        return raw_store_format(store);
+    }
+
+    /* A recording cut short by a power loss keeps its committed segments */
+    struct raw_store_index *index = &store->index;
+    bool recovered = false;
+
+    for (uint32_t i = 0; i < index->count; i++)
+    {
+        struct raw_store_entry *entry = &index->entries[i];
+        if (entry->state != RAW_STORE_RECORDING)
+        {
+            continue;
+        }
+
+        uint32_t end = entry->first_sector + entry_segments(store, entry) * store->segment_sectors;
+        index->head = end % store->data_sectors;
+        entry->state = RAW_STORE_COMPLETE;
+        recovered = true;
+    }
+
+    /* Nothing worth uploading was committed */
+    while (index->count > 0 && index->entries[index->count - 1].length == 0)
+    {
+        memset(&index->entries[--index->count], 0, sizeof(index->entries[0]));
+    }
+
+    return recovered ? commit(store) : ESP_OK;
+}
+
+esp_err_t raw_store_open(struct raw_store *store,
+                         const struct raw_store_dev *dev,
+                         uint32_t segment_sectors,
+                         size_t chunk_sectors)
+{
+    memset(store, 0, sizeof(*store));
+    store->dev = *dev;
+
+    if (chunk_sectors == 0 || segment_sectors % chunk_sectors
+        || dev->num_sectors < RAW_STORE_INDEX_SECTORS + 2 * segment_sectors)
+    {
+        raw_store_close(store);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    store->segment_sectors = segment_sectors;
+    store->data_sectors = (dev->num_sectors - RAW_STORE_INDEX_SECTORS) / segment_sectors
+                          * segment_sectors;
+    store->chunk_sectors = chunk_sectors;
+
+    store->chunk = alloc_buffer(chunk_sectors * RAW_STORE_SECTOR_SIZE);
+    store->sector = alloc_buffer(RAW_STORE_SECTOR_SIZE);
+    if (!store->chunk || !store->sector)
+    {
+        raw_store_close(store);
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = load_index(store);
+    if (err != ESP_OK)
+    {
+        raw_store_close(store);
+    }
+
+    return err;
+}
+
+void raw_store_close(struct raw_store *store)
+{
+    if (store->dev.close)
+    {
+        store->dev.close(store->dev.ctx);
+    }
+    free(store->chunk);
+    free(store->sector);
+
+    store->dev.close = NULL;
+    store->chunk = NULL;
+    store->sector = NULL;
+}
+
+esp_err_t raw_store_format(struct raw_store *store)
+{
+    struct raw_store_index *index = &store->index;
+    uint32_t sequence = index->sequence;
+
+    memset(index, 0, sizeof(*index));
+    index->magic = RAW_STORE_MAGIC;
+    index->sequence = sequence;
+    index->next_id = 1;
+    index->segment_sectors = store->segment_sectors;
+    store->active = NULL;
+
+    /* Both copies, so an older one cannot come back */
+    esp_err_t err = commit(store);
+    if (err == ESP_OK)
+    {
+        err = commit(store);
+    }
+
+    return err;
+}
+
+esp_err_t raw_store_begin(struct raw_store *store, uint32_t *id)
+{
+    struct raw_store_index *index = &store->index;
+
+    if (store->active)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (index->count == RAW_STORE_MAX_RECORDINGS)
+    {
+        evict_oldest(store);
+    }
+    evict_for_segment(store, index->head / store->segment_sectors);
+
+    store->active = &index->entries[index->count++];
+    *store->active = (struct raw_store_entry) {
+        .id = index->next_id++,
+        .first_sector = index->head,
+        .state = RAW_STORE_RECORDING,
+    };
+    store->active_bytes = 0;
+    store->active_sectors = 0;
+    store->fill = 0;
+    *id = store->active->id;
+
+    return commit(store);
+}
+
+/* Chunks start chunk-aligned within the recording, so they never cross a segment */
+static esp_err_t write_chunk(struct raw_store *store, size_t count)
+{
+    struct raw_store_entry *active = store->active;
+    esp_err_t err = ESP_OK;
+
+    if (store->active_sectors + count > store->data_sectors)
+    {
+        /* The recording would overwrite its own start */
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (store->active_sectors > 0 && store->active_sectors % store->segment_sectors == 0)
+    {
+        uint32_t sector = (active->first_sector + store->active_sectors) % store->data_sectors;
+
+        evict_for_segment(store, sector / store->segment_sectors);
+        active = store->active;
+        active->length = store->active_sectors * RAW_STORE_SECTOR_SIZE;
+        err = commit(store);
+    }
+
+    esp_err_t write_err = store->dev.write(store->dev.ctx,
+                                           data_to_dev(store,
+                                                       active->first_sector
+                                                           + store->active_sectors),
+                                           store->chunk,
+                                           count);
+
+    /* Offsets in the recording stay put even if the data did not make it */
+    store->active_sectors += count;
+    store->fill = 0;
+
+    return (err != ESP_OK) ? err : write_err;
+}
+
+esp_err_t raw_store_append(struct raw_store *store, const void *data, size_t len)
+{
+    const uint8_t *src = data;
+    size_t chunk_size = store->chunk_sectors * RAW_STORE_SECTOR_SIZE;
+    esp_err_t err = ESP_OK;
+
+    if (!store->active)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    while (len > 0)
+    {
+        size_t n = MIN(len, chunk_size - store->fill);
+
+        memcpy(&store->chunk[store->fill], src, n);
+        store->fill += n;
+        store->active_bytes += n;
+        src += n;
+        len -= n;
+
+        if (store->fill == chunk_size)
+        {
+            esp_err_t chunk_err = write_chunk(store, store->chunk_sectors);
+            if (chunk_err == ESP_ERR_NO_MEM)
+            {
+                /* The chunk is dropped, the recording ends where the store is full */
+                store->active_bytes -= store->fill;
+                store->fill = 0;
+                return chunk_err;
+            }
+            err = (err != ESP_OK) ? err : chunk_err;
+        }
+    }
+
+    return err;
+}
+
+esp_err_t raw_store_end(struct raw_store *store, const void *header, size_t header_len)
+{
+    struct raw_store_entry *active = store->active;
+    esp_err_t err = ESP_OK;
+
+    if (!active)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (store->fill > 0)
+    {
+        size_t count = (store->fill + RAW_STORE_SECTOR_SIZE - 1) / RAW_STORE_SECTOR_SIZE;
+
+        memset(&store->chunk[store->fill], 0, count * RAW_STORE_SECTOR_SIZE - store->fill);
+        err = write_chunk(store, count);
+        if (err == ESP_ERR_NO_MEM)
+        {
+            store->active_bytes -= store->fill;
+            store->fill = 0;
+        }
+        active = store->active;
+    }
+
+    if (header && header_len <= RAW_STORE_SECTOR_SIZE && store->active_sectors > 0)
+    {
+        uint32_t first = data_to_dev(store, active->first_sector);
+        esp_err_t header_err = store->dev.read(store->dev.ctx, first, store->sector, 1);
+
+        if (header_err == ESP_OK)
+        {
+            memcpy(store->sector, header, header_len);
+            header_err = store->dev.write(store->dev.ctx, first, store->sector, 1);
+        }
+        err = (err != ESP_OK) ? err : header_err;
+    }
+
+    active->length = MIN(store->active_bytes, store->active_sectors * RAW_STORE_SECTOR_SIZE);
+    active->state = RAW_STORE_COMPLETE;
+    store->index.head = (active->first_sector
+                         + entry_segments(store, active) * store->segment_sectors)
+                        % store->data_sectors;
+    store->active = NULL;
+
+    esp_err_t commit_err = commit(store);
+    return (err != ESP_OK) ? err : commit_err;
+}
+
+const struct raw_store_entry *raw_store_next_pending(const struct raw_store *store)
+{
+    for (uint32_t i = 0; i < store->index.count; i++)
+    {
+        const struct raw_store_entry *entry = &store->index.entries[i];
+        if (entry->state == RAW_STORE_COMPLETE && entry->length > 0)
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+esp_err_t raw_store_set_state(struct raw_store *store, uint32_t id, enum raw_store_state state)
+{
+    struct raw_store_entry *entry = find_entry(store, id);
+
+    if (!entry || entry == store->active)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    entry->state = state;
+    return commit(store);
+}
+
+esp_err_t raw_store_read(struct raw_store *store,
+                         uint32_t id,
+                         uint32_t offset,
+                         void *buf,
+                         size_t len,
+                         size_t *read)
+{
+    const struct raw_store_entry *entry = find_entry(store, id);
+    uint8_t *dst = buf;
+
+    *read = 0;
+    if (!entry || entry == store->active)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    len = (offset < entry->length) ? MIN(len, entry->length - offset) : 0;
+
+    while (len > 0)
+    {
+        uint32_t sector = (entry->first_sector + offset / RAW_STORE_SECTOR_SIZE)
+                          % store->data_sectors;
+        size_t skip = offset % RAW_STORE_SECTOR_SIZE;
+        size_t n;
+        esp_err_t err;
+
+        if (skip == 0 && len >= RAW_STORE_SECTOR_SIZE)
+        {
+            /* Whole sectors go straight to the caller, up to the end of the region */
+            size_t count = MIN(len / RAW_STORE_SECTOR_SIZE, store->data_sectors - sector);
+
+            err = store->dev.read(store->dev.ctx, data_to_dev(store, sector), dst, count);
+            n = count * RAW_STORE_SECTOR_SIZE;
+        }
+        else
+        {
+            err = store->dev.read(store->dev.ctx, data_to_dev(store, sector), store->sector, 1);
+            n = MIN(len, RAW_STORE_SECTOR_SIZE - skip);
+            memcpy(dst, &store->sector[skip], n);
+        }
+
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+
+        dst += n;
+        offset += n;
+        len -= n;
+        *read += n;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t file_seek(FILE *f, uint32_t sector)
+{
+    return fseek(f, (long) sector * RAW_STORE_SECTOR_SIZE, SEEK_SET) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t file_read(void *ctx, uint32_t sector, void *buf, size_t count)
+{
+    FILE *f = ctx;
+
+    if (file_seek(f, sector) != ESP_OK || fread(buf, RAW_STORE_SECTOR_SIZE, count, f) != count)
+    {
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t file_write(void *ctx, uint32_t sector, const void *buf, size_t count)
+{
+    FILE *f = ctx;
+
+    if (file_seek(f, sector) != ESP_OK || fwrite(buf, RAW_STORE_SECTOR_SIZE, count, f) != count)
+    {
+        return ESP_FAIL;
+    }
+
+    return (fflush(f) == 0) ? ESP_OK : ESP_FAIL;
+}
+
+static void file_close(void *ctx)
+{
+    fclose(ctx);
+}
+
+esp_err_t raw_store_dev_file_open(struct raw_store_dev *dev, const char *path, uint32_t num_sectors)
+{
+    FILE *f = fopen(path, "r+b");
+    if (!f)
+    {
+        f = fopen(path, "w+b");
+    }
+    if (!f)
+    {
+        return ESP_FAIL;
+    }
+
+    /* Every access is whole sectors at a known position, stdio buffering only adds a copy */
+    setvbuf(f, NULL, _IONBF, 0);
+
+    long size = (long) num_sectors * RAW_STORE_SECTOR_SIZE;
+    if (fseek(f, 0, SEEK_END) != 0 || ftell(f) < size)
+    {
+        if (fseek(f, size - 1, SEEK_SET) != 0 || fputc(0, f) == EOF)
+        {
+            fclose(f);
+            return ESP_FAIL;
+        }
+    }
+
+    *dev = (struct raw_store_dev) {
+        .read = file_read,
+        .write = file_write,
+        .close = file_close,
+        .num_sectors = num_sectors,
+        .ctx = f,
+    };
+
+    return ESP_OK;
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef ESP_PLATFORM
+#include "sdmmc_cmd.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RAW_STORE_SECTOR_SIZE       (512)
+/* Sectors 0 and 1 of the store hold the two copies of the index */
+#define RAW_STORE_INDEX_SECTORS     (2)
+#define RAW_STORE_MAX_RECORDINGS    (30)
+
+enum raw_store_state {
+    RAW_STORE_FREE = 0,
+    /* Being written, the length covers the segments completed so far */
+    RAW_STORE_RECORDING,
+    RAW_STORE_COMPLETE,
+    RAW_STORE_UPLOADED,
+};
+
+struct raw_store_entry {
+    uint32_t id;
+    /* First data sector, relative to the start of the data region */
+    uint32_t first_sector;
+    uint32_t length;
+    uint8_t state;
+    uint8_t reserved[3];
+};
+
+/*
+ * One sector. The two copies are written alternately, each commit going to the
+ * copy the previous one did not use. A copy torn by a power loss fails its CRC
+ * and the other one, one commit older, is used instead.
+ */
+struct raw_store_index {
+    uint32_t magic;
+    uint32_t sequence;
+    /* Data sector the next recording starts at, always on a segment boundary */
+    uint32_t head;
+    uint32_t next_id;
+    uint32_t count;
+    /* Geometry the store was formatted with */
+    uint32_t segment_sectors;
+    /* Oldest first */
+    struct raw_store_entry entries[RAW_STORE_MAX_RECORDINGS];
+    uint8_t reserved[4];
+    uint32_t crc;
+};
+
+/**
+ * @brief Sector-addressed storage under the store.
+ */
+struct raw_store_dev {
+    esp_err_t (*read)(void *ctx, uint32_t sector, void *buf, size_t count);
+    esp_err_t (*write)(void *ctx, uint32_t sector, const void *buf, size_t count);
+    void (*close)(void *ctx);
+    uint32_t num_sectors;
+    void *ctx;
+};
+
+/**
+ * @brief Append-only recording log on a raw block device.
+ *
+ * The data region is a ring of fixed-size segments. A recording starts on a
+ * segment boundary and is written sequentially in chunk-sized writes. Once
+ * the log wraps, the oldest recordings are evicted segment by segment. The
+ * index is committed when a recording starts, at every segment boundary and
+ * when it ends, so a power loss costs at most the segment being written.
+ */
+struct raw_store {
+    struct raw_store_dev dev;
+    struct raw_store_index index;
+    uint32_t segment_sectors;
+    /* Whole segments after the index sectors */
+    uint32_t data_sectors;
+    /* Recording being appended to, NULL when idle */
+    struct raw_store_entry *active;
+    uint32_t active_bytes;
+    uint32_t active_sectors;
+    uint8_t *chunk;
+    size_t chunk_sectors;
+    size_t fill;
+    /* Bounce buffer for partial sector reads and the header rewrite */
+    uint8_t *sector;
+    /* Recordings overwritten before they were uploaded */
+    uint32_t evicted_unsent;
+};
+
+/**
+ * @brief Open the store on dev, or format it if neither index copy is valid.
+ *
+ * A recording left in RAW_STORE_RECORDING by a power loss is kept as
+ * RAW_STORE_COMPLETE with the length of its last committed segment.
+ *
+ * The store owns dev from here on, it is closed on failure or by
+ * raw_store_close().
+ *
+ * @param segment_sectors Eviction granularity, a multiple of chunk_sectors
+ * @param chunk_sectors Sectors written per device write while recording
+ */
+esp_err_t raw_store_open(struct raw_store *store,
+                         const struct raw_store_dev *dev,
+                         uint32_t segment_sectors,
+                         size_t chunk_sectors);
+void raw_store_close(struct raw_store *store);
+
+/**
+ * @brief Drop every recording.
+ */
+esp_err_t raw_store_format(struct raw_store *store);
+
+/**
+ * @brief Start a new recording at the head of the log.
+ */
+esp_err_t raw_store_begin(struct raw_store *store, uint32_t *id);
+esp_err_t raw_store_append(struct raw_store *store, const void *data, size_t len);
+
+/**
+ * @brief Write out the last partial chunk and mark the recording complete.
+ *
+ * @param header If not NULL, overwrites the first header_len bytes of the
+ * recording, which must fit in its first sector
+ */
+esp_err_t raw_store_end(struct raw_store *store, const void *header, size_t header_len);
+
+/**
+ * @brief Oldest complete recording that has not been uploaded yet.
+ */
+const struct raw_store_entry *raw_store_next_pending(const struct raw_store *store);
+esp_err_t raw_store_set_state(struct raw_store *store, uint32_t id, enum raw_store_state state);
+
+/**
+ * @brief Read part of a recording.
+ *
+ * @param read Bytes read, short at the end of the recording
+ */
+esp_err_t raw_store_read(struct raw_store *store,
+                         uint32_t id,
+                         uint32_t offset,
+                         void *buf,
+                         size_t len,
+                         size_t *read);
+
+/**
+ * @brief Device backed by a regular file, through stdio. Runs on a host for
+ * testing, and on the SD card's FAT file system as the baseline to compare
+ * the raw device against.
+ */
+esp_err_t raw_store_dev_file_open(struct raw_store_dev *dev,
+                                  const char *path,
+                                  uint32_t num_sectors);
+
+#ifdef ESP_PLATFORM
+/**
+ * @brief Device writing straight to the card's sectors with sdmmc_write_sectors().
+ *
+ * The sectors belong to a contiguous file at base_path/name, created with
+ * esp_vfs_fat_create_contiguous_file() if it does not exist yet. FAT only
+ * reserves the space, none of its structures change while recording.
+ */
+esp_err_t raw_store_dev_sdmmc_open(struct raw_store_dev *dev,
+                                   sdmmc_card_t *card,
+                                   const char *base_path,
+                                   const char *name,
+                                   uint32_t num_sectors);
+
+/**
+ * @brief Fill half the store once through the sdmmc device and once through
+ * the FAT file holding it, and log the throughput of both. Leaves the store
+ * empty.
+ */
+void raw_store_benchmark(sdmmc_card_t *card,
+                         const char *base_path,
+                         const char *name,
+                         uint32_t num_sectors,
+                         uint32_t segment_sectors,
+                         size_t chunk_sectors);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "diskio_sdmmc.h"
+#include "esp_idf_version.h"
+#include "esp_timer.h"
+#include "esp_vfs_fat.h"
+#include "ff.h"
+#include "raw_store.h"
+
+#include <golioth/client.h>
+static const char *TAG = "raw_store";
+
+struct sdmmc_dev {
+    sdmmc_card_t *card;
+    /* Card sector of the first sector of the file */
+    uint32_t first_sector;
+};
+
+static esp_err_t sdmmc_dev_read(void *ctx, uint32_t sector, void *buf, size_t count)
+{
+    struct sdmmc_dev *dev = ctx;
+    return sdmmc_read_sectors(dev->card, buf, dev->first_sector + sector, count);
+}
+
+static esp_err_t sdmmc_dev_write(void *ctx, uint32_t sector, const void *buf, size_t count)
+{
+    struct sdmmc_dev *dev = ctx;
+    return sdmmc_write_sectors(dev->card, buf, dev->first_sector + sector, count);
+}
+
+static void sdmmc_dev_close(void *ctx)
+{
+    free(ctx);
+}
+
+/* FatFs path of name on the card's volume */
+static esp_err_t ff_path(sdmmc_card_t *card, const char *name, char *path, size_t len)
+{
+    BYTE pdrv = ff_diskio_get_pdrv_card(card);
+    if (pdrv == 0xFF)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    snprintf(path, len, "%u:/%s", (unsigned int) pdrv, name);
+    return ESP_OK;
+}
+
+/* Card sector the file's data starts at, from its first cluster */
+static esp_err_t file_first_sector(sdmmc_card_t *card, const char *name, uint32_t *sector)
+{
+    char path[32];
+    if (ff_path(card, name, path, sizeof(path)) != ESP_OK)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    FIL fil;
+    if (f_open(&fil, path, FA_READ) != FR_OK)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    FATFS *fs = fil.obj.fs;
+    *sector = (uint32_t) (fs->database + (LBA_t) (fil.obj.sclust - 2) * fs->csize);
+    f_close(&fil);
+
+    return ESP_OK;
+}
+
+/* Creates the file at size bytes, in contiguous clusters */
+static esp_err_t create_contiguous(sdmmc_card_t *card,
+                                   const char *base_path,
+                                   const char *path,
+                                   const char *name,
+                                   uint32_t size)
+{
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
+    return esp_vfs_fat_create_contiguous_file(base_path, path, size, true);
+#elif FF_USE_EXPAND
+    /* The VFS helper is new in ESP-IDF 5.3, before it go to FatFs */
+    char fpath[32];
+    if (ff_path(card, name, fpath, sizeof(fpath)) != ESP_OK)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    FIL fil;
+    FRESULT res = f_open(&fil, fpath, FA_WRITE | FA_CREATE_ALWAYS);
+    if (res == FR_OK)
+    {
+        res = f_expand(&fil, size, 1);
+        f_close(&fil);
+    }
+
+    return (res == FR_OK) ? ESP_OK : ESP_FAIL;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t raw_store_dev_sdmmc_open(struct raw_store_dev *dev,
+                                   sdmmc_card_t *card,
+                                   const char *base_path,
+                                   const char *name,
+                                   uint32_t num_sectors)
+{
+    uint32_t size = num_sectors * RAW_STORE_SECTOR_SIZE;
+    char path[64];
+    struct stat st;
+    esp_err_t err;
+
+    snprintf(path, sizeof(path), "%s/%s", base_path, name);
+
+    /*
+     * The file only reserves the sectors. It is created once, contiguous, and
+     * only ever overwritten in place, so its clusters do not move afterwards.
+     */
+    if (stat(path, &st) != 0 || (uint32_t) st.st_size != size)
+    {
+        GLTH_LOGI(TAG, "Creating %" PRIu32 " KB store file %s", size / 1024, path);
+        unlink(path);
+
+        err = create_contiguous(card, base_path, path, name, size);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+    }
+
+    struct sdmmc_dev *ctx = calloc(1, sizeof(*ctx));
+    if (!ctx)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ctx->card = card;
+    err = file_first_sector(card, name, &ctx->first_sector);
+    if (err != ESP_OK)
+    {
+        free(ctx);
+        return err;
+    }
+
+    *dev = (struct raw_store_dev) {
+        .read = sdmmc_dev_read,
+        .write = sdmmc_dev_write,
+        .close = sdmmc_dev_close,
+        .num_sectors = num_sectors,
+        .ctx = ctx,
+    };
+
+    return ESP_OK;
+}
+
+/* Appends bytes of pattern as one recording, returning the rate in hundredths of MB/s */
+static uint32_t benchmark_dev(const struct raw_store_dev *dev,
+                              uint32_t segment_sectors,
+                              size_t chunk_sectors,
+                              uint32_t bytes)
+{
+    static uint8_t block[1024];
+    struct raw_store store;
+    uint32_t id;
+
+    if (raw_store_open(&store, dev, segment_sectors, chunk_sectors) != ESP_OK)
+    {
+        return 0;
+    }
+
+    memset(block, 0x5A, sizeof(block));
+    raw_store_format(&store);
+
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = raw_store_begin(&store, &id);
+    for (uint32_t written = 0; err == ESP_OK && written < bytes; written += sizeof(block))
+    {
+        err = raw_store_append(&store, block, sizeof(block));
+    }
+    if (err == ESP_OK)
+    {
+        err = raw_store_end(&store, NULL, 0);
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start;
+
+    /* Leave the store empty rather than holding a fake recording */
+    raw_store_format(&store);
+    raw_store_close(&store);
+
+    if (err != ESP_OK || elapsed_us <= 0)
+    {
+        return 0;
+    }
+
+    return (uint32_t) ((uint64_t) bytes * 100 / elapsed_us);
+}
+
+void raw_store_benchmark(sdmmc_card_t *card,
+                         const char *base_path,
+                         const char *name,
+                         uint32_t num_sectors,
+                         uint32_t segment_sectors,
+                         size_t chunk_sectors)
+{
+    /* Half the store, so the log does not wrap */
+    uint32_t bytes = (num_sectors / 2) * RAW_STORE_SECTOR_SIZE;
+    char path[64];
+    struct raw_store_dev dev;
+    uint32_t raw_rate = 0;
+    uint32_t fat_rate = 0;
+
+    snprintf(path, sizeof(path), "%s/%s", base_path, name);
+
+    if (raw_store_dev_sdmmc_open(&dev, card, base_path, name, num_sectors) == ESP_OK)
+    {
+        raw_rate = benchmark_dev(&dev, segment_sectors, chunk_sectors, bytes);
+    }
+
+    /* The same sectors, written through FATFS and stdio */
+    if (raw_store_dev_file_open(&dev, path, num_sectors) == ESP_OK)
+    {
+        fat_rate = benchmark_dev(&dev, segment_sectors, chunk_sectors, bytes);
+    }
+
+    GLTH_LOGI(TAG,
+              "%" PRIu32 " KB in %u KB writes: raw %" PRIu32 ".%02" PRIu32 " MB/s, FAT %" PRIu32
+              ".%02" PRIu32 " MB/s",
+              bytes / 1024,
+              (unsigned int) (chunk_sectors * RAW_STORE_SECTOR_SIZE / 1024),
+              raw_rate / 100,
+              raw_rate % 100,
+              fat_rate / 100,
+              fat_rate % 100);
+}
@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include "esp_heap_caps.h"
+#include "resampler.h"
+
+#ifdef RESAMPLER_HAVE_ESP_DSP
+#include "dsps_dotprod.h"
+#endif
+
+/* Pass band edge as a fraction of the output Nyquist frequency */
+#define RESAMPLER_CUTOFF        (0.9f)
+/* Leaves room for the filter's overshoot on near full-scale input */
+#define RESAMPLER_GAIN          (0.9f)
+/* Keeps |acc| below 2^31 for any input: 32768 * 65535 */
+#define RESAMPLER_MAX_ROW_L1    (65535)
+#define RESAMPLER_ALIGN         (16)
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+    while (b)
+    {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+static int16_t dot_scalar(const int16_t *x, const int16_t *h, int16_t *scratch)
+{
+    (void) scratch;
+
+    /* Same rounding as dsps_dotprod_s16() with shift 0 */
+    int32_t acc = 0x7FFF;
+    for (int i = 0; i < RESAMPLER_TAPS; i++)
+    {
+        acc += x[i] * h[i];
+    }
+
+    acc >>= 15;
+    return (int16_t) MAX(MIN(acc, INT16_MAX), INT16_MIN);
+}
+
+#ifdef RESAMPLER_HAVE_ESP_DSP
+static int16_t dot_esp_dsp(const int16_t *x, const int16_t *h, int16_t *scratch)
+{
+    int16_t y;
+
+    /* The vector loads need 16-byte aligned operands, coefficient rows already are */
+    if ((uintptr_t) x & (RESAMPLER_ALIGN - 1))
+    {
+        memcpy(scratch, x, RESAMPLER_TAPS * sizeof(int16_t));
+        x = scratch;
+    }
+
+    dsps_dotprod_s16(x, h, &y, RESAMPLER_TAPS, 0);
+    return y;
+}
+#endif
+
+/* Windowed-sinc (Blackman) low-pass at the upsampled rate, split into polyphase rows */
+static void design_filter(struct resampler *rs)
+{
+    const size_t len = (size_t) rs->up * RESAMPLER_TAPS;
+    const float fc = RESAMPLER_CUTOFF / (2.0f * MAX(rs->up, rs->down));
+    const float center = (len - 1) / 2.0f;
+    float gain = RESAMPLER_GAIN * rs->up;
+
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        uint32_t max_l1 = 0;
+
+        for (uint16_t phase = 0; phase < rs->up; phase++)
+        {
+            int16_t *row = &rs->coeffs[phase * RESAMPLER_TAPS];
+            uint32_t l1 = 0;
+
+            for (int k = 0; k < RESAMPLER_TAPS; k++)
+            {
+                size_t i = phase + (size_t) k * rs->up;
+                float t = i - center;
+                float sinc = (t == 0.0f) ? 2.0f * fc
+                                         : sinf(2.0f * (float) M_PI * fc * t) / ((float) M_PI * t);
+                float w = 0.42f - 0.5f * cosf(2.0f * (float) M_PI * i / (len - 1))
+                          + 0.08f * cosf(4.0f * (float) M_PI * i / (len - 1));
+                long q = lroundf(sinc * w * gain * 32768.0f);
+
+                row[RESAMPLER_TAPS - 1 - k] = (int16_t) MAX(MIN(q, INT16_MAX), INT16_MIN);
+                l1 += (uint32_t) abs(row[RESAMPLER_TAPS - 1 - k]);
+            }
+
+            max_l1 = MAX(max_l1, l1);
+        }
+
+        if (max_l1 <= RESAMPLER_MAX_ROW_L1)
+        {
+            return;
+        }
+
+        gain *= (float) RESAMPLER_MAX_ROW_L1 / max_l1;
+    }
+}
+
+esp_err_t resampler_init(struct resampler *rs,
+                         uint32_t in_rate,
+                         uint32_t out_rate,
+                         enum resampler_kernel kernel)
+{
+    if (in_rate == 0 || out_rate == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t g = gcd(in_rate, out_rate);
+    if (out_rate / g > RESAMPLER_MAX_UP || in_rate / g > UINT16_MAX)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    memset(rs, 0, sizeof(*rs));
+    rs->up = (uint16_t) (out_rate / g);
+    rs->down = (uint16_t) (in_rate / g);
+
+    switch (kernel)
+    {
+        case RESAMPLER_KERNEL_SCALAR:
+            rs->dot = dot_scalar;
+            break;
+#ifdef RESAMPLER_HAVE_ESP_DSP
+        case RESAMPLER_KERNEL_ESP_DSP:
+            rs->dot = dot_esp_dsp;
+            break;
+#endif
+        default:
+            return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    rs->coeffs = heap_caps_aligned_alloc(RESAMPLER_ALIGN,
+                                         (size_t) rs->up * RESAMPLER_TAPS * sizeof(int16_t),
+                                         MALLOC_CAP_8BIT);
+    rs->scratch = heap_caps_aligned_alloc(RESAMPLER_ALIGN,
+                                          RESAMPLER_TAPS * sizeof(int16_t),
+                                          MALLOC_CAP_8BIT);
+    rs->buf = malloc((RESAMPLER_TAPS - 1 + RESAMPLER_CHUNK) * sizeof(int16_t));
+    if (!rs->coeffs || !rs->scratch || !rs->buf)
+    {
+        resampler_deinit(rs);
+        return ESP_ERR_NO_MEM;
+    }
+
+    design_filter(rs);
+
+    /* Start on silence so the first output lines up with the first input sample */
+    memset(rs->buf, 0, (RESAMPLER_TAPS - 1) * sizeof(int16_t));
+    rs->filled = RESAMPLER_TAPS - 1;
+    rs->pos = (RESAMPLER_TAPS - 1) * rs->up;
+
+    return ESP_OK;
+}
+
+void resampler_deinit(struct resampler *rs)
+{
+    heap_caps_free(rs->coeffs);
+    heap_caps_free(rs->scratch);
+    free(rs->buf);
+
+    rs->coeffs = NULL;
+    rs->scratch = NULL;
+    rs->buf = NULL;
+}
+
+size_t resampler_max_output(const struct resampler *rs, size_t num_samples)
+{
+    return (num_samples * rs->up) / rs->down + 1;
+}
+
+size_t resampler_process(struct resampler *rs, const int16_t *in, size_t num_samples, int16_t *out)
+{
+    size_t written = 0;
+
+    while (num_samples > 0)
+    {
+        size_t chunk = MIN(num_samples, RESAMPLER_TAPS - 1 + RESAMPLER_CHUNK - rs->filled);
+
+        memcpy(&rs->buf[rs->filled], in, chunk * sizeof(int16_t));
+        rs->filled += chunk;
+        in += chunk;
+        num_samples -= chunk;
+
+        /* Every output whose newest input sample is now buffered */
+        while (rs->pos / rs->up < rs->filled)
+        {
+            size_t newest = rs->pos / rs->up;
+            uint32_t phase = rs->pos % rs->up;
+
+            out[written++] = rs->dot(&rs->buf[newest - (RESAMPLER_TAPS - 1)],
+                                     &rs->coeffs[phase * RESAMPLER_TAPS],
+                                     rs->scratch);
+            rs->pos += rs->down;
+        }
+
+        /* Keep the history the next outputs still reach back into */
+        size_t drop = rs->filled - (RESAMPLER_TAPS - 1);
+        memmove(rs->buf, &rs->buf[drop], (RESAMPLER_TAPS - 1) * sizeof(int16_t));
+        rs->filled = RESAMPLER_TAPS - 1;
+        rs->pos -= drop * rs->up;
+    }
+
+    return written;
+}
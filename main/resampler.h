@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Taps per polyphase branch, a multiple of 16 to suit the SIMD dot product */
+#define RESAMPLER_TAPS          (64)
+/* Input samples buffered per filtering pass */
+#define RESAMPLER_CHUNK         (512)
+/* Largest interpolation factor once the rate ratio is reduced */
+#define RESAMPLER_MAX_UP        (512)
+
+#ifdef CONFIG_IDF_TARGET_ESP32S3
+#define RESAMPLER_HAVE_ESP_DSP  1
+#endif
+
+enum resampler_kernel {
+    /* Portable C dot product */
+    RESAMPLER_KERNEL_SCALAR,
+    /* esp-dsp dsps_dotprod_s16(), only with RESAMPLER_HAVE_ESP_DSP */
+    RESAMPLER_KERNEL_ESP_DSP,
+};
+
+#ifdef RESAMPLER_HAVE_ESP_DSP
+#define RESAMPLER_KERNEL_DEFAULT    RESAMPLER_KERNEL_ESP_DSP
+#else
+#define RESAMPLER_KERNEL_DEFAULT    RESAMPLER_KERNEL_SCALAR
+#endif
+
+typedef int16_t (*resampler_dot_fn)(const int16_t *x, const int16_t *h, int16_t *scratch);
+
+/**
+ * @brief Streaming rational-ratio polyphase FIR resampler for mono 16-bit PCM.
+ *
+ * The ratio out_rate / in_rate is reduced to up / down (44100 -> 16000 is
+ * 160 / 441, 48000 -> 16000 is 1 / 3). A windowed-sinc low-pass designed at
+ * init is split into up branches of RESAMPLER_TAPS coefficients. Each output
+ * sample is one dot product of a branch with the most recent input samples.
+ */
+struct resampler {
+    uint16_t up;
+    uint16_t down;
+    /* up rows of RESAMPLER_TAPS Q15 coefficients, time reversed */
+    int16_t *coeffs;
+    /* RESAMPLER_TAPS - 1 samples of history followed by up to RESAMPLER_CHUNK new ones */
+    int16_t *buf;
+    size_t filled;
+    /* Next output position in 1/up input samples, relative to buf[0] */
+    uint32_t pos;
+    /* Aligned copy of an unaligned window for the SIMD kernel */
+    int16_t *scratch;
+    resampler_dot_fn dot;
+};
+
+esp_err_t resampler_init(struct resampler *rs,
+                         uint32_t in_rate,
+                         uint32_t out_rate,
+                         enum resampler_kernel kernel);
+void resampler_deinit(struct resampler *rs);
+
+/**
+ * @brief Largest number of samples resampler_process() may write for num_samples of input.
+ */
+size_t resampler_max_output(const struct resampler *rs, size_t num_samples);
+
+/**
+ * @brief Resample a block of input, writing every output sample it completes to out.
+ *
+ * @return Number of samples written to out
+ */
+size_t resampler_process(struct resampler *rs, const int16_t *in, size_t num_samples, int16_t *out);
+
+#ifdef __cplusplus
+}
+#endif
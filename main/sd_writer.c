@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "sd_writer.h"
+
+esp_err_t sd_writer_open(struct sd_writer *w, FILE *f, size_t chunk_size)
+{
+    if (!f || chunk_size == 0 || chunk_size % SD_WRITER_SECTOR_SIZE)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(w, 0, sizeof(*w));
+    w->chunk_size = chunk_size;
+
+    /* The SD driver bounces buffers it cannot DMA from one sector at a time */
+    w->buf = heap_caps_malloc(chunk_size, MALLOC_CAP_DMA);
+    if (!w->buf)
+    {
+        w->buf = heap_caps_malloc(chunk_size, MALLOC_CAP_8BIT);
+    }
+    if (!w->buf)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    /* Chunks go straight to the file descriptor, stdio would only copy them again */
+    setvbuf(f, NULL, _IONBF, 0);
+    w->f = f;
+
+    return ESP_OK;
+}
+
+static bool write_chunk(struct sd_writer *w)
+{
+    int64_t start = esp_timer_get_time();
+    ssize_t n = write(fileno(w->f), w->buf, w->fill);
+    uint32_t latency_us = (uint32_t) (esp_timer_get_time() - start);
+
+    w->writes++;
+    w->total_us += latency_us;
+    w->max_us = MAX(w->max_us, latency_us);
+    if (latency_us >= SD_WRITER_SLOW_US)
+    {
+        w->slow_writes++;
+    }
+
+    bool ok = (n == (ssize_t) w->fill);
+    if (ok)
+    {
+        w->bytes += w->fill;
+    }
+    else
+    {
+        w->failures++;
+    }
+
+    w->fill = 0;
+    return ok;
+}
+
+bool sd_writer_write(struct sd_writer *w, const void *data, size_t len)
+{
+    const uint8_t *src = data;
+    bool ok = true;
+
+    while (len > 0)
+    {
+        size_t n = MIN(len, w->chunk_size - w->fill);
+
+        memcpy(&w->buf[w->fill], src, n);
+        w->fill += n;
+        src += n;
+        len -= n;
+
+        if (w->fill == w->chunk_size)
+        {
+            ok &= write_chunk(w);
+        }
+    }
+
+    return ok;
+}
+
+bool sd_writer_flush(struct sd_writer *w)
+{
+    if (w->fill == 0)
+    {
+        return true;
+    }
+
+    return write_chunk(w);
+}
+
+void sd_writer_close(struct sd_writer *w)
+{
+    if (w->f)
+    {
+        fclose(w->f);
+    }
+    heap_caps_free(w->buf);
+
+    w->f = NULL;
+    w->buf = NULL;
+}
+
+uint32_t sd_writer_rate_centi_mbps(const struct sd_writer *w)
+{
+    if (w->total_us == 0)
+    {
+        return 0;
+    }
+
+    return (uint32_t) ((uint64_t) w->bytes * 100 / w->total_us);
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SD_WRITER_SECTOR_SIZE   (512)
+/* Chunk writes that take longer than this are counted as stalls */
+#define SD_WRITER_SLOW_US       (10 * 1000)
+
+/**
+ * @brief Coalesces small appends into large, sector-aligned writes.
+ *
+ * Everything written to the file goes through the chunk buffer, header
+ * included, so every chunk starts at a file offset that is a multiple of
+ * chunk_size. With a chunk size that is a multiple (or a divisor) of the FAT
+ * cluster size, FATFS hands each chunk to the card as one multi-sector write
+ * instead of staging it sector by sector through its window buffer. stdio
+ * buffering is turned off so the data is only copied once.
+ */
+struct sd_writer {
+    FILE *f;
+    uint8_t *buf;
+    size_t chunk_size;
+    size_t fill;
+    /* Bytes that reached the file */
+    uint32_t bytes;
+    uint32_t writes;
+    uint32_t slow_writes;
+    uint32_t failures;
+    uint32_t max_us;
+    uint64_t total_us;
+};
+
+/**
+ * @brief Take over an open file, which must not have been read or written yet.
+ *
+ * @param chunk_size Multiple of SD_WRITER_SECTOR_SIZE
+ */
+esp_err_t sd_writer_open(struct sd_writer *w, FILE *f, size_t chunk_size);
+
+/**
+ * @brief Append data, writing out every chunk it completes.
+ *
+ * @return false if a chunk write failed, its contents are lost
+ */
+bool sd_writer_write(struct sd_writer *w, const void *data, size_t len);
+
+/**
+ * @brief Write out the partial chunk at the end of the file.
+ */
+bool sd_writer_flush(struct sd_writer *w);
+
+/**
+ * @brief Free the chunk buffer and close the file, without flushing.
+ */
+void sd_writer_close(struct sd_writer *w);
+
+/**
+ * @brief Throughput while writing, in hundredths of MB/s (bytes per us * 100).
+ */
+uint32_t sd_writer_rate_centi_mbps(const struct sd_writer *w);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "esp_console.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "segments.h"
+
+/* Include the Golioth Client to access backend logging */
+#include <golioth/client.h>
+static const char *TAG = "segments";
+
+#define UPLOAD_TASK_PRIORITY    (4)
+#define UPLOAD_TASK_STACK_SIZE  (6144)
+
+struct closed_segment {
+    uint32_t seq;
+    uint8_t file_idx;
+};
+
+static struct {
+    struct audio_ctx base;
+    segment_upload_fn upload;
+    void *arg;
+    /* File indices free for recording */
+    QueueHandle_t free_q;
+    /* Recorded segments waiting for upload */
+    QueueHandle_t closed_q;
+    int64_t start_us;
+    struct segment_metrics metrics;
+} _seg;
+
+/* Guards _seg.metrics, written by the recorder and the upload task */
+static portMUX_TYPE _metrics_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static struct audio_ctx segment_ctx(uint8_t file_idx)
+{
+    struct audio_ctx ctx = _seg.base;
+
+    /* Short names, .wav ones are 8.3 and work without FATFS long filename support */
+    snprintf(ctx.filename, sizeof(ctx.filename), "seg%u" AUDIO_FILE_EXT, (unsigned int) file_idx);
+    return ctx;
+}
+
+static void upload_task(void *arg)
+{
+    struct closed_segment seg;
+
+    while (true)
+    {
+        xQueueReceive(_seg.closed_q, &seg, portMAX_DELAY);
+
+        struct audio_ctx ctx = segment_ctx(seg.file_idx);
+        GLTH_LOGI(TAG, "Uploading segment %" PRIu32 " from %s", seg.seq, ctx.filename);
+
+        bool uploaded = (_seg.upload(&ctx, _seg.arg) == 0);
+
+        portENTER_CRITICAL(&_metrics_lock);
+        if (uploaded)
+        {
+            _seg.metrics.segments_uploaded++;
+        }
+        else
+        {
+            _seg.metrics.upload_failures++;
+        }
+        portEXIT_CRITICAL(&_metrics_lock);
+
+        if (!uploaded)
+        {
+            GLTH_LOGE(TAG, "Segment %" PRIu32 " upload failed, discarding", seg.seq);
+        }
+
+        xQueueSend(_seg.free_q, &seg.file_idx, portMAX_DELAY);
+    }
+}
+
+struct segment_metrics segments_get_metrics(void)
+{
+    uint32_t elapsed_ms = (uint32_t) ((esp_timer_get_time() - _seg.start_us) / 1000);
+
+    portENTER_CRITICAL(&_metrics_lock);
+    struct segment_metrics m = _seg.metrics;
+    portEXIT_CRITICAL(&_metrics_lock);
+
+    m.elapsed_ms = elapsed_ms;
+    m.duty_cycle_permille =
+        elapsed_ms ? (uint32_t) ((uint64_t) m.recorded_ms * 1000 / elapsed_ms) : 0;
+    return m;
+}
+
+static void log_metrics(void)
+{
+    struct segment_metrics m = segments_get_metrics();
+
+    GLTH_LOGI(TAG,
+              "%" PRIu32 " segments recorded (%" PRIu32 " failed), %" PRIu32
+              " uploaded (%" PRIu32 " failed), duty cycle %" PRIu32 ".%03" PRIu32
+              ", stalls %" PRIu32,
+              m.segments_recorded,
+              m.record_failures,
+              m.segments_uploaded,
+              m.upload_failures,
+              m.duty_cycle_permille / 1000,
+              m.duty_cycle_permille % 1000,
+              m.backpressure_stalls);
+}
+
+static int cmd_segments(int argc, char **argv)
+{
+    log_metrics();
+    return 0;
+}
+
+static void delete_queues(void)
+{
+    if (_seg.free_q)
+    {
+        vQueueDelete(_seg.free_q);
+        _seg.free_q = NULL;
+    }
+    if (_seg.closed_q)
+    {
+        vQueueDelete(_seg.closed_q);
+        _seg.closed_q = NULL;
+    }
+}
+
+esp_err_t segments_run(const struct audio_ctx *base, segment_upload_fn upload, void *arg)
+{
+    _seg.base = *base;
+    _seg.upload = upload;
+    _seg.arg = arg;
+    _seg.free_q = xQueueCreate(CONFIG_EXAMPLE_SEGMENT_FILES, sizeof(uint8_t));
+    _seg.closed_q = xQueueCreate(CONFIG_EXAMPLE_SEGMENT_FILES, sizeof(struct closed_segment));
+
+    if (!_seg.free_q || !_seg.closed_q)
+    {
+        GLTH_LOGE(TAG, "Unable to allocate segment queues");
+        delete_queues();
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (uint8_t i = 0; i < CONFIG_EXAMPLE_SEGMENT_FILES; i++)
+    {
+        xQueueSend(_seg.free_q, &i, 0);
+    }
+
+    /* Without the uploader the recorder would fill every file and wait forever */
+    if (xTaskCreate(upload_task,
+                    "seg_upload",
+                    UPLOAD_TASK_STACK_SIZE,
+                    NULL,
+                    UPLOAD_TASK_PRIORITY,
+                    NULL)
+        != pdPASS)
+    {
+        GLTH_LOGE(TAG, "Unable to start the segment upload task");
+        delete_queues();
+        return ESP_ERR_NO_MEM;
+    }
+
+    const esp_console_cmd_t cmd = {
+        .command = "segments",
+        .help = "Show segmented recording and upload statistics",
+        .hint = NULL,
+        .func = cmd_segments,
+    };
+    esp_console_cmd_register(&cmd);
+
+    _seg.start_us = esp_timer_get_time();
+
+    for (uint32_t seq = 0;; seq++)
+    {
+        uint8_t file_idx;
+
+        if (xQueueReceive(_seg.free_q, &file_idx, 0) != pdTRUE)
+        {
+            /* Every file is waiting for upload, the microphone idles until one frees up */
+            portENTER_CRITICAL(&_metrics_lock);
+            _seg.metrics.backpressure_stalls++;
+            portEXIT_CRITICAL(&_metrics_lock);
+            GLTH_LOGW(TAG, "Uploads falling behind, waiting for a free segment file");
+            xQueueReceive(_seg.free_q, &file_idx, portMAX_DELAY);
+        }
+
+        struct audio_ctx ctx = segment_ctx(file_idx);
+        uint32_t recorded_ms = 0;
+        esp_err_t err = record_wav(&ctx, &recorded_ms);
+
+        portENTER_CRITICAL(&_metrics_lock);
+        if (err == ESP_OK)
+        {
+            _seg.metrics.segments_recorded++;
+            _seg.metrics.recorded_ms += recorded_ms;
+        }
+        else
+        {
+            _seg.metrics.record_failures++;
+        }
+        portEXIT_CRITICAL(&_metrics_lock);
+
+        if (err != ESP_OK)
+        {
+            /* Nothing worth uploading, the file is recorded over next */
+            GLTH_LOGE(TAG, "Segment %" PRIu32 " recording failed: %d, discarding", seq, err);
+            xQueueSend(_seg.free_q, &file_idx, portMAX_DELAY);
+            continue;
+        }
+
+        struct closed_segment seg = {
+            .seq = seq,
+            .file_idx = file_idx,
+        };
+        xQueueSend(_seg.closed_q, &seg, portMAX_DELAY);
+
+        struct segment_metrics m = segments_get_metrics();
+        GLTH_LOGI(TAG,
+                  "Segment %" PRIu32 " closed, duty cycle %" PRIu32 ".%03" PRIu32
+                  ", upload backlog %u, stalls %" PRIu32,
+                  seq,
+                  m.duty_cycle_permille / 1000,
+                  m.duty_cycle_permille % 1000,
+                  (unsigned int) uxQueueMessagesWaiting(_seg.closed_q),
+                  m.backpressure_stalls);
+    }
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "audio.h"
+
+/**
+ * @brief Uploads one closed segment file. Returns 0 on success.
+ */
+typedef int (*segment_upload_fn)(struct audio_ctx *segment, void *arg);
+
+struct segment_metrics {
+    uint32_t segments_recorded;
+    /* Segments that failed or captured nothing, recorded over without an upload */
+    uint32_t record_failures;
+    uint32_t segments_uploaded;
+    uint32_t upload_failures;
+    uint32_t backpressure_stalls;
+    /* Captured audio in the segments queued for upload */
+    uint32_t recorded_ms;
+    uint32_t elapsed_ms;
+    /* Recorded seconds per wall-clock second, in thousandths */
+    uint32_t duty_cycle_permille;
+};
+
+/**
+ * @brief Record back-to-back segments forever.
+ *
+ * Segment N+1 is recorded into the next of CONFIG_EXAMPLE_SEGMENT_FILES files while
+ * a background task uploads segment N. When every file is waiting for upload the
+ * recorder blocks until one is released (backpressure).
+ *
+ * @return Only returns when the queues or the upload task could not be created,
+ * with ESP_ERR_NO_MEM
+ */
+esp_err_t segments_run(const struct audio_ctx *base, segment_upload_fn upload, void *arg);
+
+/**
+ * @brief Snapshot of the counters, also printed by the "segments" shell command
+ * that segments_run() registers.
+ */
+struct segment_metrics segments_get_metrics(void);
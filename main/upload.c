@@ -0,0 +1,820 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "audio.h"
+#include "block_size_ctl.h"
+#include "lz_stream.h"
+#include "upload.h"
+#include "upload_prefetch.h"
+#include "upload_progress.h"
+#include "upload_stats.h"
+#include "vad.h"
+
+#ifdef CONFIG_EXAMPLE_RESUMABLE_UPLOAD
+#include "esp_random.h"
+#include "esp_rom_crc.h"
+#endif
+
+#include <golioth/client.h>
+static const char *TAG = "upload";
+
+#define STATS_JSON_MAX          (256)
+/* Prefetched block size and resume granularity, CoAP's largest block */
+#define UPLOAD_BLOCK_SIZE       (UPLOAD_SINK_BLOCK_SIZE)
+
+#ifdef CONFIG_EXAMPLE_RESUMABLE_UPLOAD
+#define UPLOAD_PART_SIZE        (CONFIG_EXAMPLE_UPLOAD_PART_KB * UPLOAD_BLOCK_SIZE)
+#define UPLOAD_RETRY_DELAY_MS   (5000)
+#endif
+
+/* Time-to-first-byte and peak heap use for one record + upload cycle */
+struct upload_metrics {
+    int64_t start_us;
+    /* End of recording, 0 when recording and upload overlap */
+    int64_t recorded_us;
+    int64_t first_byte_us;
+    size_t baseline_free;
+};
+
+static struct upload_metrics _metrics;
+
+void upload_metrics_start(void)
+{
+    heap_caps_monitor_local_minimum_free_size_start();
+    _metrics.baseline_free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    _metrics.first_byte_us = 0;
+    _metrics.recorded_us = 0;
+    _metrics.start_us = esp_timer_get_time();
+}
+
+void upload_metrics_recorded(void)
+{
+    _metrics.recorded_us = esp_timer_get_time();
+}
+
+void upload_metrics_first_byte(void)
+{
+    if (_metrics.first_byte_us == 0)
+    {
+        _metrics.first_byte_us = esp_timer_get_time();
+    }
+}
+
+void upload_metrics_report(const char *mode)
+{
+    size_t min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    heap_caps_monitor_local_minimum_free_size_stop();
+
+    int64_t total_us = esp_timer_get_time() - _metrics.start_us;
+    int64_t ttfb_us = _metrics.first_byte_us ? _metrics.first_byte_us - _metrics.start_us : -1;
+
+    GLTH_LOGI(TAG,
+              "[%s] time to first byte: %" PRId32 " ms, total: %" PRId32
+              " ms, peak heap use: %u bytes",
+              mode,
+              (int32_t) (ttfb_us / 1000),
+              (int32_t) (total_us / 1000),
+              (unsigned int) (_metrics.baseline_free - min_free));
+
+    if (_metrics.recorded_us)
+    {
+        GLTH_LOGI(TAG,
+                  "[%s] record: %" PRId32 " ms, upload: %" PRId32 " ms",
+                  mode,
+                  (int32_t) ((_metrics.recorded_us - _metrics.start_us) / 1000),
+                  (int32_t) ((_metrics.start_us + total_us - _metrics.recorded_us) / 1000));
+    }
+}
+
+#ifdef CONFIG_EXAMPLE_ADAPTIVE_BLOCK_SIZE
+/* Shared by all transfers, so each starts from what the previous ones measured */
+static struct block_size_ctl _block_ctl;
+static portMUX_TYPE _block_ctl_lock = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+/* Times each fill callback of a blockwise transfer, see upload_blockwise() */
+struct timed_upload {
+    upload_sink_read_block_cb cb;
+    void *arg;
+    struct upload_transfer transfer;
+    /* Block size of this transfer, the SDK's block buffer, 0 until the first block */
+    uint32_t block_size;
+};
+
+#ifdef CONFIG_EXAMPLE_ADAPTIVE_BLOCK_SIZE
+/*
+ * Under CoAP Block1 every block but the last must carry the size given by the
+ * SZX option, which the SDK takes from its block buffer
+ * (CONFIG_GOLIOTH_BLOCKWISE_UPLOAD_MAX_BLOCK_SIZE), not from the length the
+ * fill callback returns. Shorter blocks would land at the wrong offsets, so
+ * blocks keep the SDK's size. The controller measures them and recommends a
+ * buffer size for the link, logged at the start of each transfer.
+ */
+static void observe_block_size(struct timed_upload *timed, size_t block_size, uint32_t latency_us)
+{
+    if (timed->block_size == 0)
+    {
+        timed->block_size = block_size;
+
+        /* Asked of a copy, so the controller's state stays that of the size sent */
+        portENTER_CRITICAL(&_block_ctl_lock);
+        struct block_size_ctl advice = _block_ctl;
+        portEXIT_CRITICAL(&_block_ctl_lock);
+
+        uint32_t best = block_size_ctl_select(&advice, block_size);
+        if (best != block_size)
+        {
+            GLTH_LOGI(TAG,
+                      "Block size %" PRIu32 " bytes, %" PRIu32
+                      " recommended for this link (GOLIOTH_BLOCKWISE_UPLOAD_MAX_BLOCK_SIZE)",
+                      timed->block_size,
+                      best);
+        }
+    }
+    else if (latency_us)
+    {
+        portENTER_CRITICAL(&_block_ctl_lock);
+        block_size_ctl_observe(&_block_ctl, timed->block_size, latency_us);
+        portEXIT_CRITICAL(&_block_ctl_lock);
+    }
+}
+#endif
+
+static enum golioth_status timed_block_cb(uint32_t block_idx,
+                                          uint8_t *block_buffer,
+                                          size_t *block_size,
+                                          bool *is_last,
+                                          void *arg)
+{
+    struct timed_upload *timed = (struct timed_upload *) arg;
+
+    uint32_t latency_us = upload_transfer_fill_start(&timed->transfer, block_idx);
+#ifdef CONFIG_EXAMPLE_ADAPTIVE_BLOCK_SIZE
+    observe_block_size(timed, *block_size, latency_us);
+#else
+    (void) latency_us;
+#endif
+    enum golioth_status status = timed->cb(block_idx, block_buffer, block_size, is_last, timed->arg);
+    upload_transfer_fill_end(&timed->transfer, (status == GOLIOTH_OK) ? *block_size : 0);
+
+    return status;
+}
+
+#ifdef CONFIG_EXAMPLE_UPLOAD_STATS_STREAM
+static void publish_upload_stats(const struct upload_sink *sink,
+                                 const struct upload_stats_summary *summary,
+                                 const char *path)
+{
+    char json[STATS_JSON_MAX];
+    size_t len = upload_stats_summary_json(summary, path, json, sizeof(json));
+
+    int err = sink->write(sink->ctx,
+                          "upload_stats",
+                          UPLOAD_SINK_JSON,
+                          (const uint8_t *) json,
+                          len);
+    if (err)
+    {
+        GLTH_LOGW(TAG, "Failed to publish upload stats: %d", err);
+    }
+}
+#endif
+
+/*
+ * Blockwise upload of path, timing the fill callback against the wait for each
+ * block's acknowledgement. The summary is logged, kept for the upload_stats
+ * shell command and published to the upload_stats stream.
+ */
+int upload_blockwise(const struct upload_sink *sink,
+                     const char *path,
+                     upload_sink_read_block_cb cb,
+                     void *arg)
+{
+    struct timed_upload timed = {
+        .cb = cb,
+        .arg = arg,
+    };
+
+    upload_transfer_begin(&timed.transfer);
+
+    int err = sink->write_blockwise(sink->ctx, path, timed_block_cb, (void *) &timed);
+
+    struct upload_stats_summary summary = upload_transfer_end(&timed.transfer, path, err);
+#ifdef CONFIG_EXAMPLE_UPLOAD_STATS_STREAM
+    publish_upload_stats(sink, &summary, path);
+#else
+    (void) summary;
+#endif
+
+    return err;
+}
+
+void upload_init(void)
+{
+    upload_stats_start();
+#ifdef CONFIG_EXAMPLE_ADAPTIVE_BLOCK_SIZE
+    block_size_ctl_init(&_block_ctl);
+#endif
+}
+
+static FILE *get_audio_filestream(struct audio_ctx *a_ctx)
+{
+    char path[sizeof(SD_MOUNT_POINT) + sizeof(a_ctx->filename)];
+    snprintf(path, sizeof(path), "%s/%s", SD_MOUNT_POINT, a_ctx->filename);
+
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        GLTH_LOGE(TAG, "File not found");
+        return NULL;
+    }
+    else {
+        GLTH_LOGI(TAG, "File size: %li", st.st_size);
+    }
+
+    GLTH_LOGI(TAG, "Opening file: %s", path);
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        GLTH_LOGE(TAG, "Failed to open file for reading");
+        return NULL;
+    }
+
+    return f;
+}
+
+static void release_audio_filestream(FILE *f)
+{
+    if (!f)
+    {
+        GLTH_LOGE(TAG, "Filestream is NULL");
+        return;
+    }
+
+    fclose(f);
+}
+
+/* Uploads up to remaining bytes of f from its current position */
+struct filestream_upload {
+    FILE *f;
+    size_t remaining;
+};
+
+static enum golioth_status block_upload_audio_filestream_cb(uint32_t block_idx,
+                                                            uint8_t *block_buffer,
+                                                            size_t *block_size,
+                                                            bool *is_last,
+                                                            void *arg)
+{
+    int err = 0;
+    struct filestream_upload *upload = (struct filestream_upload *)arg;
+    FILE *f = upload ? upload->f : NULL;
+
+    if (!f)
+    {
+        GLTH_LOGE(TAG, "arg was NULL but should have been pointer to a filestream");
+        return GOLIOTH_ERR_INVALID_STATE;
+    }
+
+    size_t bytes_read = fread(block_buffer, 1, MIN(*block_size, upload->remaining), f);
+    upload->remaining -= bytes_read;
+
+    err = ferror(f);
+    if (err)
+    {
+        GLTH_LOGE(TAG, "Error reading filestream: %d", err);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (bytes_read < *block_size)
+    {
+        *block_size = bytes_read;
+    }
+
+    int eof = feof(f);
+    if (eof || upload->remaining == 0)
+    {
+        *is_last = true;
+    }
+
+    if (*block_size == 0)
+    {
+        GLTH_LOGE(TAG, "Error, no bytes read from audio filestream");
+        goto error_uploading_file;
+    }
+
+    upload_metrics_first_byte();
+
+    GLTH_LOGI(TAG,
+              "Uploading block_id: %u block_size: %zu is_last: %u",
+              (unsigned int) block_idx,
+              *block_size,
+              *is_last);
+
+    return GOLIOTH_OK;
+
+error_uploading_file:
+    *block_size = 0;
+    *is_last = 1;
+    return GOLIOTH_ERR_NO_MORE_DATA;
+}
+
+static enum golioth_status block_upload_audio_stream_cb(uint32_t block_idx,
+                                                        uint8_t *block_buffer,
+                                                        size_t *block_size,
+                                                        bool *is_last,
+                                                        void *arg)
+{
+    struct audio_stream *stream = (struct audio_stream *)arg;
+
+    if (!stream)
+    {
+        GLTH_LOGE(TAG, "arg was NULL but should have been pointer to an audio stream");
+        return GOLIOTH_ERR_INVALID_STATE;
+    }
+
+    *block_size = audio_stream_read(stream, block_buffer, *block_size, is_last);
+
+    if (*block_size == 0)
+    {
+        GLTH_LOGE(TAG, "Error, no bytes read from audio stream");
+        *is_last = 1;
+        return GOLIOTH_ERR_NO_MORE_DATA;
+    }
+
+    upload_metrics_first_byte();
+
+    GLTH_LOGI(TAG,
+              "Uploading block_id: %u block_size: %zu is_last: %u",
+              (unsigned int) block_idx,
+              *block_size,
+              *is_last);
+
+    return GOLIOTH_OK;
+}
+
+#if CONFIG_EXAMPLE_UPLOAD_PREFETCH_DEPTH > 0
+static enum golioth_status block_upload_prefetch_cb(uint32_t block_idx,
+                                                    uint8_t *block_buffer,
+                                                    size_t *block_size,
+                                                    bool *is_last,
+                                                    void *arg)
+{
+    struct upload_prefetch *pf = (struct upload_prefetch *)arg;
+
+    if (!pf)
+    {
+        GLTH_LOGE(TAG, "arg was NULL but should have been pointer to a prefetcher");
+        return GOLIOTH_ERR_INVALID_STATE;
+    }
+
+    *block_size = upload_prefetch_read(pf, block_buffer, *block_size, is_last);
+
+    if (*block_size == 0)
+    {
+        GLTH_LOGE(TAG, "Error, no bytes read from audio filestream");
+        *is_last = 1;
+        return GOLIOTH_ERR_NO_MORE_DATA;
+    }
+
+    upload_metrics_first_byte();
+
+    GLTH_LOGI(TAG,
+              "Uploading block_id: %u block_size: %zu is_last: %u",
+              (unsigned int) block_idx,
+              *block_size,
+              *is_last);
+
+    return GOLIOTH_OK;
+}
+
+static void log_prefetch_stats(const struct upload_prefetch_stats *stats)
+{
+    uint32_t avg_wait_us = stats->waits ? (uint32_t) (stats->total_wait_us / stats->waits) : 0;
+
+    GLTH_LOGI(TAG,
+              "Prefetch: %" PRIu32 " bytes in %" PRIu32 " reads, %" PRIu32
+              " waited for SD (avg %" PRIu32 " us, max %" PRIu32 " us)",
+              stats->bytes,
+              stats->reads,
+              stats->waits,
+              avg_wait_us,
+              stats->max_wait_us);
+}
+#endif
+
+#ifdef CONFIG_EXAMPLE_UPLOAD_COMPRESSION
+/* Compression stage between a file source and the upload, see upload_compressed() */
+struct compressed_upload {
+    struct lz_stream *lz;
+    lz_stream_read_fn source;
+    void *source_ctx;
+    uint32_t expected;
+    uint32_t blocks;
+    uint32_t max_cpu_us;
+    uint64_t cpu_us;
+    /* Time spent in the source, taken out of the compression time */
+    uint64_t read_us;
+};
+
+static size_t timed_source_read(void *ctx, uint8_t *buf, size_t len)
+{
+    struct compressed_upload *c = (struct compressed_upload *) ctx;
+    int64_t start = esp_timer_get_time();
+
+    size_t n = c->source(c->source_ctx, buf, len);
+
+    c->read_us += (uint64_t) (esp_timer_get_time() - start);
+    return n;
+}
+
+static size_t read_filestream(void *ctx, uint8_t *buf, size_t len)
+{
+    struct filestream_upload *upload = (struct filestream_upload *) ctx;
+    size_t n = fread(buf, 1, MIN(len, upload->remaining), upload->f);
+
+    upload->remaining -= n;
+    return n;
+}
+
+#if CONFIG_EXAMPLE_UPLOAD_PREFETCH_DEPTH > 0
+static size_t read_prefetch(void *ctx, uint8_t *buf, size_t len)
+{
+    bool is_last;
+
+    return upload_prefetch_read((struct upload_prefetch *) ctx, buf, len, &is_last);
+}
+#endif
+
+static enum golioth_status block_upload_compressed_cb(uint32_t block_idx,
+                                                      uint8_t *block_buffer,
+                                                      size_t *block_size,
+                                                      bool *is_last,
+                                                      void *arg)
+{
+    struct compressed_upload *c = (struct compressed_upload *) arg;
+    int64_t start = esp_timer_get_time();
+    uint64_t read_us = c->read_us;
+
+    *block_size = lz_stream_read(c->lz, block_buffer, *block_size, is_last);
+
+    uint32_t cpu_us = (uint32_t) (esp_timer_get_time() - start - (int64_t) (c->read_us - read_us));
+    c->blocks++;
+    c->cpu_us += cpu_us;
+    c->max_cpu_us = MAX(c->max_cpu_us, cpu_us);
+
+    /* The stream ends early if the file could not be read to the end */
+    if (*is_last && c->expected != LZ_STREAM_SIZE_UNKNOWN && c->lz->bytes_in != c->expected)
+    {
+        GLTH_LOGE(TAG,
+                  "Error, read %" PRIu32 " of %" PRIu32 " bytes from audio filestream",
+                  c->lz->bytes_in,
+                  c->expected);
+        return GOLIOTH_ERR_NO_MORE_DATA;
+    }
+
+    upload_metrics_first_byte();
+
+    GLTH_LOGI(TAG,
+              "Uploading block_id: %u block_size: %zu is_last: %u (%" PRIu32 " us)",
+              (unsigned int) block_idx,
+              *block_size,
+              *is_last,
+              cpu_us);
+
+    return GOLIOTH_OK;
+}
+
+static void log_compression_stats(const struct compressed_upload *c)
+{
+    int32_t saved = (int32_t) c->lz->bytes_in - (int32_t) c->lz->bytes_out;
+    int32_t saved_pct = c->lz->bytes_in ? saved * 100 / (int32_t) c->lz->bytes_in : 0;
+    uint32_t avg_us = c->blocks ? (uint32_t) (c->cpu_us / c->blocks) : 0;
+
+    GLTH_LOGI(TAG,
+              "Compressed %" PRIu32 " to %" PRIu32 " bytes, saved %" PRId32 " (%" PRId32
+              "%%), CPU per block avg %" PRIu32 " us, max %" PRIu32 " us",
+              c->lz->bytes_in,
+              c->lz->bytes_out,
+              saved,
+              saved_pct,
+              avg_us,
+              c->max_cpu_us);
+}
+
+/* Bytes upload_filestream() will read: len, or up to the end of the file */
+static uint32_t filestream_size(FILE *f, size_t len)
+{
+    struct stat st;
+    long pos = ftell(f);
+
+    if (fstat(fileno(f), &st) != 0 || pos < 0)
+    {
+        return LZ_STREAM_SIZE_UNKNOWN;
+    }
+
+    return (uint32_t) MIN(len, (size_t) (st.st_size > pos ? st.st_size - pos : 0));
+}
+
+/* Uploads a GLZ container holding size bytes pulled from source */
+static int upload_compressed(const struct upload_sink *sink,
+                             const char *path,
+                             lz_stream_read_fn source,
+                             void *source_ctx,
+                             uint32_t size)
+{
+    struct compressed_upload c = {
+        .lz = malloc(sizeof(struct lz_stream)),
+        .source = source,
+        .source_ctx = source_ctx,
+        .expected = size,
+    };
+
+    if (!c.lz)
+    {
+        GLTH_LOGE(TAG, "Unable to allocate compressor");
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    /* Differences of neighbouring samples repeat far more often than the samples */
+    uint8_t flags = (CONFIG_EXAMPLE_BIT_SAMPLE == 16) ? LZ_STREAM_FLAG_DELTA16 : 0;
+    lz_stream_init(c.lz, flags, size, timed_source_read, &c);
+
+    int err = upload_blockwise(sink, path, block_upload_compressed_cb, (void *) &c);
+
+    log_compression_stats(&c);
+    free(c.lz);
+
+    return err;
+}
+#endif
+
+/*
+ * Uploads len bytes of f, reading ahead of the upload when prefetching is enabled.
+ * With compress set and CONFIG_EXAMPLE_UPLOAD_COMPRESSION, the bytes are sent as a
+ * GLZ container instead.
+ */
+static int upload_filestream(const struct upload_sink *sink,
+                             const char *path,
+                             FILE *f,
+                             size_t len,
+                             bool compress)
+{
+#ifdef CONFIG_EXAMPLE_UPLOAD_COMPRESSION
+    uint32_t size = (f && compress) ? filestream_size(f, len) : 0;
+#endif
+
+#if CONFIG_EXAMPLE_UPLOAD_PREFETCH_DEPTH > 0
+    struct upload_prefetch *pf = upload_prefetch_start(f,
+                                                       len,
+                                                       UPLOAD_BLOCK_SIZE,
+                                                       CONFIG_EXAMPLE_UPLOAD_PREFETCH_DEPTH);
+    if (pf)
+    {
+#ifdef CONFIG_EXAMPLE_UPLOAD_COMPRESSION
+        int err = compress ? upload_compressed(sink, path, read_prefetch, pf, size)
+                           : upload_blockwise(sink, path, block_upload_prefetch_cb, (void *) pf);
+#else
+        int err = upload_blockwise(sink,
+                                   path,
+                                   block_upload_prefetch_cb,
+                                   (void *) pf);
+#endif
+
+        struct upload_prefetch_stats stats = upload_prefetch_stop(pf);
+        log_prefetch_stats(&stats);
+        return err;
+    }
+
+    if (f)
+    {
+        GLTH_LOGW(TAG, "Prefetch unavailable, reading in the upload callback");
+    }
+#endif
+
+    struct filestream_upload upload = {
+        .f = f,
+        .remaining = len,
+    };
+
+#ifdef CONFIG_EXAMPLE_UPLOAD_COMPRESSION
+    if (f && compress)
+    {
+        return upload_compressed(sink, path, read_filestream, &upload, size);
+    }
+#endif
+
+    return upload_blockwise(sink,
+                            path,
+                            block_upload_audio_filestream_cb,
+                            f ? (void *) &upload : NULL);
+}
+
+#ifdef CONFIG_EXAMPLE_RESUMABLE_UPLOAD
+/* Tells a new recording from the one being resumed when both have the same name and size */
+static uint32_t first_block_crc(FILE *f)
+{
+    uint8_t *buf = malloc(UPLOAD_BLOCK_SIZE);
+    uint32_t crc = 0;
+
+    if (buf)
+    {
+        size_t len = fread(buf, 1, UPLOAD_BLOCK_SIZE, f);
+        crc = esp_rom_crc32_le(0, buf, len);
+        free(buf);
+    }
+
+    rewind(f);
+    return crc;
+}
+
+/*
+ * Uploads f as parts of UPLOAD_PART_SIZE bytes, each a complete blockwise transfer
+ * to file_upload/<id>/<offset>-<size>. Progress is saved to NVS after every part,
+ * so a failed part is retried, and an upload cut short by a reset continues on the
+ * next run, from the first part that was not acknowledged.
+ */
+static int upload_resumable(const struct upload_sink *sink, const char *name, FILE *f)
+{
+    struct upload_progress progress;
+    struct stat st;
+
+    if (!f || fstat(fileno(f), &st) != 0)
+    {
+        return GOLIOTH_ERR_INVALID_STATE;
+    }
+
+    uint32_t size = (uint32_t) st.st_size;
+    uint32_t crc = first_block_crc(f);
+
+    if (upload_progress_load(name, &progress) && progress.size == size
+        && progress.first_block_crc == crc)
+    {
+        GLTH_LOGI(TAG,
+                  "Resuming upload %08" PRIx32 " at block %" PRIu32,
+                  progress.id,
+                  progress.next_block);
+    }
+    else
+    {
+        progress = (struct upload_progress) {
+            .id = esp_random(),
+            .size = size,
+            .first_block_crc = crc,
+        };
+        snprintf(progress.name, sizeof(progress.name), "%s", name);
+
+        /* Saved up front, so a part that reached the server before a reset keeps its path */
+        upload_progress_save(&progress);
+    }
+
+    uint32_t offset = MIN(progress.next_block * UPLOAD_BLOCK_SIZE, size);
+    int retries = 0;
+    int err = GOLIOTH_OK;
+
+    while (offset < size)
+    {
+        uint32_t part_len = MIN(UPLOAD_PART_SIZE, size - offset);
+        char path[48];
+
+        snprintf(path,
+                 sizeof(path),
+                 "file_upload/%08" PRIx32 "/%" PRIu32 "-%" PRIu32,
+                 progress.id,
+                 offset,
+                 size);
+
+        fseek(f, offset, SEEK_SET);
+        err = upload_filestream(sink, path, f, part_len, true);
+        if (err != GOLIOTH_OK)
+        {
+            if (retries++ >= CONFIG_EXAMPLE_UPLOAD_RETRIES)
+            {
+                break;
+            }
+
+            GLTH_LOGW(TAG,
+                      "Upload of part at %" PRIu32 " failed (%d), retry %d in %d ms",
+                      offset,
+                      err,
+                      retries,
+                      UPLOAD_RETRY_DELAY_MS);
+            vTaskDelay(pdMS_TO_TICKS(UPLOAD_RETRY_DELAY_MS));
+            continue;
+        }
+
+        retries = 0;
+        offset += part_len;
+        progress.next_block = offset / UPLOAD_BLOCK_SIZE;
+        upload_progress_save(&progress);
+    }
+
+    if (offset >= size)
+    {
+        upload_progress_clear(name);
+    }
+
+    return err;
+}
+#endif
+
+#if !defined(CONFIG_EXAMPLE_RESUMABLE_UPLOAD) || defined(CONFIG_EXAMPLE_VAD)
+/*
+ * Queued recordings may upload concurrently, and blockwise transfers to the same
+ * path would be mixed up on the server, so each gets a path of its own.
+ */
+static void upload_path(char *path, size_t len, const char *base, const struct audio_ctx *a_ctx)
+{
+#ifdef CONFIG_EXAMPLE_UPLOAD_QUEUE
+    snprintf(path, len, "%s/%s", base, a_ctx->filename);
+#else
+    snprintf(path, len, "%s", base);
+#endif
+}
+#endif
+
+int upload_audio_file(const struct upload_sink *sink, struct audio_ctx *a_ctx)
+{
+    FILE *f = get_audio_filestream(a_ctx);
+
+#ifdef CONFIG_EXAMPLE_RESUMABLE_UPLOAD
+    int err = upload_resumable(sink, a_ctx->filename, f);
+#else
+    char path[sizeof("file_upload/") + sizeof(a_ctx->filename)];
+    upload_path(path, sizeof(path), "file_upload", a_ctx);
+    int err = upload_filestream(sink, path, f, SIZE_MAX, true);
+#endif
+
+    release_audio_filestream(f);
+
+#ifdef CONFIG_EXAMPLE_VAD
+    /* The activity index follows its recording so timestamps can be rebuilt */
+    if (err == GOLIOTH_OK)
+    {
+        struct audio_ctx index_ctx = audio_ctx_index(a_ctx);
+        f = get_audio_filestream(&index_ctx);
+
+        char index_path[sizeof("file_upload_index/") + sizeof(a_ctx->filename)];
+        upload_path(index_path, sizeof(index_path), "file_upload_index", a_ctx);
+        err = upload_filestream(sink, index_path, f, SIZE_MAX, false);
+
+        release_audio_filestream(f);
+    }
+#endif
+
+    return err;
+}
+
+#ifdef CONFIG_EXAMPLE_VAD
+int upload_activity_index(const struct upload_sink *sink)
+{
+    char *json = malloc(VAD_INDEX_JSON_MAX);
+    if (!json)
+    {
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    size_t len = audio_activity_index_json(json, VAD_INDEX_JSON_MAX);
+    int err = sink->write(sink->ctx,
+                          "file_upload_index",
+                          UPLOAD_SINK_OCTET_STREAM,
+                          (const uint8_t *) json,
+                          len);
+
+    free(json);
+    return err;
+}
+#endif
+
+int upload_audio_stream(const struct upload_sink *sink, struct audio_ctx *a_ctx)
+{
+    struct audio_stream *stream = audio_stream_start(a_ctx);
+
+    int err = upload_blockwise(sink,
+                               "file_upload",
+                               block_upload_audio_stream_cb,
+                               (void *) stream);
+
+    audio_stream_stop(stream);
+
+#ifdef CONFIG_EXAMPLE_VAD
+    if (err == GOLIOTH_OK)
+    {
+        err = upload_activity_index(sink);
+    }
+#endif
+
+    return err;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include "audio.h"
+#include "upload_sink.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Register the upload_stats shell command and reset the block size
+ * controller. Once, before the first upload.
+ */
+void upload_init(void);
+
+/*
+ * Time to first byte and peak heap use of one record + upload cycle. Started
+ * before recording, marked when the recording is complete (not at all when
+ * recording and upload overlap), reported after the upload.
+ */
+void upload_metrics_start(void);
+void upload_metrics_recorded(void);
+void upload_metrics_first_byte(void);
+void upload_metrics_report(const char *mode);
+
+/**
+ * @brief Blockwise upload of the blocks cb hands out to path.
+ *
+ * The fill callback is timed against the wait for each block's
+ * acknowledgement. The summary is logged, kept for the upload_stats shell
+ * command and, with CONFIG_EXAMPLE_UPLOAD_STATS_STREAM, written to the
+ * upload_stats path of the same sink.
+ *
+ * @return GOLIOTH_OK or the error of the sink or of cb
+ */
+int upload_blockwise(const struct upload_sink *sink,
+                     const char *path,
+                     upload_sink_read_block_cb cb,
+                     void *arg);
+
+/**
+ * @brief Upload the recording named by a_ctx from the SD card, followed by its
+ * activity index with CONFIG_EXAMPLE_VAD.
+ */
+int upload_audio_file(const struct upload_sink *sink, struct audio_ctx *a_ctx);
+
+/**
+ * @brief Record and upload at the same time, straight from the capture ring.
+ */
+int upload_audio_stream(const struct upload_sink *sink, struct audio_ctx *a_ctx);
+
+/**
+ * @brief Upload the activity index of the last recording, for recordings that
+ * have no index file next to them.
+ */
+int upload_activity_index(const struct upload_sink *sink);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "audio_ring.h"
+#include "upload_prefetch.h"
+
+#define READER_TASK_PRIORITY    (5)
+#define READER_TASK_STACK_SIZE  (3072)
+/* How often a reader waiting for a free block checks for a stop request */
+#define READER_POLL_MS          (100)
+
+struct upload_prefetch {
+    struct audio_ring ring;
+    FILE *f;
+    volatile bool stop;
+    SemaphoreHandle_t done_sem;
+    /* Bytes to hand out, at most up to the end of the file */
+    uint32_t size;
+    /* Bytes left for the reader */
+    uint32_t unread;
+    /* Block being copied out, NULL between blocks */
+    struct audio_slot *slot;
+    size_t slot_pos;
+    bool eos;
+    struct upload_prefetch_stats stats;
+};
+
+static void reader_task(void *arg)
+{
+    struct upload_prefetch *pf = arg;
+
+    while (!pf->stop)
+    {
+        struct audio_slot *slot = audio_ring_acquire_wait(&pf->ring,
+                                                          pdMS_TO_TICKS(READER_POLL_MS));
+        if (!slot)
+        {
+            continue;
+        }
+
+        size_t want = MIN(pf->ring.slot_size, pf->unread);
+        size_t len = want ? fread(slot->data, 1, want, pf->f) : 0;
+        if (len == 0)
+        {
+            audio_ring_cancel(&pf->ring, slot);
+            break;
+        }
+
+        slot->len = len;
+        pf->unread -= len;
+        audio_ring_commit(&pf->ring, slot);
+
+        /* End of the range, end of file or read error */
+        if (len < want || pf->unread == 0)
+        {
+            break;
+        }
+    }
+
+    audio_ring_finish(&pf->ring);
+    xSemaphoreGive(pf->done_sem);
+    vTaskDelete(NULL);
+}
+
+struct upload_prefetch *upload_prefetch_start(FILE *f,
+                                              size_t len,
+                                              size_t block_size,
+                                              size_t depth)
+{
+    struct stat st;
+
+    if (!f || fstat(fileno(f), &st) != 0)
+    {
+        return NULL;
+    }
+
+    struct upload_prefetch *pf = calloc(1, sizeof(struct upload_prefetch));
+    if (!pf)
+    {
+        return NULL;
+    }
+
+    long pos = ftell(f);
+    pf->f = f;
+    pf->size = (pos >= 0 && st.st_size > pos) ? (uint32_t) (st.st_size - pos) : 0;
+    pf->size = MIN(pf->size, len);
+    pf->unread = pf->size;
+    pf->done_sem = xSemaphoreCreateBinary();
+
+    if (!pf->done_sem || audio_ring_init(&pf->ring, depth, block_size) != ESP_OK)
+    {
+        if (pf->done_sem)
+        {
+            vSemaphoreDelete(pf->done_sem);
+        }
+        free(pf);
+        return NULL;
+    }
+
+    if (xTaskCreate(reader_task,
+                    "upload_prefetch",
+                    READER_TASK_STACK_SIZE,
+                    pf,
+                    READER_TASK_PRIORITY,
+                    NULL)
+        != pdPASS)
+    {
+        audio_ring_deinit(&pf->ring);
+        vSemaphoreDelete(pf->done_sem);
+        free(pf);
+        return NULL;
+    }
+
+    return pf;
+}
+
+/* Next block from the reader, timing the wait if none is ready yet */
+static struct audio_slot *next_block(struct upload_prefetch *pf)
+{
+    struct audio_slot *slot = audio_ring_consume(&pf->ring, 0);
+
+    if (!slot)
+    {
+        int64_t start = esp_timer_get_time();
+        slot = audio_ring_consume(&pf->ring, portMAX_DELAY);
+        uint32_t wait_us = (uint32_t) (esp_timer_get_time() - start);
+
+        pf->stats.waits++;
+        pf->stats.total_wait_us += wait_us;
+        pf->stats.max_wait_us = MAX(pf->stats.max_wait_us, wait_us);
+    }
+
+    return slot;
+}
+
+size_t upload_prefetch_read(struct upload_prefetch *pf, uint8_t *buf, size_t len, bool *is_last)
+{
+    size_t copied = 0;
+
+    pf->stats.reads++;
+
+    while (copied < len && !pf->eos)
+    {
+        if (!pf->slot)
+        {
+            struct audio_slot *slot = next_block(pf);
+            if (audio_slot_is_eos(slot))
+            {
+                audio_ring_release(&pf->ring, slot);
+                pf->eos = true;
+                break;
+            }
+
+            pf->slot = slot;
+            pf->slot_pos = 0;
+        }
+
+        size_t n = MIN(len - copied, pf->slot->len - pf->slot_pos);
+        memcpy(&buf[copied], &pf->slot->data[pf->slot_pos], n);
+        copied += n;
+        pf->slot_pos += n;
+
+        if (pf->slot_pos == pf->slot->len)
+        {
+            audio_ring_release(&pf->ring, pf->slot);
+            pf->slot = NULL;
+        }
+    }
+
+    pf->stats.bytes += copied;
+
+    /* The size is known up front, so the last block needs no look-ahead */
+    *is_last = pf->eos || pf->stats.bytes >= pf->size;
+
+    return copied;
+}
+
+struct upload_prefetch_stats upload_prefetch_stop(struct upload_prefetch *pf)
+{
+    struct upload_prefetch_stats stats = pf->stats;
+
+    pf->stop = true;
+    xSemaphoreTake(pf->done_sem, portMAX_DELAY);
+
+    vSemaphoreDelete(pf->done_sem);
+    audio_ring_deinit(&pf->ring);
+    free(pf);
+
+    return stats;
+}
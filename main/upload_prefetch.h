@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+struct upload_prefetch_stats {
+    /* Bytes handed to the upload callback */
+    uint32_t bytes;
+    /* Reads that found no block ready and had to wait for the SD card */
+    uint32_t reads;
+    uint32_t waits;
+    uint32_t max_wait_us;
+    uint64_t total_wait_us;
+};
+
+/**
+ * @brief Reads a file ahead of a blockwise upload.
+ *
+ * A reader task keeps up to depth blocks of the file in RAM, so the upload
+ * callback only copies a ready block instead of waiting on the SD card.
+ */
+struct upload_prefetch;
+
+/**
+ * @brief Start reading up to len bytes of f from its current position.
+ *
+ * @param len Bytes to read, SIZE_MAX for the rest of the file
+ * @return NULL if the reader could not be started, f is left untouched
+ */
+struct upload_prefetch *upload_prefetch_start(FILE *f,
+                                              size_t len,
+                                              size_t block_size,
+                                              size_t depth);
+
+/**
+ * @brief Copy the next len bytes of the file into buf.
+ *
+ * @param is_last Set once the end of the file has been handed out
+ * @return Bytes copied, short only at the end of the file or on a read error
+ */
+size_t upload_prefetch_read(struct upload_prefetch *pf, uint8_t *buf, size_t len, bool *is_last);
+
+/**
+ * @brief Stop the reader, which may still be running if the upload was
+ * aborted, and free everything. The file is not closed.
+ */
+struct upload_prefetch_stats upload_prefetch_stop(struct upload_prefetch *pf);
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_rom_crc.h"
+/* nvs_flash.h pulls in the IDF nvs.h, not the sample's nvs.h found first on the include path */
+#include "nvs_flash.h"
+#include "upload_progress.h"
+
+#define PROGRESS_NAMESPACE  "upload"
+
+/*
+ * NVS keys are limited to 15 characters, so the key is a CRC of the whole name,
+ * which names sharing a prefix do not share
+ */
+static void progress_key(const char *name, char key[NVS_KEY_NAME_MAX_SIZE])
+{
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *) name, strlen(name));
+
+    snprintf(key, NVS_KEY_NAME_MAX_SIZE, "%08" PRIx32, crc);
+}
+
+bool upload_progress_load(const char *name, struct upload_progress *progress)
+{
+    nvs_handle_t handle;
+    size_t len = sizeof(*progress);
+    char key[NVS_KEY_NAME_MAX_SIZE];
+
+    progress_key(name, key);
+
+    if (nvs_open(PROGRESS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+    {
+        return false;
+    }
+
+    esp_err_t err = nvs_get_blob(handle, key, progress, &len);
+    nvs_close(handle);
+
+    /* The stored full name tells apart the rare two names with the same CRC */
+    return err == ESP_OK && len == sizeof(*progress)
+           && strncmp(progress->name, name, sizeof(progress->name)) == 0;
+}
+
+esp_err_t upload_progress_save(const struct upload_progress *progress)
+{
+    nvs_handle_t handle;
+    char key[NVS_KEY_NAME_MAX_SIZE];
+
+    progress_key(progress->name, key);
+
+    esp_err_t err = nvs_open(PROGRESS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    err = nvs_set_blob(handle, key, progress, sizeof(*progress));
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+
+    return err;
+}
+
+void upload_progress_clear(const char *name)
+{
+    nvs_handle_t handle;
+    char key[NVS_KEY_NAME_MAX_SIZE];
+
+    progress_key(name, key);
+
+    if (nvs_open(PROGRESS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+    {
+        return;
+    }
+
+    nvs_erase_key(handle, key);
+    nvs_commit(handle);
+    nvs_close(handle);
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * @brief Progress of a resumable upload, kept in NVS across resets.
+ *
+ * A file is uploaded as a series of parts, each a complete blockwise
+ * transfer of its own. next_block counts the 1 KB blocks acknowledged so
+ * far, always a whole number of parts. Each file name has its own record,
+ * so several uploads can be in progress at once.
+ */
+struct upload_progress {
+    /* Random id naming the upload on the server */
+    uint32_t id;
+    /* Identify the file, so a different recording under the same name starts over */
+    uint32_t size;
+    uint32_t first_block_crc;
+    uint32_t next_block;
+    /* Whole file name, the NVS key is a CRC of it */
+    char name[32];
+};
+
+/**
+ * @return false if no upload is in progress
+ */
+bool upload_progress_load(const char *name, struct upload_progress *progress);
+esp_err_t upload_progress_save(const struct upload_progress *progress);
+void upload_progress_clear(const char *name);
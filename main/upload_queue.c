@@ -0,0 +1,530 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "upload_queue.h"
+
+/* Include the Golioth Client to access backend logging */
+#include <golioth/client.h>
+static const char *TAG = "upload_queue";
+
+#define JOURNAL_PATH            SD_MOUNT_POINT "/uploadq.txt"
+#define JOURNAL_TMP_PATH        SD_MOUNT_POINT "/uploadq.tmp"
+#define JOURNAL_LINE_MAX        (32)
+
+#define WORKER_TASK_PRIORITY    (4)
+#define WORKER_TASK_STACK_SIZE  (6144)
+/* Longest a worker sleeps before looking for due retries again */
+#define WORKER_POLL_MS          (1000)
+#define WAIT_POLL_MS            (100)
+
+/* First retry delay, doubled after every further failure */
+#define BACKOFF_BASE_MS         (2000)
+#define BACKOFF_MAX_MS          (CONFIG_EXAMPLE_UPLOAD_BACKOFF_MAX_S * 1000)
+
+enum entry_state {
+    ENTRY_FREE,
+    /* Named, still being recorded */
+    ENTRY_RESERVED,
+    ENTRY_PENDING,
+    ENTRY_UPLOADING,
+};
+
+struct queue_entry {
+    uint32_t seq;
+    uint32_t attempts;
+    int64_t retry_at_us;
+    enum entry_state state;
+};
+
+static struct {
+    upload_queue_fn upload;
+    void *arg;
+    FILE *journal;
+    uint32_t next_seq;
+    struct queue_entry entries[CONFIG_EXAMPLE_UPLOAD_QUEUE_SIZE];
+    SemaphoreHandle_t lock;
+    /* Given when a recording is queued or the workers should stop */
+    SemaphoreHandle_t wake;
+    SemaphoreHandle_t done_sem;
+    volatile bool stop;
+    uint32_t uploaded;
+    uint32_t failures;
+} _q;
+
+static struct audio_ctx entry_ctx(uint32_t seq)
+{
+    struct audio_ctx ctx = audio_ctx_default();
+
+    /* r<seq>.wav is 8.3 and works without FATFS long filename support */
+    snprintf(ctx.filename, sizeof(ctx.filename), "r%07" PRIu32 AUDIO_FILE_EXT, seq);
+    return ctx;
+}
+
+static bool recording_exists(const struct audio_ctx *rec)
+{
+    char path[sizeof(SD_MOUNT_POINT) + sizeof(rec->filename)];
+    struct stat st;
+
+    snprintf(path, sizeof(path), "%s/%s", SD_MOUNT_POINT, rec->filename);
+    return stat(path, &st) == 0;
+}
+
+static void delete_recording(const struct audio_ctx *rec)
+{
+    char path[sizeof(SD_MOUNT_POINT) + sizeof(rec->filename)];
+
+    snprintf(path, sizeof(path), "%s/%s", SD_MOUNT_POINT, rec->filename);
+    unlink(path);
+
+#ifdef CONFIG_EXAMPLE_VAD
+    struct audio_ctx index_ctx = audio_ctx_index(rec);
+    snprintf(path, sizeof(path), "%s/%s", SD_MOUNT_POINT, index_ctx.filename);
+    unlink(path);
+#endif
+}
+
+/* Appends one record, durable once this returns. Called with the lock held. */
+static esp_err_t journal_append(FILE *f, const char *op, uint32_t seq)
+{
+    if (fprintf(f, "%s %" PRIu32 "\n", op, seq) < 0 || fflush(f) != 0 || fsync(fileno(f)) != 0)
+    {
+        GLTH_LOGE(TAG, "Unable to write the journal");
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+static void remove_seq(uint32_t *seqs, size_t *count, uint32_t seq)
+{
+    for (size_t i = 0; i < *count; i++)
+    {
+        if (seqs[i] == seq)
+        {
+            memmove(&seqs[i], &seqs[i + 1], (*count - i - 1) * sizeof(seqs[0]));
+            (*count)--;
+            return;
+        }
+    }
+}
+
+/*
+ * Reads the journal into the list of recordings queued but not uploaded, oldest
+ * first. A line cut short by a reset has no newline and is ignored.
+ */
+static esp_err_t journal_replay(FILE *f, uint32_t **seqs, size_t *count)
+{
+    char line[JOURNAL_LINE_MAX];
+    size_t capacity = 0;
+
+    while (fgets(line, sizeof(line), f))
+    {
+        char op[8];
+        uint32_t seq;
+
+        if (!strchr(line, '\n') || sscanf(line, "%7s %" SCNu32, op, &seq) != 2)
+        {
+            continue;
+        }
+
+        if (strcmp(op, "next") == 0)
+        {
+            _q.next_seq = MAX(_q.next_seq, seq);
+        }
+        else if (strcmp(op, "add") == 0)
+        {
+            if (*count == capacity)
+            {
+                capacity = capacity ? capacity * 2 : CONFIG_EXAMPLE_UPLOAD_QUEUE_SIZE;
+                uint32_t *grown = realloc(*seqs, capacity * sizeof(uint32_t));
+                if (!grown)
+                {
+                    return ESP_ERR_NO_MEM;
+                }
+                *seqs = grown;
+            }
+
+            (*seqs)[(*count)++] = seq;
+            _q.next_seq = MAX(_q.next_seq, seq + 1);
+        }
+        else if (strcmp(op, "done") == 0)
+        {
+            remove_seq(*seqs, count, seq);
+        }
+    }
+
+    return ESP_OK;
+}
+
+/*
+ * Replaces the journal with one holding only the next sequence number and the
+ * pending recordings, so it does not grow across runs. The new journal is
+ * written to a temporary file first, replay falls back to it if a reset
+ * interrupts the swap.
+ */
+static esp_err_t journal_compact(const uint32_t *seqs, size_t count)
+{
+    FILE *f = fopen(JOURNAL_TMP_PATH, "w");
+    if (!f)
+    {
+        return ESP_FAIL;
+    }
+
+    esp_err_t err = journal_append(f, "next", _q.next_seq);
+    for (size_t i = 0; i < count && err == ESP_OK; i++)
+    {
+        err = journal_append(f, "add", seqs[i]);
+    }
+    fclose(f);
+
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    /* FAT cannot rename over an existing file */
+    unlink(JOURNAL_PATH);
+    return rename(JOURNAL_TMP_PATH, JOURNAL_PATH) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t journal_open(void)
+{
+    uint32_t *seqs = NULL;
+    size_t count = 0;
+
+    _q.next_seq = 1;
+
+    FILE *f = fopen(JOURNAL_PATH, "r");
+    if (!f)
+    {
+        /* A reset between the unlink and rename of a compaction */
+        f = fopen(JOURNAL_TMP_PATH, "r");
+    }
+
+    esp_err_t err = ESP_OK;
+    if (f)
+    {
+        err = journal_replay(f, &seqs, &count);
+        fclose(f);
+    }
+
+    if (err == ESP_OK)
+    {
+        err = journal_compact(seqs, count);
+    }
+
+    if (err == ESP_OK)
+    {
+        /* Recordings beyond the queue size stay in the journal for a later run */
+        for (size_t i = 0; i < MIN(count, CONFIG_EXAMPLE_UPLOAD_QUEUE_SIZE); i++)
+        {
+            _q.entries[i] = (struct queue_entry) {
+                .seq = seqs[i],
+                .state = ENTRY_PENDING,
+            };
+        }
+
+        GLTH_LOGI(TAG,
+                  "Resuming %u queued recordings, next is %" PRIu32,
+                  (unsigned int) count,
+                  _q.next_seq);
+
+        _q.journal = fopen(JOURNAL_PATH, "a");
+        err = _q.journal ? ESP_OK : ESP_FAIL;
+    }
+
+    free(seqs);
+    return err;
+}
+
+static uint32_t backoff_ms(uint32_t attempts)
+{
+    uint32_t shift = MIN(attempts - 1, 16);
+
+    return MIN((uint32_t) BACKOFF_BASE_MS << shift, BACKOFF_MAX_MS);
+}
+
+/*
+ * Claims the oldest recording that is due for upload. Otherwise returns NULL and
+ * sets wait to the time until the next retry is due.
+ */
+static struct queue_entry *claim_next(TickType_t *wait)
+{
+    struct queue_entry *next = NULL;
+    int64_t now = esp_timer_get_time();
+    int64_t soonest = now + WORKER_POLL_MS * 1000LL;
+
+    xSemaphoreTake(_q.lock, portMAX_DELAY);
+
+    for (size_t i = 0; i < CONFIG_EXAMPLE_UPLOAD_QUEUE_SIZE; i++)
+    {
+        struct queue_entry *e = &_q.entries[i];
+
+        if (e->state != ENTRY_PENDING)
+        {
+            continue;
+        }
+
+        if (e->retry_at_us > now)
+        {
+            soonest = MIN(soonest, e->retry_at_us);
+        }
+        else if (!next || e->seq < next->seq)
+        {
+            next = e;
+        }
+    }
+
+    if (next)
+    {
+        next->state = ENTRY_UPLOADING;
+    }
+
+    xSemaphoreGive(_q.lock);
+
+    *wait = pdMS_TO_TICKS((soonest - now) / 1000) + 1;
+    return next;
+}
+
+static void upload_entry(struct queue_entry *e)
+{
+    struct audio_ctx rec = entry_ctx(e->seq);
+    int err = 0;
+
+    if (!recording_exists(&rec))
+    {
+        /* Nothing to retry, e.g. a reset hit between journaling and deleting an upload */
+        GLTH_LOGW(TAG, "%s is missing, dropping it from the queue", rec.filename);
+    }
+    else
+    {
+        GLTH_LOGI(TAG, "Uploading %s, attempt %" PRIu32, rec.filename, e->attempts + 1);
+        err = _q.upload(&rec, _q.arg);
+    }
+
+    xSemaphoreTake(_q.lock, portMAX_DELAY);
+
+    if (err == 0)
+    {
+        /* Journaled first: a reset before the delete leaves a stray file, not a stuck entry */
+        journal_append(_q.journal, "done", e->seq);
+        delete_recording(&rec);
+
+        e->state = ENTRY_FREE;
+        _q.uploaded++;
+    }
+    else
+    {
+        e->attempts++;
+        e->retry_at_us = esp_timer_get_time() + backoff_ms(e->attempts) * 1000LL;
+        e->state = ENTRY_PENDING;
+        _q.failures++;
+
+        GLTH_LOGW(TAG,
+                  "Upload of %s failed (%d), retrying in %" PRIu32 " ms",
+                  rec.filename,
+                  err,
+                  backoff_ms(e->attempts));
+    }
+
+    xSemaphoreGive(_q.lock);
+}
+
+static void worker_task(void *arg)
+{
+    while (!_q.stop)
+    {
+        TickType_t wait;
+        struct queue_entry *e = claim_next(&wait);
+
+        if (e)
+        {
+            upload_entry(e);
+        }
+        else
+        {
+            xSemaphoreTake(_q.wake, wait);
+        }
+    }
+
+    xSemaphoreGive(_q.done_sem);
+    vTaskDelete(NULL);
+}
+
+esp_err_t upload_queue_start(upload_queue_fn upload, void *arg)
+{
+    _q.upload = upload;
+    _q.arg = arg;
+    _q.lock = xSemaphoreCreateMutex();
+    _q.wake = xSemaphoreCreateCounting(CONFIG_EXAMPLE_UPLOAD_QUEUE_WORKERS, 0);
+    _q.done_sem = xSemaphoreCreateCounting(CONFIG_EXAMPLE_UPLOAD_QUEUE_WORKERS, 0);
+
+    if (!_q.lock || !_q.wake || !_q.done_sem)
+    {
+        GLTH_LOGE(TAG, "Unable to allocate upload queue");
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t err = journal_open();
+    if (err != ESP_OK)
+    {
+        GLTH_LOGE(TAG, "Unable to open the upload journal: %d", err);
+        return err;
+    }
+
+    for (int i = 0; i < CONFIG_EXAMPLE_UPLOAD_QUEUE_WORKERS; i++)
+    {
+        xTaskCreate(worker_task,
+                    "upload_worker",
+                    WORKER_TASK_STACK_SIZE,
+                    NULL,
+                    WORKER_TASK_PRIORITY,
+                    NULL);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t upload_queue_reserve(struct audio_ctx *rec)
+{
+    esp_err_t err = ESP_ERR_NO_MEM;
+
+    xSemaphoreTake(_q.lock, portMAX_DELAY);
+
+    for (size_t i = 0; i < CONFIG_EXAMPLE_UPLOAD_QUEUE_SIZE; i++)
+    {
+        struct queue_entry *e = &_q.entries[i];
+
+        if (e->state == ENTRY_FREE)
+        {
+            *e = (struct queue_entry) {
+                .seq = _q.next_seq++,
+                .state = ENTRY_RESERVED,
+            };
+
+            uint32_t rec_time = rec->rec_time;
+            *rec = entry_ctx(e->seq);
+            rec->rec_time = rec_time;
+
+            err = ESP_OK;
+            break;
+        }
+    }
+
+    xSemaphoreGive(_q.lock);
+
+    if (err != ESP_OK)
+    {
+        GLTH_LOGW(TAG, "Upload queue full");
+    }
+
+    return err;
+}
+
+esp_err_t upload_queue_add(const struct audio_ctx *rec)
+{
+    uint32_t seq;
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+
+    if (sscanf(rec->filename, "r%" SCNu32, &seq) != 1)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(_q.lock, portMAX_DELAY);
+
+    for (size_t i = 0; i < CONFIG_EXAMPLE_UPLOAD_QUEUE_SIZE; i++)
+    {
+        struct queue_entry *e = &_q.entries[i];
+
+        if (e->state == ENTRY_RESERVED && e->seq == seq)
+        {
+            err = journal_append(_q.journal, "add", seq);
+            e->state = (err == ESP_OK) ? ENTRY_PENDING : ENTRY_FREE;
+            break;
+        }
+    }
+
+    xSemaphoreGive(_q.lock);
+
+    if (err == ESP_OK)
+    {
+        xSemaphoreGive(_q.wake);
+    }
+
+    return err;
+}
+
+struct upload_queue_metrics upload_queue_get_metrics(void)
+{
+    struct upload_queue_metrics m = {0};
+
+    xSemaphoreTake(_q.lock, portMAX_DELAY);
+
+    for (size_t i = 0; i < CONFIG_EXAMPLE_UPLOAD_QUEUE_SIZE; i++)
+    {
+        const struct queue_entry *e = &_q.entries[i];
+
+        if (e->state == ENTRY_PENDING || e->state == ENTRY_UPLOADING)
+        {
+            m.pending++;
+            m.max_attempts = MAX(m.max_attempts, e->attempts);
+        }
+    }
+
+    m.uploaded = _q.uploaded;
+    m.failures = _q.failures;
+
+    xSemaphoreGive(_q.lock);
+
+    return m;
+}
+
+bool upload_queue_wait_empty(TickType_t timeout)
+{
+    TickType_t start = xTaskGetTickCount();
+
+    while (upload_queue_get_metrics().pending > 0)
+    {
+        if (xTaskGetTickCount() - start >= timeout)
+        {
+            return false;
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(WAIT_POLL_MS));
+    }
+
+    return true;
+}
+
+void upload_queue_stop(void)
+{
+    _q.stop = true;
+
+    for (int i = 0; i < CONFIG_EXAMPLE_UPLOAD_QUEUE_WORKERS; i++)
+    {
+        xSemaphoreGive(_q.wake);
+    }
+
+    for (int i = 0; i < CONFIG_EXAMPLE_UPLOAD_QUEUE_WORKERS; i++)
+    {
+        xSemaphoreTake(_q.done_sem, portMAX_DELAY);
+    }
+
+    fclose(_q.journal);
+    _q.journal = NULL;
+}
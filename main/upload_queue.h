@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "audio.h"
+
+/**
+ * @brief Uploads one queued recording. Returns 0 on success.
+ */
+typedef int (*upload_queue_fn)(struct audio_ctx *rec, void *arg);
+
+struct upload_queue_metrics {
+    uint32_t pending;
+    uint32_t uploaded;
+    uint32_t failures;
+    /* Most failed attempts of any pending recording */
+    uint32_t max_attempts;
+};
+
+/**
+ * @brief Persistent queue of recordings waiting for upload.
+ *
+ * Every recording gets a unique name, r<seq>.wav, from a sequence number that
+ * survives resets. Queued and uploaded recordings are appended to a journal
+ * on the SD card, so after a reset the queue is rebuilt from the journal alone
+ * instead of a directory scan. CONFIG_EXAMPLE_UPLOAD_QUEUE_WORKERS tasks upload
+ * recordings oldest first. A failed upload is retried after an exponentially
+ * growing delay, and a recording is only deleted once it has been uploaded.
+ */
+
+/**
+ * @brief Rebuild the queue from the journal and start the upload workers.
+ */
+esp_err_t upload_queue_start(upload_queue_fn upload, void *arg);
+
+/**
+ * @brief Name a new recording. Fails with ESP_ERR_NO_MEM when the queue is full,
+ * in which case nothing should be recorded.
+ */
+esp_err_t upload_queue_reserve(struct audio_ctx *rec);
+
+/**
+ * @brief Queue a recording named by upload_queue_reserve(). The recording is
+ * in the journal once this returns.
+ */
+esp_err_t upload_queue_add(const struct audio_ctx *rec);
+
+/**
+ * @brief Wait until every queued recording has been uploaded.
+ *
+ * @return false if recordings were still pending after timeout
+ */
+bool upload_queue_wait_empty(TickType_t timeout);
+
+/**
+ * @brief Stop the workers once their current uploads are done. Pending
+ * recordings stay in the journal for the next run.
+ */
+void upload_queue_stop(void);
+
+struct upload_queue_metrics upload_queue_get_metrics(void);
@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+#include "upload_sink.h"
+
+#include <golioth/client.h>
+static const char *TAG = "upload_sink";
+
+#define FILE_PATH_MAX   (128)
+
+struct loopback_sink {
+    struct upload_sink_loopback_stats stats;
+    portMUX_TYPE lock;
+};
+
+/* CRC-32 as in zlib, a nibble at a time to keep the table small */
+static uint32_t crc32_update(uint32_t crc, const uint8_t *data, size_t len)
+{
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4,
+        0x4DB26158, 0x5005713C, 0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+        0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+
+    return ~crc;
+}
+
+/*
+ * Asks cb for blocks as the Golioth SDK does and hands each one to store, which
+ * returns false to abort the transfer.
+ */
+static enum golioth_status pull_blocks(upload_sink_read_block_cb cb,
+                                       void *arg,
+                                       bool (*store)(void *ctx, const uint8_t *data, size_t len),
+                                       void *store_ctx)
+{
+    uint8_t *block = malloc(UPLOAD_SINK_BLOCK_SIZE);
+    if (!block)
+    {
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    enum golioth_status status = GOLIOTH_OK;
+    bool is_last = false;
+
+    for (uint32_t idx = 0; !is_last; idx++)
+    {
+        size_t block_size = UPLOAD_SINK_BLOCK_SIZE;
+
+        status = cb(idx, block, &block_size, &is_last, arg);
+        if (status != GOLIOTH_OK)
+        {
+            break;
+        }
+
+        if (!store(store_ctx, block, block_size))
+        {
+            status = GOLIOTH_ERR_IO;
+            break;
+        }
+    }
+
+    free(block);
+    return status;
+}
+
+/* Creates the directories leading up to the last component of path */
+static void make_parents(char *path)
+{
+    for (char *p = strchr(path + 1, '/'); p; p = strchr(p + 1, '/'))
+    {
+        *p = '\0';
+        if (mkdir(path, 0755) != 0 && errno != EEXIST)
+        {
+            GLTH_LOGW(TAG, "Unable to create %s: %d", path, errno);
+        }
+        *p = '/';
+    }
+}
+
+static FILE *file_create(const char *dir, const char *path, char *full, size_t len)
+{
+    snprintf(full, len, "%s/%s", dir, path);
+    make_parents(full);
+
+    FILE *f = fopen(full, "wb");
+    if (!f)
+    {
+        GLTH_LOGE(TAG, "Unable to create %s", full);
+    }
+
+    return f;
+}
+
+static bool file_store(void *ctx, const uint8_t *data, size_t len)
+{
+    return fwrite(data, 1, len, (FILE *) ctx) == len;
+}
+
+static enum golioth_status file_write_blockwise(void *ctx,
+                                                const char *path,
+                                                upload_sink_read_block_cb cb,
+                                                void *arg)
+{
+    char full[FILE_PATH_MAX];
+    FILE *f = file_create(ctx, path, full, sizeof(full));
+    if (!f)
+    {
+        return GOLIOTH_ERR_IO;
+    }
+
+    enum golioth_status status = pull_blocks(cb, arg, file_store, f);
+
+    if (fclose(f) != 0 && status == GOLIOTH_OK)
+    {
+        status = GOLIOTH_ERR_IO;
+    }
+
+    /* A server keeps nothing of a failed transfer */
+    if (status != GOLIOTH_OK)
+    {
+        remove(full);
+    }
+
+    return status;
+}
+
+static enum golioth_status file_write(void *ctx,
+                                      const char *path,
+                                      enum upload_sink_content type,
+                                      const uint8_t *data,
+                                      size_t len)
+{
+    char full[FILE_PATH_MAX];
+    FILE *f = file_create(ctx, path, full, sizeof(full));
+    if (!f)
+    {
+        return GOLIOTH_ERR_IO;
+    }
+
+    bool ok = file_store(f, data, len);
+    ok = (fclose(f) == 0) && ok;
+
+    return ok ? GOLIOTH_OK : GOLIOTH_ERR_IO;
+}
+
+static void file_close(void *ctx)
+{
+    free(ctx);
+}
+
+esp_err_t upload_sink_file_open(struct upload_sink *sink, const char *dir)
+{
+    char *root = strdup(dir);
+    if (!root)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (mkdir(root, 0755) != 0 && errno != EEXIST)
+    {
+        GLTH_LOGE(TAG, "Unable to create %s: %d", root, errno);
+        free(root);
+        return ESP_FAIL;
+    }
+
+    *sink = (struct upload_sink) {
+        .write_blockwise = file_write_blockwise,
+        .write = file_write,
+        .close = file_close,
+        .name = "file",
+        .ctx = root,
+    };
+
+    return ESP_OK;
+}
+
+/* Per transfer, so concurrent transfers only meet in the shared totals */
+struct loopback_transfer {
+    uint32_t blocks;
+    uint64_t bytes;
+    uint32_t crc;
+};
+
+static bool loopback_store(void *ctx, const uint8_t *data, size_t len)
+{
+    struct loopback_transfer *t = ctx;
+
+    t->blocks++;
+    t->bytes += len;
+    t->crc = crc32_update(t->crc, data, len);
+
+    return true;
+}
+
+static enum golioth_status loopback_write_blockwise(void *ctx,
+                                                    const char *path,
+                                                    upload_sink_read_block_cb cb,
+                                                    void *arg)
+{
+    struct loopback_sink *lb = ctx;
+    struct loopback_transfer t = {0};
+
+    enum golioth_status status = pull_blocks(cb, arg, loopback_store, &t);
+
+    portENTER_CRITICAL(&lb->lock);
+    lb->stats.blocks += t.blocks;
+    lb->stats.bytes += t.bytes;
+    if (status == GOLIOTH_OK)
+    {
+        lb->stats.transfers++;
+        lb->stats.crc = t.crc;
+    }
+    portEXIT_CRITICAL(&lb->lock);
+
+    return status;
+}
+
+static enum golioth_status loopback_write(void *ctx,
+                                          const char *path,
+                                          enum upload_sink_content type,
+                                          const uint8_t *data,
+                                          size_t len)
+{
+    struct loopback_sink *lb = ctx;
+
+    portENTER_CRITICAL(&lb->lock);
+    lb->stats.writes++;
+    portEXIT_CRITICAL(&lb->lock);
+
+    return GOLIOTH_OK;
+}
+
+static void loopback_close(void *ctx)
+{
+    struct loopback_sink *lb = ctx;
+
+    GLTH_LOGI(TAG,
+              "Loopback received %" PRIu32 " transfers, %" PRIu32 " blocks, %" PRIu64
+              " bytes, %" PRIu32 " writes",
+              lb->stats.transfers,
+              lb->stats.blocks,
+              lb->stats.bytes,
+              lb->stats.writes);
+    free(lb);
+}
+
+esp_err_t upload_sink_loopback_open(struct upload_sink *sink)
+{
+    struct loopback_sink *lb = calloc(1, sizeof(struct loopback_sink));
+    if (!lb)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    lb->lock = (portMUX_TYPE) portMUX_INITIALIZER_UNLOCKED;
+
+    *sink = (struct upload_sink) {
+        .write_blockwise = loopback_write_blockwise,
+        .write = loopback_write,
+        .close = loopback_close,
+        .name = "loopback",
+        .ctx = lb,
+    };
+
+    return ESP_OK;
+}
+
+struct upload_sink_loopback_stats upload_sink_loopback_get_stats(const struct upload_sink *sink)
+{
+    struct loopback_sink *lb = sink->ctx;
+
+    portENTER_CRITICAL(&lb->lock);
+    struct upload_sink_loopback_stats stats = lb->stats;
+    portEXIT_CRITICAL(&lb->lock);
+
+    return stats;
+}
+
+esp_err_t upload_sink_default_open(struct upload_sink *sink, struct golioth_client *client)
+{
+#if defined(CONFIG_EXAMPLE_UPLOAD_SINK_FILE)
+    return upload_sink_file_open(sink, CONFIG_EXAMPLE_UPLOAD_SINK_DIR);
+#elif defined(CONFIG_EXAMPLE_UPLOAD_SINK_LOOPBACK)
+    return upload_sink_loopback_open(sink);
+#else
+    return upload_sink_golioth_open(sink, client);
+#endif
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <golioth/golioth_status.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Largest block a sink asks for, the Golioth SDK's default blockwise buffer */
+#define UPLOAD_SINK_BLOCK_SIZE  (1024)
+
+/**
+ * @brief Fills the next block of a blockwise transfer, as the Golioth SDK's
+ * stream_read_block_cb does.
+ *
+ * block_size holds the largest block on entry and the bytes filled on return.
+ * is_last is set with the last block.
+ */
+typedef enum golioth_status (*upload_sink_read_block_cb)(uint32_t block_idx,
+                                                         uint8_t *block_buffer,
+                                                         size_t *block_size,
+                                                         bool *is_last,
+                                                         void *arg);
+
+enum upload_sink_content {
+    UPLOAD_SINK_OCTET_STREAM,
+    UPLOAD_SINK_JSON,
+};
+
+/**
+ * @brief Where uploads go, addressed by path.
+ */
+struct upload_sink {
+    /* Pulls blocks from cb until it sets is_last or fails, returns once all are stored */
+    enum golioth_status (*write_blockwise)(void *ctx,
+                                           const char *path,
+                                           upload_sink_read_block_cb cb,
+                                           void *arg);
+    enum golioth_status (*write)(void *ctx,
+                                 const char *path,
+                                 enum upload_sink_content type,
+                                 const uint8_t *data,
+                                 size_t len);
+    void (*close)(void *ctx);
+    const char *name;
+    void *ctx;
+};
+
+/* Counted by the loopback sink */
+struct upload_sink_loopback_stats {
+    uint32_t transfers;
+    uint32_t blocks;
+    uint64_t bytes;
+    /* CRC-32 of the last blockwise transfer */
+    uint32_t crc;
+    uint32_t writes;
+};
+
+/**
+ * @brief Golioth stream, with blockwise transfers for write_blockwise.
+ */
+struct golioth_client;
+
+esp_err_t upload_sink_golioth_open(struct upload_sink *sink, struct golioth_client *client);
+
+/**
+ * @brief Files under dir, one per path, subdirectories created as needed.
+ * A later upload to the same path replaces the file.
+ */
+esp_err_t upload_sink_file_open(struct upload_sink *sink, const char *dir);
+
+/**
+ * @brief Receiver in the same process that only counts and checksums what it
+ * gets, for measuring everything but the network.
+ */
+esp_err_t upload_sink_loopback_open(struct upload_sink *sink);
+struct upload_sink_loopback_stats upload_sink_loopback_get_stats(const struct upload_sink *sink);
+
+/**
+ * @brief Sink picked by CONFIG_EXAMPLE_UPLOAD_SINK. client is only used by the
+ * Golioth sink.
+ */
+esp_err_t upload_sink_default_open(struct upload_sink *sink, struct golioth_client *client);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <golioth/client.h>
+#include <golioth/stream.h>
+#include "upload_sink.h"
+
+#define WRITE_TIMEOUT_S     (10)
+
+static enum golioth_status golioth_write_blockwise(void *ctx,
+                                                   const char *path,
+                                                   upload_sink_read_block_cb cb,
+                                                   void *arg)
+{
+    return golioth_stream_set_blockwise_sync((struct golioth_client *) ctx,
+                                             path,
+                                             GOLIOTH_CONTENT_TYPE_OCTET_STREAM,
+                                             cb,
+                                             arg);
+}
+
+static enum golioth_status golioth_write(void *ctx,
+                                         const char *path,
+                                         enum upload_sink_content type,
+                                         const uint8_t *data,
+                                         size_t len)
+{
+    return golioth_stream_set_sync((struct golioth_client *) ctx,
+                                   path,
+                                   (type == UPLOAD_SINK_JSON) ? GOLIOTH_CONTENT_TYPE_JSON
+                                                              : GOLIOTH_CONTENT_TYPE_OCTET_STREAM,
+                                   data,
+                                   len,
+                                   WRITE_TIMEOUT_S);
+}
+
+/* The client outlives the sink */
+static void golioth_close(void *ctx)
+{
+}
+
+esp_err_t upload_sink_golioth_open(struct upload_sink *sink, struct golioth_client *client)
+{
+    if (!client)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *sink = (struct upload_sink) {
+        .write_blockwise = golioth_write_blockwise,
+        .write = golioth_write,
+        .close = golioth_close,
+        .name = "golioth",
+        .ctx = client,
+    };
+
+    return ESP_OK;
+}
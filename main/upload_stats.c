@@ -0,0 +1,262 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_console.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "upload_stats.h"
+
+#include <golioth/client.h>
+static const char *TAG = "upload_stats";
+
+#define PATH_MAX_LEN    (48)
+
+static struct {
+    struct upload_stats_summary summary;
+    char path[PATH_MAX_LEN];
+    bool valid;
+} _last;
+static portMUX_TYPE _last_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static int latency_bucket(uint32_t latency_us)
+{
+    uint32_t ms = latency_us / 1000;
+
+    if (ms < 4)
+    {
+        return (int) ms;
+    }
+
+    int octave = 31 - __builtin_clz(ms);
+    int bucket = 4 + (octave - 2) * 4 + (int) ((ms >> (octave - 2)) & 3);
+
+    return (bucket < UPLOAD_STATS_LATENCY_BUCKETS) ? bucket : UPLOAD_STATS_LATENCY_BUCKETS - 1;
+}
+
+/* Largest latency counted in a bucket, in ms */
+static uint32_t bucket_upper_ms(int bucket)
+{
+    if (bucket < 4)
+    {
+        return (uint32_t) bucket;
+    }
+
+    int octave = (bucket - 4) / 4 + 2;
+    uint32_t sub = (uint32_t) (bucket - 4) % 4;
+
+    return (((4 + sub) << (octave - 2)) + (1U << (octave - 2))) - 1;
+}
+
+static uint32_t percentile_ms(const struct upload_transfer *t, uint32_t samples, uint32_t pct)
+{
+    uint32_t target = (samples * pct + 99) / 100;
+    uint32_t seen = 0;
+
+    for (int i = 0; i < UPLOAD_STATS_LATENCY_BUCKETS; i++)
+    {
+        seen += t->latency_hist[i];
+        if (seen >= target && seen > 0)
+        {
+            return bucket_upper_ms(i);
+        }
+    }
+
+    return 0;
+}
+
+static uint32_t record_wait(struct upload_transfer *t, int64_t now)
+{
+    uint32_t wait_us = (uint32_t) (now - t->fill_end_us);
+    int bucket = latency_bucket(wait_us);
+
+    t->wait_us += wait_us;
+
+    /* Saturate rather than wrap on very long transfers */
+    if (t->latency_hist[bucket] < UINT16_MAX)
+    {
+        t->latency_hist[bucket]++;
+    }
+
+    return wait_us;
+}
+
+void upload_transfer_begin(struct upload_transfer *t)
+{
+    memset(t, 0, sizeof(*t));
+    t->start_us = esp_timer_get_time();
+    t->last_block_idx = -1;
+}
+
+uint32_t upload_transfer_fill_start(struct upload_transfer *t, uint32_t block_idx)
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t latency_us = 0;
+
+    if (t->blocks > 0)
+    {
+        latency_us = record_wait(t, now);
+    }
+    else
+    {
+        /* Time to the first callback is request setup, not a block latency */
+        t->wait_us += (uint64_t) (now - t->start_us);
+    }
+
+    if ((int64_t) block_idx <= t->last_block_idx)
+    {
+        t->retransmits++;
+    }
+
+    t->last_block_idx = block_idx;
+    t->fill_start_us = now;
+
+    return latency_us;
+}
+
+void upload_transfer_fill_end(struct upload_transfer *t, size_t block_size)
+{
+    t->fill_end_us = esp_timer_get_time();
+    t->fill_us += (uint64_t) (t->fill_end_us - t->fill_start_us);
+    t->bytes += block_size;
+    t->blocks++;
+}
+
+struct upload_stats_summary upload_transfer_end(struct upload_transfer *t,
+                                                const char *path,
+                                                int status)
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t samples = 0;
+
+    /* The last block's acknowledgement arrives before the sync call returns */
+    if (t->blocks > 0)
+    {
+        record_wait(t, now);
+    }
+
+    for (int i = 0; i < UPLOAD_STATS_LATENCY_BUCKETS; i++)
+    {
+        samples += t->latency_hist[i];
+    }
+
+    uint64_t duration_us = (uint64_t) (now - t->start_us);
+    struct upload_stats_summary s = {
+        .status = status,
+        .bytes = t->bytes,
+        .blocks = t->blocks,
+        .duration_ms = (uint32_t) (duration_us / 1000),
+        .bytes_per_s = duration_us ? (uint32_t) ((uint64_t) t->bytes * 1000000 / duration_us) : 0,
+        .fill_ms = (uint32_t) (t->fill_us / 1000),
+        .wait_ms = (uint32_t) (t->wait_us / 1000),
+        .p50_ms = percentile_ms(t, samples, 50),
+        .p95_ms = percentile_ms(t, samples, 95),
+        .p99_ms = percentile_ms(t, samples, 99),
+        .retransmits = t->retransmits,
+    };
+
+    /* Formatted outside the spinlock, which only covers the copies */
+    char last_path[sizeof(_last.path)];
+    snprintf(last_path, sizeof(last_path), "%s", path);
+
+    portENTER_CRITICAL(&_last_lock);
+    _last.summary = s;
+    memcpy(_last.path, last_path, sizeof(_last.path));
+    _last.valid = true;
+    portEXIT_CRITICAL(&_last_lock);
+
+    upload_stats_log();
+
+    return s;
+}
+
+size_t upload_stats_summary_json(const struct upload_stats_summary *s,
+                                 const char *path,
+                                 char *buf,
+                                 size_t len)
+{
+    int n = snprintf(buf,
+                     len,
+                     "{\"path\":\"%s\",\"status\":%d,\"bytes\":%" PRIu32 ",\"blocks\":%" PRIu32
+                     ",\"ms\":%" PRIu32 ",\"Bps\":%" PRIu32 ",\"fill_ms\":%" PRIu32
+                     ",\"wait_ms\":%" PRIu32 ",\"p50\":%" PRIu32 ",\"p95\":%" PRIu32
+                     ",\"p99\":%" PRIu32 ",\"retx\":%" PRIu32 "}",
+                     path,
+                     s->status,
+                     s->bytes,
+                     s->blocks,
+                     s->duration_ms,
+                     s->bytes_per_s,
+                     s->fill_ms,
+                     s->wait_ms,
+                     s->p50_ms,
+                     s->p95_ms,
+                     s->p99_ms,
+                     s->retransmits);
+
+    if (n < 0)
+    {
+        return 0;
+    }
+
+    return ((size_t) n < len) ? (size_t) n : len - 1;
+}
+
+void upload_stats_log(void)
+{
+    char path[PATH_MAX_LEN];
+
+    portENTER_CRITICAL(&_last_lock);
+    struct upload_stats_summary s = _last.summary;
+    bool valid = _last.valid;
+    memcpy(path, _last.path, sizeof(path));
+    portEXIT_CRITICAL(&_last_lock);
+
+    if (!valid)
+    {
+        GLTH_LOGI(TAG, "No uploads yet");
+        return;
+    }
+
+    GLTH_LOGI(TAG,
+              "%s: status %d, %" PRIu32 " bytes in %" PRIu32 " blocks, %" PRIu32 " ms, %" PRIu32
+              " B/s",
+              path,
+              s.status,
+              s.bytes,
+              s.blocks,
+              s.duration_ms,
+              s.bytes_per_s);
+    GLTH_LOGI(TAG,
+              "Fill %" PRIu32 " ms, network %" PRIu32 " ms, block latency p50 %" PRIu32
+              " p95 %" PRIu32 " p99 %" PRIu32 " ms, %" PRIu32 " retransmits",
+              s.fill_ms,
+              s.wait_ms,
+              s.p50_ms,
+              s.p95_ms,
+              s.p99_ms,
+              s.retransmits);
+}
+
+static int cmd_upload_stats(int argc, char **argv)
+{
+    upload_stats_log();
+    return 0;
+}
+
+void upload_stats_start(void)
+{
+    const esp_console_cmd_t cmd = {
+        .command = "upload_stats",
+        .help = "Show throughput and block latency of the last upload",
+        .hint = NULL,
+        .func = cmd_upload_stats,
+    };
+    esp_console_cmd_register(&cmd);
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Block latency buckets: 1 ms wide up to 7 ms (< 1 ms, 1 ms, ... 7 ms), then 4
+ * per power of two, each a quarter of it wide (8-9 ms, 10-11 ms, 12-13 ms,
+ * 14-15 ms, 16-19 ms, ...), and >= 28.7 s last. Percentiles report the upper
+ * end of their bucket, so they are exact below 8 ms and at most 25% high above.
+ */
+#define UPLOAD_STATS_LATENCY_BUCKETS    (56)
+
+/**
+ * @brief Timing of one blockwise transfer, kept by the task running it.
+ *
+ * A block's latency runs from the end of its fill callback to the start of the
+ * next one (or the end of the transfer), i.e. the time the SDK spent sending it
+ * and waiting for the acknowledgement.
+ */
+struct upload_transfer {
+    int64_t start_us;
+    int64_t fill_start_us;
+    int64_t fill_end_us;
+    int64_t last_block_idx;
+    uint32_t bytes;
+    uint32_t blocks;
+    uint32_t retransmits;
+    uint64_t fill_us;
+    uint64_t wait_us;
+    uint16_t latency_hist[UPLOAD_STATS_LATENCY_BUCKETS];
+};
+
+struct upload_stats_summary {
+    int status;
+    uint32_t bytes;
+    uint32_t blocks;
+    uint32_t duration_ms;
+    /* Payload bytes per second over the whole transfer */
+    uint32_t bytes_per_s;
+    uint32_t fill_ms;
+    uint32_t wait_ms;
+    uint32_t p50_ms;
+    uint32_t p95_ms;
+    uint32_t p99_ms;
+    /* Blocks the SDK asked the callback for more than once */
+    uint32_t retransmits;
+};
+
+void upload_transfer_begin(struct upload_transfer *t);
+
+/**
+ * @brief Called on entry to and exit from the block callback. No allocation,
+ * no blocking and no formatted I/O.
+ *
+ * @return Latency of the previous block in us, 0 on the first call
+ */
+uint32_t upload_transfer_fill_start(struct upload_transfer *t, uint32_t block_idx);
+void upload_transfer_fill_end(struct upload_transfer *t, size_t block_size);
+
+/**
+ * @brief Close the transfer, log its summary and keep it as the last one.
+ */
+struct upload_stats_summary upload_transfer_end(struct upload_transfer *t,
+                                                const char *path,
+                                                int status);
+
+/**
+ * @brief Compact JSON object for the summary.
+ *
+ * @return Length written, not counting the terminator
+ */
+size_t upload_stats_summary_json(const struct upload_stats_summary *s,
+                                 const char *path,
+                                 char *buf,
+                                 size_t len);
+
+/**
+ * @brief Log the summary of the last transfer.
+ */
+void upload_stats_log(void);
+
+/**
+ * @brief Register the "upload_stats" shell command.
+ */
+void upload_stats_start(void);
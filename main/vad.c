@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include "vad.h"
+
+/* Keeps digital silence from pulling the floor to zero (about -78 dBFS) */
+#define VAD_MIN_NOISE_FLOOR     (4)
+/* Floor tracking: fast towards quieter frames, slow (~10 s) towards louder ones */
+#define VAD_FLOOR_FALL_SHIFT    (3)
+#define VAD_FLOOR_RISE_SHIFT    (10)
+/*
+ * The floor also rises by at most 1/128 of itself per frame (about 3.4 dB/s), so
+ * from its start at VAD_MIN_NOISE_FLOOR it takes many seconds to reach a sound
+ * that was there from the first frame
+ */
+#define VAD_FLOOR_MAX_RISE_SHIFT (7)
+
+esp_err_t vad_init(struct vad *vad, const struct vad_config *config)
+{
+    uint32_t frame_samples = config->sample_rate / VAD_FRAMES_PER_SECOND;
+
+    if (frame_samples == 0 || frame_samples > VAD_MAX_FRAME_SAMPLES)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(vad, 0, sizeof(*vad));
+    vad->index.sample_rate = config->sample_rate;
+    vad->frame_samples = (uint16_t) frame_samples;
+    vad->threshold_q8 = (uint32_t) lroundf(256.0f * powf(10.0f, config->threshold_db / 10.0f));
+    vad->hangover_frames = config->hangover_ms * VAD_FRAMES_PER_SECOND / 1000;
+    vad->noise_floor = VAD_MIN_NOISE_FLOOR;
+    vad->preroll_frames = config->preroll_ms * VAD_FRAMES_PER_SECOND / 1000;
+
+    if (vad->preroll_frames)
+    {
+        vad->preroll = malloc(vad->preroll_frames * frame_samples * sizeof(int16_t));
+        if (!vad->preroll)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    return ESP_OK;
+}
+
+void vad_deinit(struct vad *vad)
+{
+    free(vad->preroll);
+    vad->preroll = NULL;
+}
+
+size_t vad_max_output(const struct vad *vad, size_t num_samples)
+{
+    return num_samples + ((size_t) vad->preroll_frames + 1) * vad->frame_samples;
+}
+
+static size_t emit(struct vad *vad, const int16_t *x, size_t n, int16_t *out)
+{
+    memcpy(out, x, n * sizeof(int16_t));
+    vad->index.ranges[vad->index.num_ranges - 1].len += n;
+    vad->index.kept_samples += n;
+    return n;
+}
+
+static void open_gate(struct vad *vad, uint32_t position)
+{
+    struct vad_index *index = &vad->index;
+    uint32_t start = position - vad->preroll_count * vad->frame_samples;
+
+    vad->open = true;
+
+    /* A pre-roll reaching back to the end of the last range just extends it */
+    if (index->num_ranges > 0)
+    {
+        struct vad_range *last = &index->ranges[index->num_ranges - 1];
+        if (last->start + last->len == start)
+        {
+            return;
+        }
+    }
+
+    index->ranges[index->num_ranges++] = (struct vad_range) {
+        .start = start,
+        .len = 0,
+    };
+}
+
+static size_t drain_preroll(struct vad *vad, int16_t *out)
+{
+    size_t n = 0;
+    uint32_t oldest = (vad->preroll_head + vad->preroll_frames - vad->preroll_count)
+                      % vad->preroll_frames;
+
+    for (uint32_t i = 0; i < vad->preroll_count; i++)
+    {
+        uint32_t idx = (oldest + i) % vad->preroll_frames;
+        n += emit(vad, &vad->preroll[idx * vad->frame_samples], vad->frame_samples, &out[n]);
+    }
+
+    vad->preroll_count = 0;
+    return n;
+}
+
+static void hold_preroll(struct vad *vad, const int16_t *x, size_t n)
+{
+    /* Partial frames only happen at the end of the stream, nothing follows them */
+    if (!vad->preroll_frames || n != vad->frame_samples)
+    {
+        return;
+    }
+
+    memcpy(&vad->preroll[vad->preroll_head * vad->frame_samples], x, n * sizeof(int16_t));
+    vad->preroll_head = (vad->preroll_head + 1) % vad->preroll_frames;
+    if (vad->preroll_count < vad->preroll_frames)
+    {
+        vad->preroll_count++;
+    }
+}
+
+static size_t process_frame(struct vad *vad, const int16_t *x, size_t n, int16_t *out)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        sum += (uint32_t) (x[i] * x[i]);
+    }
+
+    uint64_t energy = sum / n;
+    uint32_t position = vad->index.total_samples;
+    vad->index.total_samples += n;
+
+    uint64_t floor = vad->noise_floor > VAD_MIN_NOISE_FLOOR ? vad->noise_floor
+                                                            : VAD_MIN_NOISE_FLOOR;
+    bool active = (energy << 8) > floor * vad->threshold_q8;
+
+    if (energy < vad->noise_floor)
+    {
+        vad->noise_floor -= (vad->noise_floor - energy) >> VAD_FLOOR_FALL_SHIFT;
+    }
+    else
+    {
+        uint64_t max_rise = MAX(floor >> VAD_FLOOR_MAX_RISE_SHIFT, 1);
+
+        vad->noise_floor += MIN((energy - vad->noise_floor) >> VAD_FLOOR_RISE_SHIFT, max_rise);
+    }
+
+    size_t written = 0;
+
+    if (active)
+    {
+        if (!vad->open)
+        {
+            open_gate(vad, position);
+            written += drain_preroll(vad, out);
+        }
+        vad->hang = vad->hangover_frames;
+        return written + emit(vad, x, n, &out[written]);
+    }
+
+    if (vad->open)
+    {
+        if (vad->hang > 0)
+        {
+            vad->hang--;
+            return emit(vad, x, n, out);
+        }
+
+        if (vad->index.num_ranges == VAD_MAX_RANGES)
+        {
+            /* No room to describe another gap, keep everything from here on */
+            vad->index.saturated = true;
+            return emit(vad, x, n, out);
+        }
+
+        vad->open = false;
+    }
+
+    hold_preroll(vad, x, n);
+    return 0;
+}
+
+size_t vad_process(struct vad *vad, const int16_t *pcm, size_t num_samples, int16_t *out)
+{
+    size_t written = 0;
+
+    while (num_samples > 0)
+    {
+        /* Whole frames straight from the input, partial ones through the frame buffer */
+        if (vad->frame_fill == 0 && num_samples >= vad->frame_samples)
+        {
+            written += process_frame(vad, pcm, vad->frame_samples, &out[written]);
+            pcm += vad->frame_samples;
+            num_samples -= vad->frame_samples;
+            continue;
+        }
+
+        size_t chunk = vad->frame_samples - vad->frame_fill;
+        if (chunk > num_samples)
+        {
+            chunk = num_samples;
+        }
+
+        memcpy(&vad->frame[vad->frame_fill], pcm, chunk * sizeof(int16_t));
+        vad->frame_fill += chunk;
+        pcm += chunk;
+        num_samples -= chunk;
+
+        if (vad->frame_fill == vad->frame_samples)
+        {
+            written += process_frame(vad, vad->frame, vad->frame_samples, &out[written]);
+            vad->frame_fill = 0;
+        }
+    }
+
+    return written;
+}
+
+size_t vad_flush(struct vad *vad, int16_t *out)
+{
+    if (vad->frame_fill == 0)
+    {
+        return 0;
+    }
+
+    size_t written = process_frame(vad, vad->frame, vad->frame_fill, out);
+    vad->frame_fill = 0;
+
+    /* The pre-roll is dropped: there is no onset left for it to lead into */
+    return written;
+}
+
+/* snprintf() at pos, clamping pos to the terminator on truncation */
+static void json_append(char *buf, size_t len, size_t *pos, const char *fmt, ...)
+{
+    if (*pos + 1 >= len)
+    {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(&buf[*pos], len - *pos, fmt, args);
+    va_end(args);
+
+    if (n > 0)
+    {
+        *pos = MIN(*pos + (size_t) n, len - 1);
+    }
+}
+
+size_t vad_index_to_json(const struct vad_index *index, char *buf, size_t len)
+{
+    size_t pos = 0;
+
+    if (len == 0)
+    {
+        return 0;
+    }
+    buf[0] = '\0';
+
+    json_append(buf,
+                len,
+                &pos,
+                "{\"rate\":%" PRIu32 ",\"total\":%" PRIu32 ",\"kept\":%" PRIu32
+                ",\"saturated\":%s,\"ranges\":[",
+                index->sample_rate,
+                index->total_samples,
+                index->kept_samples,
+                index->saturated ? "true" : "false");
+
+    for (size_t i = 0; i < index->num_ranges; i++)
+    {
+        json_append(buf,
+                    len,
+                    &pos,
+                    "%s[%" PRIu32 ",%" PRIu32 "]",
+                    i ? "," : "",
+                    index->ranges[i].start,
+                    index->ranges[i].len);
+    }
+
+    json_append(buf, len, &pos, "]}");
+
+    return pos;
+}
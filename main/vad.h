@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VAD_MAX_RANGES          (64)
+/* Decisions are made on 10 ms frames */
+#define VAD_FRAMES_PER_SECOND   (100)
+#define VAD_MAX_FRAME_SAMPLES   (48000 / VAD_FRAMES_PER_SECOND)
+/* Longest output of vad_index_to_json() */
+#define VAD_INDEX_JSON_MAX      (96 + (VAD_MAX_RANGES * 24))
+
+/* Kept region, in samples of the original (ungated) timeline */
+struct vad_range {
+    uint32_t start;
+    uint32_t len;
+};
+
+struct vad_index {
+    uint32_t sample_rate;
+    uint32_t total_samples;
+    uint32_t kept_samples;
+    size_t num_ranges;
+    /* Ran out of ranges, the gate stayed open from the last one on */
+    bool saturated;
+    struct vad_range ranges[VAD_MAX_RANGES];
+};
+
+struct vad_config {
+    uint32_t sample_rate;
+    /* Energy above the noise floor that opens the gate */
+    uint32_t threshold_db;
+    /* Silence kept after the last active frame */
+    uint32_t hangover_ms;
+    /* Audio kept ahead of the first active frame */
+    uint32_t preroll_ms;
+};
+
+/**
+ * @brief Streaming energy-based activity gate.
+ *
+ * Short-term energy is compared against an adaptive noise floor that starts at
+ * the quietest level and follows quiet frames quickly and loud ones slowly, so
+ * sound present from the first frame is not taken for noise. Active frames
+ * open the gate, which stays open for the hangover period after the last one.
+ * While closed, the most recent pre-roll worth of frames is held back so the
+ * onset of a sound is kept.
+ * Every region passed through is recorded in the index.
+ */
+struct vad {
+    struct vad_index index;
+    uint16_t frame_samples;
+    uint16_t frame_fill;
+    int16_t frame[VAD_MAX_FRAME_SAMPLES];
+    uint32_t threshold_q8;
+    uint32_t hangover_frames;
+    uint32_t hang;
+    uint64_t noise_floor;
+    bool open;
+    /* Pre-roll ring of whole frames */
+    int16_t *preroll;
+    uint32_t preroll_frames;
+    uint32_t preroll_head;
+    uint32_t preroll_count;
+};
+
+esp_err_t vad_init(struct vad *vad, const struct vad_config *config);
+void vad_deinit(struct vad *vad);
+
+/**
+ * @brief Largest number of samples vad_process() may write for num_samples of input.
+ */
+size_t vad_max_output(const struct vad *vad, size_t num_samples);
+
+/**
+ * @brief Gate samples, writing the kept ones to out.
+ *
+ * Output lags the input by less than one frame.
+ *
+ * @return Number of samples written to out
+ */
+size_t vad_process(struct vad *vad, const int16_t *pcm, size_t num_samples, int16_t *out);
+
+/**
+ * @brief Decide on the trailing partial frame at the end of the stream.
+ *
+ * @return Number of samples written to out (less than one frame)
+ */
+size_t vad_flush(struct vad *vad, int16_t *out);
+
+/**
+ * @brief Format an index as {"rate":R,"total":T,"kept":K,"ranges":[[start,len],...]}
+ *
+ * @return Length of the string written to buf, excluding the terminator
+ */
+size_t vad_index_to_json(const struct vad_index *index, char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
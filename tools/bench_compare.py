@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2024 Golioth, Inc.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+"""Compare two runs of the audio kernel benchmarks.
+
+Each run is the output of the bench shell command or of
+tools/host_pipeline's audio_bench: one JSON object per line. Other lines, such
+as device log output, are skipped. Cases are matched on kernel, corpus and
+buffer size and compared on cycles per unit.
+
+Exits with status 1 when a case got slower by more than the threshold.
+
+Usage: bench_compare.py [--threshold PERCENT] OLD NEW
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    meta = {}
+    cases = {}
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith("{"):
+                continue
+            try:
+                case = json.loads(line)
+            except json.JSONDecodeError:
+                continue
+            if case.get("bench") == "_meta":
+                meta = case
+            elif "bench" in case:
+                cases[(case["bench"], case["corpus"], case["buffer"])] = case
+    return meta, cases
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("old")
+    parser.add_argument("new")
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="slowdown in percent that fails the comparison (default 10)")
+    args = parser.parse_args()
+
+    old_meta, old = load(args.old)
+    new_meta, new = load(args.new)
+
+    for key in ("target", "cpu_mhz", "corpus_samples"):
+        if old_meta.get(key) != new_meta.get(key):
+            print(f"warning: {key} differs: {old_meta.get(key)} -> {new_meta.get(key)}",
+                  file=sys.stderr)
+
+    print(f"{'kernel':<22} {'corpus':<8} {'buffer':>6} {'old':>10} {'new':>10} {'change':>8}")
+
+    regressions = 0
+    for key in sorted(old.keys() & new.keys()):
+        before = old[key]["cycles_per_unit"]
+        after = new[key]["cycles_per_unit"]
+        change = (after - before) * 100.0 / before if before else 0.0
+        flag = ""
+        if change > args.threshold:
+            flag = "  slower"
+            regressions += 1
+        print(f"{key[0]:<22} {key[1]:<8} {key[2]:>6} {before:>10.2f} {after:>10.2f}"
+              f" {change:>+7.1f}%{flag}")
+
+    for key in sorted(old.keys() - new.keys()):
+        print(f"{key[0]:<22} {key[1]:<8} {key[2]:>6}  only in {args.old}")
+    for key in sorted(new.keys() - old.keys()):
+        print(f"{key[0]:<22} {key[1]:<8} {key[2]:>6}  only in {args.new}")
+
+    if regressions:
+        print(f"{regressions} case(s) more than {args.threshold:g}% slower", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
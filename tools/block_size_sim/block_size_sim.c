@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Host-side simulator comparing fixed CoAP block sizes with the adaptive
+ * controller in main/block_size_ctl.c over a lossy link.
+ *
+ * Build and run from this directory:
+ *
+ *     cc -O2 -I../../main block_size_sim.c ../../main/block_size_ctl.c -lm -o block_size_sim
+ *     ./block_size_sim -r 150 -b 256
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "block_size_ctl.h"
+
+/* CoAP transmission parameters, RFC 7252 section 4.8 */
+#define ACK_TIMEOUT_S       (2.0)
+#define ACK_RANDOM_FACTOR   (1.5)
+#define MAX_RETRANSMIT      (4)
+/* Size of the acknowledgement on the way back */
+#define ACK_BYTES           (BLOCK_SIZE_CTL_OVERHEAD)
+
+#define FIXED_SIZES         (BLOCK_SIZE_CTL_SIZES)
+
+struct link {
+    double rtt_s;
+    double jitter_s;
+    double bytes_per_s;
+    /* Loss rate per byte on air */
+    double loss_per_byte;
+};
+
+struct result {
+    double seconds;
+    uint32_t failed_transfers;
+};
+
+static uint64_t rng_state;
+
+static double rng_uniform(void)
+{
+    /* xorshift64*, deterministic for a given seed */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (double) ((rng_state * 0x2545F4914F6CDD1DULL) >> 11) / (double) (1ULL << 53);
+}
+
+static bool packet_lost(const struct link *link, uint32_t bytes)
+{
+    return rng_uniform() < 1.0 - exp(-link->loss_per_byte * bytes);
+}
+
+/*
+ * Sends one block with CoAP's confirmable retransmissions. Returns false if it
+ * was not acknowledged after MAX_RETRANSMIT retries, adds the time spent to now.
+ */
+static bool send_block(const struct link *link, uint32_t size, double *now)
+{
+    double timeout = ACK_TIMEOUT_S * (1.0 + rng_uniform() * (ACK_RANDOM_FACTOR - 1.0));
+    uint32_t on_air = size + BLOCK_SIZE_CTL_OVERHEAD;
+
+    for (int attempt = 0; attempt <= MAX_RETRANSMIT; attempt++)
+    {
+        double tx = on_air / link->bytes_per_s;
+
+        if (!packet_lost(link, on_air) && !packet_lost(link, ACK_BYTES))
+        {
+            *now += tx + link->rtt_s + rng_uniform() * link->jitter_s;
+            return true;
+        }
+
+        *now += timeout;
+        timeout *= 2.0;
+    }
+
+    return false;
+}
+
+/*
+ * Uploads file_bytes as transfers of part_bytes, as the resumable upload does.
+ * A failed transfer is sent again. With ctl set, the block size of each
+ * transfer comes from the controller, otherwise it is fixed_size.
+ */
+static struct result simulate(const struct link *link,
+                              uint32_t file_bytes,
+                              uint32_t part_bytes,
+                              uint32_t fixed_size,
+                              struct block_size_ctl *ctl)
+{
+    struct result r = {0};
+    uint32_t offset = 0;
+
+    while (offset < file_bytes)
+    {
+        uint32_t part = (file_bytes - offset < part_bytes) ? file_bytes - offset : part_bytes;
+        uint32_t size = ctl ? block_size_ctl_select(ctl, BLOCK_SIZE_CTL_MAX) : fixed_size;
+        uint32_t sent = 0;
+        bool ok = true;
+
+        while (ok && sent < part)
+        {
+            uint32_t len = (part - sent < size) ? part - sent : size;
+            double start = r.seconds;
+
+            ok = send_block(link, len, &r.seconds);
+            if (ok)
+            {
+                sent += len;
+            }
+
+            if (ctl && len == size)
+            {
+                block_size_ctl_observe(ctl, size, (uint32_t) ((r.seconds - start) * 1e6));
+            }
+        }
+
+        if (ok)
+        {
+            offset += part;
+        }
+        else
+        {
+            r.failed_transfers++;
+        }
+    }
+
+    return r;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s [-r rtt_ms] [-j jitter_ms] [-b kbit/s] [-l loss_%%_at_1KB]\n"
+            "          [-f file_KB] [-p part_KB] [-n runs] [-s seed]\n"
+            "Without -l, sweeps block loss rates from 0 to 40%%.\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    double rtt_ms = 150.0;
+    double jitter_ms = 20.0;
+    double kbps = 256.0;
+    double loss_pct = -1.0;
+    uint32_t file_kb = 256;
+    uint32_t part_kb = 64;
+    int runs = 20;
+    uint64_t seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:j:b:l:f:p:n:s:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'r':
+                rtt_ms = atof(optarg);
+                break;
+            case 'j':
+                jitter_ms = atof(optarg);
+                break;
+            case 'b':
+                kbps = atof(optarg);
+                break;
+            case 'l':
+                loss_pct = atof(optarg);
+                break;
+            case 'f':
+                file_kb = (uint32_t) atoi(optarg);
+                break;
+            case 'p':
+                part_kb = (uint32_t) atoi(optarg);
+                break;
+            case 'n':
+                runs = atoi(optarg);
+                break;
+            case 's':
+                seed = strtoull(optarg, NULL, 0);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    static const double sweep[] = {0.0, 1.0, 5.0, 10.0, 20.0, 30.0, 40.0};
+    size_t num_losses = (loss_pct < 0.0) ? sizeof(sweep) / sizeof(sweep[0]) : 1;
+
+    printf("RTT %.0f ms, jitter %.0f ms, %.0f kbit/s, %" PRIu32 " KB in %" PRIu32
+           " KB transfers, %d runs\n\n",
+           rtt_ms,
+           jitter_ms,
+           kbps,
+           file_kb,
+           part_kb,
+           runs);
+    printf("loss@1KB");
+    for (int i = 0; i < FIXED_SIZES; i++)
+    {
+        printf("  %7u", BLOCK_SIZE_CTL_MIN << i);
+    }
+    printf("  adaptive  vs 1024  vs best\n");
+
+    for (size_t l = 0; l < num_losses; l++)
+    {
+        double pct = (loss_pct < 0.0) ? sweep[l] : loss_pct;
+        struct link link = {
+            .rtt_s = rtt_ms / 1000.0,
+            .jitter_s = jitter_ms / 1000.0,
+            .bytes_per_s = kbps * 1000.0 / 8.0,
+            .loss_per_byte = -log(1.0 - pct / 100.0) / (1024 + BLOCK_SIZE_CTL_OVERHEAD),
+        };
+        double rate[FIXED_SIZES + 1] = {0};
+
+        for (int i = 0; i <= FIXED_SIZES; i++)
+        {
+            double seconds = 0.0;
+
+            /* Same seed for every size, so they see comparable loss patterns */
+            rng_state = seed * 0x9E3779B97F4A7C15ULL + l + 1;
+
+            /* Kept across runs, as on the device */
+            struct block_size_ctl ctl;
+            block_size_ctl_init(&ctl);
+
+            for (int run = 0; run < runs; run++)
+            {
+                struct result r = simulate(&link,
+                                           file_kb * 1024,
+                                           part_kb * 1024,
+                                           BLOCK_SIZE_CTL_MIN << (i < FIXED_SIZES ? i : 0),
+                                           (i == FIXED_SIZES) ? &ctl : NULL);
+                seconds += r.seconds;
+            }
+
+            rate[i] = (double) file_kb * 1024 * runs / seconds;
+        }
+
+        double best = 0.0;
+        for (int i = 0; i < FIXED_SIZES; i++)
+        {
+            best = (rate[i] > best) ? rate[i] : best;
+        }
+
+        printf("%7.0f%%", pct);
+        for (int i = 0; i <= FIXED_SIZES; i++)
+        {
+            printf(i < FIXED_SIZES ? "  %7.0f" : "  %8.0f", rate[i]);
+        }
+        printf("  %+5.0f%%  %+6.0f%%\n",
+               (rate[FIXED_SIZES] / rate[FIXED_SIZES - 1] - 1.0) * 100.0,
+               (rate[FIXED_SIZES] / best - 1.0) * 100.0);
+    }
+
+    printf("\nThroughput in payload bytes per second.\n");
+    return 0;
+}
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2024 Golioth, Inc.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+"""Decompress uploads sent with CONFIG_EXAMPLE_UPLOAD_COMPRESSION.
+
+Files that do not start with the GLZ container header are copied unchanged,
+so a whole download directory can be passed through this script.
+
+Usage: glz_decompress.py INPUT OUTPUT
+"""
+
+import struct
+import sys
+
+HEADER = struct.Struct("<3sBBB2xI")
+FLAG_DELTA16 = 1 << 0
+SIZE_UNKNOWN = 0xFFFFFFFF
+
+
+def undelta16(data):
+    out = bytearray(len(data))
+    prev = 0
+    for i in range(0, len(data) - 1, 2):
+        prev = (prev + (data[i] | data[i + 1] << 8)) & 0xFFFF
+        out[i] = prev & 0xFF
+        out[i + 1] = prev >> 8
+    if len(data) % 2:
+        # A trailing odd byte is the low byte of a sample, its borrow never applies
+        out[-1] = (data[-1] + prev) & 0xFF
+    return bytes(out)
+
+
+def decompress(data):
+    if len(data) < HEADER.size or not data.startswith(b"GLZ"):
+        return data
+
+    magic, version, flags, window_bits, size = HEADER.unpack_from(data)
+    if version != 1:
+        raise ValueError(f"unsupported GLZ version {version}")
+
+    out = bytearray()
+    pos = HEADER.size
+    while pos < len(data):
+        group = data[pos]
+        pos += 1
+        for bit in range(8):
+            if pos >= len(data):
+                break
+            if group & (1 << bit):
+                b0, b1 = data[pos], data[pos + 1]
+                pos += 2
+                offset = ((b0 >> 4) << 8 | b1) + 1
+                length = (b0 & 0x0F) + 3
+                if offset > len(out) or offset > 1 << window_bits:
+                    raise ValueError("match reaches outside the window")
+                for _ in range(length):
+                    out.append(out[-offset])
+            else:
+                out.append(data[pos])
+                pos += 1
+
+    if flags & FLAG_DELTA16:
+        out = undelta16(out)
+    if size != SIZE_UNKNOWN and len(out) != size:
+        raise ValueError(f"expected {size} bytes, got {len(out)}")
+    return bytes(out)
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(__doc__.strip(), file=sys.stderr)
+        return 1
+
+    with open(sys.argv[1], "rb") as f:
+        data = f.read()
+    with open(sys.argv[2], "wb") as f:
+        f.write(decompress(data))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Runs the audio kernel microbenchmarks of main/bench.c on the host and prints
+ * one JSON line per case, the same output as the device's bench shell command.
+ *
+ *     cmake -B build && cmake --build build
+ *     ./build/audio_bench > new.jsonl
+ *     ../bench_compare.py old.jsonl new.jsonl
+ *
+ * An argument only runs the kernels whose name starts with it.
+ */
+
+#include <stdio.h>
+#include "bench.h"
+#include "i2c_sim.h"
+
+int main(int argc, char **argv)
+{
+    if (argc > 2)
+    {
+        fprintf(stderr, "usage: %s [kernel]\n", argv[0]);
+        return 1;
+    }
+
+    /* For the I2C kernels */
+    axp192_sim_attach();
+
+    int cases = bench_run((argc > 1) ? argv[1] : NULL);
+
+    return (cases > 0) ? 0 : 1;
+}
@@ -0,0 +1,455 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Runs the record, encode and upload pipeline of main/ as a Linux program, with
+ * FreeRTOS and the ESP-IDF services it uses mapped onto POSIX in port/. The
+ * recording goes to ./sdcard as it would on the device.
+ *
+ * Build and run from this directory:
+ *
+ *     cmake -B build && cmake --build build
+ *     ./build/host_pipeline -t 5 -n 3
+ *
+ * Options are set at configure time, as Kconfig does for the device:
+ *
+ *     cmake -B build -DEXAMPLE_CONFIG="CONFIG_EXAMPLE_AUDIO_FORMAT_FLAC;CONFIG_EXAMPLE_VAD"
+ *
+ * With FLAC, -c decodes every upload with flac_lite_decode_frame() and checks it
+ * against the PCM the source returned, bit for bit. Slots dropped on overruns
+ * are skipped, anything else that differs fails the run. The activity gate and
+ * the resampler change the samples, so -c needs both disabled.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "audio.h"
+#include "audio_source.h"
+#include "capture_stats.h"
+#include "flac_lite.h"
+#include "upload.h"
+#include "upload_sink.h"
+
+#include <golioth/client.h>
+static const char *TAG = "host_pipeline";
+
+/* Growable byte buffer */
+struct buffer {
+    uint8_t *data;
+    size_t len;
+    size_t size;
+};
+
+/*
+ * Source that passes reads through and keeps what they returned, with the
+ * length of each read, as the capture task gets one slot per read
+ */
+struct tee_source {
+    const struct audio_source *inner;
+    struct buffer pcm;
+    struct buffer reads;
+};
+
+/* Sink that passes uploads through and keeps the last blockwise transfer */
+struct tee_sink {
+    const struct upload_sink *inner;
+    struct buffer upload;
+    upload_sink_read_block_cb cb;
+    void *arg;
+};
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-s synthetic|wav:FILE] [-o loopback|file:DIR] [-t SECONDS] [-n RUNS] "
+            "[-c]\n",
+            prog);
+}
+
+static bool buffer_append(struct buffer *buf, const void *data, size_t len)
+{
+    if (buf->len + len > buf->size)
+    {
+        size_t size = MAX(buf->size * 2, buf->len + len);
+        uint8_t *grown = realloc(buf->data, size);
+        if (!grown)
+        {
+            return false;
+        }
+        buf->data = grown;
+        buf->size = size;
+    }
+
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    return true;
+}
+
+static esp_err_t tee_start(void *ctx)
+{
+    struct tee_source *tee = ctx;
+
+    tee->pcm.len = 0;
+    tee->reads.len = 0;
+    return tee->inner->start(tee->inner->ctx);
+}
+
+static esp_err_t tee_read(void *ctx, void *buf, size_t len, size_t *bytes_read)
+{
+    struct tee_source *tee = ctx;
+    esp_err_t err = tee->inner->read(tee->inner->ctx, buf, len, bytes_read);
+
+    if (err == ESP_OK
+        && (!buffer_append(&tee->pcm, buf, *bytes_read)
+            || !buffer_append(&tee->reads, bytes_read, sizeof(*bytes_read))))
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    return err;
+}
+
+static void tee_stop(void *ctx)
+{
+    struct tee_source *tee = ctx;
+
+    tee->inner->stop(tee->inner->ctx);
+}
+
+static void tee_close(void *ctx)
+{
+    struct tee_source *tee = ctx;
+
+    free(tee->pcm.data);
+    free(tee->reads.data);
+}
+
+static enum golioth_status tee_read_block(uint32_t block_idx,
+                                          uint8_t *block_buffer,
+                                          size_t *block_size,
+                                          bool *is_last,
+                                          void *arg)
+{
+    struct tee_sink *tee = arg;
+    enum golioth_status status = tee->cb(block_idx, block_buffer, block_size, is_last, tee->arg);
+
+    if (status == GOLIOTH_OK && !buffer_append(&tee->upload, block_buffer, *block_size))
+    {
+        return GOLIOTH_ERR_MEM_ALLOC;
+    }
+
+    return status;
+}
+
+static enum golioth_status tee_write_blockwise(void *ctx,
+                                               const char *path,
+                                               upload_sink_read_block_cb cb,
+                                               void *arg)
+{
+    struct tee_sink *tee = ctx;
+
+    tee->upload.len = 0;
+    tee->cb = cb;
+    tee->arg = arg;
+    return tee->inner->write_blockwise(tee->inner->ctx, path, tee_read_block, tee);
+}
+
+static enum golioth_status tee_write(void *ctx,
+                                     const char *path,
+                                     enum upload_sink_content type,
+                                     const uint8_t *data,
+                                     size_t len)
+{
+    struct tee_sink *tee = ctx;
+
+    return tee->inner->write(tee->inner->ctx, path, type, data, len);
+}
+
+/*
+ * Decodes the uploaded stream and matches it against the source's reads in
+ * order: each read is either in the upload at the current position or was
+ * dropped as a whole on an overrun.
+ */
+static bool check_flac(const struct buffer *upload, const struct tee_source *source)
+{
+    int16_t *decoded = malloc(source->pcm.len + FLAC_LITE_BLOCK_SIZE * sizeof(int16_t));
+    size_t num_decoded = 0;
+    size_t pos = FLAC_LITE_STREAM_HEADER_SIZE;
+    bool ok = false;
+
+    if (!decoded)
+    {
+        GLTH_LOGE(TAG, "FLAC check: unable to allocate %u bytes", (unsigned int) source->pcm.len);
+        return false;
+    }
+
+    if (upload->len < pos || memcmp(upload->data, "fLaC", 4) != 0)
+    {
+        GLTH_LOGE(TAG, "FLAC check: the upload is not a FLAC stream");
+        goto out;
+    }
+
+    while (pos < upload->len)
+    {
+        size_t n = 0;
+
+        if (num_decoded * sizeof(int16_t) > source->pcm.len)
+        {
+            GLTH_LOGE(TAG, "FLAC check: more samples uploaded than captured");
+            goto out;
+        }
+
+        int used = flac_lite_decode_frame(upload->data + pos,
+                                          upload->len - pos,
+                                          decoded + num_decoded,
+                                          &n);
+        if (used < 0)
+        {
+            GLTH_LOGE(TAG, "FLAC check: invalid frame at byte %u", (unsigned int) pos);
+            goto out;
+        }
+        pos += used;
+        num_decoded += n;
+    }
+
+    const uint8_t *out = (const uint8_t *) decoded;
+    size_t out_len = num_decoded * sizeof(int16_t);
+    const size_t *reads = (const size_t *) source->reads.data;
+    size_t num_reads = source->reads.len / sizeof(size_t);
+    size_t matched = 0;
+    size_t dropped = 0;
+    size_t offset = 0;
+
+    for (size_t i = 0; i < num_reads; i++)
+    {
+        if (matched + reads[i] <= out_len
+            && memcmp(out + matched, source->pcm.data + offset, reads[i]) == 0)
+        {
+            matched += reads[i];
+        }
+        else
+        {
+            dropped += reads[i];
+        }
+        offset += reads[i];
+    }
+
+    ok = (matched == out_len);
+    if (ok)
+    {
+        GLTH_LOGI(TAG,
+                  "FLAC check: %u samples match the source, %u bytes dropped",
+                  (unsigned int) num_decoded,
+                  (unsigned int) dropped);
+    }
+    else
+    {
+        GLTH_LOGE(TAG,
+                  "FLAC check: only %u of %u decoded bytes match the source",
+                  (unsigned int) matched,
+                  (unsigned int) out_len);
+    }
+
+out:
+    free(decoded);
+    return ok;
+}
+
+static esp_err_t open_source(struct audio_source *src, const char *spec)
+{
+    if (strcmp(spec, "synthetic") == 0)
+    {
+        return audio_source_synthetic_open(src);
+    }
+    if (strncmp(spec, "wav:", 4) == 0)
+    {
+        return audio_source_wav_open(src, spec + 4);
+    }
+
+    return ESP_ERR_INVALID_ARG;
+}
+
+static esp_err_t open_sink(struct upload_sink *sink, const char *spec)
+{
+    if (strcmp(spec, "loopback") == 0)
+    {
+        return upload_sink_loopback_open(sink);
+    }
+    if (strncmp(spec, "file:", 5) == 0)
+    {
+        return upload_sink_file_open(sink, spec + 5);
+    }
+
+    return ESP_ERR_INVALID_ARG;
+}
+
+static int run(const struct upload_sink *sink, struct audio_ctx *a_ctx)
+{
+    upload_metrics_start();
+
+#ifdef CONFIG_EXAMPLE_UPLOAD_MODE_STREAM
+    int err = upload_audio_stream(sink, a_ctx);
+    const char *mode = "stream";
+#else
+    record_wav(a_ctx, NULL);
+    upload_metrics_recorded();
+
+    int err = upload_audio_file(sink, a_ctx);
+    const char *mode = "file";
+#endif
+
+    upload_metrics_report(mode);
+    return err;
+}
+
+int main(int argc, char **argv)
+{
+    const char *source_spec = NULL;
+    const char *sink_spec = NULL;
+    struct audio_ctx a_ctx = audio_ctx_default();
+    int runs = 1;
+    bool check = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:o:t:n:ch")) != -1)
+    {
+        switch (opt)
+        {
+            case 's':
+                source_spec = optarg;
+                break;
+            case 'o':
+                sink_spec = optarg;
+                break;
+            case 't':
+                a_ctx.rec_time = strtoul(optarg, NULL, 0);
+                break;
+            case 'n':
+                runs = atoi(optarg);
+                break;
+            case 'c':
+                check = true;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (mkdir(SD_MOUNT_POINT, 0755) != 0 && errno != EEXIST)
+    {
+        GLTH_LOGE(TAG, "Unable to create %s: %d", SD_MOUNT_POINT, errno);
+        return 1;
+    }
+
+#if !defined(CONFIG_EXAMPLE_AUDIO_FORMAT_FLAC) || defined(CONFIG_EXAMPLE_VAD) \
+    || defined(CONFIG_EXAMPLE_RESAMPLE)
+    if (check)
+    {
+        GLTH_LOGE(TAG, "-c needs CONFIG_EXAMPLE_AUDIO_FORMAT_FLAC without VAD or resampling");
+        return 1;
+    }
+#endif
+
+    init_microphone();
+
+    struct audio_source source;
+    if (source_spec || check)
+    {
+        esp_err_t err = source_spec ? open_source(&source, source_spec)
+                                    : audio_source_default_open(&source);
+        if (err != ESP_OK)
+        {
+            GLTH_LOGE(TAG, "Unable to open source %s", source_spec ? source_spec : "default");
+            return 1;
+        }
+        audio_set_source(&source);
+    }
+
+    struct tee_source tee_source = {
+        .inner = &source,
+    };
+    struct audio_source checked_source = {
+        .start = tee_start,
+        .read = tee_read,
+        .stop = tee_stop,
+        .close = tee_close,
+        .name = source.name,
+        .ctx = &tee_source,
+    };
+    if (check)
+    {
+        audio_set_source(&checked_source);
+    }
+
+    capture_stats_start();
+    upload_init();
+
+    struct upload_sink sink;
+    esp_err_t err = sink_spec ? open_sink(&sink, sink_spec) : upload_sink_default_open(&sink, NULL);
+    if (err != ESP_OK)
+    {
+        GLTH_LOGE(TAG, "Unable to open sink %s", sink_spec ? sink_spec : "default");
+        return 1;
+    }
+
+    GLTH_LOGI(TAG,
+              "Uploading to %s, %d run(s) of %" PRIu32 " seconds",
+              sink.name,
+              runs,
+              a_ctx.rec_time);
+
+    struct tee_sink tee_sink = {
+        .inner = &sink,
+    };
+    struct upload_sink checked_sink = {
+        .write_blockwise = tee_write_blockwise,
+        .write = tee_write,
+        .name = sink.name,
+        .ctx = &tee_sink,
+    };
+
+    int failed = 0;
+    for (int i = 0; i < runs; i++)
+    {
+        int status = run(check ? &checked_sink : &sink, &a_ctx);
+        if (status)
+        {
+            GLTH_LOGE(TAG, "Run %d failed: %d", i + 1, status);
+            failed++;
+        }
+        else if (check && !check_flac(&tee_sink.upload, &tee_source))
+        {
+            failed++;
+        }
+
+        if (strcmp(sink.name, "loopback") == 0)
+        {
+            struct upload_sink_loopback_stats stats = upload_sink_loopback_get_stats(&sink);
+            GLTH_LOGI(TAG, "Last transfer CRC-32: %08" PRIx32, stats.crc);
+        }
+    }
+
+    sink.close(sink.ctx);
+    free(tee_sink.upload.data);
+    if (check)
+    {
+        checked_source.close(checked_source.ctx);
+    }
+    if (source_spec || check)
+    {
+        source.close(source.ctx);
+    }
+
+    return failed ? 1 : 0;
+}
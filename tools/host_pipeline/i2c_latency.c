@@ -0,0 +1,332 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Measures how long an urgent register write waits while another task polls
+ * the PMU telemetry as fast as it can, on the simulated bus of port/i2c.c:
+ *
+ * - direct:   both call i2c_read_bytes() and i2c_write_byte(), which hand
+ *             each transfer to the I2C service owning the port and wait for
+ *             it, at normal priority
+ * - fifo:     both queue with i2c_service_submit(), the write at the
+ *             telemetry's priority, so it queues behind a whole poll
+ * - priority: both queue with i2c_service_submit(), the write as urgent
+ *
+ * For each it reports how long the writing task was blocked, and the time
+ * from the request to the end of the write.
+ *
+ *     cmake -B build && cmake --build build
+ *     ./build/i2c_latency -l 50 -d 2000
+ *
+ * -l sets the latency added to every transfer in µs, -d the duration of each
+ * mode in ms and -p the period of the urgent writes in ms.
+ */
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "i2c_device.h"
+#include "i2c_service.h"
+#include "i2c_sim.h"
+
+#define PMU_ADDR        (0x34)
+#define PMU_SDA         (21)
+#define PMU_SCL         (22)
+#define PMU_FREQ        (400000)
+/* Data buffer register, written by the urgent task */
+#define PMU_DATA_REG    (0x06)
+
+#define MAX_SAMPLES     (4096)
+
+enum mode {
+    MODE_DIRECT,
+    MODE_FIFO,
+    MODE_PRIORITY,
+    NUM_MODES,
+};
+
+static const char *_mode_names[NUM_MODES] = {"direct", "fifo", "priority"};
+
+/* The registers of one telemetry poll, as read by the Axp192_Get* functions */
+static const uint8_t _telemetry_regs[] = {0x78, 0x7a, 0x7c, 0x5a, 0x5c, 0x56, 0x58};
+#define NUM_TELEMETRY_REGS (sizeof(_telemetry_regs) / sizeof(_telemetry_regs[0]))
+
+struct poller {
+    I2CDevice_t device;
+    enum mode mode;
+    atomic_bool stop;
+    uint32_t polls;
+    SemaphoreHandle_t stopped;
+};
+
+struct samples {
+    uint32_t blocked_us[MAX_SAMPLES];
+    uint32_t latency_us[MAX_SAMPLES];
+    size_t count;
+};
+
+static struct samples _samples;
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-l LATENCY_US] [-d DURATION_MS] [-p PERIOD_MS]\n", prog);
+}
+
+static void poller_task(void *arg)
+{
+    struct poller *p = arg;
+    uint8_t data[NUM_TELEMETRY_REGS][2];
+    struct i2c_service_xfer xfers[NUM_TELEMETRY_REGS];
+    SemaphoreHandle_t done_sem = xSemaphoreCreateCounting(NUM_TELEMETRY_REGS, 0);
+
+    while (!atomic_load(&p->stop))
+    {
+        if (p->mode == MODE_DIRECT)
+        {
+            for (size_t i = 0; i < NUM_TELEMETRY_REGS; i++)
+            {
+                i2c_read_bytes(p->device, _telemetry_regs[i], data[i], sizeof(data[i]));
+            }
+        }
+        else
+        {
+            /* A whole poll queued at once, as a telemetry task would */
+            for (size_t i = 0; i < NUM_TELEMETRY_REGS; i++)
+            {
+                xfers[i] = (struct i2c_service_xfer) {
+                    .device = p->device,
+                    .reg_addr = _telemetry_regs[i],
+                    .data = data[i],
+                    .length = sizeof(data[i]),
+                    .done_sem = done_sem,
+                };
+                i2c_service_submit(&xfers[i], I2C_SERVICE_NORMAL);
+            }
+            for (size_t i = 0; i < NUM_TELEMETRY_REGS; i++)
+            {
+                xSemaphoreTake(done_sem, portMAX_DELAY);
+            }
+        }
+        p->polls++;
+    }
+
+    vSemaphoreDelete(done_sem);
+    xSemaphoreGive(p->stopped);
+    vTaskDelete(NULL);
+}
+
+/* One urgent write, returns false when it failed */
+static bool urgent_write(I2CDevice_t device,
+                         enum mode mode,
+                         uint8_t value,
+                         SemaphoreHandle_t done_sem,
+                         uint32_t *blocked_us,
+                         uint32_t *latency_us)
+{
+    int64_t start_us = esp_timer_get_time();
+
+    if (mode == MODE_DIRECT)
+    {
+        esp_err_t err = i2c_write_byte(device, PMU_DATA_REG, value);
+
+        *blocked_us = esp_timer_get_time() - start_us;
+        *latency_us = *blocked_us;
+        return err == ESP_OK;
+    }
+
+    struct i2c_service_xfer xfer = {
+        .device = device,
+        .reg_addr = PMU_DATA_REG,
+        .data = &value,
+        .length = 1,
+        .write = true,
+        .done_sem = done_sem,
+    };
+    enum i2c_service_prio prio = (mode == MODE_PRIORITY) ? I2C_SERVICE_URGENT
+                                                         : I2C_SERVICE_NORMAL;
+
+    esp_err_t err = i2c_service_submit(&xfer, prio);
+    *blocked_us = esp_timer_get_time() - start_us;
+    if (err != ESP_OK)
+    {
+        return false;
+    }
+
+    /* Free to do other work here, the wait is only to time the write */
+    xSemaphoreTake(done_sem, portMAX_DELAY);
+    *latency_us = xfer.done_us - start_us;
+    return xfer.err == ESP_OK;
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+struct summary {
+    uint32_t mean;
+    uint32_t p99;
+    uint32_t max;
+};
+
+/* Sorts values */
+static struct summary summarize(uint32_t *values, size_t count)
+{
+    uint64_t sum = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        sum += values[i];
+    }
+    qsort(values, count, sizeof(values[0]), compare_u32);
+
+    return (struct summary) {
+        .mean = sum / count,
+        .p99 = values[(count - 1) * 99 / 100],
+        .max = values[count - 1],
+    };
+}
+
+static int run(enum mode mode, I2CDevice_t pmu, I2CDevice_t urgent, int duration_ms, int period_ms)
+{
+    struct poller poller = {
+        .device = pmu,
+        .mode = mode,
+        .stopped = xSemaphoreCreateBinary(),
+    };
+    SemaphoreHandle_t done_sem = xSemaphoreCreateBinary();
+    int failures = 0;
+
+    _samples.count = 0;
+    i2c_service_reset_stats(I2C_NUM_1);
+    xTaskCreate(poller_task, "poller", 4096, &poller, 5, NULL);
+
+    int64_t end_us = esp_timer_get_time() + (int64_t) duration_ms * 1000;
+    while (esp_timer_get_time() < end_us && _samples.count < MAX_SAMPLES)
+    {
+        vTaskDelay(pdMS_TO_TICKS(period_ms));
+
+        size_t i = _samples.count++;
+        if (!urgent_write(urgent,
+                          mode,
+                          (uint8_t) i,
+                          done_sem,
+                          &_samples.blocked_us[i],
+                          &_samples.latency_us[i]))
+        {
+            failures++;
+        }
+    }
+
+    atomic_store(&poller.stop, true);
+    xSemaphoreTake(poller.stopped, portMAX_DELAY);
+    vSemaphoreDelete(poller.stopped);
+    vSemaphoreDelete(done_sem);
+
+    struct summary blocked = summarize(_samples.blocked_us, _samples.count);
+    struct summary latency = summarize(_samples.latency_us, _samples.count);
+    printf("%-9s %6zu %7" PRIu32 " %7" PRIu32 " %7" PRIu32 " %9" PRIu32 " %7" PRIu32 " %7" PRIu32
+           " %6" PRIu32 "\n",
+           _mode_names[mode],
+           _samples.count,
+           blocked.mean,
+           blocked.p99,
+           blocked.max,
+           latency.mean,
+           latency.p99,
+           latency.max,
+           poller.polls);
+
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t latency_us = 50;
+    int duration_ms = 1000;
+    int period_ms = 5;
+    int failures = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "l:d:p:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'l':
+                latency_us = strtoul(optarg, NULL, 0);
+                break;
+            case 'd':
+                duration_ms = atoi(optarg);
+                break;
+            case 'p':
+                period_ms = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    axp192_sim_attach();
+    i2c_sim_set_latency(latency_us);
+
+    I2CDevice_t pmu = i2c_malloc_device(I2C_NUM_1, PMU_SDA, PMU_SCL, PMU_FREQ, PMU_ADDR);
+    I2CDevice_t urgent = i2c_malloc_device(I2C_NUM_1, PMU_SDA, PMU_SCL, PMU_FREQ, PMU_ADDR);
+    if (!pmu || !urgent || i2c_service_start(I2C_NUM_1, 10) != ESP_OK)
+    {
+        fprintf(stderr, "Unable to set up the I2C devices\n");
+        return 1;
+    }
+
+    printf("urgent writes every %d ms for %d ms, %" PRIu32 " us latency per transfer\n",
+           period_ms,
+           duration_ms,
+           latency_us);
+    printf("%-16s %-23s %-25s\n", "", "blocked us", "request to written us");
+    printf("%-9s %6s %7s %7s %7s %9s %7s %7s %6s\n",
+           "mode",
+           "writes",
+           "mean",
+           "p99",
+           "max",
+           "mean",
+           "p99",
+           "max",
+           "polls");
+
+    for (enum mode mode = 0; mode < NUM_MODES; mode++)
+    {
+        failures += run(mode, pmu, urgent, duration_ms, period_ms);
+    }
+
+    struct i2c_service_stats stats;
+    i2c_service_get_stats(I2C_NUM_1, I2C_SERVICE_URGENT, &stats);
+    printf("service, last mode: urgent %" PRIu32 " transfers, longest wait %" PRIu32
+           " us; rejected %" PRIu32 "\n",
+           stats.completed,
+           stats.max_wait_us,
+           stats.rejected);
+
+    if (failures)
+    {
+        printf("%d urgent writes failed\n", failures);
+    }
+
+    /* Every transfer has completed, the service no longer refers to them */
+    i2c_free_device(urgent);
+    i2c_free_device(pmu);
+
+    return failures ? 1 : 0;
+}
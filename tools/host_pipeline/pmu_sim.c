@@ -0,0 +1,392 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Runs the Core2's PMU code against the simulated AXP192 of port/axp192_sim.c:
+ *
+ * - checks that the declarative profile of main/m5stack_core2 leaves the
+ *   registers as the one-setter-per-field sequence it replaced did,
+ * - polls the battery, VBUS and ACIN telemetry from a simulated supply and
+ *   checks the values read back,
+ * - checks the decoding of the multi-register ADC and counter values, with
+ *   the unused bits of the registers set,
+ * - checks that a control register write queued with Axp192_SubmitXfer()
+ *   leaves the register shadow in step with the chip.
+ *
+ * The I2C service owns the PMU's port throughout, as on the device.
+ *
+ * Both init sequences and the telemetry poll report their I2C transfers and
+ * time, on the simulated bus and on the wall clock.
+ *
+ *     cmake -B build && cmake --build build
+ *     ./build/pmu_sim -l 50 -t trace.csv
+ *
+ * -l sets the latency added to every transfer, in µs, -n the number of
+ * telemetry polls and -t a file for a CSV trace of the transfers. Exits with
+ * status 1 when a check fails.
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "axp192.h"
+#include "axp192_i2c.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
+#include "i2c_service.h"
+#include "i2c_sim.h"
+#include "m5stack_core2_pmu.h"
+
+/* What the telemetry poll reads */
+static const struct axp192_sim_supply _supply = {
+    .vbus_mv = 5020,
+    .vbus_ma = 480,
+    .bat_mv = 4105,
+    .bat_charge_ma = 180,
+    .bat_discharge_ma = 12,
+};
+
+struct decode_case {
+    const char *name;
+    uint8_t reg;
+    uint8_t raw[4];
+    uint32_t (*read)(uint8_t reg);
+    uint32_t expected;
+};
+
+static uint32_t read12(uint8_t reg)
+{
+    return Axp192_Read12Bit(reg);
+}
+
+static uint32_t read13(uint8_t reg)
+{
+    return Axp192_Read13Bit(reg);
+}
+
+static uint32_t read16(uint8_t reg)
+{
+    return Axp192_Read16Bit(reg);
+}
+
+/* The unused high bits of the low registers are set, which the reads must drop */
+static const struct decode_case _decode_cases[] = {
+    {"Read12Bit", AXP192_BAT_ADC_VOLTAGE_REG, {0xab, 0xf5}, read12, 0xab5},
+    {"Read12Bit", AXP192_VBUS_ADC_CURRENT_REG, {0xff, 0xff}, read12, 0xfff},
+    {"Read13Bit", AXP192_BAT_ADC_CURRENT_IN_REG, {0xab, 0xe7}, read13, 0x1567},
+    {"Read13Bit", AXP192_BAT_ADC_CURRENT_OUT_REG, {0x80, 0xff}, read13, 0x101f},
+    {"Read16Bit", 0x70, {0x12, 0x34}, read16, 0x1234},
+    {"Read24Bit", 0x70, {0x80, 0x12, 0x34}, Axp192_Read24Bit, 0x801234},
+    {"Read32Bit", 0xb0, {0x80, 0x12, 0x34, 0x56}, Axp192_Read32Bit, 0x80123456},
+};
+
+struct bus_usage {
+    struct i2c_sim_stats bus;
+    int64_t wall_us;
+};
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-l LATENCY_US] [-n POLLS] [-t TRACE]\n", prog);
+}
+
+static void bus_usage_start(struct bus_usage *usage)
+{
+    i2c_sim_reset_stats();
+    usage->wall_us = esp_timer_get_time();
+}
+
+static void bus_usage_stop(struct bus_usage *usage)
+{
+    usage->wall_us = esp_timer_get_time() - usage->wall_us;
+    i2c_sim_get_stats(&usage->bus);
+}
+
+/* The PMU setup before it became a profile */
+static void setters_init(void)
+{
+    uint8_t value = (1 << AXP192_LDO2_EN_BIT) | (1 << AXP192_DC3_EN_BIT)
+                  | (1 << AXP192_DC1_EN_BIT);
+
+    Axp192_SetLDO23Volt(3300, 0);
+    Axp192_SetDCDC2Volt(0);
+    Axp192_SetDCDC3Volt(2700);
+    Axp192_SetVoffVolt(3000);
+    Axp192_SetChargeCurrent(CHARGE_Current_100mA);
+    Axp192_SetChargeVoltage(CHARGE_VOLT_4200mV);
+    Axp192_EnableCharge(1);
+    Axp192_SetPressStartupTime(STARTUP_128mS);
+    Axp192_SetPressPoweroffTime(POWEROFF_4S);
+
+    Axp192_EnableLDODCExt(value);
+    Axp192_SetGPIO4Mode(1);
+    Axp192_SetGPIO2Mode(1);
+    Axp192_SetGPIO2Level(0);
+
+    Axp192_SetGPIO0Volt(3300);
+    Axp192_SetAdc1Enable(0xfe);
+
+    Axp192_SetGPIO0Mode(1);
+    Axp192_EnableExten(1);
+    Axp192_SetGPIO1Mode(0);
+}
+
+static void profile_init(void)
+{
+    Axp192_ApplyProfile(m5stack_core2_pmu_profile, m5stack_core2_pmu_profile_len);
+}
+
+/* Runs init on a fresh chip, with the shadow load of Axp192_I2CInit() */
+static Axp192_I2CStats_t run(const char *name, void (*init)(void), uint8_t regs[256])
+{
+    Axp192_I2CStats_t before;
+    Axp192_I2CStats_t after;
+    struct bus_usage usage;
+
+    axp192_sim_reset();
+    Axp192_GetI2CStats(&before);
+    bus_usage_start(&usage);
+    Axp192_ShadowLoad();
+    init();
+    bus_usage_stop(&usage);
+    Axp192_GetI2CStats(&after);
+
+    for (int reg = 0; reg < 256; reg++)
+    {
+        regs[reg] = axp192_sim_get(reg);
+    }
+
+    Axp192_I2CStats_t delta = {
+        .reads = after.reads - before.reads,
+        .writes = after.writes - before.writes,
+        .shadow_hits = after.shadow_hits - before.shadow_hits,
+    };
+    printf("%-8s %3" PRIu32 " transfers: %3" PRIu32 " reads, %3" PRIu32 " writes, %3" PRIu32
+           " reads from the shadow\n",
+           name,
+           delta.reads + delta.writes,
+           delta.reads,
+           delta.writes,
+           delta.shadow_hits);
+    printf("%-8s %5" PRIu64 " us on the bus, %5" PRId64 " us wall\n",
+           "",
+           usage.bus.bus_us,
+           usage.wall_us);
+
+    return delta;
+}
+
+/* Whether value is within one LSB of expected */
+static bool check_value(const char *name, float value, float expected, float lsb)
+{
+    bool ok = fabsf(value - expected) <= lsb;
+
+    if (!ok)
+    {
+        printf("%s: %.4f, expected %.4f\n", name, value, expected);
+    }
+
+    return ok;
+}
+
+/* Polls the supply telemetry as an application would, returns the failed checks */
+static int telemetry(int polls)
+{
+    struct bus_usage usage;
+    int failures = 0;
+
+    axp192_sim_set_supply(&_supply);
+
+    bus_usage_start(&usage);
+    for (int i = 0; i < polls; i++)
+    {
+        float bat_v = Axp192_GetBatVolt();
+        float bat_ma = Axp192_GetBatCurrent();
+        float vbus_v = Axp192_GetVbusVolt();
+        float vbus_ma = Axp192_GetVbusCurrent();
+        float acin_v = Axp192_GetAcinVolt();
+        float acin_ma = Axp192_GetAcinCurrent();
+
+        if (i > 0)
+        {
+            continue;
+        }
+
+        failures += !check_value("battery V", bat_v, _supply.bat_mv / 1000.0f, 0.0011f);
+        failures += !check_value("battery mA",
+                                 bat_ma,
+                                 (float) _supply.bat_charge_ma - _supply.bat_discharge_ma,
+                                 1.0f);
+        failures += !check_value("VBUS V", vbus_v, _supply.vbus_mv / 1000.0f, 0.0017f);
+        failures += !check_value("VBUS mA", vbus_ma, _supply.vbus_ma, 0.375f);
+        failures += !check_value("ACIN V", acin_v, 0.0f, 0.0f);
+        failures += !check_value("ACIN mA", acin_ma, 0.0f, 0.0f);
+    }
+    bus_usage_stop(&usage);
+
+    if (polls > 0)
+    {
+        printf("telemetry %3" PRIu32 " transfers, %5" PRIu64 " us on the bus, %5" PRId64
+               " us wall per poll of %d\n",
+               usage.bus.transfers / polls,
+               usage.bus.bus_us / polls,
+               usage.wall_us / polls,
+               polls);
+    }
+
+    return failures;
+}
+
+static int decoding(void)
+{
+    int failures = 0;
+
+    for (size_t i = 0; i < sizeof(_decode_cases) / sizeof(_decode_cases[0]); i++)
+    {
+        const struct decode_case *c = &_decode_cases[i];
+
+        for (size_t j = 0; j < sizeof(c->raw); j++)
+        {
+            axp192_sim_set(c->reg + j, c->raw[j]);
+        }
+
+        uint32_t value = c->read(c->reg);
+        if (value != c->expected)
+        {
+            printf("%s(0x%02x): 0x%" PRIx32 ", expected 0x%" PRIx32 "\n",
+                   c->name,
+                   c->reg,
+                   value,
+                   c->expected);
+            failures++;
+        }
+    }
+
+    printf("decoding  %zu cases, %d failed\n",
+           sizeof(_decode_cases) / sizeof(_decode_cases[0]),
+           failures);
+
+    return failures;
+}
+
+/* A queued write to a shadowed register, then a bit-field update on top of it */
+static int queued_write(void)
+{
+    const uint8_t reg = AXP192_GPIO0_VOLT_REG;
+    uint8_t value = axp192_sim_get(reg) ^ 0xa0;
+    SemaphoreHandle_t done_sem = xSemaphoreCreateBinary();
+    struct i2c_service_xfer xfer = {
+        .reg_addr = reg,
+        .data = &value,
+        .length = 1,
+        .write = true,
+        .done_sem = done_sem,
+    };
+    int failures = 0;
+
+    if (Axp192_SubmitXfer(&xfer, I2C_SERVICE_URGENT) != ESP_OK)
+    {
+        printf("queued write: unable to submit\n");
+        vSemaphoreDelete(done_sem);
+        return 1;
+    }
+    xSemaphoreTake(done_sem, portMAX_DELAY);
+    vSemaphoreDelete(done_sem);
+
+    /* Read-modify-write from the shadow: stale bits would undo the queued write */
+    Axp192_WriteBits(reg, 0x0f, 0, 4);
+    uint8_t expected = (value & 0xf0) | 0x0f;
+
+    if (xfer.err != ESP_OK || axp192_sim_get(reg) != expected)
+    {
+        printf("queued write: register 0x%02x is 0x%02x, expected 0x%02x\n",
+               reg,
+               axp192_sim_get(reg),
+               expected);
+        failures++;
+    }
+    printf("queued write %s\n", failures ? "failed" : "kept the shadow in step");
+
+    return failures;
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t expected[256];
+    uint8_t actual[256];
+    int failures = 0;
+    int polls = 10;
+    FILE *trace = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "l:n:t:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'l':
+                i2c_sim_set_latency(strtoul(optarg, NULL, 0));
+                break;
+            case 'n':
+                polls = atoi(optarg);
+                break;
+            case 't':
+                trace = fopen(optarg, "w");
+                if (!trace)
+                {
+                    perror(optarg);
+                    return 1;
+                }
+                i2c_sim_trace(trace);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    axp192_sim_attach();
+    /* As m5stack_core2_init_pmu() does, so every transfer goes through the service */
+    if (i2c_service_start(I2C_NUM_1, 10) != ESP_OK)
+    {
+        fprintf(stderr, "Unable to start the I2C service\n");
+        return 1;
+    }
+    Axp192_Init();
+
+    run("setters", setters_init, expected);
+    run("profile", profile_init, actual);
+
+    for (int reg = 0; reg < 256; reg++)
+    {
+        if (actual[reg] != expected[reg])
+        {
+            printf("register 0x%02x: 0x%02x, setters left 0x%02x\n", reg, actual[reg], expected[reg]);
+            failures++;
+        }
+    }
+
+    int changed = Axp192_ApplyProfile(m5stack_core2_pmu_profile, m5stack_core2_pmu_profile_len);
+    printf("profile applied again: %d registers written\n", changed);
+    if (changed != 0)
+    {
+        failures++;
+    }
+
+    failures += telemetry(polls);
+    failures += decoding();
+    failures += queued_write();
+
+    if (trace)
+    {
+        i2c_sim_trace(NULL);
+        fclose(trace);
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+#include "i2c_sim.h"
+
+#define AXP192_SIM_ADDR     (0x34)
+
+#define REG_POWER_STATUS    (0x00)
+#define REG_CHARGE_STATUS   (0x01)
+#define REG_ADC1_ENABLE     (0x82)
+
+/* ADC result registers, with their enable bit in REG_ADC1_ENABLE and LSB */
+struct axp192_adc {
+    uint8_t reg;
+    uint8_t bits;
+    uint8_t enable_bit;
+    /* Size of the LSB in µV or µA */
+    uint32_t lsb_u;
+};
+
+enum axp192_adc_channel {
+    ADC_ACIN_V,
+    ADC_ACIN_I,
+    ADC_VBUS_V,
+    ADC_VBUS_I,
+    ADC_BAT_V,
+    ADC_BAT_CHARGE_I,
+    ADC_BAT_DISCHARGE_I,
+    NUM_ADC_CHANNELS,
+};
+
+static const struct axp192_adc _adcs[NUM_ADC_CHANNELS] = {
+    [ADC_ACIN_V] = {0x56, 12, 5, 1700},
+    [ADC_ACIN_I] = {0x58, 12, 4, 625},
+    [ADC_VBUS_V] = {0x5a, 12, 3, 1700},
+    [ADC_VBUS_I] = {0x5c, 12, 2, 375},
+    [ADC_BAT_V] = {0x78, 12, 7, 1100},
+    [ADC_BAT_CHARGE_I] = {0x7a, 13, 6, 500},
+    [ADC_BAT_DISCHARGE_I] = {0x7c, 13, 6, 500},
+};
+
+struct axp192_sim {
+    uint8_t regs[256];
+    /* Register the next read or write goes to */
+    uint8_t pointer;
+    /* Bytes written since the device was addressed */
+    uint32_t written;
+    struct axp192_sim_supply supply;
+};
+
+static struct axp192_sim _sim;
+
+/* Status, ADC and coulomb counter registers, which only the chip changes */
+static bool is_read_only(uint8_t reg)
+{
+    return reg <= 0x01 || (reg >= 0x56 && reg <= 0x7f) || (reg >= 0xb0 && reg <= 0xb7);
+}
+
+/* Conversion result of a channel, the high 8 bits then the rest in the low bits */
+static void adc_store(enum axp192_adc_channel channel, uint32_t value_m)
+{
+    const struct axp192_adc *adc = &_adcs[channel];
+    uint32_t raw = 0;
+
+    if (_sim.regs[REG_ADC1_ENABLE] & (1 << adc->enable_bit))
+    {
+        uint32_t max = (1u << adc->bits) - 1;
+
+        raw = (uint32_t) ((uint64_t) value_m * 1000 / adc->lsb_u);
+        raw = (raw > max) ? max : raw;
+    }
+
+    _sim.regs[adc->reg] = raw >> (adc->bits - 8);
+    _sim.regs[adc->reg + 1] = raw & ((1u << (adc->bits - 8)) - 1);
+}
+
+/*
+ * Refreshes the status and ADC registers from the supply. Only done when the
+ * supply or the ADC enables change, so that registers set with
+ * axp192_sim_set() stay as set.
+ */
+static void sample(void)
+{
+    const struct axp192_sim_supply *s = &_sim.supply;
+
+    _sim.regs[REG_POWER_STATUS] = ((s->acin_mv > 0) << 7) | ((s->vbus_mv > 0) << 5)
+                                | ((s->bat_charge_ma > 0) << 2);
+    _sim.regs[REG_CHARGE_STATUS] = ((s->bat_charge_ma > 0) << 6) | ((s->bat_mv > 0) << 5);
+
+    adc_store(ADC_ACIN_V, s->acin_mv);
+    adc_store(ADC_ACIN_I, s->acin_ma);
+    adc_store(ADC_VBUS_V, s->vbus_mv);
+    adc_store(ADC_VBUS_I, s->vbus_ma);
+    adc_store(ADC_BAT_V, s->bat_mv);
+    adc_store(ADC_BAT_CHARGE_I, s->bat_charge_ma);
+    adc_store(ADC_BAT_DISCHARGE_I, s->bat_discharge_ma);
+}
+
+static void sim_start(void *ctx, bool read)
+{
+    struct axp192_sim *sim = ctx;
+
+    sim->written = 0;
+}
+
+static bool sim_write(void *ctx, uint8_t byte)
+{
+    struct axp192_sim *sim = ctx;
+
+    /* Register address, value, register address, value... */
+    if (sim->written++ % 2 == 0)
+    {
+        sim->pointer = byte;
+    }
+    else if (!is_read_only(sim->pointer))
+    {
+        sim->regs[sim->pointer] = byte;
+        if (sim->pointer == REG_ADC1_ENABLE)
+        {
+            sample();
+        }
+    }
+
+    return true;
+}
+
+static uint8_t sim_read(void *ctx)
+{
+    struct axp192_sim *sim = ctx;
+
+    return sim->regs[sim->pointer++];
+}
+
+static const struct i2c_sim_device _device = {
+    .start = sim_start,
+    .write = sim_write,
+    .read = sim_read,
+    .ctx = &_sim,
+};
+
+void axp192_sim_attach(void)
+{
+    i2c_sim_attach(I2C_NUM_1, AXP192_SIM_ADDR, &_device);
+}
+
+uint8_t axp192_sim_get(uint8_t reg)
+{
+    return _sim.regs[reg];
+}
+
+void axp192_sim_set(uint8_t reg, uint8_t value)
+{
+    _sim.regs[reg] = value;
+}
+
+void axp192_sim_reset(void)
+{
+    memset(&_sim, 0, sizeof(_sim));
+}
+
+void axp192_sim_set_supply(const struct axp192_sim_supply *supply)
+{
+    _sim.supply = *supply;
+    sample();
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <time.h>
+#include "esp_cpu.h"
+#include "esp_timer.h"
+
+static int64_t monotonic_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int64_t _boot_ns;
+
+/* Timestamps count from the start of the program, as they do from boot on the device */
+__attribute__((constructor)) static void record_boot(void)
+{
+    _boot_ns = monotonic_ns();
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return (monotonic_ns() - _boot_ns) / 1000;
+}
+
+uint32_t esp_cpu_get_cycle_count(void)
+{
+    return (uint32_t) monotonic_ns();
+}
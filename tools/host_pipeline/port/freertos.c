@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    /* Recursive mutexes: the task holding it and how often it took it */
+    pthread_t holder;
+    UBaseType_t depth;
+    /* In a StaticSemaphore_t of the caller, not freed on delete */
+    bool is_static;
+    uint8_t items[];
+};
+
+/* Freed when the task's thread exits */
+struct host_task {
+    TaskFunction_t fn;
+    void *arg;
+};
+
+static pthread_key_t _task_key;
+static pthread_once_t _task_key_once = PTHREAD_ONCE_INIT;
+
+static void task_key_init(void)
+{
+    pthread_key_create(&_task_key, free);
+}
+
+static void *task_entry(void *arg)
+{
+    struct host_task *task = arg;
+
+    pthread_setspecific(_task_key, task);
+    task->fn(task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn,
+                       const char *name,
+                       uint32_t stack_depth,
+                       void *arg,
+                       UBaseType_t priority,
+                       TaskHandle_t *handle)
+{
+    pthread_once(&_task_key_once, task_key_init);
+
+    struct host_task *task = malloc(sizeof(struct host_task));
+    if (!task)
+    {
+        return pdFAIL;
+    }
+    *task = (struct host_task) {.fn = fn, .arg = arg};
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    pthread_t thread;
+    int err = pthread_create(&thread, &attr, task_entry, task);
+    pthread_attr_destroy(&attr);
+
+    if (err != 0)
+    {
+        free(task);
+        return pdFAIL;
+    }
+
+    if (handle)
+    {
+        *handle = task;
+    }
+
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL)
+    {
+        pthread_exit(NULL);
+    }
+    abort();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    pthread_once(&_task_key_once, task_key_init);
+
+    return pthread_getspecific(_task_key);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = {
+        .tv_sec = ticks / 1000,
+        .tv_nsec = (long) (ticks % 1000) * 1000000,
+    };
+
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+    {
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t) (esp_timer_get_time() / 1000);
+}
+
+static void queue_init(struct host_queue *q, UBaseType_t length, UBaseType_t item_size)
+{
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    q->length = length;
+    q->item_size = item_size;
+}
+
+static struct host_queue *queue_alloc(UBaseType_t length, UBaseType_t item_size)
+{
+    struct host_queue *q = calloc(1, sizeof(struct host_queue) + length * item_size);
+    if (q)
+    {
+        queue_init(q, length, item_size);
+    }
+
+    return q;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    return queue_alloc(length, item_size);
+}
+
+QueueHandle_t host_queue_create_counting(UBaseType_t max_count, UBaseType_t initial_count)
+{
+    struct host_queue *q = queue_alloc(max_count, 0);
+    if (q)
+    {
+        q->count = initial_count;
+    }
+
+    return q;
+}
+
+_Static_assert(sizeof(struct host_queue) <= sizeof(StaticSemaphore_t),
+               "StaticSemaphore_t too small for a semaphore");
+
+QueueHandle_t host_queue_create_binary_static(StaticSemaphore_t *buffer)
+{
+    struct host_queue *q = (struct host_queue *) buffer;
+
+    memset(q, 0, sizeof(struct host_queue));
+    queue_init(q, 1, 0);
+    q->is_static = true;
+
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t q)
+{
+    pthread_cond_destroy(&q->not_full);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_mutex_destroy(&q->lock);
+    if (!q->is_static)
+    {
+        free(q);
+    }
+}
+
+/* Waits on cond until ready() or ticks have passed, with q->lock held */
+static bool queue_wait(struct host_queue *q,
+                       pthread_cond_t *cond,
+                       bool (*ready)(const struct host_queue *q),
+                       TickType_t ticks)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        while (!ready(q))
+        {
+            pthread_cond_wait(cond, &q->lock);
+        }
+        return true;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ticks / 1000;
+    deadline.tv_nsec += (long) (ticks % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    while (!ready(q))
+    {
+        if (pthread_cond_timedwait(cond, &q->lock, &deadline) == ETIMEDOUT)
+        {
+            return ready(q);
+        }
+    }
+
+    return true;
+}
+
+static bool has_space(const struct host_queue *q)
+{
+    return q->count < q->length;
+}
+
+static bool has_items(const struct host_queue *q)
+{
+    return q->count > 0;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks)
+{
+    pthread_mutex_lock(&q->lock);
+
+    if (!queue_wait(q, &q->not_full, has_space, ticks))
+    {
+        pthread_mutex_unlock(&q->lock);
+        return errQUEUE_FULL;
+    }
+
+    if (q->item_size)
+    {
+        UBaseType_t tail = (q->head + q->count) % q->length;
+        memcpy(&q->items[tail * q->item_size], item, q->item_size);
+    }
+    q->count++;
+
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks)
+{
+    pthread_mutex_lock(&q->lock);
+
+    if (!queue_wait(q, &q->not_empty, has_items, ticks))
+    {
+        pthread_mutex_unlock(&q->lock);
+        return errQUEUE_EMPTY;
+    }
+
+    if (q->item_size)
+    {
+        memcpy(item, &q->items[q->head * q->item_size], q->item_size);
+        q->head = (q->head + 1) % q->length;
+    }
+    q->count--;
+
+    pthread_cond_signal(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q)
+{
+    pthread_mutex_lock(&q->lock);
+    UBaseType_t count = q->count;
+    pthread_mutex_unlock(&q->lock);
+
+    return count;
+}
+
+QueueHandle_t host_queue_create_recursive(void)
+{
+    return host_queue_create_counting(1, 1);
+}
+
+BaseType_t host_queue_take_recursive(QueueHandle_t q, TickType_t ticks)
+{
+    pthread_mutex_lock(&q->lock);
+
+    if (q->depth > 0 && pthread_equal(q->holder, pthread_self()))
+    {
+        q->depth++;
+        pthread_mutex_unlock(&q->lock);
+        return pdPASS;
+    }
+
+    if (!queue_wait(q, &q->not_empty, has_items, ticks))
+    {
+        pthread_mutex_unlock(&q->lock);
+        return pdFAIL;
+    }
+
+    q->count--;
+    q->holder = pthread_self();
+    q->depth = 1;
+
+    pthread_mutex_unlock(&q->lock);
+    return pdPASS;
+}
+
+BaseType_t host_queue_give_recursive(QueueHandle_t q)
+{
+    pthread_mutex_lock(&q->lock);
+
+    if (q->depth == 0 || !pthread_equal(q->holder, pthread_self()))
+    {
+        pthread_mutex_unlock(&q->lock);
+        return pdFAIL;
+    }
+
+    if (--q->depth == 0)
+    {
+        q->count++;
+        pthread_cond_signal(&q->not_empty);
+    }
+
+    pthread_mutex_unlock(&q->lock);
+    return pdPASS;
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Counts the bytes the pipeline has allocated, for the peak heap figure of the
+ * upload metrics. The build links with -Wl,--wrap for each allocator below, so
+ * calls from the pipeline land here and reach the C library as __real_*.
+ * Allocations made inside the C library, such as stdio buffers, are not
+ * counted. As with CONFIG_HEAP_USE_HOOKS on the device, the heap trace hooks
+ * see each allocation and free.
+ */
+
+#include <malloc.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_heap_caps.h"
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void *__real_aligned_alloc(size_t alignment, size_t size);
+void __real_free(void *ptr);
+
+static atomic_size_t _in_use;
+/* Highest _in_use since the monitor was last started */
+static atomic_size_t _peak;
+
+static void *account_alloc(void *ptr)
+{
+    if (ptr)
+    {
+        size_t in_use = atomic_fetch_add(&_in_use, malloc_usable_size(ptr))
+                      + malloc_usable_size(ptr);
+        size_t peak = atomic_load(&_peak);
+
+        while (in_use > peak && !atomic_compare_exchange_weak(&_peak, &peak, in_use))
+        {
+        }
+
+        if (esp_heap_trace_alloc_hook)
+        {
+            esp_heap_trace_alloc_hook(ptr, malloc_usable_size(ptr), MALLOC_CAP_DEFAULT);
+        }
+    }
+
+    return ptr;
+}
+
+static void account_free(void *ptr)
+{
+    if (ptr)
+    {
+        atomic_fetch_sub(&_in_use, malloc_usable_size(ptr));
+
+        if (esp_heap_trace_free_hook)
+        {
+            esp_heap_trace_free_hook(ptr);
+        }
+    }
+}
+
+void *__wrap_malloc(size_t size)
+{
+    return account_alloc(__real_malloc(size));
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    return account_alloc(__real_calloc(nmemb, size));
+}
+
+void *__wrap_aligned_alloc(size_t alignment, size_t size)
+{
+    return account_alloc(__real_aligned_alloc(alignment, size));
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    size_t old_size = ptr ? malloc_usable_size(ptr) : 0;
+
+    void *moved = __real_realloc(ptr, size);
+    if (!moved && size)
+    {
+        /* The old block is still there */
+        return NULL;
+    }
+
+    atomic_fetch_sub(&_in_use, old_size);
+    return account_alloc(moved);
+}
+
+void __wrap_free(void *ptr)
+{
+    account_free(ptr);
+    __real_free(ptr);
+}
+
+char *__wrap_strdup(const char *s)
+{
+    size_t len = strlen(s) + 1;
+    char *copy = __wrap_malloc(len);
+    if (copy)
+    {
+        memcpy(copy, s, len);
+    }
+
+    return copy;
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    return malloc(size);
+}
+
+void *heap_caps_aligned_alloc(size_t alignment, size_t size, uint32_t caps)
+{
+    /* aligned_alloc wants a multiple of the alignment */
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+}
+
+void heap_caps_free(void *ptr)
+{
+    free(ptr);
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    return HEAP_HOST_SIZE - atomic_load(&_in_use);
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+    return HEAP_HOST_SIZE - atomic_load(&_peak);
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    return heap_caps_get_free_size(caps);
+}
+
+int heap_caps_monitor_local_minimum_free_size_start(void)
+{
+    atomic_store(&_peak, atomic_load(&_in_use));
+    return 0;
+}
+
+int heap_caps_monitor_local_minimum_free_size_stop(void)
+{
+    return 0;
+}
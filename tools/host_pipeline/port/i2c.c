@@ -0,0 +1,443 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Command lists of the legacy I2C driver. As in ESP-IDF, a list made by
+ * i2c_cmd_link_create() is allocated and one made by
+ * i2c_cmd_link_create_static() lives in the caller's buffer, so the heap
+ * counters see the difference. i2c_master_cmd_begin() plays the list to the
+ * simulated devices attached with i2c_sim_attach(). Other addresses do not
+ * acknowledge.
+ *
+ * A transfer blocks its caller for as long as it would take on the wire, nine
+ * clocks per byte and one each for start and stop conditions at the rate set
+ * with i2c_param_config(), plus the latency set with i2c_sim_set_latency().
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "driver/i2c.h"
+#include "esp_timer.h"
+#include "i2c_sim.h"
+
+/* Commands in a list from i2c_cmd_link_create(), enough for a register read */
+#define I2C_CMD_LINK_OPS    (16)
+/* Devices per port */
+#define I2C_SIM_DEVICES     (4)
+/* Bus clock of a port i2c_param_config() has not set */
+#define I2C_SIM_DEFAULT_HZ  (100000)
+/* Bytes of a transfer shown in the trace, for each direction */
+#define I2C_SIM_TRACE_BYTES (16)
+
+enum i2c_op_type {
+    I2C_OP_START,
+    I2C_OP_WRITE,
+    I2C_OP_READ,
+    I2C_OP_STOP,
+};
+
+struct i2c_op {
+    enum i2c_op_type type;
+    /* Written by I2C_OP_WRITE when data is NULL */
+    uint8_t byte;
+    i2c_ack_type_t ack;
+    union {
+        const uint8_t *data;
+        uint8_t *dest;
+    };
+    size_t len;
+};
+
+struct i2c_cmd {
+    bool is_static;
+    size_t num_ops;
+    size_t max_ops;
+    struct i2c_op ops[];
+};
+
+struct i2c_sim_slot {
+    uint8_t addr;
+    const struct i2c_sim_device *dev;
+};
+
+static struct i2c_sim_slot _devices[I2C_NUM_MAX][I2C_SIM_DEVICES];
+static uint32_t _clk_hz[I2C_NUM_MAX];
+
+/* Guards the latency, trace and statistics below */
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t _latency_us;
+static FILE *_trace;
+static struct i2c_sim_stats _stats;
+
+/* What a transfer did on the wire, for timing and the trace */
+struct i2c_xfer {
+    uint8_t addr;
+    /* Bytes clocked, address bytes included, and start and stop conditions */
+    uint32_t bytes;
+    uint32_t conditions;
+    uint8_t written[I2C_SIM_TRACE_BYTES];
+    size_t num_written;
+    uint8_t read[I2C_SIM_TRACE_BYTES];
+    size_t num_read;
+};
+
+_Static_assert(sizeof(struct i2c_op) <= I2C_INTERNAL_STRUCT_SIZE,
+               "I2C_LINK_RECOMMENDED_SIZE() too small for the host's commands");
+_Static_assert(sizeof(struct i2c_cmd) + alignof(struct i2c_cmd) <= 2 * I2C_INTERNAL_STRUCT_SIZE,
+               "I2C_LINK_RECOMMENDED_SIZE() too small for the host's command list");
+
+esp_err_t i2c_sim_attach(i2c_port_t i2c_num, uint8_t addr, const struct i2c_sim_device *dev)
+{
+    if (i2c_num >= I2C_NUM_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (int i = 0; i < I2C_SIM_DEVICES; i++)
+    {
+        struct i2c_sim_slot *slot = &_devices[i2c_num][i];
+        if (!slot->dev || slot->addr == addr)
+        {
+            slot->addr = addr;
+            slot->dev = dev;
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_NO_MEM;
+}
+
+static const struct i2c_sim_device *find_device(i2c_port_t i2c_num, uint8_t addr)
+{
+    for (int i = 0; i < I2C_SIM_DEVICES; i++)
+    {
+        if (_devices[i2c_num][i].dev && _devices[i2c_num][i].addr == addr)
+        {
+            return _devices[i2c_num][i].dev;
+        }
+    }
+
+    return NULL;
+}
+
+void i2c_sim_set_latency(uint32_t us)
+{
+    pthread_mutex_lock(&_lock);
+    _latency_us = us;
+    pthread_mutex_unlock(&_lock);
+}
+
+void i2c_sim_trace(FILE *file)
+{
+    pthread_mutex_lock(&_lock);
+    _trace = file;
+    if (_trace)
+    {
+        fprintf(_trace, "time_us,port,addr,write,read,bus_us,status\n");
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+void i2c_sim_get_stats(struct i2c_sim_stats *stats)
+{
+    pthread_mutex_lock(&_lock);
+    *stats = _stats;
+    pthread_mutex_unlock(&_lock);
+}
+
+void i2c_sim_reset_stats(void)
+{
+    pthread_mutex_lock(&_lock);
+    memset(&_stats, 0, sizeof(_stats));
+    pthread_mutex_unlock(&_lock);
+}
+
+esp_err_t i2c_param_config(i2c_port_t i2c_num, const i2c_config_t *i2c_conf)
+{
+    if (i2c_num >= I2C_NUM_MAX || !i2c_conf)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    _clk_hz[i2c_num] = i2c_conf->master.clk_speed;
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t i2c_num,
+                             i2c_mode_t mode,
+                             size_t slv_rx_buf_len,
+                             size_t slv_tx_buf_len,
+                             int intr_alloc_flags)
+{
+    return (i2c_num < I2C_NUM_MAX) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t i2c_driver_delete(i2c_port_t i2c_num)
+{
+    return (i2c_num < I2C_NUM_MAX) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create_static(uint8_t *buffer, uint32_t size)
+{
+    uintptr_t start = ((uintptr_t) buffer + alignof(struct i2c_cmd) - 1)
+                    & ~(uintptr_t) (alignof(struct i2c_cmd) - 1);
+    size_t skip = start - (uintptr_t) buffer;
+
+    if (!buffer || size < skip + sizeof(struct i2c_cmd))
+    {
+        return NULL;
+    }
+
+    struct i2c_cmd *cmd = (struct i2c_cmd *) start;
+    cmd->is_static = true;
+    cmd->num_ops = 0;
+    cmd->max_ops = (size - skip - sizeof(struct i2c_cmd)) / sizeof(struct i2c_op);
+
+    return cmd;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create(void)
+{
+    struct i2c_cmd *cmd =
+        malloc(sizeof(struct i2c_cmd) + I2C_CMD_LINK_OPS * sizeof(struct i2c_op));
+    if (cmd)
+    {
+        cmd->is_static = false;
+        cmd->num_ops = 0;
+        cmd->max_ops = I2C_CMD_LINK_OPS;
+    }
+
+    return cmd;
+}
+
+void i2c_cmd_link_delete_static(i2c_cmd_handle_t cmd_handle)
+{
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle)
+{
+    struct i2c_cmd *cmd = cmd_handle;
+
+    if (cmd && !cmd->is_static)
+    {
+        free(cmd);
+    }
+}
+
+static esp_err_t add_op(i2c_cmd_handle_t cmd_handle, struct i2c_op op)
+{
+    struct i2c_cmd *cmd = cmd_handle;
+
+    if (!cmd)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (cmd->num_ops == cmd->max_ops)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    cmd->ops[cmd->num_ops++] = op;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd_handle)
+{
+    return add_op(cmd_handle, (struct i2c_op) {.type = I2C_OP_START});
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd_handle, uint8_t data, bool ack_en)
+{
+    return add_op(cmd_handle, (struct i2c_op) {.type = I2C_OP_WRITE, .byte = data, .len = 1});
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd_handle,
+                           const uint8_t *data,
+                           size_t data_len,
+                           bool ack_en)
+{
+    return add_op(cmd_handle,
+                  (struct i2c_op) {.type = I2C_OP_WRITE, .data = data, .len = data_len});
+}
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd_handle, uint8_t *data, i2c_ack_type_t ack)
+{
+    return i2c_master_read(cmd_handle, data, 1, ack);
+}
+
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd_handle,
+                          uint8_t *data,
+                          size_t data_len,
+                          i2c_ack_type_t ack)
+{
+    return add_op(cmd_handle,
+                  (struct i2c_op) {.type = I2C_OP_READ, .dest = data, .len = data_len, .ack = ack});
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd_handle)
+{
+    return add_op(cmd_handle, (struct i2c_op) {.type = I2C_OP_STOP});
+}
+
+static void sleep_us(uint32_t us)
+{
+    struct timespec ts = {
+        .tv_sec = us / 1000000,
+        .tv_nsec = (long) (us % 1000000) * 1000,
+    };
+
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+    {
+    }
+}
+
+static void trace_bytes(FILE *file, const uint8_t *bytes, size_t len)
+{
+    for (size_t i = 0; i < len && i < I2C_SIM_TRACE_BYTES; i++)
+    {
+        fprintf(file, "%02x", bytes[i]);
+    }
+    if (len > I2C_SIM_TRACE_BYTES)
+    {
+        fprintf(file, "...");
+    }
+}
+
+/* Charges the transfer's time on the wire to the caller and records it */
+static void finish_xfer(i2c_port_t i2c_num, const struct i2c_xfer *xfer, esp_err_t err)
+{
+    uint32_t hz = _clk_hz[i2c_num] ? _clk_hz[i2c_num] : I2C_SIM_DEFAULT_HZ;
+    uint64_t clocks = (uint64_t) xfer->bytes * 9 + xfer->conditions;
+
+    pthread_mutex_lock(&_lock);
+
+    uint32_t bus_us = _latency_us + (uint32_t) ((clocks * 1000000 + hz - 1) / hz);
+
+    _stats.transfers++;
+    _stats.bytes += xfer->bytes;
+    _stats.bus_us += bus_us;
+    if (err != ESP_OK)
+    {
+        _stats.failed++;
+    }
+
+    if (_trace)
+    {
+        fprintf(_trace, "%" PRId64 ",%d,0x%02x,", esp_timer_get_time(), i2c_num, xfer->addr);
+        trace_bytes(_trace, xfer->written, xfer->num_written);
+        fprintf(_trace, ",");
+        trace_bytes(_trace, xfer->read, xfer->num_read);
+        fprintf(_trace, ",%" PRIu32 ",%s\n", bus_us, (err == ESP_OK) ? "ok" : "nack");
+    }
+
+    pthread_mutex_unlock(&_lock);
+
+    sleep_us(bus_us);
+}
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t i2c_num,
+                               i2c_cmd_handle_t cmd_handle,
+                               TickType_t ticks_to_wait)
+{
+    struct i2c_cmd *cmd = cmd_handle;
+
+    if (!cmd || i2c_num >= I2C_NUM_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const struct i2c_sim_device *dev = NULL;
+    bool addressing = false;
+    esp_err_t err = ESP_OK;
+    struct i2c_xfer xfer = {0};
+
+    for (size_t i = 0; i < cmd->num_ops && err == ESP_OK; i++)
+    {
+        const struct i2c_op *op = &cmd->ops[i];
+
+        switch (op->type)
+        {
+            case I2C_OP_START:
+                addressing = true;
+                xfer.conditions++;
+                break;
+            case I2C_OP_WRITE:
+                for (size_t j = 0; j < op->len && err == ESP_OK; j++)
+                {
+                    uint8_t byte = op->data ? op->data[j] : op->byte;
+
+                    xfer.bytes++;
+                    if (addressing)
+                    {
+                        /* The first byte after a start selects a device, or nothing answers */
+                        addressing = false;
+                        xfer.addr = byte >> 1;
+                        dev = find_device(i2c_num, byte >> 1);
+                        if (!dev)
+                        {
+                            err = ESP_FAIL;
+                        }
+                        else if (dev->start)
+                        {
+                            dev->start(dev->ctx, byte & I2C_MASTER_READ);
+                        }
+                        continue;
+                    }
+
+                    if (xfer.num_written < I2C_SIM_TRACE_BYTES)
+                    {
+                        xfer.written[xfer.num_written] = byte;
+                    }
+                    xfer.num_written++;
+
+                    if (!dev || !dev->write(dev->ctx, byte))
+                    {
+                        err = ESP_FAIL;
+                    }
+                }
+                break;
+            case I2C_OP_READ:
+                if (!dev)
+                {
+                    err = ESP_FAIL;
+                    break;
+                }
+                for (size_t j = 0; j < op->len; j++)
+                {
+                    op->dest[j] = dev->read(dev->ctx);
+
+                    xfer.bytes++;
+                    if (xfer.num_read < I2C_SIM_TRACE_BYTES)
+                    {
+                        xfer.read[xfer.num_read] = op->dest[j];
+                    }
+                    xfer.num_read++;
+                }
+                break;
+            case I2C_OP_STOP:
+                xfer.conditions++;
+                if (dev && dev->stop)
+                {
+                    dev->stop(dev->ctx);
+                }
+                dev = NULL;
+                break;
+        }
+    }
+
+    if (err != ESP_OK && dev && dev->stop)
+    {
+        dev->stop(dev->ctx);
+    }
+
+    finish_xfer(i2c_num, &xfer, err);
+    return err;
+}
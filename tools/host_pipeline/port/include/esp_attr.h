@@ -0,0 +1,10 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+/* Everything runs from the same memory */
+#define IRAM_ATTR
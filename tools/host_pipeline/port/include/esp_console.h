@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include "esp_err.h"
+
+/* There is no shell on the host, commands are accepted and never run */
+typedef int (*esp_console_cmd_func_t)(int argc, char **argv);
+
+typedef struct {
+    const char *command;
+    const char *help;
+    const char *hint;
+    esp_console_cmd_func_t func;
+    void *argtable;
+} esp_console_cmd_t;
+
+static inline esp_err_t esp_console_cmd_register(const esp_console_cmd_t *cmd)
+{
+    (void) cmd;
+    return ESP_OK;
+}
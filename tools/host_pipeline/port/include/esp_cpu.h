@@ -0,0 +1,15 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Nanoseconds of CLOCK_MONOTONIC, which is what a cycle is with the host's
+ * CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ of 1000. Wraps like the real counter.
+ */
+uint32_t esp_cpu_get_cycle_count(void);
@@ -0,0 +1,16 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include "golioth/golioth_debug.h"
+
+#define ESP_LOGE(tag, ...)  GLTH_LOGE(tag, __VA_ARGS__)
+#define ESP_LOGW(tag, ...)  GLTH_LOGW(tag, __VA_ARGS__)
+#define ESP_LOGI(tag, ...)  GLTH_LOGI(tag, __VA_ARGS__)
+#define ESP_LOGD(tag, ...)  GLTH_LOGD(tag, __VA_ARGS__)
+
+#define ESP_LOG_BUFFER_HEX(tag, buffer, len)  ((void) (tag), (void) (buffer), (void) (len))
@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_queue *QueueHandle_t;
+
+#define errQUEUE_EMPTY  ((BaseType_t) 0)
+#define errQUEUE_FULL   ((BaseType_t) 0)
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks);
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#define xQueueSendToBack(queue, item, ticks)    xQueueSend(queue, item, ticks)
+
+/* Semaphores are queues of items without data, as in FreeRTOS */
+QueueHandle_t host_queue_create_counting(UBaseType_t max_count, UBaseType_t initial_count);
+QueueHandle_t host_queue_create_recursive(void);
+BaseType_t host_queue_take_recursive(QueueHandle_t queue, TickType_t ticks);
+BaseType_t host_queue_give_recursive(QueueHandle_t queue);
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/queue.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+/* Room for a semaphore without allocating it, as in FreeRTOS */
+typedef struct {
+    _Alignas(max_align_t) uint8_t storage[256];
+} StaticSemaphore_t;
+
+QueueHandle_t host_queue_create_binary_static(StaticSemaphore_t *buffer);
+
+#define xSemaphoreCreateBinary()                host_queue_create_counting(1, 0)
+#define xSemaphoreCreateBinaryStatic(buf)       host_queue_create_binary_static(buf)
+#define xSemaphoreCreateCounting(max, initial)  host_queue_create_counting(max, initial)
+#define xSemaphoreCreateMutex()                 host_queue_create_counting(1, 1)
+#define xSemaphoreTake(sem, ticks)              xQueueReceive(sem, NULL, ticks)
+#define xSemaphoreGive(sem)                     xQueueSend(sem, NULL, 0)
+#define vSemaphoreDelete(sem)                   vQueueDelete(sem)
+
+/* Taken again by its holder without blocking, given back as often as taken */
+#define xSemaphoreCreateRecursiveMutex()        host_queue_create_recursive()
+#define xSemaphoreTakeRecursive(sem, ticks)     host_queue_take_recursive(sem, ticks)
+#define xSemaphoreGiveRecursive(sem)            host_queue_give_recursive(sem)
@@ -0,0 +1,16 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <golioth/golioth_debug.h>
+#include <golioth/golioth_status.h>
+
+/* There is no client on the host, the pipeline uploads to a file or loopback sink */
+struct golioth_client;
@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "esp_timer.h"
+
+/* Same layout as ESP-IDF's log output: level, milliseconds since start, tag */
+#define GLTH_LOG(level, tag, fmt, ...)                    \
+    printf(level " (%" PRId64 ") %s: " fmt "\n",          \
+           esp_timer_get_time() / 1000,                   \
+           tag,                                           \
+           ##__VA_ARGS__)
+
+#define GLTH_LOGE(tag, ...) GLTH_LOG("E", tag, __VA_ARGS__)
+#define GLTH_LOGW(tag, ...) GLTH_LOG("W", tag, __VA_ARGS__)
+#define GLTH_LOGI(tag, ...) GLTH_LOG("I", tag, __VA_ARGS__)
+#define GLTH_LOGD(tag, ...) ((void) (tag))
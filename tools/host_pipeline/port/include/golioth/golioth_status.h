@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+/* The subset of the Golioth SDK's status codes the pipeline uses */
+enum golioth_status {
+    GOLIOTH_OK,
+    GOLIOTH_ERR_FAIL,
+    GOLIOTH_ERR_MEM_ALLOC,
+    GOLIOTH_ERR_NULL,
+    GOLIOTH_ERR_IO,
+    GOLIOTH_ERR_TIMEOUT,
+    GOLIOTH_ERR_INVALID_STATE,
+    GOLIOTH_ERR_NO_MORE_DATA,
+};
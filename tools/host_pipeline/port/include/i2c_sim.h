@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+/* Devices on the host's I2C bus, see i2c.c */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "driver/i2c.h"
+
+struct i2c_sim_device {
+    /* A start condition addressed to the device. Optional. */
+    void (*start)(void *ctx, bool read);
+    /* A byte from the master, false to not acknowledge it */
+    bool (*write)(void *ctx, uint8_t byte);
+    /* A byte for the master */
+    uint8_t (*read)(void *ctx);
+    /* The stop condition ending the transfer. Optional. */
+    void (*stop)(void *ctx);
+    void *ctx;
+};
+
+/* Puts dev on the bus at the 7-bit address addr, replacing any device there */
+esp_err_t i2c_sim_attach(i2c_port_t i2c_num, uint8_t addr, const struct i2c_sim_device *dev);
+
+/* Time every transfer takes on top of its clocks on the wire, 0 by default */
+void i2c_sim_set_latency(uint32_t us);
+
+/*
+ * Writes a CSV line per transfer to file, NULL to stop: start time, port,
+ * 7-bit address, bytes written and read in hex, time on the bus and status
+ */
+void i2c_sim_trace(FILE *file);
+
+struct i2c_sim_stats {
+    uint32_t transfers;
+    /* Transfers that were not acknowledged */
+    uint32_t failed;
+    /* Bytes clocked, device addresses included */
+    uint64_t bytes;
+    uint64_t bus_us;
+};
+
+void i2c_sim_get_stats(struct i2c_sim_stats *stats);
+void i2c_sim_reset_stats(void);
+
+/*
+ * The AXP192 PMU at 0x34 on I2C_NUM_1, where the Core2 has it. Reads
+ * auto-increment the register address. Writes alternate register addresses
+ * and values. Registers start at zero and read-only ones ignore writes.
+ *
+ * The ADC registers report the supply set with axp192_sim_set_supply(), in
+ * the chip's encoding, for the ADCs enabled in register 0x82. The power status
+ * registers follow it too.
+ */
+void axp192_sim_attach(void);
+uint8_t axp192_sim_get(uint8_t reg);
+/* Sets a register, read-only ones included */
+void axp192_sim_set(uint8_t reg, uint8_t value);
+/* Zeroes the registers and the supply */
+void axp192_sim_reset(void);
+
+/* Voltages in mV, currents in mA. A source at 0 mV is absent. */
+struct axp192_sim_supply {
+    uint32_t acin_mv;
+    uint32_t acin_ma;
+    uint32_t vbus_mv;
+    uint32_t vbus_ma;
+    uint32_t bat_mv;
+    uint32_t bat_charge_ma;
+    uint32_t bat_discharge_ma;
+};
+
+void axp192_sim_set_supply(const struct axp192_sim_supply *supply);
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2024 Golioth, Inc.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#pragma once
+
+/*
+ * Stands in for the sdkconfig.h that ESP-IDF generates from Kconfig. Options
+ * are set with -D through EXAMPLE_CONFIG in CMakeLists.txt. Values left unset
+ * get their Kconfig default, bool options are off unless listed.
+ */
+
+#ifndef CONFIG_EXAMPLE_SAMPLE_RATE
+#define CONFIG_EXAMPLE_SAMPLE_RATE 44100
+#endif
+#ifndef CONFIG_EXAMPLE_BIT_SAMPLE
+#define CONFIG_EXAMPLE_BIT_SAMPLE 16
+#endif
+#ifndef CONFIG_EXAMPLE_REC_TIME
+#define CONFIG_EXAMPLE_REC_TIME 2
+#endif
+#ifndef CONFIG_EXAMPLE_CAPTURE_RING_SLOTS
+#define CONFIG_EXAMPLE_CAPTURE_RING_SLOTS 4
+#endif
+#ifndef CONFIG_EXAMPLE_SD_WRITE_CHUNK_KB
+#define CONFIG_EXAMPLE_SD_WRITE_CHUNK_KB 16
+#endif
+#ifndef CONFIG_EXAMPLE_CAPTURE_STATS_INTERVAL
+#define CONFIG_EXAMPLE_CAPTURE_STATS_INTERVAL 5
+#endif
+
+/* Defaults of the source and sink the runner starts with, -s and -o pick others */
+#if !defined(CONFIG_EXAMPLE_CAPTURE_WAV_FILE)
+#define CONFIG_EXAMPLE_CAPTURE_SYNTHETIC 1
+#endif
+#if !defined(CONFIG_EXAMPLE_UPLOAD_SINK_FILE)
+#define CONFIG_EXAMPLE_UPLOAD_SINK_LOOPBACK 1
+#endif
+#ifndef CONFIG_EXAMPLE_CAPTURE_WAV_PATH
+#define CONFIG_EXAMPLE_CAPTURE_WAV_PATH "input.wav"
+#endif
+#ifndef CONFIG_EXAMPLE_UPLOAD_SINK_DIR
+#define CONFIG_EXAMPLE_UPLOAD_SINK_DIR "uploads"
+#endif
+
+#if !defined(CONFIG_EXAMPLE_AUDIO_FORMAT_IMA_ADPCM) && !defined(CONFIG_EXAMPLE_AUDIO_FORMAT_FLAC)
+#define CONFIG_EXAMPLE_AUDIO_FORMAT_PCM 1
+#endif
+
+#if !defined(CONFIG_EXAMPLE_UPLOAD_MODE_STREAM)
+#define CONFIG_EXAMPLE_UPLOAD_MODE_FILE 1
+#if !defined(CONFIG_EXAMPLE_UPLOAD_PREFETCH_DEPTH)
+#define CONFIG_EXAMPLE_UPLOAD_PREFETCH_DEPTH 4
+#endif
+#endif
+
+#ifdef CONFIG_EXAMPLE_RESAMPLE
+#ifndef CONFIG_EXAMPLE_RESAMPLE_RATE
+#define CONFIG_EXAMPLE_RESAMPLE_RATE 16000
+#endif
+#endif
+
+#ifdef CONFIG_EXAMPLE_VAD
+#ifndef CONFIG_EXAMPLE_VAD_THRESHOLD_DB
+#define CONFIG_EXAMPLE_VAD_THRESHOLD_DB 9
+#endif
+#ifndef CONFIG_EXAMPLE_VAD_HANGOVER_MS
+#define CONFIG_EXAMPLE_VAD_HANGOVER_MS 300
+#endif
+#ifndef CONFIG_EXAMPLE_VAD_PREROLL_MS
+#define CONFIG_EXAMPLE_VAD_PREROLL_MS 200
+#endif
+#endif
+
+#define CONFIG_IDF_TARGET "linux"
+#define CONFIG_IDF_TARGET_LINUX 1
+
+/* port/heap.c calls the heap trace hooks */
+#define CONFIG_HEAP_USE_HOOKS 1
+
+/* With a 1000 MHz "CPU", esp_cpu_get_cycle_count() counts nanoseconds */
+#define CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ 1000
+
+/* Options that need the SD card driver, PSRAM or NVS */
+#if defined(CONFIG_EXAMPLE_UPLOAD_MODE_SEGMENTED) || defined(CONFIG_EXAMPLE_RAW_STORE) \
+    || defined(CONFIG_EXAMPLE_PSRAM_RECORDING) || defined(CONFIG_EXAMPLE_UPLOAD_QUEUE)  \
+    || defined(CONFIG_EXAMPLE_RESUMABLE_UPLOAD) || defined(CONFIG_EXAMPLE_PREALLOCATE_FILES)
+#error "Only available on the device"
+#endif
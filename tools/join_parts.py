@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2024 Golioth, Inc.
+#
+# SPDX-License-Identifier: Apache-2.0
+
+"""Rebuild a recording sent with CONFIG_EXAMPLE_RESUMABLE_UPLOAD.
+
+Every part is a transfer of its own to file_upload/<id>/<offset>-<size>, which
+the pipeline stores as its own object. Pass the objects of one upload id, or
+the directory they were downloaded to. Parts are joined in offset order, a
+part that was sent twice is used once, and parts compressed with
+CONFIG_EXAMPLE_UPLOAD_COMPRESSION are decompressed first. Nothing is written
+unless the parts cover the whole file.
+
+Usage: join_parts.py OUTPUT PART... | join_parts.py OUTPUT DIR
+"""
+
+import os
+import re
+import sys
+
+from glz_decompress import decompress
+
+PART_NAME = re.compile(r"(\d+)-(\d+)$")
+
+
+def load_parts(paths):
+    parts = {}
+    size = None
+    for path in paths:
+        match = PART_NAME.search(os.path.basename(path))
+        if not match:
+            raise ValueError(f"{path}: not named <offset>-<size>")
+        offset, part_size = int(match[1]), int(match[2])
+        if size is not None and part_size != size:
+            raise ValueError(f"{path}: file size {part_size}, other parts say {size}")
+        size = part_size
+
+        with open(path, "rb") as f:
+            data = decompress(f.read())
+        if parts.get(offset, data) != data:
+            raise ValueError(f"{path}: differs from another copy of the part at {offset}")
+        parts[offset] = data
+    return parts, size
+
+
+def join(parts, size):
+    out = bytearray()
+    for offset in sorted(parts):
+        if offset != len(out):
+            raise ValueError(f"missing bytes {len(out)} to {offset}")
+        out += parts[offset]
+    if len(out) != size:
+        raise ValueError(f"parts cover {len(out)} of {size} bytes")
+    return bytes(out)
+
+
+def main():
+    if len(sys.argv) < 3:
+        print(__doc__.strip(), file=sys.stderr)
+        return 1
+
+    paths = sys.argv[2:]
+    if len(paths) == 1 and os.path.isdir(paths[0]):
+        paths = [os.path.join(paths[0], name) for name in os.listdir(paths[0])]
+
+    try:
+        data = join(*load_parts(paths))
+    except ValueError as e:
+        print(e, file=sys.stderr)
+        return 1
+
+    with open(sys.argv[1], "wb") as f:
+        f.write(data)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())